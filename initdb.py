@@ -18,8 +18,33 @@ queries = [
     e_owners_uuid TIMEUUID,
     e_email_uuid TIMEUUID,
     e_content TEXT,
+    e_blob_hash VARCHAR,
     PRIMARY KEY ((e_bucket), e_domain, e_owners_uuid, e_email_uuid)
   ) WITH CLUSTERING ORDER BY (e_domain DESC, e_owners_uuid DESC, e_email_uuid DESC);''',
+  # Creates the table for the shared raw email bodies
+  '''CREATE TABLE IF NOT EXISTS fannst.raw_blobs (
+    e_hash VARCHAR,
+    e_compressed BOOLEAN,
+    e_size BIGINT,
+    e_chunks INT,
+    e_content BLOB,
+    PRIMARY KEY (e_hash)
+  );''',
+  # Creates the table for the chunks of large raw bodies
+  '''CREATE TABLE IF NOT EXISTS fannst.raw_blob_chunks (
+    e_hash VARCHAR,
+    e_index INT,
+    e_compressed BOOLEAN,
+    e_size INT,
+    e_content BLOB,
+    PRIMARY KEY ((e_hash), e_index)
+  ) WITH CLUSTERING ORDER BY (e_index ASC);''',
+  # Creates the table with the reference counts of the raw bodies
+  '''CREATE TABLE IF NOT EXISTS fannst.raw_blob_refs (
+    e_hash VARCHAR,
+    e_refs COUNTER,
+    PRIMARY KEY (e_hash)
+  );''',
   # Creates the table for the email shortcuts
   '''CREATE TABLE IF NOT EXISTS fannst.email_shortcuts (
     e_domain VARCHAR,
@@ -53,6 +78,15 @@ queries = [
     e_subscribed BOOLEAN,
     PRIMARY KEY((e_bucket), e_domain, e_uuid, e_mailbox_path)
   ) WITH CLUSTERING ORDER BY (e_domain DESC, e_uuid DESC, e_mailbox_path DESC);''',
+  # Creates the table for the persistent mailbox counters
+  '''CREATE TABLE IF NOT EXISTS fannst.mailbox_meta (
+    e_bucket BIGINT,
+    e_domain VARCHAR,
+    e_uuid TIMEUUID,
+    e_mailbox_path VARCHAR,
+    e_max_uid INT,
+    PRIMARY KEY((e_bucket), e_domain, e_uuid, e_mailbox_path)
+  ) WITH CLUSTERING ORDER BY (e_domain DESC, e_uuid DESC, e_mailbox_path DESC);''',
   # Creates the accounts tabke
   '''CREATE TABLE IF NOT EXISTS fannst.accounts (
       a_username VARCHAR,
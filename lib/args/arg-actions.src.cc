@@ -15,6 +15,7 @@
 */
 
 #include "arg-actions.src.h"
+#include "../dns/DNSZone.src.h"
 
 namespace FSMTP::ARG_ACTIONS {
   /**
@@ -30,7 +31,7 @@ namespace FSMTP::ARG_ACTIONS {
     getline(cin, domain2add);
 
     // Connects to apache cassandra and redis
-    unique_ptr<CassandraConnection> cassandra;
+    shared_ptr<CassandraConnection> cassandra;
     try {
       cassandra = Global::getCassandra();
       logger << _BASH_SUCCESS_MARK << "Connected to cassandra" << ENDL;
@@ -82,7 +83,7 @@ namespace FSMTP::ARG_ACTIONS {
     getline(cin, domain);
 
     // Connects to apache cassandra and redis
-    unique_ptr<CassandraConnection> cassandra;
+    shared_ptr<CassandraConnection> cassandra;
     try {
       cassandra = Global::getCassandra();
       logger << _BASH_SUCCESS_MARK << "Connected to cassandra" << ENDL;
@@ -321,4 +322,30 @@ namespace FSMTP::ARG_ACTIONS {
 
     exit(0);
   }
+
+  void compileZoneArgAction(const string &path) {
+    Logger logger("CompileZone", LoggerLevel::INFO);
+    auto &config = Global::getConfig();
+
+    // Compiles the zone file into the image the DNS server maps, so large
+    //  zones may be compiled elsewhere, and shipped as image
+    const string zoneFile = config["dns_server"]["zone_file"].asString();
+    string zoneCompiled = path.empty() ? config["dns_server"]["zone_compiled"].asString() : path;
+    if (zoneCompiled.empty()) zoneCompiled = zoneFile + ".bin";
+
+    if (zoneFile.empty()) {
+      logger << FATAL << "No zone file configured in dns_server.zone_file" << ENDL << CLASSIC;
+      exit(-1);
+    }
+
+    try {
+      DNS::Zone::compile(DNS::readZoneFile(zoneFile), zoneCompiled);
+      logger << "Compiled '" << zoneFile << "' into '" << zoneCompiled << "'" << ENDL;
+    } catch (const exception &e) {
+      logger << FATAL << "Could not compile zone: " << e.what() << ENDL << CLASSIC;
+      exit(-1);
+    }
+
+    exit(0);
+  }
 }
@@ -51,4 +51,14 @@ namespace FSMTP::ARG_ACTIONS
    * Registers an new user under an specified domain
    */
   void addUser();
+
+  /**
+   * Runs the benchmark with the specified name
+   */
+  void benchmarkArgAction(const string &name);
+
+  /**
+   * Compiles the zone file of the DNS server into its image
+   */
+  void compileZoneArgAction(const string &path);
 }
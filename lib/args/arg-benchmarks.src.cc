@@ -0,0 +1,483 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "arg-actions.src.h"
+#include "../dns/Resolver.src.h"
+#include "../dns/DNSServer.src.h"
+#include "../dkim/DKIMCanonicalization.src.h"
+#include "../mime/MIMETree.src.h"
+#include "../general/cleanup.src.h"
+#include "../general/base64.src.h"
+
+namespace FSMTP::ARG_ACTIONS {
+  /**
+   * Resolves the same names over and over against an local DNSServer, once
+   *  with the cache cleared before each query, and once with the cache
+   */
+  static void dnsCacheBenchmark(Logger &logger) {
+    const int32_t port = 15353;
+    const size_t names = 16, rounds = 500;
+    auto &conf = Global::getConfig();
+
+    // Creates an zone with the names we will resolve, and starts
+    //  the local server which acts as the authoritative one
+    conf["dns_server"]["zone_file"] = "";
+    conf["dns_server"]["zone_compiled"] = "";
+    conf["zone"] = Json::Value(Json::arrayValue);
+    for (size_t i = 0; i < names; ++i) {
+      Json::Value record;
+      record["record_data"] = "127.0.0." + to_string(i + 1);
+      record["record_root"] = "@";
+      record["record_ttl"] = 3600;
+
+      Json::Value domain;
+      domain["domain"] = "host" + to_string(i) + ".bench.local";
+      domain["records"]["a"].append(record);
+      conf["zone"].append(domain);
+    }
+
+    DNS::DNSServer server(port);
+    DNS::Resolver::useNameserver("127.0.0.1", port);
+    this_thread::sleep_for(milliseconds(100));
+
+    auto run = [&](const bool cached) {
+      size_t failures = 0;
+      DNS::DNSCache::clear();
+
+      auto start = steady_clock::now();
+      for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < names; ++i) {
+          if (!cached) DNS::DNSCache::clear();
+
+          const string name = "host" + to_string(i) + ".bench.local";
+          try {
+            DNS::Resolver resolver;
+            resolver.query(name.c_str(), ns_t_a).initParse().getRecords();
+          } catch (const runtime_error &e) {
+            ++failures;
+          }
+        }
+      }
+      auto took = duration_cast<microseconds>(steady_clock::now() - start);
+
+      const size_t total = names * rounds;
+      logger << (cached ? "Cached:   " : "Uncached: ") << total << " queries in "
+        << took.count() / 1000 << "ms, " << (total * 1000000 / max<int64_t>(took.count(), 1))
+        << " queries/s, " << failures << " failures" << ENDL;
+    };
+
+    run(false);
+    run(true);
+
+    DNS::DNSCacheStats stats = DNS::DNSCache::getStats();
+    logger << "Cache { hits: " << stats.hits << ", negative hits: " << stats.negativeHits
+      << ", misses: " << stats.misses << ", entries: " << stats.entries
+      << ", bytes: " << stats.bytes << " }" << ENDL;
+  }
+
+  /**
+   * Blasts queries at an local DNSServer from as many clients as it has
+   *  workers, each client keeps an batch of queries in flight
+   */
+  static void dnsServerBenchmark(const string &argument, Logger &logger) {
+    const int32_t port = 15354;
+    const size_t names = 1000, batch = 32;
+    const size_t threads = argument.empty() ? 2 : max<size_t>(stoul(argument), 1);
+    const seconds duration(3);
+    auto &conf = Global::getConfig();
+
+    // Creates an zone with the MX, SPF and DKIM records an mail domain has
+    conf["dns_server"]["zone_file"] = "";
+    conf["dns_server"]["zone_compiled"] = "";
+    conf["zone"] = Json::Value(Json::arrayValue);
+    Json::Value domain;
+    domain["domain"] = "bench.local";
+    for (size_t i = 0; i < names; ++i) {
+      Json::Value record;
+      record["record_data"] = "10.0." + to_string(i / 256) + "." + to_string(i % 256);
+      record["record_root"] = "host" + to_string(i);
+      record["record_ttl"] = 3600;
+      domain["records"]["a"].append(record);
+    }
+
+    Json::Value mx, spf, dkim;
+    mx["record_data"] = "host0.bench.local";
+    mx["record_root"] = "@";
+    mx["record_ttl"] = 3600;
+    mx["record_priority"] = 10;
+    spf["record_data"] = "v=spf1 mx -all";
+    spf["record_root"] = "@";
+    spf["record_ttl"] = 3600;
+    dkim["record_data"] = "v=DKIM1; k=rsa; p=" + string(392, 'A');
+    dkim["record_root"] = "default._domainkey";
+    dkim["record_ttl"] = 3600;
+    domain["records"]["mx"].append(mx);
+    domain["records"]["txt"].append(spf);
+    domain["records"]["txt"].append(dkim);
+    conf["zone"].append(domain);
+
+    // Builds the queries up front, mostly address lookups with the mail
+    //  records and some misses in between
+    vector<string> queries;
+    auto addQuery = [&](const string &name, const uint16_t type) {
+      string query = string("\0\0\1\0\0\1\0\0\0\0\0\0", 12) + DNS::encodeDomainName(name);
+      query += static_cast<char>(type >> 8);
+      query += static_cast<char>(type & 0xFF);
+      query += string("\0\1", 2);
+      queries.push_back(query);
+    };
+    for (size_t i = 0; i < names; ++i) addQuery("host" + to_string(i) + ".bench.local", ns_t_a);
+    for (size_t i = 0; i < names / 10; ++i) {
+      addQuery("bench.local", ns_t_mx);
+      addQuery("bench.local", ns_t_txt);
+      addQuery("default._domainkey.bench.local", ns_t_txt);
+      addQuery("missing" + to_string(i) + ".bench.local", ns_t_a);
+    }
+
+    DNS::DNSServer server(port, threads);
+    this_thread::sleep_for(milliseconds(100));
+
+    atomic<size_t> sent(0), received(0);
+    vector<thread> clients;
+    const auto end = steady_clock::now() + duration;
+    for (size_t c = 0; c < threads; ++c) {
+      clients.emplace_back([&, c]() {
+        int32_t fd = socket(AF_INET, SOCK_DGRAM, 0);
+        DEFER(close(fd));
+
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof (address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        struct timeval timeout = { 0, 100000 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+        if (connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof (address)) < 0) return;
+
+        struct mmsghdr out[batch], in[batch];
+        struct iovec outVec[batch], inVec[batch];
+        vector<char> buffers(batch * _FSMTP_DNS_SERVER_MAX_RESPONSE);
+        memset(out, 0, sizeof (out));
+        memset(in, 0, sizeof (in));
+        for (size_t i = 0; i < batch; ++i) {
+          inVec[i].iov_base = &buffers[i * _FSMTP_DNS_SERVER_MAX_RESPONSE];
+          inVec[i].iov_len = _FSMTP_DNS_SERVER_MAX_RESPONSE;
+          in[i].msg_hdr.msg_iov = &inVec[i];
+          in[i].msg_hdr.msg_iovlen = 1;
+          out[i].msg_hdr.msg_iov = &outVec[i];
+          out[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        size_t next = c * 7919, localSent = 0, localReceived = 0;
+        while (steady_clock::now() < end) {
+          for (size_t i = 0; i < batch; ++i, ++next) {
+            const string &query = queries[next % queries.size()];
+            outVec[i].iov_base = const_cast<char *>(query.data());
+            outVec[i].iov_len = query.size();
+          }
+
+          int32_t rc = sendmmsg(fd, out, batch, 0);
+          if (rc <= 0) continue;
+          localSent += rc;
+
+          // Waits for the responses of the batch, lost datagrams are
+          //  given up on after the receive timeout
+          for (int32_t pending = rc; pending > 0;) {
+            int32_t got = recvmmsg(fd, in, pending, MSG_WAITFORONE, nullptr);
+            if (got <= 0) break;
+            pending -= got;
+            localReceived += got;
+          }
+        }
+
+        sent += localSent;
+        received += localReceived;
+      });
+    }
+
+    for (thread &client : clients) client.join();
+
+    DNS::DNSServerStats stats = server.getStats();
+    logger << threads << " workers: " << received << " responses to " << sent << " queries in "
+      << duration.count() << "s, " << received / duration.count() << " queries/s" << ENDL;
+    logger << "Server { queries: " << stats.queries << ", answers: " << stats.answers
+      << ", negative: " << stats.negative << ", refused: " << stats.refused
+      << ", errors: " << stats.errors << " }" << ENDL;
+  }
+
+  /**
+   * Reads the messages of the corpus directory ( one message per file ), if
+   *  there is none, the HTML templates are used as bodies of test messages
+   */
+  static vector<string> readCorpus(const string &path, Logger &logger) {
+    vector<string> messages;
+
+    auto read = [](const filesystem::path &file) {
+      ifstream stream(file, ios::binary);
+      return string(istreambuf_iterator<char>(stream), istreambuf_iterator<char>());
+    };
+
+    if (!path.empty()) {
+      for (const auto &entry : filesystem::directory_iterator(path))
+        if (entry.is_regular_file()) messages.push_back(read(entry.path()));
+    } else {
+      for (const char *file : { "../templates/head.html", "../templates/header.html", "../templates/footer.html", "../templates/mailer/error.html" }) {
+        string body = read(file);
+        if (body.empty()) continue;
+
+        // Converts the line endings to CRLF, as they are on the wire
+        string message = "From: Bench <bench@fannst.nl>\r\nTo:   test@fannst.nl\r\n"
+          "Subject:  An  \t benchmark   message  \r\nContent-Type: text/html\r\n\r\n";
+        for (const char c : body) {
+          if (c == '\n') message += "\r\n";
+          else message += c;
+        }
+
+        messages.push_back(message);
+      }
+    }
+
+    logger << "Corpus: " << messages.size() << " messages" << (path.empty() ? " ( templates )" : "") << ENDL;
+    return messages;
+  }
+
+  /**
+   * Runs the DKIM canonicalization and whitespace reduction over an corpus of
+   *  messages, once for each SIMD level the CPU supports
+   */
+  static void whitespaceBenchmark(const string &corpusPath, Logger &logger) {
+    vector<string> messages = readCorpus(corpusPath, logger);
+    const size_t rounds = 50;
+
+    // Splits the messages into their headers and body up front, so
+    //  we only measure the kernels
+    vector<pair<string, string>> parts;
+    size_t bodyBytes = 0, headerBytes = 0;
+    for (const string &message : messages) {
+      size_t end = message.find("\r\n\r\n");
+      if (end == string::npos) continue;
+
+      // Unfolds the headers, as the signer does before canonicalizing
+      vector<string> lines = MIME::getMIMELines(message);
+      strvec_it headersBegin, headersEnd, bodyBegin, bodyEnd;
+      tie(headersBegin, headersEnd, bodyBegin, bodyEnd) = MIME::splitMIMEBodyAndHeaders(lines.begin(), lines.end());
+      vector<string> headers = MIME::joinHeaders(headersBegin, headersEnd);
+
+      parts.push_back(make_pair(MIME::getStringFromLines(headers.begin(), headers.end()), message.substr(end + 4)));
+      headerBytes += parts.back().first.size();
+      bodyBytes += parts.back().second.size();
+    }
+
+    if (parts.empty() || bodyBytes == 0) {
+      logger << FATAL << "Corpus is empty" << ENDL << CLASSIC;
+      return;
+    }
+
+    auto throughput = [](const size_t bytes, const microseconds took) {
+      return to_string(bytes / max<int64_t>(took.count(), 1)) + "MB/s";
+    };
+
+    const Cleanup::SIMDLevel supported = Cleanup::getSIMDLevel();
+    for (int32_t level = Cleanup::SIMDNone; level <= supported; ++level) {
+      Cleanup::setSIMDLevel(static_cast<Cleanup::SIMDLevel>(level));
+      size_t checksum = 0;
+
+      auto start = steady_clock::now();
+      for (size_t r = 0; r < rounds; ++r)
+        for (const auto &part : parts) checksum += DKIM::relaxedBody(part.second).size();
+      auto bodyTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+      start = steady_clock::now();
+      for (size_t r = 0; r < rounds; ++r) {
+        for (const auto &part : parts) {
+          checksum += DKIM::relaxedHeaders(part.first, { "from", "to", "subject", "content-type" }).size();
+        }
+      }
+      auto headersTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+      start = steady_clock::now();
+      for (size_t r = 0; r < rounds; ++r) {
+        for (const auto &part : parts) {
+          string reduced;
+          Cleanup::reduceWhitespace(part.second, reduced);
+          checksum += reduced.size();
+        }
+      }
+      auto reduceTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+      logger << Cleanup::simdLevelToString(static_cast<Cleanup::SIMDLevel>(level)) << ": "
+        << "relaxed body " << throughput(bodyBytes * rounds, bodyTook)
+        << ", relaxed headers " << throughput(headerBytes * rounds, headersTook)
+        << ", reduceWhitespace " << throughput(bodyBytes * rounds, reduceTook)
+        << " ( checksum " << checksum << " )" << ENDL;
+    }
+
+    Cleanup::setSIMDLevel(supported);
+  }
+
+  /**
+   * Parses an corpus of messages with the line based parser, and with the
+   *  MIME tree, with and without copying the result into an FullEmail
+   */
+  static void mimeBenchmark(const string &corpusPath, Logger &logger) {
+    vector<string> messages = readCorpus(corpusPath, logger);
+    const size_t rounds = 200;
+
+    // Adds an nested multipart message, since the templates are single part
+    string multipart = "From: Bench <bench@fannst.nl>\r\nTo: test@fannst.nl\r\nSubject: Multipart\r\n"
+      "Content-Type: multipart/mixed; boundary=\"outer\"\r\n\r\n--outer\r\n"
+      "Content-Type: multipart/alternative; boundary=inner\r\n\r\n";
+    for (const char *type : { "text/plain", "text/html" }) {
+      multipart += "--inner\r\nContent-Type: " + string(type) + "; charset=utf-8\r\n\r\n";
+      for (size_t i = 0; i < 200; ++i) multipart += "An line of text in the alternative part of the message.\r\n";
+    }
+    multipart += "--inner--\r\n--outer\r\nContent-Type: application/pdf\r\nContent-Transfer-Encoding: base64\r\n\r\n";
+    for (size_t i = 0; i < 400; ++i) multipart += string(76, 'A') + "\r\n";
+    multipart += "--outer--\r\n";
+    messages.push_back(multipart);
+
+    size_t bytes = 0;
+    for (const string &message : messages) bytes += message.size();
+
+    auto throughput = [](const size_t bytes, const microseconds took) {
+      return to_string(bytes / max<int64_t>(took.count(), 1)) + "MB/s";
+    };
+
+    size_t checksum = 0;
+    auto start = steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+      for (const string &message : messages) {
+        FullEmail email;
+        vector<string> lines = MIME::getMIMELines(message);
+        MIME::parseMIMERecursive(email, 0, lines.begin(), lines.end());
+        checksum += email.e_BodySections.size();
+      }
+    }
+    auto linesTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+    start = steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+      for (const string &message : messages) {
+        MIME::MIMETree tree(message);
+        checksum += tree.getNodes().size();
+      }
+    }
+    auto treeTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+    start = steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+      for (const string &message : messages) {
+        FullEmail email;
+        MIME::parseMIME(message, email);
+        checksum += email.e_BodySections.size();
+      }
+    }
+    auto adapterTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+    logger << "Lines " << throughput(bytes * rounds, linesTook)
+      << ", tree " << throughput(bytes * rounds, treeTook)
+      << ", tree into FullEmail " << throughput(bytes * rounds, adapterTook)
+      << " ( checksum " << checksum << " )" << ENDL;
+  }
+
+  /**
+   * Encodes and decodes an attachment sized buffer, once for each SIMD level
+   *  the CPU supports, and once with OpenSSL for comparison
+   */
+  static void base64Benchmark(Logger &logger) {
+    const size_t size = 4 * 1024 * 1024, rounds = 20;
+
+    mt19937 engine(1);
+    string raw(size, '\0');
+    for (char &c : raw) c = static_cast<char>(engine());
+
+    // Wraps the encoded data at 76 characters, as it is in MIME bodies
+    string encoded = Encoding::encodeBase64(raw), wrapped;
+    Encoding::Base64Encoder encoder(76);
+    encoder.update(raw.c_str(), raw.size(), wrapped);
+    encoder.finish(wrapped);
+
+    auto throughput = [](const size_t bytes, const microseconds took) {
+      return to_string(bytes / max<int64_t>(took.count(), 1)) + "MB/s";
+    };
+
+    size_t checksum = 0;
+    string out(encoded.size() + 1, '\0');
+    auto start = steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+      checksum += EVP_EncodeBlock(
+        reinterpret_cast<unsigned char *>(&out[0]),
+        reinterpret_cast<const unsigned char *>(raw.c_str()), raw.size()
+      );
+    }
+    auto encodeTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+    start = steady_clock::now();
+    for (size_t r = 0; r < rounds; ++r) {
+      checksum += EVP_DecodeBlock(
+        reinterpret_cast<unsigned char *>(&out[0]),
+        reinterpret_cast<const unsigned char *>(encoded.c_str()), encoded.size()
+      );
+    }
+    auto decodeTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+    logger << "OpenSSL: encode " << throughput(size * rounds, encodeTook)
+      << ", decode " << throughput(size * rounds, decodeTook) << ENDL;
+
+    const Cleanup::SIMDLevel supported = Cleanup::getSIMDLevel();
+    for (int32_t level = Cleanup::SIMDNone; level <= supported; ++level) {
+      Cleanup::setSIMDLevel(static_cast<Cleanup::SIMDLevel>(level));
+
+      start = steady_clock::now();
+      for (size_t r = 0; r < rounds; ++r) checksum += Encoding::encodeBase64(raw).size();
+      encodeTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+      start = steady_clock::now();
+      for (size_t r = 0; r < rounds; ++r) checksum += Encoding::decodeBase64(encoded).size();
+      decodeTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+      start = steady_clock::now();
+      for (size_t r = 0; r < rounds; ++r) checksum += Encoding::decodeBase64(wrapped).size();
+      auto wrappedTook = duration_cast<microseconds>(steady_clock::now() - start);
+
+      logger << Cleanup::simdLevelToString(static_cast<Cleanup::SIMDLevel>(level)) << ": "
+        << "encode " << throughput(size * rounds, encodeTook)
+        << ", decode " << throughput(size * rounds, decodeTook)
+        << ", decode MIME lines " << throughput(size * rounds, wrappedTook)
+        << " ( checksum " << checksum << " )" << ENDL;
+    }
+
+    Cleanup::setSIMDLevel(supported);
+  }
+
+  void benchmarkArgAction(const string &name) {
+    Logger logger("BENCHMARK", LoggerLevel::INFO);
+
+    // Arguments of an benchmark follow its name, after an colon
+    size_t sep = name.find(':');
+    const string benchmark = name.substr(0, sep);
+    const string argument = sep == string::npos ? "" : name.substr(sep + 1);
+
+    if (benchmark == "dns-cache") dnsCacheBenchmark(logger);
+    else if (benchmark == "dns-server") dnsServerBenchmark(argument, logger);
+    else if (benchmark == "whitespace") whitespaceBenchmark(argument, logger);
+    else if (benchmark == "mime") mimeBenchmark(argument, logger);
+    else if (benchmark == "base64") base64Benchmark(logger);
+    else logger << FATAL << "Unknown benchmark: '" << name << "'" << ENDL << CLASSIC;
+
+    exit(0);
+  }
+}
@@ -74,6 +74,8 @@ namespace FSMTP
 			else if (arg.compare("mailtest")) ARG_ACTIONS::mailTestArgAction();
 			else if (arg.compare("domainadd")) ARG_ACTIONS::addDomain();
 			else if (arg.compare("adduser")) ARG_ACTIONS::addUser();
+			else if (arg.compare("benchmark")) ARG_ACTIONS::benchmarkArgAction(arg.c_Arg);
+			else if (arg.compare("compile-zone")) ARG_ACTIONS::compileZoneArgAction(arg.c_Arg);
 
 			if (arg.compare("help"))
 			{
@@ -86,6 +88,8 @@ namespace FSMTP
 				cout << "-a, -adduser: " << "\tAdds an user to the database" << endl;
 				cout << "-d, -domainadd:" << "\tAdds an new domain." << endl;
 				cout << "-m, -mailtest: " << "\tSends an email." << endl;
+				cout << "-b, -benchmark=[name]: " << "\tRuns an benchmark ( dns-cache, dns-server[:threads], whitespace[:corpus-dir], mime[:corpus-dir], base64 )." << endl;
+				cout << "-c, -compile-zone=[image]: " << "\tCompiles the zone file of the DNS server into its image." << endl;
 
 				exit(0);
 			}
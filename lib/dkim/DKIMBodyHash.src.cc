@@ -0,0 +1,48 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "DKIMBodyHash.src.h"
+
+namespace FSMTP::DKIM {
+  DKIMBodyHash::DKIMBodyHash(const bool relaxed, const EVP_MD *type, const int64_t limit):
+    DKIMBodyCanonicalizer(relaxed, limit), m_Context(EVP_MD_CTX_new())
+  {
+    if (!this->m_Context || EVP_DigestInit_ex(this->m_Context, type, nullptr) <= 0) {
+      EVP_MD_CTX_free(this->m_Context);
+      throw runtime_error(EXCEPT_DEBUG(string("EVP_DigestInit_ex() failed: ") + SSL_STRERROR));
+    }
+  }
+
+  DKIMBodyHash::~DKIMBodyHash() {
+    EVP_MD_CTX_free(this->m_Context);
+  }
+
+  void DKIMBodyHash::write(const char *data, const size_t len) {
+    if (EVP_DigestUpdate(this->m_Context, data, len) <= 0)
+      throw runtime_error(EXCEPT_DEBUG(string("EVP_DigestUpdate() failed: ") + SSL_STRERROR));
+  }
+
+  string DKIMBodyHash::final() {
+    this->finish();
+
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    if (EVP_DigestFinal_ex(this->m_Context, digest, &len) <= 0)
+      throw runtime_error(EXCEPT_DEBUG(string("EVP_DigestFinal_ex() failed: ") + SSL_STRERROR));
+
+    return Hashes::encodeBase64(string(reinterpret_cast<char *>(digest), len));
+  }
+}
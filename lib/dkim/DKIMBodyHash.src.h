@@ -0,0 +1,46 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef _LIB_DKIM_BODY_HASH_H
+#define _LIB_DKIM_BODY_HASH_H
+
+#include "../default.h"
+#include "DKIMCanonicalization.src.h"
+#include "DKIMHashes.src.h"
+
+namespace FSMTP::DKIM {
+  /**
+   * Hashes the canonicalized body while it is being canonicalized, so the
+   *  body may be fed in chunks and is never copied as a whole
+   */
+  class DKIMBodyHash : public DKIMBodyCanonicalizer {
+  public:
+    DKIMBodyHash(const bool relaxed, const EVP_MD *type, const int64_t limit = -1);
+    ~DKIMBodyHash();
+
+    /**
+     * Finishes the canonicalization and returns the base64
+     *  encoded digest, call only once
+     */
+    string final();
+  protected:
+    void write(const char *data, const size_t len);
+  private:
+    EVP_MD_CTX *m_Context;
+  };
+}
+
+#endif
@@ -17,6 +17,12 @@
 #include "DKIMCanonicalization.src.h"
 
 namespace FSMTP::DKIM {
+  DKIMBodyCanonicalizer::DKIMBodyCanonicalizer(const bool relaxed, const int64_t limit):
+    m_Relaxed(relaxed), m_Limit(limit), m_Length(0), m_EmptyLines(0),
+    m_PendingWSP(false), m_PendingCR(false), m_LineHasContent(false),
+    m_BufferLength(0)
+  {}
+
   /**
    * : RFC 6376
    * 
@@ -34,75 +40,173 @@ namespace FSMTP::DKIM {
    *     does not end with a CRLF, a CRLF is added.  (For email, this is
    *     only possible when using extensions to SMTP or non-SMTP transport
    *     mechanisms.)
+   * 
+   * The "simple" body canonicalization algorithm ignores all empty lines
+   * at the end of the message body. [...] If there is no body or
+   * no trailing CRLF on the message body, a CRLF is added.
    */
-  string relaxedBody(const string &raw) {
-    vector<string> lines = MIME::getMIMELines(raw);
-    
-    // Reduces all the whitespace to a single whitespace char
-    //  after which we remove the whitespace at the end of line
-    for_each(lines.begin(), lines.end(), [&](string &line) {
-      // Reduces all the whitespace to a single char
-      string reducedLine;
-      reducedLine.reserve(line.length());
-      bool lww = false;
-      for_each(line.begin(), line.end(), [&](char c) {
-        if (c == '\t') c = ' ';
-
-        if (c == ' ') {
-          if (lww) return;
-          else lww = true;
-        } else lww = false;
-
-        reducedLine += c;
-      });
+  void DKIMBodyCanonicalizer::update(const char *data, const size_t len) {
+    for (size_t i = 0; i < len;) {
+      // Finds the run of bytes which are copied as-is, the first one goes
+      //  through content() to write the held back lines and whitespace
+      size_t run = this->m_Relaxed
+        ? Cleanup::findWhitespaceFold(data + i, len - i)
+        : Cleanup::findLineBreak(data + i, len - i);
 
-      // Removes the whitespace at the end of line, after which
-      //  we update the current line
-      if (*(reducedLine.end() - 1) == ' ') reducedLine.pop_back();
-      line = reducedLine;
-    });
+      if (run > 0) {
+        if (this->m_PendingCR) {
+          this->m_PendingCR = false;
+          this->content('\r');
+        }
+
+        // The run may start with an single space, which is merged
+        //  with any whitespace held back from the previous data
+        if (this->m_Relaxed && data[i] == ' ') {
+          this->m_PendingWSP = true;
+          ++i;
+          --run;
+        }
 
-    // Loops over the lines, and checks if it contains content, after which we remove
-    //  the whitespace at the end of the document
-    strvec_it lastValidLine = lines.begin();
-    for (strvec_it it = lines.begin(); it != lines.end(); ++it) {
-      if (!(*it).empty()) lastValidLine = it;
+        if (run > 0) {
+          this->content(data[i]);
+          this->emit(data + i + 1, run - 1);
+          i += run;
+        }
+      }
+
+      if (i == len) break;
+
+      // Lines end at the LF, an CR is only part of the line
+      //  if something other than an LF follows it
+      const char c = data[i++];
+      if (c == '\n') {
+        this->endLine();
+        continue;
+      } else if (this->m_PendingCR) {
+        this->m_PendingCR = false;
+        this->content('\r');
+      }
+
+      if (c == '\r') this->m_PendingCR = true;
+      else this->m_PendingWSP = true;
     }
+  }
 
-    // Erases the lines at the end of the document, after which we
-    //  will join the lines and return the result
-    lines.erase(lastValidLine + 1, lines.end());
-    return MIME::getStringFromLines(lines.begin(), lines.end());
+  void DKIMBodyCanonicalizer::update(const string &data) {
+    this->update(data.c_str(), data.size());
   }
 
-  /**
-   * : RFC 6376
-   * 
-   * The "simple" body canonicalization algorithm ignores all empty lines
-   * at the end of the message body.  An empty line is a line of zero
-   * length after removal of the line terminator.  If there is no body or
-   * no trailing CRLF on the message body, a CRLF is added.  It makes no
-   * other changes to the message body.  In more formal terms, the
-   * "simple" body canonicalization algorithm converts "*CRLF" at the end
-   * of the body to a single "CRLF".
-   * 
-   * Note that a completely empty or missing body is canonicalized as a
-   * single "CRLF"; that is, the canonicalized length will be 2 octets.
-   */
-  string simpleBody(const string &raw) {
-    vector<string> lines = MIME::getMIMELines(raw);
+  void DKIMBodyCanonicalizer::finish() {
+    // Completes the last line if it did not end with an CRLF, an empty
+    //  body is an single CRLF with simple canonicalization
+    if (this->m_LineHasContent) this->endLine();
+    else if (!this->m_Relaxed && this->m_Length == 0) this->emitCRLF();
+
+    this->flush();
+  }
 
-    // Loops over the lines, and stores the index of the
-    //  last line with content, so the rest may be removed
-    strvec_it lastValidLine = lines.begin();
-    for (strvec_it it = lines.begin(); it != lines.end(); ++it) {
-      if (!(*it).empty()) lastValidLine = it;
+  size_t DKIMBodyCanonicalizer::getLength() const {
+    return this->m_Length;
+  }
+
+  void DKIMBodyCanonicalizer::content(const char c) {
+    // Writes the empty lines we held back, since they are
+    //  not at the end of the body
+    if (!this->m_LineHasContent) {
+      for (; this->m_EmptyLines > 0; --this->m_EmptyLines) this->emitCRLF();
+      this->m_LineHasContent = true;
+    }
+
+    if (this->m_PendingWSP) {
+      this->emit(' ');
+      this->m_PendingWSP = false;
     }
-    
-    // Erases the end of the lines vector, so removes the empty lines
-    //  after which we join them and return them as an string
-    lines.erase(lastValidLine + 1, lines.end());
-    return MIME::getStringFromLines(lines.begin(), lines.end());
+
+    this->emit(c);
+  }
+
+  void DKIMBodyCanonicalizer::endLine() {
+    // Whitespace at the end of the line is dropped, and an line
+    //  without content is held back as an possible trailing line
+    this->m_PendingCR = false;
+    this->m_PendingWSP = false;
+
+    if (this->m_LineHasContent) {
+      this->emitCRLF();
+      this->m_LineHasContent = false;
+    } else ++this->m_EmptyLines;
+  }
+
+  void DKIMBodyCanonicalizer::emit(const char c) {
+    if (++this->m_Length > static_cast<size_t>(this->m_Limit) && this->m_Limit >= 0) return;
+
+    this->m_Buffer[this->m_BufferLength++] = c;
+    if (this->m_BufferLength == _DKIM_CANON_BUFFER_SIZE) this->flush();
+  }
+
+  void DKIMBodyCanonicalizer::emit(const char *data, size_t len) {
+    size_t start = this->m_Length;
+    this->m_Length += len;
+
+    if (this->m_Limit >= 0) {
+      if (start >= static_cast<size_t>(this->m_Limit)) return;
+      len = min(len, static_cast<size_t>(this->m_Limit) - start);
+    }
+
+    // Large runs skip the buffer, smaller ones are
+    //  gathered to limit the calls to write()
+    if (this->m_BufferLength + len > _DKIM_CANON_BUFFER_SIZE) {
+      this->flush();
+
+      if (len >= _DKIM_CANON_BUFFER_SIZE) {
+        this->write(data, len);
+        return;
+      }
+    }
+
+    memcpy(this->m_Buffer + this->m_BufferLength, data, len);
+    this->m_BufferLength += len;
+  }
+
+  void DKIMBodyCanonicalizer::emitCRLF() {
+    this->emit('\r');
+    this->emit('\n');
+  }
+
+  void DKIMBodyCanonicalizer::flush() {
+    if (this->m_BufferLength == 0) return;
+
+    this->write(this->m_Buffer, this->m_BufferLength);
+    this->m_BufferLength = 0;
+  }
+
+  class DKIMStringCanonicalizer : public DKIMBodyCanonicalizer {
+  public:
+    DKIMStringCanonicalizer(const bool relaxed):
+      DKIMBodyCanonicalizer(relaxed)
+    {}
+
+    string m_Result;
+  protected:
+    void write(const char *data, const size_t len) {
+      this->m_Result.append(data, len);
+    }
+  };
+
+  string relaxedBody(const string &raw) {
+    DKIMStringCanonicalizer canonicalizer(true);
+    canonicalizer.update(raw);
+    canonicalizer.finish();
+
+    return canonicalizer.m_Result;
+  }
+
+  string simpleBody(const string &raw) {
+    DKIMStringCanonicalizer canonicalizer(false);
+    canonicalizer.update(raw);
+    canonicalizer.finish();
+
+    return canonicalizer.m_Result;
   }
 
   /**
@@ -187,24 +291,12 @@ namespace FSMTP::DKIM {
       //  and do not process the header any further
       if (find(filter.begin(), filter.end(), key) == filter.end()) return;
 
-      // Reduces all the whitespace in the value to a single whitespace occurence
-      //  after which we will remove the suffix whitespace
-      string reducedValue;
-      reducedValue.reserve(line.length());
-      bool lww = false;
-      for_each(val.begin(), val.end(), [&](const char c) {
-        if (c == ' ') {
-          if (lww) return;
-          else lww = true;
-        } else lww = false;
-
-        reducedValue += c;
-      });
-
-      // Removes the suffix and prefix whitespace from the value, this is just
-      //  the whitespace at the end of line or the begin
-      if (*(reducedValue.end() - 1) == ' ') reducedValue.pop_back();
-      if (*reducedValue.begin() == ' ') reducedValue.erase(reducedValue.begin(), reducedValue.begin() + 1);
+      // Reduces all the whitespace ( spaces and tabs ) in the value to a single
+      //  space, after which we remove the prefix and suffix whitespace
+      string reducedValue(val.size(), '\0');
+      reducedValue.resize(Cleanup::collapseWhitespace(val.c_str(), val.size(), &reducedValue[0], true));
+      reducedValue.resize(Cleanup::trimTrailingWhitespace(reducedValue.c_str(), reducedValue.size()));
+      if (!reducedValue.empty() && reducedValue[0] == ' ') reducedValue.erase(0, 1);
 
       // Builds the header and pushes it to the final result vector,
       //  which will join it back to a message
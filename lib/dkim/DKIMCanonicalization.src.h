@@ -19,8 +19,49 @@
 
 #include "../default.h"
 #include "../mime/mimev2.src.h"
+#include "../general/whitespace.src.h"
+
+#define _DKIM_CANON_BUFFER_SIZE 4096
 
 namespace FSMTP::DKIM {
+  /**
+   * Canonicalizes an body in a single pass, while it is being received, the
+   *  trailing empty lines are only counted, and written once content follows
+   *  them, so the extra memory is constant. If an limit ( l= ) is given, only
+   *  that many canonicalized bytes are written
+   */
+  class DKIMBodyCanonicalizer {
+  public:
+    DKIMBodyCanonicalizer(const bool relaxed, const int64_t limit = -1);
+    virtual ~DKIMBodyCanonicalizer() = default;
+
+    void update(const char *data, const size_t len);
+    void update(const string &data);
+    void finish();
+
+    /**
+     * Gets the full canonicalized length, including the part
+     *  past the limit
+     */
+    size_t getLength() const;
+  protected:
+    virtual void write(const char *data, const size_t len) = 0;
+  private:
+    void content(const char c);
+    void endLine();
+    void emit(const char c);
+    void emit(const char *data, size_t len);
+    void emitCRLF();
+    void flush();
+
+    bool m_Relaxed;
+    int64_t m_Limit;
+    size_t m_Length, m_EmptyLines;
+    bool m_PendingWSP, m_PendingCR, m_LineHasContent;
+    char m_Buffer[_DKIM_CANON_BUFFER_SIZE];
+    size_t m_BufferLength;
+  };
+
   string relaxedBody(const string &raw);
   string simpleBody(const string &raw);
 
@@ -37,7 +37,7 @@ namespace FSMTP::DKIM::Hashes
 			throw std::runtime_error("Could not update the SHA1 context");
 
 		// Digests the hash
-		uint8_t *digest = new uint8_t[SHA_DIGEST_LENGTH];
+		uint8_t digest[SHA_DIGEST_LENGTH];
 		rc = SHA1_Final(digest, &ctx);
 		if (rc < 0)
 			throw std::runtime_error("Could not digest SHA1 context");
@@ -46,25 +46,7 @@ namespace FSMTP::DKIM::Hashes
 		// Turn into Base64
 		// ==================================
 
-		BIO *bio = nullptr, *base64 = nullptr;
-		BUF_MEM *bufMem = nullptr;
-
-		// Initializes the base64 encoder and sets the flags
-		base64 = BIO_new(BIO_f_base64());
-		bio = BIO_new(BIO_s_mem());
-		bio = BIO_push(base64, bio);
-		BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-
-		// Generatest he base64 encoded string
-		BIO_write(bio, digest, SHA_DIGEST_LENGTH);
-		BIO_flush(bio);
-		BIO_get_mem_ptr(bio, &bufMem);
-
-		// Creates the result, and frees the memory
-		std::string res(bufMem->data, bufMem->length);
-		BIO_free_all(bio);
-		delete[] digest;
-		return res;
+		return Encoding::encodeBase64(reinterpret_cast<char *>(digest), SHA_DIGEST_LENGTH);
 	}
 
 	/**
@@ -96,7 +78,7 @@ namespace FSMTP::DKIM::Hashes
 			throw std::runtime_error("Could not update the SHA256 context");
 
 		// Digests the hash
-		uint8_t *digest = new uint8_t[SHA256_DIGEST_LENGTH];
+		uint8_t digest[SHA256_DIGEST_LENGTH];
 		rc = SHA256_Final(digest, &ctx);
 		if (rc < 0)
 			throw std::runtime_error("Could not digest SHA256 context");
@@ -109,215 +91,149 @@ namespace FSMTP::DKIM::Hashes
 		// - the email header
 		// ==================================
 
-		BIO *bio = nullptr, *base64 = nullptr;
-		BUF_MEM *bufMem = nullptr;
-
-		// Initializes the base64 encoder and sets the flags
-		base64 = BIO_new(BIO_f_base64());
-		bio = BIO_new(BIO_s_mem());
-		bio = BIO_push(base64, bio);
-		BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-
-		// Generatest he base64 encoded string
-		BIO_write(bio, digest, SHA256_DIGEST_LENGTH);
-		BIO_flush(bio);
-		BIO_get_mem_ptr(bio, &bufMem);
-
-		// Creates the result, and frees the memory
-		std::string res(bufMem->data, bufMem->length);
-		BIO_free_all(bio);
-		delete[] digest;
-		return res;
+		return Encoding::encodeBase64(reinterpret_cast<char *>(digest), SHA256_DIGEST_LENGTH);
 	}
 
-	string RSAShagenerateSignature(const string &raw, const char *pkey, const EVP_MD *type) {
-		int32_t rc;
+	static string ed25519Digest(const string &raw, const EVP_MD *type) {
+		unsigned char digest[EVP_MAX_MD_SIZE];
+		unsigned int len = 0;
 
-		// =====================================
-		// Reads the private key file
-		//
-		// Because the signing process involves
-		// - some cryptographic stuff, we need
-		// - to read our private dkim file
-		// =====================================
-
-		// Creates the file pointer (rt = read text)
-		FILE *privateKey = fopen(pkey, "rt");
-		if (!privateKey)
-		{
-			std::string message = "fopen() failed: ";
-			message += strerror(errno);
-			throw std::runtime_error(message);
+		if (!EVP_Digest(raw.c_str(), raw.size(), digest, &len, type ? type : EVP_sha256(), nullptr)) {
+			throw runtime_error(EXCEPT_DEBUG(string("EVP_Digest() failed: ") + SSL_STRERROR));
 		}
 
-		// Reads the private key
-		RSA *rsa = PEM_read_RSAPrivateKey(privateKey, nullptr, nullptr, nullptr);
-		if (!rsa)
-			throw std::runtime_error("PEM_read_RSAPrivateKey() failed");
+		return string(reinterpret_cast<char *>(digest), len);
+	}
 
-		// Closes the file
-		fclose(privateKey);
+	EVP_PKEY *loadPrivateKey(const string &path) {
+		FILE *file = fopen(path.c_str(), "rt");
+		if (!file) {
+			throw runtime_error(EXCEPT_DEBUG("fopen() failed: " + string(strerror(errno))));
+		}
+		DEFER(fclose(file));
 
-		// =====================================
-		// Performs the signing process
-		//
-		// Signs the specified contents
-		// =====================================
+		// Reads both the RSA and Ed25519 keys, the type is
+		//  taken from the PEM itself
+		EVP_PKEY *key = PEM_read_PrivateKey(file, nullptr, nullptr, nullptr);
+		if (!key) {
+			throw runtime_error(EXCEPT_DEBUG(string("PEM_read_PrivateKey() failed: ") + SSL_STRERROR));
+		}
 
-		EVP_MD_CTX *rsaSignContext = EVP_MD_CTX_new();
-		EVP_PKEY *evpPrivateKey = EVP_PKEY_new();
+		return key;
+	}
 
-		// Assigns the RSA Private key to the EVP Private key
-		EVP_PKEY_assign_RSA(evpPrivateKey, rsa);
+	string encodeBase64(const string &raw) {
+		return Encoding::encodeBase64(raw);
+	}
 
-		// Initializes the signer
-		rc = EVP_DigestSignInit(rsaSignContext, nullptr, type, nullptr, evpPrivateKey);
-		if (rc < 0)
-			throw std::runtime_error("EVP_DigestSignInit() failed");
+	string sign(const string &raw, EVP_PKEY *key, const EVP_MD *type) {
+		EVP_MD_CTX *signContext = EVP_MD_CTX_new();
+		DEFER(EVP_MD_CTX_free(signContext));
 
-		// Updates the signer
-		rc = EVP_DigestSignUpdate(rsaSignContext, raw.c_str(), raw.size());
-		if (rc < 0)
-			throw std::runtime_error("EVP_DigestSignUpdate() failed");
+		// Ed25519-SHA256 signs the digest of the data with PureEdDSA ( RFC 8463 ),
+		//  so we hash ourselves and pass no digest to OpenSSL
+		string digest;
+		if (EVP_PKEY_id(key) == EVP_PKEY_ED25519) {
+			digest = ed25519Digest(raw, type);
+			type = nullptr;
+		}
+		const string &data = digest.empty() ? raw : digest;
 
-		// Gets the signed content length, and allocates the required
-		// - memory so we wont have any undefined behaviour
-		std::size_t len;
-		rc = EVP_DigestSignFinal(rsaSignContext, nullptr, &len);
-		if (rc < 0)
-			throw std::runtime_error("EVP_DigestSignFinal() failed");
-		uint8_t *buffer = new uint8_t[len];
+		if (EVP_DigestSignInit(signContext, nullptr, type, nullptr, key) <= 0) {
+			throw runtime_error(EXCEPT_DEBUG(string("EVP_DigestSignInit() failed: ") + SSL_STRERROR));
+		}
 
-		// Gets the result and stores it inside of the buffer
-		// - and frees the memory
-		rc = EVP_DigestSignFinal(rsaSignContext, buffer, &len);
-		if (rc < 0)
-			throw std::runtime_error("EVP_DigestSignUpdate() failed");
-		EVP_MD_CTX_free(rsaSignContext);
-		EVP_PKEY_free(evpPrivateKey);
+		size_t len = 0;
+		if (EVP_DigestSign(
+			signContext, nullptr, &len,
+			reinterpret_cast<const unsigned char *>(data.c_str()), data.size()
+		) <= 0) {
+			throw runtime_error(EXCEPT_DEBUG(string("EVP_DigestSign() failed: ") + SSL_STRERROR));
+		}
 
-		// =====================================
-		// Generates the base64 string
-		//
-		// Gets the raw bytes and turns them
-		// - into an base64 string
-		// =====================================		
-
-		BIO *bio = nullptr, *base64 = nullptr;
-		BUF_MEM *bufMem = nullptr;
-
-		// Initializes the BIO's and sets the flags
-		base64 = BIO_new(BIO_f_base64());
-		bio = BIO_new(BIO_s_mem());
-		bio = BIO_push(base64, bio);
-		BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-
-		// Writes the data to the BIO and encodes it
-		// - into base64
-		BIO_write(bio, buffer, len);
-		BIO_flush(bio);
-		BIO_get_mem_ptr(bio, &bufMem);
-
-		// Turns the bio into an result string, and free's the memory
-		std::string res(bufMem->data, bufMem->length);
-		BIO_free_all(bio);
-		delete[] buffer;
-		return res;
+		string signature(len, '\0');
+		if (EVP_DigestSign(
+			signContext, reinterpret_cast<unsigned char *>(&signature[0]), &len,
+			reinterpret_cast<const unsigned char *>(data.c_str()), data.size()
+		) <= 0) {
+			throw runtime_error(EXCEPT_DEBUG(string("EVP_DigestSign() failed: ") + SSL_STRERROR));
+		}
+
+		signature.resize(len);
+		return encodeBase64(signature);
 	}
 
-	/**
-	 * Verifies an signature using the public key
-	 */
-	bool RSAverify(const string &signature, const string &raw, const string &pubKey, const EVP_MD *type) {
-		// Formats the key in a way openssl can read, this is in the
-		//  pem format.
-
-		string readyPubKey = "-----BEGIN PUBLIC KEY-----\r\n";
-
-		size_t leftLength = pubKey.length(), usedLength = 0;
-		while (leftLength > 0) {
-			if (leftLength > 64) {
-				readyPubKey += pubKey.substr(usedLength, 64);
-				readyPubKey += "\r\n";
-				usedLength += 64;
-				leftLength -= 64;
-			} else {
-				readyPubKey += pubKey.substr(usedLength, leftLength);
-				readyPubKey += "\r\n";
-				usedLength += leftLength;
-				leftLength -= leftLength;
-			}
+	string RSAShagenerateSignature(const string &raw, const char *pkey, const EVP_MD *type) {
+		EVP_PKEY *key = loadPrivateKey(pkey);
+		DEFER(EVP_PKEY_free(key));
+
+		return sign(raw, key, type);
+	}
+
+	string decodeBase64(const string &raw) {
+		// The values in DKIM headers and records may be folded, the
+		//  decoder skips the whitespace itself
+		return Encoding::decodeBase64(raw);
+	}
+
+	EVP_PKEY *parsePublicKey(const string &pubKey, const bool ed25519) {
+		string der = decodeBase64(pubKey);
+		EVP_PKEY *key = nullptr;
+
+		// Ed25519 keys are published as the bare 32 byte key ( RFC 8463 ), RSA
+		//  keys as an DER encoded SubjectPublicKeyInfo
+		if (ed25519) {
+			key = EVP_PKEY_new_raw_public_key(
+				EVP_PKEY_ED25519, nullptr,
+				reinterpret_cast<const unsigned char *>(der.c_str()), der.size()
+			);
+		} else {
+			const unsigned char *p = reinterpret_cast<const unsigned char *>(der.c_str());
+			key = d2i_PUBKEY(nullptr, &p, der.size());
 		}
 
-		readyPubKey += "-----END PUBLIC KEY-----";
+		if (!key) throw runtime_error(EXCEPT_DEBUG(string("Could not parse public key: ") + SSL_STRERROR));
+		return key;
+	}
 
-		// =====================================
-		// Decodes the Base64 string
-		//
-		// Due to transmission we encoded the
-		//  binary signature to base64, so lets
-		//  decode it
-		// =====================================
-
-		BIO *base64 = nullptr, *bio = nullptr;
-		unsigned char *decodedSignature = new unsigned char[raw.size()];
-		DEFER(delete[] decodedSignature);
-
-		// Prepares the decoder
-		base64 = BIO_new(BIO_f_base64());
-		bio = BIO_new_mem_buf(signature.c_str(), signature.length());
-		bio = BIO_push(base64, bio);
-		BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-		DEFER(BIO_free_all(bio));
-
-		// Reads the decoded base64 data
-		int32_t decodedLen = BIO_read(bio, decodedSignature, raw.size());
-
-		// =====================================
-		// Gets the RSA key
-		// =====================================
-
-		BIO *pubKeyBio = BIO_new(BIO_s_mem());
-		BIO_write(pubKeyBio, readyPubKey.c_str(), readyPubKey.length());
-		DEFER(BIO_free(pubKeyBio));
-
-		RSA *rsa = nullptr;
-		if (PEM_read_bio_RSA_PUBKEY(pubKeyBio, &rsa, nullptr, nullptr) == nullptr) {
-			throw runtime_error(EXCEPT_DEBUG(SSL_STRERROR));
+	bool verify(const string &signature, const string &raw, EVP_PKEY *key, const EVP_MD *type) {
+		string decodedSignature = decodeBase64(signature);
+
+		EVP_MD_CTX *verifyContext = EVP_MD_CTX_new();
+		DEFER(EVP_MD_CTX_free(verifyContext));
+
+		string digest;
+		if (EVP_PKEY_id(key) == EVP_PKEY_ED25519) {
+			digest = ed25519Digest(raw, type);
+			type = nullptr;
 		}
+		const string &data = digest.empty() ? raw : digest;
 
-		// =====================================
-		// Validates the signature
-		// =====================================
-
-		EVP_MD_CTX *rsaVerifyContext = EVP_MD_CTX_new();
-		EVP_PKEY *rsaVerifyKey = EVP_PKEY_new();
-		EVP_PKEY_assign_RSA(rsaVerifyKey, rsa);
-		DEFER_M({
-			EVP_MD_CTX_free(rsaVerifyContext);
-			EVP_PKEY_free(rsaVerifyKey);
-		});
-
-		// Initializes the signature verifier
-		//  with the public key
-		if (EVP_DigestVerifyInit(
-			rsaVerifyContext, nullptr, type,
-			nullptr, rsaVerifyKey
-		) < 0) {
+		if (EVP_DigestVerifyInit(verifyContext, nullptr, type, nullptr, key) <= 0) {
 			throw runtime_error(EXCEPT_DEBUG(string("EVP_DigestVerifyInit() failed:") + SSL_STRERROR));
 		}
-		
-		// Updates the verifier with the data we want to compare
-		//  to the signature
-		if (EVP_DigestVerifyUpdate(rsaVerifyContext, raw.c_str(), raw.length()) < 0) {
-			throw runtime_error(EXCEPT_DEBUG(string("EVP_DigestVerfifyUpdate() failed:") + SSL_STRERROR));
-		}
 
-		// Adds the signature to the verifier, and checks if anything
-		//  goes wrong in the meantime
-		int32_t code = EVP_DigestVerifyFinal(rsaVerifyContext, decodedSignature, decodedLen);
-		if (code == 0) return false;
-		else if (code == 1) return true;
-		else throw runtime_error(EXCEPT_DEBUG(string("EVP_DigestVerifyFinal() failed: ") + SSL_STRERROR));
+		int32_t code = EVP_DigestVerify(
+			verifyContext,
+			reinterpret_cast<const unsigned char *>(decodedSignature.c_str()), decodedSignature.size(),
+			reinterpret_cast<const unsigned char *>(data.c_str()), data.size()
+		);
+
+		if (code == 1) return true;
+		else if (code == 0) return false;
+
+		// An malformed signature is just an invalid one
+		ERR_clear_error();
+		return false;
+	}
+
+	/**
+	 * Verifies an signature using the public key
+	 */
+	bool RSAverify(const string &signature, const string &raw, const string &pubKey, const EVP_MD *type) {
+		EVP_PKEY *key = parsePublicKey(pubKey, false);
+		DEFER(EVP_PKEY_free(key));
+
+		return verify(signature, raw, key, type);
 	}
 }
\ No newline at end of file
@@ -24,13 +24,35 @@
 #pragma once
 
 #include "../default.h"
+#include "../general/base64.src.h"
 
 namespace FSMTP::DKIM::Hashes
 {
 	string sha256base64(const std::string &raw);
 	string sha1base64(const string &raw);
 
+	/**
+	 * Reads an PEM private key ( RSA or Ed25519 ), the caller owns
+	 *  the returned key
+	 */
+	EVP_PKEY *loadPrivateKey(const string &path);
+
+	/**
+	 * Signs the data and returns the base64 signature, the key is only read
+	 *  so it may be shared by multiple threads
+	 */
+	string sign(const string &raw, EVP_PKEY *key, const EVP_MD *type);
 	string RSAShagenerateSignature(const string &raw, const char *pkey, const EVP_MD *type);
 
+	string encodeBase64(const string &raw);
+	string decodeBase64(const string &raw);
+
+	/**
+	 * Parses the base64 key of an DKIM record, the caller owns
+	 *  the returned key
+	 */
+	EVP_PKEY *parsePublicKey(const string &pubKey, const bool ed25519);
+
+	bool verify(const string &signature, const string &raw, EVP_PKEY *key, const EVP_MD *type);
 	bool RSAverify(const string &signature, const string &raw, const string &pubKey, const EVP_MD *type);
 }
\ No newline at end of file
@@ -36,6 +36,7 @@ namespace FSMTP::DKIM {
 		switch (a) {
 			case DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1: return "rsa-sha1";
 			case DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256: return "rsa-sha256";
+			case DKIMHeaderAlgorithm::HeaderAlgorithmED25519_SHA256: return "ed25519-sha256";
 		}
 	}
 
@@ -43,7 +44,7 @@ namespace FSMTP::DKIM {
 		m_Version(DKIMHeaderVersion::HeaderVersionDKIM1),
 		m_CanonAlgoPair(DKIMHeaderCanonAlgPair::RelaxedRelaxed),
 		m_HeaderAlgorithm(DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256),
-		m_ExpireDate(0), m_SignDate(0)
+		m_ExpireDate(0), m_SignDate(0), m_BodyLength(-1)
 	{}
 
 	DKIMHeader &DKIMHeader::parse(const string &raw) {
@@ -114,6 +115,7 @@ namespace FSMTP::DKIM {
 				transform(val.begin(), val.end(), val.begin(), [](const char c) { return tolower(c); });
 				if (val == "rsa-sha256") this->m_HeaderAlgorithm = DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256;
 				else if (val == "rsa-sha1") this->m_HeaderAlgorithm = DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1;
+				else if (val == "ed25519-sha256") this->m_HeaderAlgorithm = DKIMHeaderAlgorithm::HeaderAlgorithmED25519_SHA256;
 				else this->m_HeaderAlgorithm = DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256;
 			} else if (key == "bh") { // The body-hash
 				this->m_BodyHash = val;
@@ -127,6 +129,10 @@ namespace FSMTP::DKIM {
 			} else if (key == "t") {
 				try { this->m_SignDate = stol(val); }
 				catch (...) { this->m_SignDate = 0; }
+			} else if (key == "l") { // The number of body bytes signed
+				try { this->m_BodyLength = stoll(val); }
+				catch (...) { throw runtime_error(EXCEPT_DEBUG("Invalid body length: '" + val + '\'')); }
+				if (this->m_BodyLength < 0) throw runtime_error(EXCEPT_DEBUG("Invalid body length: '" + val + '\''));
 			}
 		});
 
@@ -175,6 +181,9 @@ namespace FSMTP::DKIM {
 	const vector<string> &DKIMHeader::getHeaders()
 	{ return this->m_Headers; }
 
+	int64_t DKIMHeader::getBodyLength()
+	{ return this->m_BodyLength; }
+
 	DKIMHeader &DKIMHeader::setBodyHash(const string &bodyHash)
 	{ this->m_BodyHash = bodyHash; return *this; }
 
@@ -202,6 +211,9 @@ namespace FSMTP::DKIM {
 	DKIMHeader &DKIMHeader::setSignDate(int64_t t)
 	{ this->m_SignDate = t; return *this; }
 
+	DKIMHeader &DKIMHeader::setBodyLength(int64_t l)
+	{ this->m_BodyLength = l; return *this; }
+
     string DKIMHeader::build() const {
 		vector<pair<string, string>> values = {
     		make_pair("v", __dkimHeaderVersionToString(this->m_Version)),
@@ -217,6 +229,9 @@ namespace FSMTP::DKIM {
 			values.push_back(make_pair("x", to_string(this->m_ExpireDate)));
 		}
 
+		if (this->m_BodyLength >= 0)
+			values.push_back(make_pair("l", to_string(this->m_BodyLength)));
+
 		values.push_back(make_pair("bh", this->m_BodyHash));
 		values.push_back(make_pair("b", this->m_Signature));
 
@@ -36,7 +36,8 @@ namespace FSMTP::DKIM {
   const char *__dkimHeaderCanonAlgPairToString(DKIMHeaderCanonAlgPair a);
 
   enum DKIMHeaderAlgorithm {
-    HeaderAlgoritmRSA_SHA256, HeaderAlgorithmRSA_SHA1
+    HeaderAlgoritmRSA_SHA256, HeaderAlgorithmRSA_SHA1,
+    HeaderAlgorithmED25519_SHA256
   };
 
   const char *__dkimHeaderAlgToString(DKIMHeaderAlgorithm a);
@@ -61,6 +62,7 @@ namespace FSMTP::DKIM {
     const string &getDomain();
     const string &getSignature();
     const vector<string> &getHeaders();
+    int64_t getBodyLength();
 
     DKIMHeader &setBodyHash(const string &bodyHash);
     DKIMHeader &setSignature(const string &signature);
@@ -71,6 +73,7 @@ namespace FSMTP::DKIM {
     DKIMHeader &setHeaderAlgo(const DKIMHeaderAlgorithm &algo);
     DKIMHeader &setExpireDate(int64_t t);
     DKIMHeader &setSignDate(int64_t t);
+    DKIMHeader &setBodyLength(int64_t l);
 
     string build() const;
 
@@ -81,7 +84,7 @@ namespace FSMTP::DKIM {
     DKIMHeaderVersion m_Version;
     DKIMHeaderCanonAlgPair m_CanonAlgoPair;
     DKIMHeaderAlgorithm m_HeaderAlgorithm;
-    int64_t m_ExpireDate, m_SignDate;
+    int64_t m_ExpireDate, m_SignDate, m_BodyLength;
   };
 }
 
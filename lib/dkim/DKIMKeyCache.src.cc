@@ -0,0 +1,80 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "DKIMKeyCache.src.h"
+
+namespace FSMTP::DKIM {
+  static mutex keyCacheMutex;
+  static TTLCache<shared_ptr<const DKIMPublicKey>> keyCache(1024);
+  static atomic<size_t> keyCacheHits(0);
+  static atomic<size_t> keyCacheMisses(0);
+
+  shared_ptr<const DKIMPublicKey> DKIMKeyCache::get(const string &selector, const string &domain) {
+    string query = selector + "._domainkey." + domain;
+    transform(query.begin(), query.end(), query.begin(), [](const char c) { return tolower(c); });
+
+    {
+      lock_guard<mutex> lock(keyCacheMutex);
+      const shared_ptr<const DKIMPublicKey> *cached = keyCache.get(query);
+      if (cached) {
+        ++keyCacheHits;
+        return *cached;
+      }
+    }
+
+    ++keyCacheMisses;
+
+    // Resolves and parses the key outside of the lock, two threads may do
+    //  this at once for the same key, which is harmless
+    uint32_t ttl = 0;
+    DKIMRecord record = DKIMRecord::fromDNS(query.c_str(), &ttl);
+
+    if (record.getPublicKey().empty())
+      throw runtime_error(EXCEPT_DEBUG("Key revoked: '" + query + '\''));
+
+    auto key = make_shared<DKIMPublicKey>();
+    key->key = shared_ptr<EVP_PKEY>(Hashes::parsePublicKey(
+      record.getPublicKey(), record.getAlgorithm() == DKIMRecordAlgorithm::RecordAlgorithmED25519
+    ), EVP_PKEY_free);
+    key->algorithm = record.getAlgorithm();
+    key->flags = record.getFlags();
+
+    lock_guard<mutex> lock(keyCacheMutex);
+    keyCache.put(query, key, ttl);
+    return key;
+  }
+
+  void DKIMKeyCache::configure(const size_t maxEntries) {
+    // Configs from before the cache do not have the size, so
+    //  a zero keeps the default
+    if (maxEntries == 0) return;
+
+    lock_guard<mutex> lock(keyCacheMutex);
+    keyCache.setMaxEntries(maxEntries);
+  }
+
+  void DKIMKeyCache::clear() {
+    lock_guard<mutex> lock(keyCacheMutex);
+    keyCache.clear();
+  }
+
+  DKIMKeyCacheStats DKIMKeyCache::getStats() {
+    lock_guard<mutex> lock(keyCacheMutex);
+    return DKIMKeyCacheStats {
+      keyCacheHits, keyCacheMisses, keyCache.size()
+    };
+  }
+}
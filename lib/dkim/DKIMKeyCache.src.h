@@ -0,0 +1,58 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef _LIB_DKIM_KEY_CACHE_H
+#define _LIB_DKIM_KEY_CACHE_H
+
+#include "../default.h"
+#include "DKIMRecord.src.h"
+#include "DKIMHashes.src.h"
+#include "../general/TTLCache.src.h"
+
+namespace FSMTP::DKIM {
+  /**
+   * An parsed verification key, with the flags of its record ( t=, h= and
+   *  s= ), EVP_PKEY is reference counted by OpenSSL and may be used by
+   *  multiple threads at once for verifying
+   */
+  struct DKIMPublicKey {
+    shared_ptr<EVP_PKEY> key;
+    DKIMRecordAlgorithm algorithm;
+    int32_t flags;
+  };
+
+  struct DKIMKeyCacheStats {
+    size_t hits;
+    size_t misses;
+    size_t entries;
+  };
+
+  /**
+   * Process wide cache of DKIM keys keyed by selector and domain, kept
+   *  for the TTL of the record, so verifying an signature of an known
+   *  selector needs neither an DNS lookup nor parsing the key
+   */
+  class DKIMKeyCache {
+  public:
+    static shared_ptr<const DKIMPublicKey> get(const string &selector, const string &domain);
+
+    static void configure(const size_t maxEntries);
+    static void clear();
+    static DKIMKeyCacheStats getStats();
+  };
+}
+
+#endif
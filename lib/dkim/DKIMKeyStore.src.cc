@@ -0,0 +1,139 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "DKIMKeyStore.src.h"
+
+namespace FSMTP::DKIM {
+  struct DKIMKeyStoreEntry {
+    string domain, selector, path;
+    DKIMHeaderAlgorithm algorithm;
+  };
+
+  typedef unordered_map<string, vector<shared_ptr<const DKIMSigningKey>>> DKIMKeyStoreMap;
+
+  static mutex keyStoreMutex;
+  static vector<DKIMKeyStoreEntry> keyStoreEntries;
+  static string keyStoreDefaultDomain;
+  static shared_ptr<const DKIMKeyStoreMap> keyStoreKeys = make_shared<DKIMKeyStoreMap>();
+  static atomic<bool> keyStoreReloadRequested(false);
+
+  static string __dkimKeyStoreLower(string str) {
+    transform(str.begin(), str.end(), str.begin(), [](const char c) { return tolower(c); });
+    return str;
+  }
+
+  void DKIMKeyStore::configure(const Json::Value &config) {
+    vector<DKIMKeyStoreEntry> entries;
+
+    // Reads the configured keys, if there are none we use the single RSA
+    //  key of the older configuration format
+    for (const Json::Value &key : config["keys"]) {
+      string algorithm = __dkimKeyStoreLower(key["algorithm"].asString());
+
+      DKIMKeyStoreEntry entry;
+      entry.domain = __dkimKeyStoreLower(key["domain"].asString());
+      entry.selector = key["selector"].asString();
+      entry.path = key["private_key"].asString();
+
+      if (algorithm == "ed25519-sha256") entry.algorithm = DKIMHeaderAlgorithm::HeaderAlgorithmED25519_SHA256;
+      else if (algorithm == "rsa-sha1") entry.algorithm = DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1;
+      else if (algorithm == "rsa-sha256" || algorithm.empty()) entry.algorithm = DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256;
+      else throw runtime_error(EXCEPT_DEBUG("Invalid DKIM signing algorithm: '" + algorithm + '\''));
+
+      entries.push_back(entry);
+    }
+
+    if (entries.empty()) {
+      entries.push_back(DKIMKeyStoreEntry {
+        __dkimKeyStoreLower(config["domain"].asString()),
+        config["keyselector"].asString(),
+        config["dkim_private"].asString(),
+        DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256
+      });
+    }
+
+    {
+      lock_guard<mutex> lock(keyStoreMutex);
+      keyStoreEntries = entries;
+      keyStoreDefaultDomain = __dkimKeyStoreLower(config["domain"].asString());
+    }
+
+    DKIMKeyStore::reload();
+  }
+
+  void DKIMKeyStore::reload() {
+    Logger logger("DKIMKeyStore", LoggerLevel::INFO);
+    vector<DKIMKeyStoreEntry> entries;
+
+    {
+      lock_guard<mutex> lock(keyStoreMutex);
+      entries = keyStoreEntries;
+    }
+
+    // Loads all the keys into an new map, which replaces the current one
+    //  only if every key could be read, so an broken key file does not
+    //  stop us from signing with the previous keys
+    auto keys = make_shared<DKIMKeyStoreMap>();
+    try {
+      for (const DKIMKeyStoreEntry &entry : entries) {
+        auto key = make_shared<DKIMSigningKey>();
+        key->domain = entry.domain;
+        key->selector = entry.selector;
+        key->algorithm = entry.algorithm;
+        key->key = shared_ptr<EVP_PKEY>(Hashes::loadPrivateKey(entry.path), EVP_PKEY_free);
+
+        bool ed25519 = EVP_PKEY_id(key->key.get()) == EVP_PKEY_ED25519;
+        if (ed25519 != (entry.algorithm == DKIMHeaderAlgorithm::HeaderAlgorithmED25519_SHA256)) {
+          throw runtime_error(EXCEPT_DEBUG("Key type of '" + entry.path + "' does not match algorithm"));
+        }
+
+        (*keys)[entry.domain].push_back(key);
+      }
+    } catch (const runtime_error &e) {
+      logger << ERROR << "Could not load DKIM keys, keeping the current ones: " << e.what() << ENDL << CLASSIC;
+      return;
+    }
+
+    lock_guard<mutex> lock(keyStoreMutex);
+    keyStoreKeys = keys;
+    logger << "Loaded " << entries.size() << " DKIM signing keys" << ENDL;
+  }
+
+  vector<shared_ptr<const DKIMSigningKey>> DKIMKeyStore::get(const string &domain) {
+    shared_ptr<const DKIMKeyStoreMap> keys;
+    string defaultDomain;
+
+    {
+      lock_guard<mutex> lock(keyStoreMutex);
+      keys = keyStoreKeys;
+      defaultDomain = keyStoreDefaultDomain;
+    }
+
+    auto it = keys->find(__dkimKeyStoreLower(domain));
+    if (it == keys->end()) it = keys->find(defaultDomain);
+    if (it == keys->end()) return {};
+
+    return it->second;
+  }
+
+  void DKIMKeyStore::requestReload() noexcept {
+    keyStoreReloadRequested = true;
+  }
+
+  bool DKIMKeyStore::reloadRequested() noexcept {
+    return keyStoreReloadRequested.exchange(false);
+  }
+}
@@ -0,0 +1,57 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef _LIB_DKIM_KEY_STORE_H
+#define _LIB_DKIM_KEY_STORE_H
+
+#include "../default.h"
+#include "../general/Logger.src.h"
+#include "DKIMHeader.src.h"
+#include "DKIMHashes.src.h"
+
+namespace FSMTP::DKIM {
+  /**
+   * An loaded signing key, the EVP_PKEY is only read while signing, so the
+   *  same key may be used by multiple threads, each with their own context
+   */
+  struct DKIMSigningKey {
+    string domain, selector;
+    DKIMHeaderAlgorithm algorithm;
+    shared_ptr<EVP_PKEY> key;
+  };
+
+  /**
+   * Holds the signing keys of all domains, these are read from disk once at
+   *  startup, and again when an reload is requested ( SIGHUP ), so signing
+   *  an message does not involve any file I/O
+   */
+  class DKIMKeyStore {
+  public:
+    static void configure(const Json::Value &config);
+    static void reload();
+
+    /**
+     * Gets the keys of an domain, if the domain has no keys, the keys
+     *  of the default domain, an domain may have both an RSA and Ed25519 key
+     */
+    static vector<shared_ptr<const DKIMSigningKey>> get(const string &domain);
+
+    static void requestReload() noexcept;
+    static bool reloadRequested() noexcept;
+  };
+}
+
+#endif
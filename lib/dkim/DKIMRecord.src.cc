@@ -26,6 +26,7 @@ namespace FSMTP::DKIM {
   const char *__dkimRecordAlgorithmToString(DKIMRecordAlgorithm a) {
     switch (a) {
       case DKIMRecordAlgorithm::RecordAlgorithmRSA: return "RSA";
+      case DKIMRecordAlgorithm::RecordAlgorithmED25519: return "ED25519";
     }
   }
 
@@ -156,7 +157,7 @@ namespace FSMTP::DKIM {
         this->m_PublicKey = val;
       } else if (key == "k") { // The key algorithm
         transform(val.begin(), val.end(), val.begin(), [](const char c) { return tolower(c); });
-        if (val == "rsa") this->m_Algorithm = DKIMRecordAlgorithm::RecordAlgorithmRSA;
+        if (val == "ed25519") this->m_Algorithm = DKIMRecordAlgorithm::RecordAlgorithmED25519;
         else this->m_Algorithm = DKIMRecordAlgorithm::RecordAlgorithmRSA;
       } else if (key == "h") { // The allowed hashing algorithms
         parseHashAlgorithms(val);
@@ -191,6 +192,14 @@ namespace FSMTP::DKIM {
   const string &DKIMRecord::getPublicKey() {
     return this->m_PublicKey;
   }
+
+  DKIMRecordAlgorithm DKIMRecord::getAlgorithm() {
+    return this->m_Algorithm;
+  }
+
+  int32_t DKIMRecord::getFlags() {
+    return this->m_Flags;
+  }
   
   DKIMRecord &DKIMRecord::print(Logger &logger) {
     logger << DEBUG;
@@ -207,7 +216,7 @@ namespace FSMTP::DKIM {
     logger << CLASSIC;
   }
 
-  DKIMRecord DKIMRecord::fromDNS(const char *query) {
+  DKIMRecord DKIMRecord::fromDNS(const char *query, uint32_t *ttl) {
     DEBUG_ONLY(Logger logger("DKIMRecord::fromDNS", LoggerLevel::DEBUG));
     DKIMRecord result;
     DNS::Resolver resolver;
@@ -221,6 +230,7 @@ namespace FSMTP::DKIM {
       //  which means we proceed to the next record
       try {
         result.parse(rr.getData());
+        if (ttl) *ttl = rr.getTTL();
         found = true;
         return false;
       } catch (...) {}
@@ -228,14 +238,11 @@ namespace FSMTP::DKIM {
       return true;
     });
 
-    // throw runtime_error(EXCEPT_DEBUG("Failed to resolve DKIM Record"));
-    // Since nothing was found we attempt to resolve the cname and see
-    //  if there are any redirects
+    // Aliases are already followed by the recursive server, and their
+    //  TXT records are in the answer, so nothing found means no record
     if (!found) {
-      records = resolver.query(query, ns_t_cname).initParse().getTXTRecords();
       DEBUG_ONLY(DNS::RR::print(logger, records));
-
-      cout << records[0].getData() << endl;
+      throw runtime_error(EXCEPT_DEBUG("Failed to resolve DKIM Record"));
     }
 
     return result;
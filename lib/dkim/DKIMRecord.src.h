@@ -35,7 +35,7 @@ namespace FSMTP::DKIM {
   const char *__dkimRecordVersionToString(DKIMRecordVersion v);
 
   enum DKIMRecordAlgorithm {
-    RecordAlgorithmRSA
+    RecordAlgorithmRSA, RecordAlgorithmED25519
   };
 
   const char *__dkimRecordAlgorithmToString(DKIMRecordAlgorithm a);
@@ -57,8 +57,10 @@ namespace FSMTP::DKIM {
     string getAllowedServicesString();
 
     const string &getPublicKey();
+    DKIMRecordAlgorithm getAlgorithm();
+    int32_t getFlags();
 
-    static DKIMRecord fromDNS(const char *query);
+    static DKIMRecord fromDNS(const char *query, uint32_t *ttl = nullptr);
 
     ~DKIMRecord();
   private:
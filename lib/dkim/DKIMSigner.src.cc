@@ -21,14 +21,8 @@ namespace FSMTP::DKIM {
 		m_Logger("DKIMSigner", LoggerLevel::DEBUG)
 	{}
 
-	DKIMSigner &DKIMSigner::setDomain(const string &domain)
-	{ this->m_Config.domain = domain; return *this; }
-
-	DKIMSigner &DKIMSigner::setKeySelector(const string &keySelector)
-	{ this->m_Config.keySelector = keySelector; return *this; }
-	
-	DKIMSigner &DKIMSigner::setPrivateKeyPath(const string &privateKeyPath)
-	{ this->m_Config.privateKeyPath = privateKeyPath; return *this; }
+	DKIMSigner &DKIMSigner::setKeys(const vector<shared_ptr<const DKIMSigningKey>> &keys)
+	{ this->m_Config.keys = keys; return *this; }
 	
 	DKIMSigner &DKIMSigner::setSignTime(int64_t signTime)
 	{ this->m_Config.signTime = signTime; return *this; }
@@ -39,9 +33,6 @@ namespace FSMTP::DKIM {
 	DKIMSigner &DKIMSigner::setAlgoPair(DKIMHeaderCanonAlgPair algorithmPair)
 	{ this->m_Config.algorithmPair = algorithmPair; return *this; }
 	
-	DKIMSigner &DKIMSigner::setSignAlgo(DKIMHeaderAlgorithm signAlgorithm)
-	{ this->m_Config.signAlgorithm = signAlgorithm; return *this; }
-
 	DKIMSigner &DKIMSigner::setConfig(const DKIMSignerConfig &config)
 	{ this->m_Config = config; return *this; }
 
@@ -54,23 +45,8 @@ namespace FSMTP::DKIM {
 	DKIMSigner &DKIMSigner::sign(const string &mime) {
 		DEBUG_ONLY(auto &logger = this->m_Logger);
 
-		// ==============================
-		// Sets result values
-		// ==============================
-
-		// Sets the default values such as the headers
-		this->m_Result.setKeySelector(this->m_Config.keySelector)
-			.setDomain(this->m_Config.domain)
-			.setHeaders(this->m_Config.headerFilter)
-			.setHeaderAlgo(this->m_Config.signAlgorithm)
-			.setCanonAlgoPair(this->m_Config.algorithmPair)
-			.setSignDate(this->m_Config.signTime)
-			.setExpireDate(this->m_Config.expireTime);
-
-		// Since the result headers have been set, we can now insert
-		//  the dkim record in the allowed headers, since we do not want
-		//  it in the final header, but do want it in the signature
-		this->m_Config.headerFilter.push_back("dkim-signature");
+		if (this->m_Config.keys.empty())
+			throw runtime_error(EXCEPT_DEBUG("No DKIM signing keys"));
 
 		// ==============================
 		// Parses the MIME message
@@ -86,90 +62,92 @@ namespace FSMTP::DKIM {
 		tie(headersBegin, headersEnd, bodyBegin, 
 			bodyEnd) = MIME::splitMIMEBodyAndHeaders(lines.begin(), lines.end());
 
-		// ==============================
-		// Generates the body hash
-		// ==============================
-
-		// Generates the body hash with the current canonicalization algorithm
-		//  and signing algorithm
-		this->generateBodyHash(MIME::getStringFromLines(bodyBegin, bodyEnd));
+		vector<string> joinedHeaders = MIME::joinHeaders(headersBegin, headersEnd);
+		string headers = MIME::getStringFromLines(joinedHeaders.begin(), joinedHeaders.end());
 
 		// ==============================
-		// Generates the fake signature
+		// Generates the body hashes
 		// ==============================
 
-		// Generates the pre-sign signature, which will contain everything
-		//  except the signature, this will be appended to the headers to be
-		//  canonicalized
-		string presignSignature = this->m_Result.build();
-
-		// Prints the presign signature to the debug console
-		//  just to inform that everything is going fine
-		DEBUG_ONLY(logger << "Generated presign signature: '" << presignSignature << '\'' << ENDL);
+		// The body lines are canonicalized and hashed in one pass, once per hash
+		//  algorithm, since an RSA-SHA256 and Ed25519-SHA256 signature share the
+		//  same body hash
+		bool relaxed = this->m_Config.algorithmPair == DKIMHeaderCanonAlgPair::RelaxedRelaxed
+			|| this->m_Config.algorithmPair == DKIMHeaderCanonAlgPair::SimpleRelaxed;
+		bool needsSha1 = any_of(this->m_Config.keys.begin(), this->m_Config.keys.end(), [](const shared_ptr<const DKIMSigningKey> &key) {
+			return key->algorithm == DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1;
+		});
+		bool needsSha256 = any_of(this->m_Config.keys.begin(), this->m_Config.keys.end(), [](const shared_ptr<const DKIMSigningKey> &key) {
+			return key->algorithm != DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1;
+		});
+
+		unique_ptr<DKIMBodyHash> sha1Hasher, sha256Hasher;
+		if (needsSha1) sha1Hasher = make_unique<DKIMBodyHash>(relaxed, EVP_sha1());
+		if (needsSha256) sha256Hasher = make_unique<DKIMBodyHash>(relaxed, EVP_sha256());
+
+		for (strvec_it it = bodyBegin; it != bodyEnd; ++it) {
+			for (DKIMBodyHash *hasher : { sha1Hasher.get(), sha256Hasher.get() }) {
+				if (!hasher) continue;
+
+				hasher->update(*it);
+				hasher->update("\r\n", 2);
+			}
+		}
 
-		// Appends the presign signature to the final headers
-		//  so we can start signing them
-		vector<string> joinedHeaders = MIME::joinHeaders(headersBegin, headersEnd);
-		string headers = MIME::getStringFromLines(joinedHeaders.begin(), joinedHeaders.end());
-		headers += presignSignature;
+		string sha1BodyHash = sha1Hasher ? sha1Hasher->final() : "";
+		string sha256BodyHash = sha256Hasher ? sha256Hasher->final() : "";
 
 		// ==============================
-		// Generates the signature
+		// Generates the signatures
 		// ==============================
 
-		// Generates the signature based on the algorithm
-		//  specified in the config
-		this->generateSignature(headers);
+		// Every key adds its own signature, each one is made over the original
+		//  headers, since verifiers ignore the other signatures
+		string signatures;
+		for (const shared_ptr<const DKIMSigningKey> &key : this->m_Config.keys) {
+			const string &bodyHash = key->algorithm == DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1 ? sha1BodyHash : sha256BodyHash;
+
+			DEBUG_ONLY(logger << "Signing with " << __dkimHeaderAlgToString(key->algorithm)
+				<< " key: '" << key->selector << "._domainkey." << key->domain << '\'' << ENDL);
+
+			signatures += Builders::foldHeader(this->generateSignature(*key, headers, bodyHash), 128);
+			signatures += "\r\n";
+		}
 
 		// ==============================
 		// Builds the signed message
 		// ==============================
 
 		this->m_SignedMessage = MIME::getStringFromLines(headersBegin, headersEnd);
-		this->m_SignedMessage += Builders::foldHeader(this->m_Result.build(), 128);
-		this->m_SignedMessage += "\r\n\r\n";
+		this->m_SignedMessage += signatures;
+		this->m_SignedMessage += "\r\n";
 		this->m_SignedMessage += MIME::getStringFromLines(bodyBegin, bodyEnd);
 
 		return *this;
 	}
 
-	void DKIMSigner::generateBodyHash(const string &body) {
+	string DKIMSigner::generateSignature(const DKIMSigningKey &key, const string &headers, const string &bodyHash) {
 		DEBUG_ONLY(auto &logger = this->m_Logger);
 
-		// Generates the canonicalized body based on the algorithm
-		//  specified by the implementation
-		string canonicalizedBody;
-		switch (this->m_Config.algorithmPair) {
-			case DKIMHeaderCanonAlgPair::RelaxedRelaxed:
-			case DKIMHeaderCanonAlgPair::SimpleRelaxed:
-				DEBUG_ONLY(logger << "Processing body with relaxed canonicalization" << ENDL);
-				canonicalizedBody = relaxedBody(body);
-				break;
-			case DKIMHeaderCanonAlgPair::RelaxedSimple:
-			case DKIMHeaderCanonAlgPair::SimpleSimple:
-				DEBUG_ONLY(logger << "Processing body with simple canonicalization" << ENDL);
-				canonicalizedBody = simpleBody(body);
-				break;
-		}
-
-		// Performs the hasing of the body, this is just the body hash
-		//  so we either use sha1 or sha256
-		switch (this->m_Config.signAlgorithm) {
-			case DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1:
-				DEBUG_ONLY(logger << "Generating body-hash with RSA-SHA1" << ENDL);
-				this->m_Result.setBodyHash(Hashes::sha1base64(canonicalizedBody));
-				break;
-			case DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256:
-				DEBUG_ONLY(logger << "Generating body-hash with RSA-SHA256" << ENDL);
-				this->m_Result.setBodyHash(Hashes::sha256base64(canonicalizedBody));
-				break;
-		}
+		// Sets the values of the signature, the signature itself is
+		//  generated later from the headers and this pre-sign header
+		DKIMHeader result;
+		result.setKeySelector(key.selector)
+			.setDomain(key.domain)
+			.setHeaders(this->m_Config.headerFilter)
+			.setHeaderAlgo(key.algorithm)
+			.setCanonAlgoPair(this->m_Config.algorithmPair)
+			.setSignDate(this->m_Config.signTime)
+			.setExpireDate(this->m_Config.expireTime)
+			.setBodyHash(bodyHash);
 
-	}
+		// The dkim signature itself is signed too, but without the
+		//  signature value, and it is not listed in h=
+		vector<string> hf = this->m_Config.headerFilter;
+		hf.push_back("dkim-signature");
 
-	void DKIMSigner::generateSignature(const string &headers) {
-		DEBUG_ONLY(auto &logger = this->m_Logger);
-		auto &hf = this->m_Config.headerFilter;
+		string presignSignature = result.build();
+		DEBUG_ONLY(logger << "Generated presign signature: '" << presignSignature << '\'' << ENDL);
 
 		// Performs the header canonicalization with the specified algorithm
 		//  we support all ;)
@@ -178,12 +156,12 @@ namespace FSMTP::DKIM {
 			case DKIMHeaderCanonAlgPair::RelaxedRelaxed:
 			case DKIMHeaderCanonAlgPair::RelaxedSimple:
 				DEBUG_ONLY(logger << "Processing headers with relaxed canonicalization" << ENDL);
-				canonicalizedHeaders = relaxedHeaders(headers, hf);
+				canonicalizedHeaders = relaxedHeaders(headers + presignSignature, hf);
 				break;
 			case DKIMHeaderCanonAlgPair::SimpleRelaxed:
 			case DKIMHeaderCanonAlgPair::SimpleSimple:
 				DEBUG_ONLY(logger << "Processing headers with simple canonicalization" << ENDL);
-				canonicalizedHeaders = simpleHeaders(headers, hf);
+				canonicalizedHeaders = simpleHeaders(headers + presignSignature, hf);
 				break;
 		}
 
@@ -191,26 +169,14 @@ namespace FSMTP::DKIM {
 		//  signature is not complete
 		canonicalizedHeaders.erase(canonicalizedHeaders.end() - 2, canonicalizedHeaders.end());
 
-		// Prints the debug message with the canonicalized headers
-		//  inside of them
-		#ifdef _SMTP_DEBUG
-		logger << "Canonicalized headers: '" << FLUSH;
-		cout << canonicalizedHeaders;
-		cout << '\'' << endl;
-		#endif
-
-		// Performs the signing of the canonicalized headers, this will be
-		//  set as the final signature in the header
-		switch (this->m_Config.signAlgorithm) {
-			case DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1:
-				DEBUG_ONLY(logger << "Generating signature with RSA-SHA1" << ENDL);
-				this->m_Result.setSignature(Hashes::RSAShagenerateSignature(canonicalizedHeaders,
-					this->m_Config.privateKeyPath.c_str(), EVP_sha1())); break;
-			case DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256:
-				DEBUG_ONLY(logger << "Generating signature with RSA-SHA256" << ENDL);
-				this->m_Result.setSignature(Hashes::RSAShagenerateSignature(canonicalizedHeaders,
-					this->m_Config.privateKeyPath.c_str(), EVP_sha256())); break;
-		}
+		// Signs the canonicalized headers with the preloaded key, Ed25519 uses
+		//  the SHA256 digest of the headers ( RFC 8463 )
+		result.setSignature(Hashes::sign(
+			canonicalizedHeaders, key.key.get(),
+			key.algorithm == DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1 ? EVP_sha1() : EVP_sha256()
+		));
+
+		return result.build();
 	}
 
 	const string &DKIMSigner::getResult() const
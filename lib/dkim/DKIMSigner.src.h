@@ -22,16 +22,17 @@
 #include "DKIMHeader.src.h"
 #include "DKIMCanonicalization.src.h"
 #include "DKIMHashes.src.h"
+#include "DKIMKeyStore.src.h"
+#include "DKIMBodyHash.src.h"
 
 #include "../general/Logger.src.h"
 #include "../mime/mimev2.src.h"
 
 namespace FSMTP::DKIM {
 	struct DKIMSignerConfig {
-		string domain, keySelector, privateKeyPath;
+		vector<shared_ptr<const DKIMSigningKey>> keys;
 		int64_t signTime, expireTime;
 		DKIMHeaderCanonAlgPair algorithmPair;
-		DKIMHeaderAlgorithm signAlgorithm;
 		vector<string> headerFilter;
 	};
 
@@ -39,13 +40,10 @@ namespace FSMTP::DKIM {
 	public:
 		DKIMSigner();
 
-		DKIMSigner &setDomain(const string &domain);
-		DKIMSigner &setKeySelector(const string &keySelector);
-		DKIMSigner &setPrivateKeyPath(const string &privateKeyPath);
+		DKIMSigner &setKeys(const vector<shared_ptr<const DKIMSigningKey>> &keys);
 		DKIMSigner &setSignTime(int64_t signTime);
 		DKIMSigner &setExpireTime(int64_t expireTime);
 		DKIMSigner &setAlgoPair(DKIMHeaderCanonAlgPair algorithmPair);
-		DKIMSigner &setSignAlgo(DKIMHeaderAlgorithm signAlgorithm);
 		DKIMSigner &setHeaderFilter(const vector<string> &filter);
 		DKIMSigner &headerFilterPush(const string &header);
 
@@ -57,11 +55,9 @@ namespace FSMTP::DKIM {
 
 		~DKIMSigner();
 	protected:
-		void generateBodyHash(const string &body);
-		void generateSignature(const string &headers);
+		string generateSignature(const DKIMSigningKey &key, const string &headers, const string &bodyHash);
 	private:
 		DKIMSignerConfig m_Config;
-		DKIMHeader m_Result;
 		string m_SignedMessage;
 		Logger m_Logger;
 	};
@@ -15,6 +15,7 @@
 */
 
 #include "DKIMValidator.src.h"
+#include "../workers/WorkQueue.src.h"
 
 namespace FSMTP::DKIM {
   DKIMValidator::DKIMValidator():
@@ -23,55 +24,76 @@ namespace FSMTP::DKIM {
     this->m_Result.type = DKIMValidatorResultType::DKIMValidationFail;
   }
 
-  DKIMSignatureResult DKIMValidator::validateSignature(
-    const string &signature, 
-    const vector<MIME::MIMEHeader> &headers, const string &body,
-    const string &rawHeaders
-  ) {
-    auto &logger = this->m_Logger;
+  struct DKIMBodyHashKey {
+    bool relaxed, sha1;
+    int64_t limit;
 
-    // =================================
-    // Parses the header
-    // =================================
+    bool operator<(const DKIMBodyHashKey &other) const {
+      return tie(relaxed, sha1, limit) < tie(other.relaxed, other.sha1, other.limit);
+    }
+  };
+
+  static DKIMBodyHashKey __dkimBodyHashKey(DKIMHeader &header) {
+    return DKIMBodyHashKey {
+      header.getCanonAlgorithmPair() == DKIMHeaderCanonAlgPair::RelaxedRelaxed
+        || header.getCanonAlgorithmPair() == DKIMHeaderCanonAlgPair::SimpleRelaxed,
+      header.getHeaderAlgorithm() == DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1,
+      header.getBodyLength()
+    };
+  }
+
+  // Signatures are verified on a few shared threads, which are started
+  //  at the first message with more than one signature, the queue is never
+  //  freed since the detached threads keep waiting on it until exit
 
-    // Parses the signature, so we can get the values from it
-    //  and process it accordingly
-    DKIMHeader header;
-    header.parse(signature);
+  static auto *verifyQueue = new Workers::WorkQueue<function<void()>>();
+  static once_flag verifyPoolStarted;
+  static atomic<size_t> verifyPoolThreads(2);
+
+  static void __dkimStartVerifyPool() {
+    for (size_t i = 0; i < verifyPoolThreads; ++i) {
+      thread([]() {
+        function<void()> task;
+        milliseconds age;
+
+        for (;;) {
+          if (verifyQueue->pop(task, age, seconds(60))) task();
+        }
+      }).detach();
+    }
+  }
+
+  void DKIMValidator::configure(const size_t verifyThreads) {
+    verifyPoolThreads = verifyThreads;
+  }
+
+  DKIMSignatureResult DKIMValidator::validateSignature(
+    const string &signature, DKIMHeader &header,
+    const string &rawHeaders, const DKIMBodyHashResult &bodyHashResult
+  ) {
+    // Runs on the verify threads, so it may not use the
+    //  logger of the validator
+    DEBUG_ONLY(Logger logger("DKIMValidator", LoggerLevel::DEBUG));
     DEBUG_ONLY(header.print(logger));
 
     // =================================
-    // Canonicalizes the body
+    // Checks the body hash
     // =================================
 
-    // Canonicalizes the body
-    string canonicalizedBody;
-    switch (header.getCanonAlgorithmPair()) {
-      case DKIMHeaderCanonAlgPair::RelaxedRelaxed:
-      case DKIMHeaderCanonAlgPair::SimpleRelaxed:
-        DEBUG_ONLY(logger << "Processing body with relaxed body canonicalization" << ENDL);
-        canonicalizedBody = relaxedBody(body);
-        break;
-      case DKIMHeaderCanonAlgPair::RelaxedSimple:
-      case DKIMHeaderCanonAlgPair::SimpleSimple:
-        DEBUG_ONLY(logger << "Processing body with simple body canonicalization" << ENDL);
-        canonicalizedBody = simpleBody(body);
-        break;
-    }
+    // The body hashes are computed once for all signatures, if l= is
+    //  set only that part of the body is hashed
+    const string &bodyHash = bodyHashResult.hash;
 
-    // Calculates the hash value, either sha1 or sha256, after which we compare it
-    //  against the one in the message, if the comparison fails, do not even check the
-    //  signature, just return error
-    string bodyHash;
-    switch (header.getHeaderAlgorithm()) {
-      case DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256:
-        bodyHash = Hashes::sha256base64(canonicalizedBody);
-        break;
-      case DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1:
-        bodyHash = Hashes::sha1base64(canonicalizedBody);
-        break;
+    // The signature is invalid if l= claims more body than there is
+    if (header.getBodyLength() >= 0 && bodyHashResult.length < static_cast<size_t>(header.getBodyLength())) {
+      return DKIMSignatureResult {
+        DKIMSignatureResultType::DKIMSignatureInvalid,
+        "body shorter than l= length"
+      };
     }
 
+    // Compares the hash against the one in the message, if the comparison fails,
+    //  do not even check the signature, just return error
     if (bodyHash != header.getBodyHash()) {
       DEBUG_ONLY(logger << WARN << "Body hash invalid, expected: '" << bodyHash << "', got: '" << header.getBodyHash() << '\'' << ENDL << CLASSIC);
       return DKIMSignatureResult {
@@ -84,24 +106,42 @@ namespace FSMTP::DKIM {
 
 
     // =================================
-    // Gets the DKIM record from DNS
+    // Gets the DKIM key
     // =================================
     
-    // Creates the query, and resolves the record from DNS,
+    // Gets the parsed key from the cache, or resolves it from DNS,
     //  if this fails return no record found
-    string query = header.getKeySelector();
-    query += "._domainkey." + header.getDomain();
-    DEBUG_ONLY(logger << "Resolving DKIM for: '" << query << '\'' << ENDL);
-    
-    DKIMRecord record;
+    shared_ptr<const DKIMPublicKey> key;
     try {
-      record = DKIMRecord::fromDNS(query.c_str());
-      DEBUG_ONLY(record.print(logger));
+      key = DKIMKeyCache::get(header.getKeySelector(), header.getDomain());
     } catch (const runtime_error &e) {
-      DEBUG_ONLY(logger << ERROR << "Could not find record for query: '" << query << '\'' << ENDL << CLASSIC);
+      DEBUG_ONLY(logger << ERROR << "Could not get key: " << e.what() << ENDL << CLASSIC);
       return DKIMSignatureResult {
         DKIMSignatureResultType::DKIMSignatureRecordNotFound,
-        "No record found for query: '" + query + '\''
+        "No record found for query: '" + header.getKeySelector() + "._domainkey." + header.getDomain() + '\''
+      };
+    }
+
+    // The key type must match the signing algorithm, else an Ed25519 signature
+    //  could be checked against an RSA key, or the other way around
+    bool ed25519Key = key->algorithm == DKIMRecordAlgorithm::RecordAlgorithmED25519;
+    bool ed25519Signature = header.getHeaderAlgorithm() == DKIMHeaderAlgorithm::HeaderAlgorithmED25519_SHA256;
+    if (ed25519Key != ed25519Signature) {
+      return DKIMSignatureResult {
+        DKIMSignatureResultType::DKIMSignatureInvalid,
+        "Key type does not match the signing algorithm"
+      };
+    }
+
+    // Checks if the record restricts the hash algorithms ( h= ), if so
+    //  the one used by the signature must be in there
+    int32_t hashFlags = key->flags & (_FSMTP_DKIM_RECORD_FLAG_ALLOWED_HASH_ALGO_SHA1 | _FSMTP_DKIM_RECORD_FLAG_ALLOWED_HASH_ALGO_SHA256);
+    int32_t requiredFlag = header.getHeaderAlgorithm() == DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1
+      ? _FSMTP_DKIM_RECORD_FLAG_ALLOWED_HASH_ALGO_SHA1 : _FSMTP_DKIM_RECORD_FLAG_ALLOWED_HASH_ALGO_SHA256;
+    if (hashFlags != 0 && !(hashFlags & requiredFlag)) {
+      return DKIMSignatureResult {
+        DKIMSignatureResultType::DKIMSignatureInvalid,
+        "Hash algorithm not allowed by key record"
       };
     }
 
@@ -148,15 +188,13 @@ namespace FSMTP::DKIM {
     //  is the dkim signature without a signature, so not the end
     canonicalizedHeaders.erase(canonicalizedHeaders.end() - 2, canonicalizedHeaders.end());
 
-    cout << '\'' << canonicalizedHeaders << '\'' << endl;
-
     // =================================
     // Validates the signature
     // =================================
 
     switch (header.getHeaderAlgorithm()) {
       case DKIMHeaderAlgorithm::HeaderAlgorithmRSA_SHA1:
-        if (!Hashes::RSAverify(header.getSignature(), canonicalizedHeaders, record.getPublicKey(), EVP_sha1())) {
+        if (!Hashes::verify(header.getSignature(), canonicalizedHeaders, key->key.get(), EVP_sha1())) {
           DEBUG_ONLY(logger << WARN << "RSA-SHA1 Signature is invalid" << ENDL << CLASSIC);
           return DKIMSignatureResult {
             DKIMSignatureResultType::DKIMSignatureInvalid,
@@ -167,7 +205,7 @@ namespace FSMTP::DKIM {
         DEBUG_ONLY(logger << "RSA-SHA1 Signature is valid !" << ENDL << CLASSIC);
         break;
       case DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256:
-        if (!Hashes::RSAverify(header.getSignature(), canonicalizedHeaders, record.getPublicKey(), EVP_sha256())) {
+        if (!Hashes::verify(header.getSignature(), canonicalizedHeaders, key->key.get(), EVP_sha256())) {
           DEBUG_ONLY(logger << WARN << "RSA-SHA256 Signature is invalid" << ENDL << CLASSIC);
           return DKIMSignatureResult {
             DKIMSignatureResultType::DKIMSignatureInvalid,
@@ -177,6 +215,17 @@ namespace FSMTP::DKIM {
 
         DEBUG_ONLY(logger << "RSA-SHA256 Signature is valid !" << ENDL << CLASSIC);
         break;
+      case DKIMHeaderAlgorithm::HeaderAlgorithmED25519_SHA256:
+        if (!Hashes::verify(header.getSignature(), canonicalizedHeaders, key->key.get(), EVP_sha256())) {
+          DEBUG_ONLY(logger << WARN << "ED25519-SHA256 Signature is invalid" << ENDL << CLASSIC);
+          return DKIMSignatureResult {
+            DKIMSignatureResultType::DKIMSignatureInvalid,
+            "ED25519-SHA256 Signature invalid"
+          };
+        }
+
+        DEBUG_ONLY(logger << "ED25519-SHA256 Signature is valid !" << ENDL << CLASSIC);
+        break;
     }
 
     return DKIMSignatureResult {
@@ -197,18 +246,28 @@ namespace FSMTP::DKIM {
     // Parses the MIME message
     // =================================
 
-    // Parses the message into lines, after which we get the body and headers
-    //  so we can process them later
-    vector<string> lines = MIME::getMIMELines(message);
-    strvec_it headersBegin, headersEnd, bodyBegin, bodyEnd;
-    tie(headersBegin, headersEnd, bodyBegin, bodyEnd) = MIME::splitMIMEBodyAndHeaders(lines.begin(), lines.end());
+    // Finds the empty line which ends the headers, only the headers are split
+    //  into lines, the body is hashed straight from the message, so it is
+    //  never copied, the body starts right after the empty line
+    size_t headersLength = message.size(), bodyOffset = message.size();
+    for (size_t pos = 0; pos < message.size();) {
+      size_t end = message.find('\n', pos);
+      if (end == string::npos) break;
+
+      size_t lineLength = end - pos;
+      if (lineLength > 0 && message[end - 1] == '\r') --lineLength;
+      if (lineLength == 0) {
+        headersLength = pos;
+        bodyOffset = end + 1;
+        break;
+      }
 
-    // Parses the headers into an vector of email key/value pairs
-    vector<MIME::MIMEHeader> headers = MIME::_parseHeaders(headersBegin, headersEnd, true);
+      pos = end + 1;
+    }
 
-    // Gets the body string, since we will have to canonicalize it 
-    //  later on in the process
-    string rawBody = MIME::getStringFromLines(bodyBegin, bodyEnd);
+    // Parses the headers into an vector of email key/value pairs
+    vector<string> lines = MIME::getMIMELines(message.substr(0, headersLength));
+    vector<MIME::MIMEHeader> headers = MIME::_parseHeaders(lines.begin(), lines.end(), true);
 
     // Gets the raw headers of the message, we will remove the DKIM-Signature ones from
     //  it since it will otherwise confuse the validation process
@@ -237,29 +296,106 @@ namespace FSMTP::DKIM {
       return *this;
     }
 
+    // =================================
+    // Parses the signatures
+    // =================================
+
+    // Parses all the signature headers, an signature which can not be
+    //  parsed is an system failure, and will not be verified
+    vector<DKIMHeader> parsedHeaders(signatures.size());
+    this->m_SigResults.resize(signatures.size());
+    vector<bool> parsed(signatures.size(), false);
+
+    for (size_t i = 0; i < signatures.size(); ++i) {
+      try {
+        parsedHeaders[i].parse(signatures[i]);
+        parsed[i] = true;
+      } catch (const runtime_error &e) {
+        DEBUG_ONLY(logger << ERROR << "Could not parse signature: " << e.what() << ENDL << CLASSIC);
+        this->m_SigResults[i] = DKIMSignatureResult {
+          DKIMSignatureResultType::DKIMSignatureSystemFailure,
+          "System failure, check logs"
+        };
+      }
+    }
+
+    // =================================
+    // Hashes the body
+    // =================================
+
+    // Signatures from the same signer mostly use the same canonicalization and
+    //  hash algorithm, so the body is only hashed once for each combination,
+    //  and all the combinations are fed in the same pass over the body
+    map<DKIMBodyHashKey, unique_ptr<DKIMBodyHash>> hashers;
+    for (size_t i = 0; i < signatures.size(); ++i) {
+      if (!parsed[i]) continue;
+
+      DKIMBodyHashKey key = __dkimBodyHashKey(parsedHeaders[i]);
+      if (hashers.find(key) != hashers.end()) continue;
+      hashers.emplace(key, make_unique<DKIMBodyHash>(key.relaxed, key.sha1 ? EVP_sha1() : EVP_sha256(), key.limit));
+    }
+
+    const size_t chunkSize = 64 * 1024;
+    for (size_t offset = bodyOffset; offset < message.size(); offset += chunkSize) {
+      const size_t len = min(chunkSize, message.size() - offset);
+      for (auto &hasher : hashers) hasher.second->update(message.c_str() + offset, len);
+    }
+
+    map<DKIMBodyHashKey, DKIMBodyHashResult> bodyHashes;
+    for (auto &hasher : hashers) {
+      string hash = hasher.second->final();
+      bodyHashes[hasher.first] = DKIMBodyHashResult { hash, hasher.second->getLength() };
+    }
+
     // =================================
     // Starts validating the signatures
     // =================================
 
-    // Loops over the signatures, and validates each one. If an exception is thrown
-    //  we catch it, and put an system failure as result, will result in neutral
-    for_each(signatures.begin(), signatures.end(), [&](const string &sig) {
-      try { this->m_SigResults.push_back(this->validateSignature(sig, headers, rawBody, rawHeaders)); }
-      catch (const runtime_error &e) {
-        DEBUG_ONLY(logger << ERROR << "Signature validation system failure: " << e.what() << ENDL << CLASSIC);
-        this->m_SigResults.push_back(DKIMSignatureResult {
+    // Validates each signature, all except the first one on the verify threads, since
+    //  the key lookup and verification of each are independent. If an exception is
+    //  thrown we catch it, and put an system failure as result, will result in neutral
+    auto verify = [&](const size_t i) {
+      try {
+        this->m_SigResults[i] = this->validateSignature(
+          signatures[i], parsedHeaders[i], rawHeaders,
+          bodyHashes.at(__dkimBodyHashKey(parsedHeaders[i]))
+        );
+        this->m_SigResults[i].domain = parsedHeaders[i].getDomain();
+      } catch (const runtime_error &e) {
+        DEBUG_ONLY(Logger("DKIMValidator", LoggerLevel::DEBUG) << ERROR << "Signature validation system failure: " << e.what() << ENDL << CLASSIC);
+        this->m_SigResults[i] = DKIMSignatureResult {
           DKIMSignatureResultType::DKIMSignatureSystemFailure,
           "System failure, check logs"
-        });
+        };
       } catch (...) {
-        DEBUG_ONLY(logger << ERROR << "Signature validation system failure: unknown" << ENDL << CLASSIC);
-        this->m_SigResults.push_back(DKIMSignatureResult {
+        this->m_SigResults[i] = DKIMSignatureResult {
           DKIMSignatureResultType::DKIMSignatureSystemFailure,
           "System failure, error unknown"
-        });
+        };
       }
-    });
-    
+    };
+
+    vector<size_t> pending;
+    for (size_t i = 0; i < signatures.size(); ++i)
+      if (parsed[i]) pending.push_back(i);
+
+    vector<future<void>> tasks;
+    if (pending.size() > 1 && verifyPoolThreads > 0) {
+      call_once(verifyPoolStarted, __dkimStartVerifyPool);
+
+      for (auto it = pending.begin() + 1; it != pending.end(); ++it) {
+        auto task = make_shared<packaged_task<void()>>(bind(verify, *it));
+        tasks.push_back(task->get_future());
+        verifyQueue->push([task]() { (*task)(); });
+      }
+
+      verify(pending.front());
+    } else {
+      for (const size_t i : pending) verify(i);
+    }
+
+    for (future<void> &task : tasks) task.wait();
+
     // Checks if one of the signatures is valid, so we can mark the message as valid
     //  or not valid
     any_of(this->m_SigResults.begin(), this->m_SigResults.end(), [&](const DKIMSignatureResult &res) {
@@ -275,6 +411,14 @@ namespace FSMTP::DKIM {
     return this->m_Result;
   }
 
+  vector<string> DKIMValidator::getValidDomains() {
+    vector<string> domains = {};
+
+    for (const DKIMSignatureResult &res : this->m_SigResults)
+      if (res.type == DKIMSignatureResultType::DKIMSignatureValid) domains.push_back(res.domain);
+    return domains;
+  }
+
   string DKIMValidator::getResultString() {
     string result;
 
@@ -26,6 +26,8 @@
 #include "DKIMCanonicalization.src.h"
 #include "DKIMHashes.src.h"
 #include "DKIMRecord.src.h"
+#include "DKIMKeyCache.src.h"
+#include "DKIMBodyHash.src.h"
 
 using namespace FSMTP::Models;
 
@@ -38,6 +40,7 @@ namespace FSMTP::DKIM {
   struct DKIMSignatureResult {
     DKIMSignatureResultType type;
     string details;
+    string domain;
   };
 
   enum DKIMValidatorResultType {
@@ -50,19 +53,37 @@ namespace FSMTP::DKIM {
     string details;
   };
 
+  struct DKIMBodyHashResult {
+    string hash;
+    size_t length;
+  };
+
   class DKIMValidator {
   public:
     DKIMValidator();
 
-    DKIMSignatureResult validateSignature(const string &signature, 
-      const vector<MIME::MIMEHeader> &headers, const string &body,
-      const string &rawHeaders);
+    /**
+     * Sets the number of threads on which the signatures of an message
+     *  are verified concurrently, zero verifies them one by one
+     */
+    static void configure(const size_t verifyThreads);
+
+    DKIMSignatureResult validateSignature(
+      const string &signature, DKIMHeader &header,
+      const string &rawHeaders, const DKIMBodyHashResult &bodyHash
+    );
 
     DKIMValidator &validate(const string &message);
 
     const DKIMValidatorResult &getResult();
     string getResultString();
 
+    /**
+     * Gets the signing domains ( d= ) of the valid signatures, used
+     *  to check the DMARC alignment
+     */
+    vector<string> getValidDomains();
+
     ~DKIMValidator();
   private:
     DKIMValidatorResult m_Result;
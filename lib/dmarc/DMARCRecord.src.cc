@@ -96,8 +96,7 @@ namespace FSMTP::DMARC {
 
 		auto parseAlignment = [](const string &a) {
 			if (a == "s") return DMARCAlignment::AlignmentStrict;
-			else if (a == "r") return DMARCAlignment::AlignmentRelaxed;
-			else DMARCAlignment::AlignmentRelaxed;
+			else return DMARCAlignment::AlignmentRelaxed;
 		};
 
 		auto parseFormat = [](const string &f) {
@@ -160,8 +159,12 @@ namespace FSMTP::DMARC {
 			return targets;
 		};
 
+		// The record must start with the version, else it is some other
+		//  TXT record, and the policy must be set ( RFC 7489 6.3 )
+		bool policyFound = false, subdomainPolicyFound = false, versionFound = false;
+
 		for_each(segments.begin(), segments.end(), [&](const string &seg) {
-			if (seg.empty()) return;
+			if (seg.empty() || all_of(seg.begin(), seg.end(), [](const char c) { return c == ' ' || c == '\t'; })) return;
 			
 			// Splits the segment into a key / value pair, so we can
 			//  later parse the value from it, based on the key
@@ -179,13 +182,18 @@ namespace FSMTP::DMARC {
 			if (*(val.end() - 1) == ' ') val.pop_back();
 
 			// Checks the key, and makes sense of the value stored inside of it
-			if (key == "v") { // Version
-				if (val == "dmarc1") this->m_Version = DMARCVersion::DMARC1;
-				else this->m_Version = DMARCVersion::DMARC1;
+			if (!versionFound) {
+				if (key != "v" || val != "dmarc1")
+					throw runtime_error(EXCEPT_DEBUG("Record does not start with v=DMARC1"));
+
+				this->m_Version = DMARCVersion::DMARC1;
+				versionFound = true;
 			} else if (key == "p") { // Policy
 				this->m_Policy = parsePolicy(val);
+				policyFound = true;
 			} else if (key == "sp") { // Subdomain policy
 				this->m_SubdomainPolicy = parsePolicy(val);
+				subdomainPolicyFound = true;
 			} else if (key == "pct") { // Filtering percentage
 				try {
 					this->m_FilteringPercentage = stoi(val);
@@ -212,11 +220,21 @@ namespace FSMTP::DMARC {
 			}
 		});
 
+		// An record without policy is only used for its reports, in which
+		//  case the policy is none, the subdomain policy defaults to the policy
+		if (!versionFound) throw runtime_error(EXCEPT_DEBUG("Record does not start with v=DMARC1"));
+		else if (!policyFound) {
+			if (this->m_FailReportTargets.empty())
+				throw runtime_error(EXCEPT_DEBUG("Record has no policy"));
+			this->m_Policy = DMARCPolicy::PolicyNone;
+		}
+
+		if (!subdomainPolicyFound) this->m_SubdomainPolicy = this->m_Policy;
 		return *this;
 	}
 
 	const char *DMARCRecord::getPolicyString() {
-		__dmarcPolicyToString(this->m_Policy);
+		return __dmarcPolicyToString(this->m_Policy);
 	}
 	
 	const char *DMARCRecord::getSubdomainPolicyString() {
@@ -252,6 +270,18 @@ namespace FSMTP::DMARC {
 		return this->m_SubdomainPolicy;
 	}
 
+	DMARCAlignment DMARCRecord::getDKIMAlignment() {
+		return this->m_DKIMAlignment;
+	}
+
+	DMARCAlignment DMARCRecord::getSPFAlignment() {
+		return this->m_SPFAlignment;
+	}
+
+	int32_t DMARCRecord::getFilteringPercentage() {
+		return this->m_FilteringPercentage;
+	}
+
 	DMARCRecord &DMARCRecord::print(Logger &logger) {
 		logger << DEBUG;
 
@@ -279,6 +309,7 @@ namespace FSMTP::DMARC {
 		logger << "\tForensic report targets: " << ENDL;
 		printTargets(this->m_FeronsicReportTargets);
 		logger << "}" << ENDL;
+		return *this;
 	}
 
 	DMARCRecord DMARCRecord::fromDNS(const char *query) {
@@ -293,7 +324,8 @@ namespace FSMTP::DMARC {
 		bool found = false;
 		all_of(records.begin(), records.end(), [&](const DNS::RR &rr) {
 			try {
-				res.parse(rr.getData());
+				DMARCRecord record;
+				res = record.parse(rr.getData());
 				found = true;
 				return false;
 			} catch (const runtime_error &e) {
@@ -301,9 +333,9 @@ namespace FSMTP::DMARC {
 			} 
 		});
 
-		// Checks if we found an valid record, if so return it, else
-		//  we throw an runtime error since there is nothing
-		if (!found) throw runtime_error(EXCEPT_DEBUG("Could not find valid DMARC record"));
+		// Checks if we found an valid record, if so return it, else we throw the
+		//  same error as for an missing name, since both mean there is no policy
+		if (!found) throw DNS::NoResults(EXCEPT_DEBUG("Could not find valid DMARC record"));
 		return res;
 	}
 
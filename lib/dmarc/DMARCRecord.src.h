@@ -22,7 +22,7 @@
 #include "../dns/Resolver.src.h"
 
 #define _FSMTP_DMARC_REPORT_INTERVAL_DEFAULT 86400
-#define _FSMTP_DMARC_REPORT_FILTER_PERC_DEFAULT 0
+#define _FSMTP_DMARC_REPORT_FILTER_PERC_DEFAULT 100
 
 namespace FSMTP::DMARC {
 	typedef enum {
@@ -86,6 +86,9 @@ namespace FSMTP::DMARC {
 
 		DMARCPolicy getPolicy();
 		DMARCPolicy getSubdomainPolicy();
+		DMARCAlignment getDKIMAlignment();
+		DMARCAlignment getSPFAlignment();
+		int32_t getFilteringPercentage();
 
 		static DMARCRecord fromDNS(const char *query);
 
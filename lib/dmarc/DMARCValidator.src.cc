@@ -0,0 +1,188 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "DMARCValidator.src.h"
+
+namespace FSMTP::DMARC {
+	const char *__dmarcResultTypeToString(DMARCResultType t) {
+		switch (t) {
+			case DMARCResultType::DMARCResultNone: return "none";
+			case DMARCResultType::DMARCResultPass: return "pass";
+			case DMARCResultType::DMARCResultFail: return "fail";
+			case DMARCResultType::DMARCResultTempError: return "temperror";
+		}
+	}
+
+	static string __dmarcLower(string str) {
+		transform(str.begin(), str.end(), str.begin(), [](const char c) { return tolower(c); });
+		if (!str.empty() && str.back() == '.') str.pop_back();
+		return str;
+	}
+
+	DMARCValidator::DMARCValidator():
+		m_Logger("DMARCValidator", LoggerLevel::DEBUG)
+	{
+		this->m_Result = DMARCValidatorResult {
+			DMARCResultType::DMARCResultNone, DMARCPolicy::PolicyNone,
+			"", false, false
+		};
+	}
+
+	DMARCValidator &DMARCValidator::setFromDomain(const string &domain) {
+		this->m_FromDomain = __dmarcLower(domain);
+		return *this;
+	}
+
+	DMARCValidator &DMARCValidator::setSPFDomain(const string &domain) {
+		this->m_SPFDomain = __dmarcLower(domain);
+		return *this;
+	}
+
+	DMARCValidator &DMARCValidator::addDKIMDomain(const string &domain) {
+		this->m_DKIMDomains.push_back(__dmarcLower(domain));
+		return *this;
+	}
+
+	bool DMARCValidator::isAligned(const string &a, const string &b, DMARCAlignment mode) {
+		if (a.empty() || b.empty()) return false;
+		else if (a == b) return true;
+		else if (mode == DMARCAlignment::AlignmentStrict) return false;
+
+		return PublicSuffixList::getOrganizationalDomain(a) == PublicSuffixList::getOrganizationalDomain(b);
+	}
+
+	DMARCValidator &DMARCValidator::validate() {
+		auto &logger = this->m_Logger;
+
+		if (this->m_FromDomain.empty()) {
+			this->m_Result.type = DMARCResultType::DMARCResultNone;
+			return *this;
+		}
+
+		// ==================================
+		// Discovers the policy
+		// ==================================
+
+		// Queries the From domain first, and if it has no record the organizational
+		//  domain, the list tells us that domain directly, so we do not have to
+		//  walk up the tree with an query for each label
+		const string orgDomain = PublicSuffixList::getOrganizationalDomain(this->m_FromDomain);
+		vector<string> candidates = { this->m_FromDomain };
+		if (orgDomain != this->m_FromDomain) candidates.push_back(orgDomain);
+		bool found = false;
+
+		for (const string &domain : candidates) {
+			this->m_Result.policyDomain = domain;
+
+			try {
+				this->m_Record = DMARCRecord::fromDNS(("_dmarc." + domain).c_str());
+				found = true;
+				break;
+			} catch (const DNS::NoResults &e) {
+				DEBUG_ONLY(logger << DEBUG << "No DMARC record for: '" << domain << '\'' << ENDL << CLASSIC);
+			} catch (const runtime_error &e) {
+				logger << ERROR << "Could not resolve DMARC record for: '" << domain << "', error: " << e.what() << ENDL << CLASSIC;
+				this->m_Result.type = DMARCResultType::DMARCResultTempError;
+				return *this;
+			}
+		}
+
+		if (!found) {
+			this->m_Result.type = DMARCResultType::DMARCResultNone;
+			this->m_Result.policyDomain.clear();
+			return *this;
+		}
+
+		DEBUG_ONLY(this->m_Record.print(logger));
+
+		// ==================================
+		// Checks the alignment
+		// ==================================
+
+		this->m_Result.spfAligned = DMARCValidator::isAligned(
+			this->m_FromDomain, this->m_SPFDomain, this->m_Record.getSPFAlignment()
+		);
+
+		this->m_Result.dkimAligned = any_of(this->m_DKIMDomains.begin(), this->m_DKIMDomains.end(), [&](const string &domain) {
+			return DMARCValidator::isAligned(this->m_FromDomain, domain, this->m_Record.getDKIMAlignment());
+		});
+
+		if (this->m_Result.spfAligned || this->m_Result.dkimAligned) {
+			this->m_Result.type = DMARCResultType::DMARCResultPass;
+			this->m_Result.policy = DMARCPolicy::PolicyNone;
+			return *this;
+		}
+
+		// ==================================
+		// Selects the policy
+		// ==================================
+
+		// The subdomain policy applies when the record was found at the organizational
+		//  domain, for an message from an subdomain of it, with pct below 100 only that
+		//  part of the messages gets the policy, the rest gets the next weaker one
+		this->m_Result.type = DMARCResultType::DMARCResultFail;
+		this->m_Result.policy = this->m_Result.policyDomain != this->m_FromDomain
+			? this->m_Record.getSubdomainPolicy() : this->m_Record.getPolicy();
+
+		if (this->m_Result.policy != DMARCPolicy::PolicyNone && this->m_Record.getFilteringPercentage() < 100) {
+			static thread_local mt19937 generator(random_device{}());
+			if (static_cast<int32_t>(generator() % 100) >= this->m_Record.getFilteringPercentage()) {
+				this->m_Result.policy = this->m_Result.policy == DMARCPolicy::PolicyReject
+					? DMARCPolicy::PolicyQuarantine : DMARCPolicy::PolicyNone;
+			}
+		}
+
+		return *this;
+	}
+
+	const DMARCValidatorResult &DMARCValidator::getResult() {
+		return this->m_Result;
+	}
+
+	DMARCRecord &DMARCValidator::getRecord() {
+		return this->m_Record;
+	}
+
+	string DMARCValidator::getResultString() {
+		string result = __dmarcResultTypeToString(this->m_Result.type);
+
+		switch (this->m_Result.type) {
+			case DMARCResultType::DMARCResultNone:
+				result += " (no record) header.from=" + this->m_FromDomain;
+				break;
+			case DMARCResultType::DMARCResultTempError:
+				result += " (lookup failed) header.from=" + this->m_FromDomain;
+				break;
+			default:
+				result += " (p:";
+				result += this->m_Record.getPolicyString();
+				result += " sp:";
+				result += this->m_Record.getSubdomainPolicyString();
+				result += " dis:";
+				result += __dmarcPolicyToString(this->m_Result.policy);
+				result += ") header.from=" + this->m_FromDomain;
+				result += " policy.domain=" + this->m_Result.policyDomain;
+				result += " spf=";
+				result += this->m_Result.spfAligned ? "aligned" : "unaligned";
+				result += " dkim=";
+				result += this->m_Result.dkimAligned ? "aligned" : "unaligned";
+		}
+
+		return result;
+	}
+
+	DMARCValidator::~DMARCValidator() = default;
+}
@@ -0,0 +1,75 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef _LIB_DMARC_VALIDATOR_H
+#define _LIB_DMARC_VALIDATOR_H
+
+#include "../default.h"
+#include "../general/Logger.src.h"
+#include "DMARCRecord.src.h"
+#include "PublicSuffix.src.h"
+
+namespace FSMTP::DMARC {
+	typedef enum {
+		DMARCResultNone, DMARCResultPass, DMARCResultFail,
+		DMARCResultTempError
+	} DMARCResultType;
+
+	const char *__dmarcResultTypeToString(DMARCResultType t);
+
+	struct DMARCValidatorResult {
+		DMARCResultType type;
+		DMARCPolicy policy;
+		string policyDomain;
+		bool spfAligned, dkimAligned;
+	};
+
+	/**
+	 * Evaluates DMARC ( RFC 7489 ) for an message, the SPF and DKIM results
+	 *  are checked for alignment with the RFC5322.From domain, the policy
+	 *  is taken from the From domain, or else its organizational domain
+	 */
+	class DMARCValidator {
+	public:
+		DMARCValidator();
+
+		DMARCValidator &setFromDomain(const string &domain);
+		DMARCValidator &setSPFDomain(const string &domain);
+		DMARCValidator &addDKIMDomain(const string &domain);
+
+		DMARCValidator &validate();
+
+		const DMARCValidatorResult &getResult();
+		DMARCRecord &getRecord();
+		string getResultString();
+
+		/**
+		 * Checks if two domains are aligned, in strict mode they must be equal,
+		 *  in relaxed mode they must share the organizational domain
+		 */
+		static bool isAligned(const string &a, const string &b, DMARCAlignment mode);
+
+		~DMARCValidator();
+	private:
+		string m_FromDomain, m_SPFDomain;
+		vector<string> m_DKIMDomains;
+		DMARCValidatorResult m_Result;
+		DMARCRecord m_Record;
+		Logger m_Logger;
+	};
+}
+
+#endif
@@ -0,0 +1,469 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "PublicSuffix.src.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace FSMTP::DMARC {
+	/**
+	 * An mapped trie file, it is unmapped once the last lookup using
+	 *  it finishes, so the list may be swapped during lookups
+	 */
+	struct PSLMapping {
+		void *data;
+		size_t size;
+		const PSLNode *nodes;
+		const uint32_t *table;
+		const char *strings;
+		uint32_t nodeCount, tableMask;
+
+		~PSLMapping() {
+			munmap(this->data, this->size);
+		}
+	};
+
+	struct PSLBuildNode {
+		uint8_t flags;
+		map<string, PSLBuildNode> children;
+	};
+
+	static string pslListPath, pslCompiledPath;
+	static shared_ptr<const PSLMapping> pslMapping;
+	static atomic<uint64_t> pslGeneration(0);
+	static mutex pslReloadMutex;
+	static atomic<bool> pslReloadRequested(false);
+
+	/**
+	 * Hashes an edge of the trie, the label is lowercased while hashing, so
+	 *  the domain does not have to be copied before an lookup ( FNV-1a )
+	 */
+	static inline uint32_t __pslHashEdge(const uint32_t parent, const char *label, const size_t len) {
+		uint32_t hash = 2166136261u ^ parent;
+
+		for (size_t i = 0; i < len; ++i) {
+			uint8_t c = label[i];
+			if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+			hash = (hash ^ c) * 16777619u;
+		}
+
+		return hash ^ (hash >> 15);
+	}
+
+	// ==================================
+	// Compiling
+	// ==================================
+
+	static char __pslPunycodeDigit(const uint32_t d) {
+		return d < 26 ? 'a' + d : '0' + (d - 26);
+	}
+
+	static uint32_t __pslPunycodeAdapt(uint32_t delta, const uint32_t points, const bool first) {
+		uint32_t k = 0;
+
+		delta = first ? delta / 700 : delta / 2;
+		delta += delta / points;
+		while (delta > ((36 - 1) * 26) / 2) {
+			delta /= 36 - 1;
+			k += 36;
+		}
+
+		return k + (36 * delta) / (delta + 38);
+	}
+
+	/**
+	 * Encodes an UTF-8 label into an A-label ( RFC 3492 ), since domains
+	 *  in messages are in their ASCII form
+	 */
+	static string __pslPunycode(const string &label) {
+		vector<uint32_t> points;
+		string result;
+
+		for (size_t i = 0; i < label.size();) {
+			const uint8_t c = label[i];
+			size_t len = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+			uint32_t point = len == 1 ? c : c & (0x3F >> (len - 1));
+
+			if (i + len > label.size())
+				throw runtime_error(EXCEPT_DEBUG("Invalid UTF-8 in label: '" + label + '\''));
+			for (size_t j = 1; j < len; ++j) point = (point << 6) | (label[i + j] & 0x3F);
+
+			points.push_back(point);
+			i += len;
+		}
+
+		for (const uint32_t point : points)
+			if (point < 0x80) result += static_cast<char>(point);
+		if (result.size() == points.size()) return result;
+
+		size_t basic = result.size(), handled = basic;
+		uint32_t n = 0x80, delta = 0, bias = 72;
+		if (basic > 0) result += '-';
+
+		while (handled < points.size()) {
+			uint32_t m = UINT32_MAX;
+			for (const uint32_t point : points)
+				if (point >= n && point < m) m = point;
+
+			delta += (m - n) * (handled + 1);
+			n = m;
+
+			for (const uint32_t point : points) {
+				if (point < n) ++delta;
+				if (point != n) continue;
+
+				uint32_t q = delta;
+				for (uint32_t k = 36;; k += 36) {
+					const uint32_t t = k <= bias ? 1 : k >= bias + 26 ? 26 : k - bias;
+					if (q < t) break;
+
+					result += __pslPunycodeDigit(t + (q - t) % (36 - t));
+					q = (q - t) / (36 - t);
+				}
+
+				result += __pslPunycodeDigit(q);
+				bias = __pslPunycodeAdapt(delta, handled + 1, handled == basic);
+				delta = 0;
+				++handled;
+			}
+
+			++delta;
+			++n;
+		}
+
+		return "xn--" + result;
+	}
+
+	void PublicSuffixList::compile(const string &listPath, const string &outPath) {
+		ifstream list(listPath);
+		if (!list.is_open())
+			throw runtime_error(EXCEPT_DEBUG("Could not open public suffix list: '" + listPath + '\''));
+
+		// ==================================
+		// Builds the trie
+		// ==================================
+
+		// Each rule is the first word on an line, comments start with '//', the labels
+		//  are inserted from the top level domain, wildcard and exception rules are
+		//  stored as flags on the node, instead of as an '*' child
+		PSLBuildNode root = { 0, {} };
+		string line;
+
+		while (getline(list, line)) {
+			size_t end = line.find_first_of(" \t\r");
+			if (end != string::npos) line.erase(end);
+			if (line.empty() || line.compare(0, 2, "//") == 0) continue;
+
+			uint8_t flag = PSLNodeFlags::PSLNodeRule;
+			if (line[0] == '!') {
+				flag = PSLNodeFlags::PSLNodeException;
+				line.erase(0, 1);
+			} else if (line.compare(0, 2, "*.") == 0) {
+				flag = PSLNodeFlags::PSLNodeWildcard;
+				line.erase(0, 2);
+			}
+
+			transform(line.begin(), line.end(), line.begin(), [](const char c) { return tolower(static_cast<uint8_t>(c)); });
+
+			PSLBuildNode *node = &root;
+			for (size_t end = line.size(); end > 0;) {
+				size_t start = line.find_last_of('.', end - 1);
+				start = start == string::npos ? 0 : start + 1;
+
+				string label = __pslPunycode(line.substr(start, end - start));
+				if (label.empty() || label.size() > 63)
+					throw runtime_error(EXCEPT_DEBUG("Invalid rule in public suffix list: '" + line + '\''));
+
+				node = &node->children[label];
+				end = start > 0 ? start - 1 : 0;
+			}
+
+			node->flags |= flag;
+		}
+
+		// ==================================
+		// Flattens the trie
+		// ==================================
+
+		// Numbers the nodes breadth first, and inserts an edge for each of them
+		//  into an table at most half full, so probe sequences stay short
+		vector<PSLNode> nodes = { PSLNode { 0, UINT32_MAX, 0, root.flags, 0 } };
+		vector<const PSLBuildNode *> queue = { &root };
+		string strings;
+
+		for (size_t i = 0; i < queue.size(); ++i) {
+			for (const auto &child : queue[i]->children) {
+				nodes.push_back(PSLNode {
+					static_cast<uint32_t>(strings.size()), static_cast<uint32_t>(i),
+					static_cast<uint8_t>(child.first.size()), child.second.flags, 0
+				});
+				queue.push_back(&child.second);
+				strings += child.first;
+			}
+		}
+
+		uint32_t tableSize = 16;
+		while (tableSize < nodes.size() * 2) tableSize <<= 1;
+		vector<uint32_t> table(tableSize, UINT32_MAX);
+
+		for (uint32_t i = 1; i < nodes.size(); ++i) {
+			uint32_t slot = __pslHashEdge(nodes[i].parent, strings.c_str() + nodes[i].label, nodes[i].labelLength) & (tableSize - 1);
+			while (table[slot] != UINT32_MAX) slot = (slot + 1) & (tableSize - 1);
+			table[slot] = i;
+		}
+
+		// ==================================
+		// Writes the file
+		// ==================================
+
+		// Writes to an temporary file first, and renames it over the old one, so the
+		//  old file stays intact for the processes which still have it mapped
+		PSLFileHeader header = {
+			_FSMTP_PSL_MAGIC, _FSMTP_PSL_VERSION,
+			static_cast<uint32_t>(nodes.size()), tableSize, static_cast<uint32_t>(strings.size())
+		};
+
+		const string tempPath = outPath + ".tmp";
+		ofstream out(tempPath, ios::binary | ios::trunc);
+		if (!out.is_open())
+			throw runtime_error(EXCEPT_DEBUG("Could not open '" + tempPath + "' for writing"));
+
+		out.write(reinterpret_cast<const char *>(&header), sizeof (header));
+		out.write(reinterpret_cast<const char *>(nodes.data()), nodes.size() * sizeof (PSLNode));
+		out.write(reinterpret_cast<const char *>(table.data()), table.size() * sizeof (uint32_t));
+		out.write(strings.data(), strings.size());
+		out.close();
+
+		if (!out.good() || rename(tempPath.c_str(), outPath.c_str()) != 0)
+			throw runtime_error(EXCEPT_DEBUG("Could not write compiled public suffix list to: '" + outPath + '\''));
+	}
+
+	// ==================================
+	// Loading
+	// ==================================
+
+	static shared_ptr<const PSLMapping> __pslMap(const string &path) {
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw runtime_error(EXCEPT_DEBUG("Could not open: '" + path + '\''));
+		DEFER(close(fd));
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof (PSLFileHeader)))
+			throw runtime_error(EXCEPT_DEBUG("Invalid compiled public suffix list: '" + path + '\''));
+
+		void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) throw runtime_error(EXCEPT_DEBUG("mmap() failed: " + string(strerror(errno))));
+
+		auto mapping = make_shared<PSLMapping>();
+		mapping->data = data;
+		mapping->size = st.st_size;
+
+		// Validates the header, the nodes and the table, so lookups can trust the
+		//  offsets in the file without checking them again
+		const PSLFileHeader *header = reinterpret_cast<const PSLFileHeader *>(data);
+		if (
+			header->magic != _FSMTP_PSL_MAGIC || header->version != _FSMTP_PSL_VERSION || header->nodeCount == 0
+			|| header->tableSize < header->nodeCount || (header->tableSize & (header->tableSize - 1)) != 0
+			|| sizeof (PSLFileHeader) + static_cast<uint64_t>(header->nodeCount) * sizeof (PSLNode)
+				+ static_cast<uint64_t>(header->tableSize) * sizeof (uint32_t) + header->stringsSize != mapping->size
+		) throw runtime_error(EXCEPT_DEBUG("Invalid compiled public suffix list: '" + path + '\''));
+
+		mapping->nodeCount = header->nodeCount;
+		mapping->tableMask = header->tableSize - 1;
+		mapping->nodes = reinterpret_cast<const PSLNode *>(header + 1);
+		mapping->table = reinterpret_cast<const uint32_t *>(mapping->nodes + header->nodeCount);
+		mapping->strings = reinterpret_cast<const char *>(mapping->table + header->tableSize);
+
+		bool emptySlot = false;
+		for (uint32_t i = 0; i < header->tableSize; ++i) {
+			if (mapping->table[i] == UINT32_MAX) emptySlot = true;
+			else if (mapping->table[i] == 0 || mapping->table[i] >= header->nodeCount)
+				throw runtime_error(EXCEPT_DEBUG("Invalid edge in compiled public suffix list: '" + path + '\''));
+		}
+
+		for (uint32_t i = 1; i < header->nodeCount; ++i) {
+			const PSLNode &node = mapping->nodes[i];
+			if (
+				static_cast<uint64_t>(node.label) + node.labelLength > header->stringsSize
+				|| node.parent >= header->nodeCount
+			) throw runtime_error(EXCEPT_DEBUG("Invalid node in compiled public suffix list: '" + path + '\''));
+		}
+
+		// An table without empty slots would make an failed lookup loop forever
+		if (!emptySlot) throw runtime_error(EXCEPT_DEBUG("Invalid compiled public suffix list: '" + path + '\''));
+
+		return mapping;
+	}
+
+	void PublicSuffixList::configure(const Json::Value &config) {
+		pslListPath = config["public_suffix_list"].asString();
+		pslCompiledPath = config["public_suffix_compiled"].asString();
+		PublicSuffixList::reload();
+	}
+
+	void PublicSuffixList::reload() {
+		Logger logger("PublicSuffixList", LoggerLevel::INFO);
+		lock_guard<mutex> lock(pslReloadMutex);
+
+		// Compiles the list if the compiled version is missing, or older than
+		//  the text list, if anything fails we keep the current list
+		try {
+			struct stat listStat, compiledStat;
+			if (
+				!pslListPath.empty() && stat(pslListPath.c_str(), &listStat) == 0
+				&& (stat(pslCompiledPath.c_str(), &compiledStat) != 0 || compiledStat.st_mtime < listStat.st_mtime)
+			) {
+				PublicSuffixList::compile(pslListPath, pslCompiledPath);
+				logger << "Compiled public suffix list: '" << pslListPath << "' into: '" << pslCompiledPath << '\'' << ENDL;
+			}
+
+			shared_ptr<const PSLMapping> mapping = __pslMap(pslCompiledPath);
+			atomic_store(&pslMapping, mapping);
+			++pslGeneration;
+			logger << "Loaded public suffix list with " << mapping->nodeCount << " nodes" << ENDL;
+		} catch (const runtime_error &e) {
+			logger << ERROR << "Could not load public suffix list, keeping current one: " << e.what() << ENDL << CLASSIC;
+		}
+	}
+
+	// ==================================
+	// Lookups
+	// ==================================
+
+	/**
+	 * Gets the current list, each thread keeps its own reference until
+	 *  the list is reloaded, so the shared pointer is not touched by lookups
+	 */
+	static const PSLMapping *__pslCurrent() {
+		thread_local shared_ptr<const PSLMapping> current;
+		thread_local uint64_t currentGeneration = UINT64_MAX;
+
+		const uint64_t generation = pslGeneration.load();
+		if (generation != currentGeneration) {
+			current = atomic_load(&pslMapping);
+			currentGeneration = generation;
+		}
+
+		return current.get();
+	}
+
+	static uint32_t __pslFindChild(const PSLMapping &list, const uint32_t parent, const char *label, const size_t len) {
+		uint32_t slot = __pslHashEdge(parent, label, len) & list.tableMask;
+
+		for (;; slot = (slot + 1) & list.tableMask) {
+			const uint32_t index = list.table[slot];
+			if (index == UINT32_MAX) return 0;
+
+			const PSLNode &node = list.nodes[index];
+			if (node.parent != parent || node.labelLength != len) continue;
+
+			const char *other = list.strings + node.label;
+			size_t i = 0;
+			for (; i < len; ++i) {
+				uint8_t c = label[i];
+				if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+				if (c != static_cast<uint8_t>(other[i])) break;
+			}
+
+			if (i == len) return index;
+		}
+	}
+
+	size_t PublicSuffixList::getSuffixLabels(const string &domain) {
+		const PSLMapping *list = __pslCurrent();
+
+		size_t end = domain.size();
+		if (end > 0 && domain[end - 1] == '.') --end;
+		if (end == 0) return 0;
+		if (!list) return 1;
+
+		// Walks the trie from the top level domain, remembering the longest
+		//  matching rule, an exception rule ends the walk, and makes its
+		//  parent the public suffix ( PSL algorithm )
+		uint32_t node = 0;
+		size_t depth = 0, labels = 0;
+
+		for (;;) {
+			const uint8_t flags = list->nodes[node].flags;
+			if (flags & PSLNodeFlags::PSLNodeRule) labels = depth;
+			if (end == 0) break;
+
+			size_t start = domain.find_last_of('.', end - 1);
+			start = start == string::npos ? 0 : start + 1;
+
+			const uint32_t child = __pslFindChild(*list, node, domain.c_str() + start, end - start);
+			if (child && (list->nodes[child].flags & PSLNodeFlags::PSLNodeException)) {
+				labels = depth;
+				break;
+			}
+
+			if (flags & PSLNodeFlags::PSLNodeWildcard) labels = max(labels, depth + 1);
+			if (!child) break;
+
+			node = child;
+			++depth;
+			if (start == 0) {
+				if (list->nodes[node].flags & PSLNodeFlags::PSLNodeRule) labels = depth;
+				break;
+			}
+
+			end = start - 1;
+		}
+
+		return labels > 0 ? labels : 1;
+	}
+
+	/**
+	 * Gets the part of the domain containing the last labels
+	 */
+	static string __pslLastLabels(const string &domain, size_t labels) {
+		size_t end = domain.size();
+		if (end > 0 && domain[end - 1] == '.') --end;
+
+		size_t start = end;
+		while (labels-- > 0 && start > 0) {
+			size_t dot = domain.find_last_of('.', start - 1);
+			start = dot == string::npos ? 0 : dot;
+		}
+
+		if (start > 0) ++start;
+		string result = domain.substr(start, end - start);
+		transform(result.begin(), result.end(), result.begin(), [](const char c) { return tolower(static_cast<uint8_t>(c)); });
+		return result;
+	}
+
+	string PublicSuffixList::getPublicSuffix(const string &domain) {
+		return __pslLastLabels(domain, PublicSuffixList::getSuffixLabels(domain));
+	}
+
+	string PublicSuffixList::getOrganizationalDomain(const string &domain) {
+		return __pslLastLabels(domain, PublicSuffixList::getSuffixLabels(domain) + 1);
+	}
+
+	size_t PublicSuffixList::getNodeCount() {
+		const PSLMapping *list = __pslCurrent();
+		return list ? list->nodeCount : 0;
+	}
+
+	void PublicSuffixList::requestReload() noexcept {
+		pslReloadRequested = true;
+	}
+
+	bool PublicSuffixList::reloadRequested() noexcept {
+		return pslReloadRequested.exchange(false);
+	}
+}
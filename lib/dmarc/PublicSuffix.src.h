@@ -0,0 +1,87 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef _LIB_DMARC_PUBLIC_SUFFIX_H
+#define _LIB_DMARC_PUBLIC_SUFFIX_H
+
+#include "../default.h"
+#include "../general/Logger.src.h"
+
+#define _FSMTP_PSL_MAGIC 0x4c535046
+#define _FSMTP_PSL_VERSION 1
+
+namespace FSMTP::DMARC {
+	typedef enum : uint8_t {
+		PSLNodeRule = 1,
+		PSLNodeWildcard = 2,
+		PSLNodeException = 4
+	} PSLNodeFlags;
+
+	struct PSLFileHeader {
+		uint32_t magic, version;
+		uint32_t nodeCount, tableSize, stringsSize;
+	};
+
+	/**
+	 * Node of the compiled trie, the edges are stored in an open addressing
+	 *  table keyed by the parent and the label, so finding an child takes
+	 *  an single probe, instead of an search through the children
+	 */
+	struct PSLNode {
+		uint32_t label, parent;
+		uint8_t labelLength, flags;
+		uint16_t reserved;
+	};
+
+	/**
+	 * The Public Suffix List, compiled from the text list into an trie file
+	 *  which is memory mapped, lookups walk the trie from the top level domain
+	 *  and never allocate or lock. The list is reloaded on SIGHUP, and recompiled
+	 *  when the text list is newer than the compiled one
+	 */
+	class PublicSuffixList {
+	public:
+		static void configure(const Json::Value &config);
+		static void reload();
+
+		/**
+		 * Compiles the text list into the trie file format, labels
+		 *  with non-ASCII characters are stored in punycode
+		 */
+		static void compile(const string &listPath, const string &outPath);
+
+		/**
+		 * Gets the number of labels of the public suffix of the domain, the
+		 *  implicit '*' rule makes this at least one
+		 */
+		static size_t getSuffixLabels(const string &domain);
+
+		static string getPublicSuffix(const string &domain);
+
+		/**
+		 * Gets the organizational domain ( RFC 7489 3.2 ), the public suffix
+		 *  and one label more, or the domain itself if it is an public suffix
+		 */
+		static string getOrganizationalDomain(const string &domain);
+
+		static size_t getNodeCount();
+
+		static void requestReload() noexcept;
+		static bool reloadRequested() noexcept;
+	};
+}
+
+#endif
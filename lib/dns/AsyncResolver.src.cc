@@ -0,0 +1,629 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "AsyncResolver.src.h"
+
+#define _ASYNC_RESOLVER_ATTEMPTS 3
+#define _ASYNC_RESOLVER_TIMEOUT 1000
+#define _ASYNC_RESOLVER_SOCKETS 16
+#define _ASYNC_RESOLVER_SOCKET_USES 64
+#define _ASYNC_RESOLVER_ID_ATTEMPTS 64
+#define _ASYNC_RESOLVER_TCP_THREADS 4
+#define _ASYNC_RESOLVER_TCP_QUEUE 256
+
+namespace FSMTP::DNS
+{
+	struct AsyncResolverPending {
+		uint16_t id;
+		string key;
+		string name;
+		int32_t type;
+		string packet;
+		size_t attempts;
+		size_t socket;
+		steady_clock::time_point deadline;
+		AsyncResolverCallback callback;
+	};
+
+	/**
+	 * An socket of each family, opened only for the families of the
+	 *  configured nameservers, the other one is -1
+	 */
+	struct AsyncResolverSocket {
+		int32_t fd4;
+		int32_t fd6;
+		size_t uses;
+		size_t pending;
+	};
+
+	static mutex resolverMutex;
+	static bool resolverStarted = false;
+	static bool resolverIPv4 = false, resolverIPv6 = false;
+	static vector<AsyncResolverSocket> resolverSockets;
+	static vector<struct sockaddr_storage> resolverNameservers;
+	static unordered_map<uint16_t, AsyncResolverPending> resolverPending;
+	static mt19937 resolverRandom;
+
+	// Truncated answers are retried over TCP on a few threads, only the I/O
+	//  thread pushes to the queue, so its size bounds the queries waiting
+	static auto *resolverTCPQueue = new Workers::WorkQueue<function<void()>>();
+
+	static socklen_t addressLength(const struct sockaddr_storage &address) {
+		return address.ss_family == AF_INET6 ? sizeof (struct sockaddr_in6) : sizeof (struct sockaddr_in);
+	}
+
+	static bool sameAddress(const struct sockaddr_storage &a, const struct sockaddr_storage &b) {
+		if (a.ss_family != b.ss_family) return false;
+
+		if (a.ss_family == AF_INET6) {
+			const auto &a6 = reinterpret_cast<const struct sockaddr_in6 &>(a);
+			const auto &b6 = reinterpret_cast<const struct sockaddr_in6 &>(b);
+			return a6.sin6_port == b6.sin6_port && memcmp(&a6.sin6_addr, &b6.sin6_addr, sizeof (a6.sin6_addr)) == 0;
+		}
+
+		const auto &a4 = reinterpret_cast<const struct sockaddr_in &>(a);
+		const auto &b4 = reinterpret_cast<const struct sockaddr_in &>(b);
+		return a4.sin_port == b4.sin_port && a4.sin_addr.s_addr == b4.sin_addr.s_addr;
+	}
+
+	/**
+	 * Opens an UDP socket on an ephemeral port, which the kernel picks
+	 *  at random, so both the ID and the port need to be guessed
+	 */
+	static int32_t openSocket(const int32_t family) {
+		int32_t fd = socket(family, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+		if (fd < 0) throw runtime_error(string("socket() failed: ") + strerror(errno));
+
+		struct sockaddr_storage local;
+		memset(&local, 0, sizeof (local));
+		local.ss_family = family;
+
+		if (bind(fd, reinterpret_cast<struct sockaddr *>(&local), addressLength(local)) < 0) {
+			close(fd);
+			throw runtime_error(string("bind() failed: ") + strerror(errno));
+		}
+
+		return fd;
+	}
+
+	/**
+	 * Opens the sockets for the families of the nameservers, closes
+	 *  the first one again if the second fails
+	 */
+	static AsyncResolverSocket openSockets(void) {
+		AsyncResolverSocket sock = { -1, -1, 0, 0 };
+
+		if (resolverIPv4) sock.fd4 = openSocket(AF_INET);
+		if (resolverIPv6) {
+			try {
+				sock.fd6 = openSocket(AF_INET6);
+			} catch (...) {
+				if (sock.fd4 >= 0) close(sock.fd4);
+				throw;
+			}
+		}
+
+		return sock;
+	}
+
+	static void closeSockets(const AsyncResolverSocket &sock) {
+		if (sock.fd4 >= 0) close(sock.fd4);
+		if (sock.fd6 >= 0) close(sock.fd6);
+	}
+
+	/**
+	 * Checks if the answer came from one of the nameservers the
+	 *  queries are sent to, anything else is ignored
+	 */
+	static bool fromNameserver(const struct sockaddr_storage &from) {
+		for (const struct sockaddr_storage &ns : resolverNameservers) {
+			if (sameAddress(ns, from)) return true;
+		}
+
+		return false;
+	}
+
+	/**
+	 * Checks if the answer belongs to the pending query, the ID and the
+	 *  question must match, so an stray or spoofed packet is ignored
+	 */
+	static bool matchesQuery(const u_char *buffer, const size_t len, const AsyncResolverPending &pending) {
+		if (len < 12) return false;
+
+		DNSHeader header;
+		memcpy(header.d_Buffer, buffer, 12);
+		header.d_BufferULen = 12;
+
+		char id[2];
+		header.getID(id);
+		if (((static_cast<uint8_t>(id[0]) << 8) | static_cast<uint8_t>(id[1])) != pending.id) return false;
+		if (header.getType() || header.getQdCount() != 1) return false;
+
+		char name[NS_MAXDNAME];
+		int32_t nameLen = dn_expand(buffer, buffer + len, buffer + 12, name, sizeof (name));
+		if (nameLen < 0 || static_cast<size_t>(12 + nameLen + 4) > len) return false;
+		if (strcasecmp(name, pending.name.c_str()) != 0) return false;
+
+		const u_char *question = buffer + 12 + nameLen;
+		if (((question[0] << 8) | question[1]) != pending.type) return false;
+		if (((question[2] << 8) | question[3]) != ns_c_in) return false;
+
+		return true;
+	}
+
+	/**
+	 * Sends the pending query to the next nameserver, each retry
+	 *  goes to another one. Requires the mutex to be locked
+	 */
+	static void transmit(AsyncResolverPending &pending) {
+		const struct sockaddr_storage &ns = resolverNameservers[pending.attempts++ % resolverNameservers.size()];
+		const AsyncResolverSocket &sock = resolverSockets[pending.socket];
+
+		pending.deadline = steady_clock::now() + milliseconds(_ASYNC_RESOLVER_TIMEOUT);
+		sendto(ns.ss_family == AF_INET6 ? sock.fd6 : sock.fd4, pending.packet.c_str(), pending.packet.size(), 0,
+			reinterpret_cast<const struct sockaddr *>(&ns), addressLength(ns));
+	}
+
+	/**
+	 * Performs the query over TCP, used when the UDP answer was
+	 *  truncated, each message is prefixed with its length
+	 */
+	static string queryTCP(const struct sockaddr_storage &ns, const string &packet) {
+		int32_t fd = socket(ns.ss_family, SOCK_STREAM, 0);
+		if (fd < 0) throw runtime_error(string("socket() failed: ") + strerror(errno));
+		DEFER(close(fd));
+
+		struct timeval timeout = { _ASYNC_RESOLVER_TIMEOUT / 1000 * 3, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+
+		if (connect(fd, reinterpret_cast<const struct sockaddr *>(&ns), addressLength(ns)) < 0)
+			throw runtime_error(string("connect() failed: ") + strerror(errno));
+
+		string request(2, '\0');
+		request[0] = static_cast<char>(packet.size() >> 8);
+		request[1] = static_cast<char>(packet.size() & 0xFF);
+		request += packet;
+
+		if (send(fd, request.c_str(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size()))
+			throw runtime_error("Could not send TCP query");
+
+		auto readFully = [&](char *buffer, size_t len) {
+			for (size_t off = 0; off < len;) {
+				ssize_t rc = recv(fd, buffer + off, len - off, 0);
+				if (rc <= 0) throw runtime_error("Could not read TCP answer");
+				off += rc;
+			}
+		};
+
+		uint8_t prefix[2];
+		readFully(reinterpret_cast<char *>(prefix), 2);
+
+		string answer((prefix[0] << 8) | prefix[1], '\0');
+		readFully(&answer[0], answer.size());
+		return answer;
+	}
+
+	/**
+	 * Parses the answer, caches it ( also when negative ) and calls
+	 *  the callback with either the records or the error
+	 */
+	static void complete(AsyncResolverPending &pending, const string &answer) {
+		vector<RR> records;
+
+		try {
+			ns_msg msg;
+			if (ns_initparse(reinterpret_cast<const u_char *>(answer.c_str()), answer.size(), &msg) < 0)
+				throw runtime_error("Invalid response");
+
+			int32_t rcode = ns_msg_getflag(msg, ns_f_rcode);
+			if (rcode == ns_r_nxdomain || (rcode == ns_r_noerror && ns_msg_count(msg, ns_s_an) == 0)) {
+				DNSCache::put(pending.key, "", getNegativeTTL(msg));
+				throw NoResults("Query has no results");
+			} else if (rcode != ns_r_noerror) {
+				throw runtime_error("Query failed with rcode " + to_string(rcode) + ": " + pending.name);
+			}
+
+			records = parseAnswers(reinterpret_cast<const u_char *>(answer.c_str()), answer.size());
+
+			uint32_t ttl = numeric_limits<uint32_t>::max();
+			for (const RR &rr : records) ttl = min(ttl, static_cast<uint32_t>(rr.getTTL()));
+			DNSCache::put(pending.key, answer, ttl);
+		} catch (...) {
+			pending.callback(vector<RR>(), current_exception());
+			return;
+		}
+
+		pending.callback(move(records), nullptr);
+	}
+
+	/**
+	 * Receives the answers and handles the timeouts, this runs on
+	 *  its own thread, which is started with the first query
+	 */
+	static void ioThread(void) {
+		u_char buffer[65536];
+
+		for (;;) {
+			vector<AsyncResolverPending> finished, expired;
+			vector<pair<AsyncResolverPending, struct sockaddr_storage>> truncated;
+			vector<struct pollfd> pfds;
+			vector<size_t> pfdSockets;
+
+			// Only this thread replaces the sockets, so the descriptors
+			//  stay valid while polling without the lock
+			{
+				lock_guard<mutex> lock(resolverMutex);
+				for (size_t i = 0; i < resolverSockets.size(); ++i) {
+					for (const int32_t fd : { resolverSockets[i].fd4, resolverSockets[i].fd6 }) {
+						if (fd < 0) continue;
+						pfds.push_back(pollfd { fd, POLLIN, 0 });
+						pfdSockets.push_back(i);
+					}
+				}
+			}
+
+			if (poll(pfds.data(), pfds.size(), 50) > 0) {
+				for (size_t i = 0; i < pfds.size(); ++i) {
+					if (!(pfds[i].revents & POLLIN)) continue;
+
+					struct sockaddr_storage from;
+					socklen_t fromLen = sizeof (from);
+					ssize_t len;
+
+					while ((len = recvfrom(pfds[i].fd, buffer, sizeof (buffer), MSG_DONTWAIT,
+						reinterpret_cast<struct sockaddr *>(&from), &fromLen)) >= 0)
+					{
+						fromLen = sizeof (from);
+						if (len < 12) continue;
+
+						uint16_t key = (buffer[0] << 8) | buffer[1];
+
+						// Only accepts the answer if the question matches, so an
+						//  stray or spoofed packet with the same ID is ignored
+						lock_guard<mutex> lock(resolverMutex);
+						auto it = resolverPending.find(key);
+						if (it == resolverPending.end() || it->second.socket != pfdSockets[i]) continue;
+						if (!fromNameserver(from) || !matchesQuery(buffer, len, it->second)) continue;
+
+						DNSHeader header;
+						memcpy(header.d_Buffer, buffer, 12);
+						header.d_BufferULen = 12;
+
+						// Truncated answers are asked again over TCP, from the server
+						//  which answered, since that one has the full answer
+						--resolverSockets[pfdSockets[i]].pending;
+						if (header.getTruncated()) truncated.push_back(make_pair(move(it->second), from));
+						else {
+							it->second.packet.assign(reinterpret_cast<char *>(buffer), len);
+							finished.push_back(move(it->second));
+						}
+
+						resolverPending.erase(it);
+					}
+				}
+			}
+
+			// Retransmits the queries which have not been answered in time, and
+			//  fails them once all the attempts are used up
+			{
+				lock_guard<mutex> lock(resolverMutex);
+				auto now = steady_clock::now();
+
+				for (auto it = resolverPending.begin(); it != resolverPending.end();) {
+					if (it->second.deadline > now) {
+						++it;
+						continue;
+					}
+
+					if (it->second.attempts < _ASYNC_RESOLVER_ATTEMPTS) {
+						transmit(it->second);
+						++it;
+						continue;
+					}
+
+					--resolverSockets[it->second.socket].pending;
+					expired.push_back(move(it->second));
+					it = resolverPending.erase(it);
+				}
+
+				// Replaces the sockets which have been used enough once they
+				//  are idle, so the source port keeps changing
+				for (AsyncResolverSocket &sock : resolverSockets) {
+					if (sock.uses < _ASYNC_RESOLVER_SOCKET_USES || sock.pending != 0) continue;
+
+					try {
+						AsyncResolverSocket replacement = openSockets();
+						closeSockets(sock);
+						sock = replacement;
+					} catch (const runtime_error &e) {}
+				}
+			}
+
+			// Calls the callbacks outside of the lock, so they may start
+			//  new queries themselves
+			for (AsyncResolverPending &pending : finished) {
+				string answer = move(pending.packet);
+				complete(pending, answer);
+			}
+
+			for (AsyncResolverPending &pending : expired) {
+				pending.callback(vector<RR>(), make_exception_ptr(
+					runtime_error("Query timed out: " + pending.name)));
+			}
+
+			for (auto &entry : truncated) {
+				if (resolverTCPQueue->size() >= _ASYNC_RESOLVER_TCP_QUEUE) {
+					entry.first.callback(vector<RR>(), make_exception_ptr(
+						runtime_error("Too many TCP queries waiting: " + entry.first.name)));
+					continue;
+				}
+
+				auto pending = make_shared<AsyncResolverPending>(move(entry.first));
+				const struct sockaddr_storage ns = entry.second;
+
+				resolverTCPQueue->push([pending, ns]() {
+					try {
+						string answer = queryTCP(ns, pending->packet);
+						if (!matchesQuery(reinterpret_cast<const u_char *>(answer.c_str()), answer.size(), *pending))
+							throw runtime_error("TCP answer does not match the query: " + pending->name);
+
+						complete(*pending, answer);
+					} catch (...) {
+						pending->callback(vector<RR>(), current_exception());
+					}
+				});
+			}
+		}
+	}
+
+	/**
+	 * Creates the sockets, reads the nameservers from the resolver
+	 *  config and starts the I/O thread. Requires the mutex to be locked
+	 */
+	static void start(void) {
+		if (resolverStarted) return;
+
+		Resolver resolver;
+		resolverNameservers = resolver.getNameservers();
+		if (resolverNameservers.empty())
+			throw runtime_error("No nameservers configured");
+
+		for (const struct sockaddr_storage &ns : resolverNameservers) {
+			if (ns.ss_family == AF_INET6) resolverIPv6 = true;
+			else resolverIPv4 = true;
+		}
+
+		random_device device;
+		seed_seq seed { device(), device(), device(), device(), device(), device(), device(), device() };
+		resolverRandom.seed(seed);
+
+		// Closes the sockets we already got if one fails, so the next
+		//  attempt starts clean instead of piling them up
+		try {
+			for (size_t i = 0; i < _ASYNC_RESOLVER_SOCKETS; ++i)
+				resolverSockets.push_back(openSockets());
+		} catch (...) {
+			for (const AsyncResolverSocket &socket : resolverSockets) closeSockets(socket);
+			resolverSockets.clear();
+			throw;
+		}
+
+		resolverStarted = true;
+		thread(ioThread).detach();
+
+		for (size_t i = 0; i < _ASYNC_RESOLVER_TCP_THREADS; ++i) {
+			thread([]() {
+				function<void()> task;
+				milliseconds age;
+
+				for (;;) {
+					if (resolverTCPQueue->pop(task, age, seconds(60))) task();
+				}
+			}).detach();
+		}
+	}
+
+	/**
+	 * Picks an random socket for the next query, preferring the ones
+	 *  which are not waiting to be replaced. Requires the mutex to be locked
+	 */
+	static size_t pickSocket(void) {
+		size_t index = resolverRandom() % resolverSockets.size();
+
+		for (size_t i = 0; i < resolverSockets.size(); ++i) {
+			size_t candidate = (index + i) % resolverSockets.size();
+			if (resolverSockets[candidate].uses < _ASYNC_RESOLVER_SOCKET_USES) return candidate;
+		}
+
+		return index;
+	}
+
+	void AsyncResolver::query(const string &name, const int32_t type, AsyncResolverCallback callback) {
+		const string key = DNSCache::key(name.c_str(), type);
+		string packet;
+
+		// Answers from the cache right away, without touching the network, errors
+		//  go through the callback just like the ones from the I/O thread
+		if (DNSCache::get(key, packet)) {
+			vector<RR> records;
+
+			try {
+				if (packet.empty()) throw NoResults("Query has no results");
+				records = parseAnswers(reinterpret_cast<const u_char *>(packet.c_str()), packet.size());
+			} catch (...) {
+				callback(vector<RR>(), current_exception());
+				return;
+			}
+
+			callback(move(records), nullptr);
+			return;
+		}
+
+		// Builds the packet before registering anything, so an invalid name
+		//  never leaves an pending entry without callback behind
+		try {
+			packet = AsyncResolver::buildQuery(name, type, 0);
+		} catch (...) {
+			callback(vector<RR>(), current_exception());
+			return;
+		}
+
+		// Starts the resolver and picks an random ID which is not in use yet,
+		//  when either fails the callback is called after the lock is released,
+		//  since it may very well start another query
+		unique_lock<mutex> lock(resolverMutex);
+		uint16_t id = 0;
+
+		try {
+			start();
+
+			size_t attempts = 0;
+			do {
+				if (++attempts > _ASYNC_RESOLVER_ID_ATTEMPTS)
+					throw runtime_error("No free query ID, too many queries in flight");
+				id = resolverRandom() & 0xFFFF;
+			} while (resolverPending.find(id) != resolverPending.end());
+		} catch (...) {
+			exception_ptr error = current_exception();
+			lock.unlock();
+
+			callback(vector<RR>(), error);
+			return;
+		}
+
+		// Patches the ID into the already built packet
+
+		packet[0] = static_cast<char>(id >> 8);
+		packet[1] = static_cast<char>(id & 0xFF);
+
+		AsyncResolverPending &pending = resolverPending[id];
+		pending.id = id;
+		pending.key = key;
+		pending.name = name;
+		if (!pending.name.empty() && pending.name.back() == '.') pending.name.pop_back();
+		pending.type = type;
+		pending.packet = move(packet);
+		pending.attempts = 0;
+		pending.socket = pickSocket();
+		pending.callback = callback;
+
+		++resolverSockets[pending.socket].uses;
+		++resolverSockets[pending.socket].pending;
+		transmit(pending);
+	}
+
+	future<vector<RR>> AsyncResolver::query(const string &name, const int32_t type) {
+		auto promise = make_shared<std::promise<vector<RR>>>();
+
+		AsyncResolver::query(name, type, [promise](vector<RR> &&records, exception_ptr error) {
+			if (error) promise->set_exception(error);
+			else promise->set_value(move(records));
+		});
+
+		return promise->get_future();
+	}
+
+	future<vector<RR>> AsyncResolver::resolveA(const string &name) {
+		return AsyncResolver::query(name, ns_t_a);
+	}
+
+	future<vector<RR>> AsyncResolver::resolveAAAA(const string &name) {
+		return AsyncResolver::query(name, ns_t_aaaa);
+	}
+
+	future<vector<RR>> AsyncResolver::resolveMX(const string &name) {
+		return AsyncResolver::query(name, ns_t_mx);
+	}
+
+	future<vector<RR>> AsyncResolver::resolveTXT(const string &name) {
+		return AsyncResolver::query(name, ns_t_txt);
+	}
+
+	future<vector<RR>> AsyncResolver::resolvePTR(const string &address) {
+		return AsyncResolver::query(AsyncResolver::reverseName(address), ns_t_ptr);
+	}
+
+	string AsyncResolver::buildQuery(const string &name, const int32_t type, const uint16_t id) {
+		DNSHeader header;
+		memset(header.d_Buffer, 0, 12);
+
+		char idBuffer[2] = {
+			static_cast<char>(id >> 8), static_cast<char>(id & 0xFF)
+		};
+		header.setID(idBuffer);
+		header.setType(true);
+		header.setRecursionDesired(true);
+		header.setQdCount(1);
+
+		string res(reinterpret_cast<char *>(header.d_Buffer), 12);
+
+		// Writes the name as labels, each prefixed with its length
+		size_t start = 0;
+		while (start < name.size()) {
+			size_t end = name.find('.', start);
+			if (end == string::npos) end = name.size();
+
+			if (end - start == 0 || end - start > 63)
+				throw invalid_argument("Invalid label in name: " + name);
+
+			res += static_cast<char>(end - start);
+			res.append(name, start, end - start);
+			start = end + 1;
+		}
+		res += '\0';
+
+		if (res.size() - 12 > NS_MAXCDNAME)
+			throw invalid_argument("Name too long: " + name);
+
+		res += static_cast<char>(type >> 8);
+		res += static_cast<char>(type & 0xFF);
+		res += static_cast<char>(0);
+		res += static_cast<char>(ns_c_in);
+
+		// Advertises an larger UDP payload, so that TCP is only needed
+		//  for the really large answers
+		vector<u_char> packet(res.begin(), res.end());
+		packet.resize(res.size() + 11);
+		packet.resize(appendEDNS0(packet.data(), res.size(), packet.size()));
+		return string(packet.begin(), packet.end());
+	}
+
+	string AsyncResolver::reverseName(const string &address) {
+		struct in_addr addr4;
+		struct in6_addr addr6;
+		string res;
+
+		if (inet_pton(AF_INET, address.c_str(), &addr4) == 1) {
+			const uint8_t *p = reinterpret_cast<const uint8_t *>(&addr4);
+			for (int32_t i = 3; i >= 0; --i) res += to_string(p[i]) + '.';
+			return res + "in-addr.arpa";
+		}
+
+		if (inet_pton(AF_INET6, address.c_str(), &addr6) == 1) {
+			static const char *hex = "0123456789abcdef";
+			for (int32_t i = 15; i >= 0; --i) {
+				res += hex[addr6.s6_addr[i] & 0x0F];
+				res += '.';
+				res += hex[addr6.s6_addr[i] >> 4];
+				res += '.';
+			}
+			return res + "ip6.arpa";
+		}
+
+		throw invalid_argument("Invalid address: " + address);
+	}
+}
@@ -0,0 +1,54 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <future>
+#include <poll.h>
+
+#include "../default.h"
+#include "Resolver.src.h"
+#include "DNSHeader.src.h"
+#include "DNSCache.src.h"
+#include "../workers/WorkQueue.src.h"
+
+namespace FSMTP::DNS
+{
+	typedef function<void(vector<RR> &&, exception_ptr)> AsyncResolverCallback;
+
+	/**
+	 * Non blocking resolver, queries are sent over an pool of UDP sockets on
+	 *  random ports, and matched to their answer by ID, socket, source and
+	 *  question by an single I/O thread, so any number of queries can be in
+	 *  flight. Truncated answers are retried over TCP on an small pool of
+	 *  threads, to the nameserver which sent them
+	 */
+	class AsyncResolver
+	{
+	public:
+		static void query(const string &name, const int32_t type, AsyncResolverCallback callback);
+		static future<vector<RR>> query(const string &name, const int32_t type);
+
+		static future<vector<RR>> resolveA(const string &name);
+		static future<vector<RR>> resolveAAAA(const string &name);
+		static future<vector<RR>> resolveMX(const string &name);
+		static future<vector<RR>> resolveTXT(const string &name);
+		static future<vector<RR>> resolvePTR(const string &address);
+
+		static string buildQuery(const string &name, const int32_t type, const uint16_t id);
+		static string reverseName(const string &address);
+	};
+}
@@ -0,0 +1,201 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "DNSCache.src.h"
+
+#define _DNS_CACHE_SHARDS 16
+
+namespace FSMTP::DNS
+{
+	struct DNSCacheEntry {
+		string key;
+		string packet;
+		steady_clock::time_point inserted;
+		steady_clock::time_point expires;
+	};
+
+	typedef list<DNSCacheEntry> DNSCacheList;
+
+	struct DNSCacheShard {
+		mutex mtx;
+		DNSCacheList entries;
+		unordered_map<string, DNSCacheList::iterator> index;
+		size_t bytes = 0;
+	};
+
+	static DNSCacheShard cacheShards[_DNS_CACHE_SHARDS];
+	static atomic<size_t> cacheShardMaxBytes(8 * 1024 * 1024 / _DNS_CACHE_SHARDS);
+	static atomic<uint32_t> cacheMaxTTL(86400);
+
+	static atomic<size_t> cacheHits(0);
+	static atomic<size_t> cacheNegativeHits(0);
+	static atomic<size_t> cacheMisses(0);
+	static atomic<size_t> cacheEvictions(0);
+
+	static DNSCacheShard &getShard(const string &key) {
+		return cacheShards[hash<string>()(key) % _DNS_CACHE_SHARDS];
+	}
+
+	/**
+	 * The size an entry takes, the key is counted too, since negative
+	 *  entries have no packet at all
+	 */
+	static size_t entrySize(const DNSCacheEntry &entry) {
+		return entry.key.size() + entry.packet.size() + sizeof (DNSCacheEntry);
+	}
+
+	// Requires the shard to be locked
+	static void erase(DNSCacheShard &shard, DNSCacheList::iterator it) {
+		shard.bytes -= entrySize(*it);
+		shard.index.erase(it->key);
+		shard.entries.erase(it);
+	}
+
+	/**
+	 * Lowers the TTL of the answer and authority records by the time the packet
+	 *  spent in the cache, so the callers which cache the records themselves
+	 *  do not keep them longer than the server allowed. The additional section
+	 *  is left alone, since the TTL of the OPT record holds the EDNS0 flags
+	 */
+	static void ageRecords(string &packet, const uint32_t elapsed) {
+		if (elapsed == 0 || packet.size() < NS_HFIXEDSZ) return;
+
+		u_char *begin = reinterpret_cast<u_char *>(&packet[0]);
+		u_char *end = begin + packet.size();
+		u_char *p = begin + NS_HFIXEDSZ;
+		int32_t len;
+
+		const uint16_t questions = ns_get16(begin + 4);
+		const uint16_t records = ns_get16(begin + 6) + ns_get16(begin + 8);
+
+		for (uint16_t i = 0; i < questions; ++i) {
+			if ((len = dn_skipname(p, end)) < 0 || end - p < len + NS_QFIXEDSZ) return;
+			p += len + NS_QFIXEDSZ;
+		}
+
+		for (uint16_t i = 0; i < records; ++i) {
+			if ((len = dn_skipname(p, end)) < 0 || end - p < len + NS_RRFIXEDSZ) return;
+			p += len;
+
+			const uint32_t ttl = ns_get32(p + 4);
+			ns_put32(ttl > elapsed ? ttl - elapsed : 0, p + 4);
+
+			const uint16_t rdlen = ns_get16(p + 8);
+			if (end - p < NS_RRFIXEDSZ + rdlen) return;
+			p += NS_RRFIXEDSZ + rdlen;
+		}
+	}
+
+	void DNSCache::configure(const size_t maxBytes, const uint32_t maxTTL) {
+		// Configs from before the cache do not have these, so a zero
+		//  keeps the default instead of disabling the cache
+		if (maxBytes > 0) cacheShardMaxBytes = maxBytes / _DNS_CACHE_SHARDS;
+		if (maxTTL > 0) cacheMaxTTL = maxTTL;
+	}
+
+	bool DNSCache::get(const string &key, string &packet) {
+		DNSCacheShard &shard = getShard(key);
+		lock_guard<mutex> lock(shard.mtx);
+
+		auto it = shard.index.find(key);
+		if (it == shard.index.end()) {
+			++cacheMisses;
+			return false;
+		}
+
+		// Removes the entry if the TTL has passed, and reports
+		//  it as an miss, so the caller queries again
+		if (it->second->expires <= steady_clock::now()) {
+			erase(shard, it->second);
+			++cacheMisses;
+			return false;
+		}
+
+		shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+		packet = it->second->packet;
+		ageRecords(packet, duration_cast<seconds>(steady_clock::now() - it->second->inserted).count());
+
+		if (packet.empty()) ++cacheNegativeHits;
+		else ++cacheHits;
+
+		return true;
+	}
+
+	void DNSCache::put(const string &key, const string &packet, uint32_t ttl) {
+		if (ttl > cacheMaxTTL) ttl = cacheMaxTTL;
+		if (ttl == 0) return;
+
+		DNSCacheShard &shard = getShard(key);
+		lock_guard<mutex> lock(shard.mtx);
+
+		auto it = shard.index.find(key);
+		if (it != shard.index.end()) erase(shard, it->second);
+
+		const steady_clock::time_point now = steady_clock::now();
+		shard.entries.push_front(DNSCacheEntry {
+			key, packet, now, now + seconds(ttl)
+		});
+		shard.index[key] = shard.entries.begin();
+		shard.bytes += entrySize(shard.entries.front());
+
+		// Evicts the least recently used entries until the shard
+		//  fits its part of the limit again
+		while (shard.bytes > cacheShardMaxBytes && !shard.entries.empty()) {
+			erase(shard, prev(shard.entries.end()));
+			++cacheEvictions;
+		}
+	}
+
+	void DNSCache::clear(void) {
+		for (DNSCacheShard &shard : cacheShards) {
+			lock_guard<mutex> lock(shard.mtx);
+
+			shard.entries.clear();
+			shard.index.clear();
+			shard.bytes = 0;
+		}
+	}
+
+	string DNSCache::key(const char *name, const int32_t type) {
+		string res;
+
+		// Names are case insensitive, and the trailing dot is optional
+		for (const char *p = name; *p != '\0'; ++p) {
+			res += tolower(static_cast<unsigned char>(*p));
+		}
+		if (!res.empty() && res.back() == '.') res.pop_back();
+
+		res += '/';
+		res += to_string(type);
+		return res;
+	}
+
+	DNSCacheStats DNSCache::getStats(void) {
+		DNSCacheStats stats {
+			cacheHits.load(), cacheNegativeHits.load(), cacheMisses.load(),
+			cacheEvictions.load(), 0, 0
+		};
+
+		for (DNSCacheShard &shard : cacheShards) {
+			lock_guard<mutex> lock(shard.mtx);
+
+			stats.entries += shard.entries.size();
+			stats.bytes += shard.bytes;
+		}
+
+		return stats;
+	}
+}
@@ -0,0 +1,57 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+#include "../default.h"
+
+namespace FSMTP::DNS
+{
+	struct DNSCacheStats {
+		size_t hits;
+		size_t negativeHits;
+		size_t misses;
+		size_t evictions;
+		size_t entries;
+		size_t bytes;
+	};
+
+	/**
+	 * Process wide cache of DNS answers keyed by ( name, type ), the raw
+	 *  answer packet is stored until its TTL expires, an empty packet means
+	 *  the name or type does not exist ( negative caching, RFC 2308 ). The
+	 *  TTLs of returned packets are lowered by the time they were cached. The
+	 *  cache is split into shards, each with its own lock and byte limit
+	 */
+	class DNSCache
+	{
+	public:
+		static void configure(const size_t maxBytes, const uint32_t maxTTL);
+
+		static bool get(const string &key, string &packet);
+		static void put(const string &key, const string &packet, uint32_t ttl);
+		static void clear(void);
+
+		static string key(const char *name, const int32_t type);
+
+		static DNSCacheStats getStats(void);
+	};
+}
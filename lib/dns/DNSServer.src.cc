@@ -16,114 +16,524 @@
 
 #include "DNSServer.src.h"
 
+#include <sys/stat.h>
+#include <poll.h>
+
 namespace FSMTP::DNS
 {
-	DNSServer::DNSServer(const int32_t port):
-		s_Socket(port), s_Run(true), s_Running(false)
+	static std::atomic<bool> dnsServerReloadRequested(false);
+
+	/**
+	 * An TCP connection of the DNS server, the queries and responses are
+	 *  prefixed with their length, and may be pipelined
+	 */
+	struct DNSServerConnection
+	{
+		int32_t c_FD;
+		std::string c_In;
+		std::string c_Out;
+		std::chrono::steady_clock::time_point c_LastActive;
+	};
+
+	/**
+	 * Identifies the version of an file by its inode, size and modification
+	 *  time, an renamed image gets an new inode even within the same second
+	 */
+	static std::string __dnsServerFileVersion(const std::string &path)
 	{
-		// Starts listening
-		this->s_Socket.startAcceptorSync(&this->s_Run, &this->s_Running, 
-			DNSServer::acceptorCallback, this);
+		struct stat st;
+		if (path.empty() || stat(path.c_str(), &st) != 0) return "";
 
-		// Reads the zone file
-		this->s_Domains = readConfig();
+		return std::to_string(st.st_ino) + ':' + std::to_string(st.st_size) + ':'
+			+ std::to_string(st.st_mtim.tv_sec) + '.' + std::to_string(st.st_mtim.tv_nsec);
 	}
 
-	const Domain &DNSServer::findDomain(const std::string &domain)
+	DNSServer::DNSServer(const int32_t port, const std::size_t threads):
+		s_Run(true), s_Queries(0), s_Answers(0), s_Negative(0),
+		s_Refused(0), s_Errors(0)
 	{
-		for (const Domain &dRef : this->s_Domains)
-			if (dRef.d_Domain == domain) return dRef;
-		throw std::runtime_error(EXCEPT_DEBUG("Could not find domain"));
+		auto &config = Global::getConfig();
+		this->s_ZoneFile = config["dns_server"]["zone_file"].asString();
+		this->s_ZoneCompiled = config["dns_server"]["zone_compiled"].asString();
+		if (this->s_ZoneCompiled.empty() && !this->s_ZoneFile.empty())
+			this->s_ZoneCompiled = this->s_ZoneFile + ".bin";
+
+		// Loads the zone, and binds all sockets before starting any worker,
+		//  so an failing bind does not leave threads behind, without an zone
+		//  we start empty, and refuse everything until an reload succeeds
+		this->reload();
+		if (!this->s_Zone) this->s_Zone = Zone::fromDomains({});
+		for (std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i)
+			this->s_Sockets.push_back(std::make_unique<DNSServerSocket>(port));
+		this->s_StreamSocket = std::make_unique<DNSServerSocket>(port, true);
+
+		for (std::unique_ptr<DNSServerSocket> &socket : this->s_Sockets)
+			this->s_Threads.emplace_back(&DNSServer::workerThread, this, socket.get());
+		this->s_Threads.emplace_back(&DNSServer::streamThread, this);
 	}
 
- 	void DNSServer::acceptorCallback(DNSServerSocket *server, void *u)
- 	{
- 		DNSServer &dnsServer = *reinterpret_cast<DNSServer *>(u);
- 		static int32_t clientAddrLen = sizeof(struct sockaddr_in);
- 		DNSHeader request, response;
- 		struct sockaddr_in clientAddr;
- 		int32_t rc;
-
- 		// Reads data from the client, and gets the client address,
- 		// - then we set the length of the buffer
- 		rc = recvfrom(server->s_SocketFD, reinterpret_cast<char *>(request.d_Buffer), 
- 			sizeof(request.d_Buffer), MSG_WAITALL, 
- 			reinterpret_cast<struct sockaddr *>(&clientAddr),
- 			reinterpret_cast<socklen_t *>(&clientAddrLen)
- 		);
- 		request.d_BufferULen = rc;
-
- 		if (rc >= 12)
- 		{
- 			// ================================================
- 			// Prints some stuff
- 			//
- 			// Nothing much
-			// ================================================
-
- 			// Creates the logger, and prints that the client is connected
-		 	char prefix[128];
-		 	sprintf(prefix, "%s:%s", "DNSCB", inet_ntoa(clientAddr.sin_addr));
-		 	Logger logger(prefix, LoggerLevel::INFO);
-		 	logger << "Client connected !" << ENDL;
-
-		 	// Logs the request
-		 	request.log(logger);
-
-			// ================================================
-			// Builds response
-			//
-			// Processes the request, and builds the response
-			// ================================================
-
-			// Parses the questions, TODO: Support multiple query's
-			bool secondQuery;
-			std::size_t answerEndIndex;
-
-			DNSQuestion question;
-			std::tie(secondQuery, answerEndIndex) = question.parse(&request.d_Buffer[12]);
-			
-			question.log(logger);
-
-			// Closes the request, and sets the values
-			// - back to the normal / default ones
-			response.clone(request, answerEndIndex + 12);
-			response.setAA(true);
-			response.setType(false);
-			response.setArCount(0);
-
-			// Reads the zone, so we can check which
-			// - domains we have
+	DNSServer::~DNSServer(void)
+	{
+		this->s_Run = false;
+		for (std::thread &thread : this->s_Threads) thread.join();
+	}
+
+	void DNSServer::setZone(std::shared_ptr<const Zone> zone)
+	{
+		std::atomic_store(&this->s_Zone, zone);
+	}
+
+	void DNSServer::reload(void)
+	{
+		Logger logger("DNSServer", LoggerLevel::INFO);
+		std::lock_guard<std::mutex> lock(this->s_ReloadMutex);
+
+		// Compiles the zone file if the image is missing, or not newer than it, the
+		//  timestamps are coarse so an equal one may still be older, an broken
+		//  zone file leaves the last good image in place
+		struct stat source, image;
+		if (
+			!this->s_ZoneFile.empty() && stat(this->s_ZoneFile.c_str(), &source) == 0 && (
+				stat(this->s_ZoneCompiled.c_str(), &image) != 0 ||
+				image.st_mtim.tv_sec < source.st_mtim.tv_sec ||
+				(image.st_mtim.tv_sec == source.st_mtim.tv_sec && image.st_mtim.tv_nsec <= source.st_mtim.tv_nsec)
+			)
+		)
+		{
 			try {
-				// Gets the domain, and sets the count
-				const Domain &domain = dnsServer.findDomain(question.d_QName);
-				response.setAsCount(domain.d_ARecords.size());
+				logger << "Compiling zone file '" << this->s_ZoneFile << "'" << ENDL;
+				Zone::compile(readZoneFile(this->s_ZoneFile), this->s_ZoneCompiled);
+			} catch (const std::exception &e)
+			{
+				logger << FATAL << "Could not compile zone file: " << e.what() << ENDL << CLASSIC;
+			}
+		}
+
+		try {
+			// Without an image the zones of the config are compiled in memory
+			std::shared_ptr<const Zone> zone = this->s_ZoneCompiled.empty()
+				? Zone::fromDomains(readConfig())
+				: Zone::map(this->s_ZoneCompiled);
+			this->setZone(zone);
+
+			logger << "Loaded zone with " << zone->getNameCount() << " names" << ENDL;
+		} catch (const std::exception &e)
+		{
+			logger << FATAL << "Could not load zone, keeping the current one: " << e.what() << ENDL << CLASSIC;
+		}
+
+		// Also remembers the version after an failure, so an broken file
+		//  is not retried until it changes again
+		this->s_ZoneVersion = __dnsServerFileVersion(this->s_ZoneFile) + '/'
+			+ __dnsServerFileVersion(this->s_ZoneCompiled);
+	}
+
+	bool DNSServer::zoneChanged(void)
+	{
+		std::lock_guard<std::mutex> lock(this->s_ReloadMutex);
+		if (this->s_ZoneCompiled.empty()) return false;
+
+		return this->s_ZoneVersion != __dnsServerFileVersion(this->s_ZoneFile) + '/'
+			+ __dnsServerFileVersion(this->s_ZoneCompiled);
+	}
+
+	void DNSServer::requestReload(void) noexcept
+	{
+		dnsServerReloadRequested = true;
+	}
 
-				// Builds the records and appends them
-				for (const DNSRecord &r : domain.d_ARecords)
+	bool DNSServer::reloadRequested(void) noexcept
+	{
+		return dnsServerReloadRequested.exchange(false);
+	}
+
+	DNSServerStats DNSServer::getStats(void)
+	{
+		return DNSServerStats{
+			this->s_Queries.load(), this->s_Answers.load(), this->s_Negative.load(),
+			this->s_Refused.load(), this->s_Errors.load()
+		};
+	}
+
+	/**
+	 * Builds the response to an query into the response buffer, returns
+	 *  zero if the query must be dropped, the buffer must be able to hold
+	 *  _FSMTP_DNS_SERVER_MAX_RESPONSE bytes, or for TCP queries
+	 *  _FSMTP_DNS_SERVER_MAX_STREAM_RESPONSE bytes
+	 *
+	 * @Param {const Zone &} zone
+	 * @Param {const char *} query
+	 * @Param {const std::size_t} len
+	 * @Param {char *} response
+	 * @Param {DNSServerStats &} stats
+	 * @Param {const bool} stream
+	 * @Return {std::size_t}
+	 */
+	std::size_t DNSServer::handleQuery(const Zone &zone, const char *query,
+		const std::size_t len, char *response, DNSServerStats &stats,
+		const bool stream)
+	{
+		const uint8_t *q = reinterpret_cast<const uint8_t *>(query);
+		uint8_t *r = reinterpret_cast<uint8_t *>(response);
+		++stats.queries;
+
+		// Never answers responses, since that could cause an loop
+		if (len < 12 || (q[2] & 0x80))
+		{
+			++stats.errors;
+			return 0;
+		}
+
+		// Copies the ID, opcode and RD flag, the counts are set at the end
+		auto header = [&](const uint8_t rcode, const bool authoritative,
+			const uint16_t qdCount, const uint16_t anCount, const uint16_t nsCount,
+			const uint16_t arCount)
+		{
+			r[0] = q[0];
+			r[1] = q[1];
+			r[2] = 0x80 | (q[2] & 0x79) | (authoritative ? 0x04 : 0x00);
+			r[3] = rcode;
+			const uint16_t counts[] = { qdCount, anCount, nsCount, arCount };
+			for (std::size_t i = 0; i < 4; ++i)
+			{
+				r[4 + i * 2] = static_cast<uint8_t>(counts[i] >> 8);
+				r[5 + i * 2] = static_cast<uint8_t>(counts[i] & 0xFF);
+			}
+		};
+
+		if (((q[2] >> 3) & 0x0F) != 0)
+		{
+			++stats.errors;
+			header(4, false, 0, 0, 0, 0);
+			return 12;
+		}
+
+		if (q[4] != 0 || q[5] != 1)
+		{
+			++stats.errors;
+			header(1, false, 0, 0, 0, 0);
+			return 12;
+		}
+
+		// Reads the name of the question into its lowercased wire format, which
+		//  is the key in the zone, questions never contain compression pointers
+		char name[256];
+		std::size_t nameLen = 0, i = 12;
+		for (;;)
+		{
+			if (i >= len) break;
+
+			const uint8_t labelLen = q[i];
+			if (labelLen == 0)
+			{
+				name[nameLen++] = '\0';
+				++i;
+				break;
+			}
+
+			if (labelLen > 63 || i + 1 + labelLen > len || nameLen + 1 + labelLen >= 255)
+			{
+				i = len;
+				break;
+			}
+
+			name[nameLen++] = static_cast<char>(labelLen);
+			for (std::size_t j = i + 1; j <= i + labelLen; ++j)
+				name[nameLen++] = static_cast<char>(q[j] >= 'A' && q[j] <= 'Z' ? q[j] | 0x20 : q[j]);
+			i += 1 + labelLen;
+		}
+
+		if (nameLen == 0 || name[nameLen - 1] != '\0' || i + 4 > len)
+		{
+			++stats.errors;
+			header(1, false, 0, 0, 0, 0);
+			return 12;
+		}
+
+		const uint16_t qType = (q[i] << 8) | q[i + 1];
+		const uint16_t qClass = (q[i + 2] << 8) | q[i + 3];
+		const std::size_t questionEnd = i + 4;
+
+		// Checks if the client sent an OPT record, in that case we may send larger
+		//  responses, and have to include our own OPT record, over TCP the
+		//  size is only limited by the length prefix
+		bool edns = false;
+		uint8_t extendedRCode = 0;
+		std::size_t maxSize = stream ? _FSMTP_DNS_SERVER_MAX_STREAM_RESPONSE : 512;
+		if (((q[10] << 8) | q[11]) > 0 && questionEnd + 11 <= len &&
+			q[questionEnd] == 0 && q[questionEnd + 1] == 0 && q[questionEnd + 2] == 41)
+		{
+			edns = true;
+			if (!stream)
+			{
+				maxSize = std::min<std::size_t>(std::max<std::size_t>((q[questionEnd + 3] << 8) | q[questionEnd + 4], 512),
+					_FSMTP_DNS_SERVER_MAX_RESPONSE);
+			}
+			if (q[questionEnd + 6] != 0) extendedRCode = 1;
+		}
+
+		memcpy(response, query, questionEnd);
+		std::size_t responseLen = questionEnd;
+		const std::size_t optLen = edns ? 11 : 0;
+
+		uint8_t rcode = 0;
+		bool authoritative = true, truncated = false;
+		uint16_t anCount = 0, nsCount = 0;
+		if (extendedRCode != 0)
+		{
+			// Unsupported EDNS version, the rcode is BADVERS
+			++stats.errors;
+			authoritative = false;
+		} else if (qClass != 1)
+		{
+			++stats.refused;
+			authoritative = false;
+			rcode = 5;
+		} else
+		{
+			const ZoneLookup lookup = zone.lookup(name, nameLen, qType);
+			switch (lookup.l_Status)
+			{
+				case ZONE_LOOKUP_FOUND:
 				{
-					char ret[256];
-					std::size_t len = r.build(ret);
+					++stats.answers;
+					if (responseLen + lookup.l_RecordsLength + optLen > maxSize)
+					{
+						truncated = true;
+						break;
+					}
 
-					memcpy(&response.d_Buffer[response.d_BufferULen+1], ret, len);
-					response.d_BufferULen += len;
+					memcpy(&response[responseLen], lookup.l_Records, lookup.l_RecordsLength);
+					responseLen += lookup.l_RecordsLength;
+					anCount = lookup.l_Count;
+					break;
 				}
-			} catch (const std::runtime_error &e)
-			{ // TODO: Handle error
+				case ZONE_LOOKUP_NODATA:
+				case ZONE_LOOKUP_NXDOMAIN:
+				{
+					++stats.negative;
+					if (lookup.l_Status == ZONE_LOOKUP_NXDOMAIN) rcode = 3;
+					if (responseLen + lookup.l_SOALength + optLen > maxSize) break;
 
+					memcpy(&response[responseLen], lookup.l_SOA, lookup.l_SOALength);
+					responseLen += lookup.l_SOALength;
+					nsCount = 1;
+					break;
+				}
+				default: case ZONE_LOOKUP_REFUSED:
+				{
+					++stats.refused;
+					authoritative = false;
+					rcode = 5;
+					break;
+				}
+			}
+		}
+
+		header(rcode, authoritative, 1, anCount, nsCount, edns ? 1 : 0);
+		if (truncated) r[2] |= 0x02;
+
+		if (edns)
+		{
+			const uint8_t opt[] = {
+				0x00, 0x00, 41,
+				_FSMTP_DNS_SERVER_MAX_RESPONSE >> 8, _FSMTP_DNS_SERVER_MAX_RESPONSE & 0xFF,
+				extendedRCode, 0x00, 0x00, 0x00,
+				0x00, 0x00
+			};
+			memcpy(&response[responseLen], opt, sizeof (opt));
+			responseLen += sizeof (opt);
+		}
+
+		return responseLen;
+	}
+
+	void DNSServer::workerThread(DNSServerSocket *socket)
+	{
+		struct mmsghdr in[_FSMTP_DNS_SERVER_BATCH], out[_FSMTP_DNS_SERVER_BATCH];
+		struct iovec inVec[_FSMTP_DNS_SERVER_BATCH], outVec[_FSMTP_DNS_SERVER_BATCH];
+		struct sockaddr_in addresses[_FSMTP_DNS_SERVER_BATCH];
+		std::vector<char> queries(_FSMTP_DNS_SERVER_BATCH * _FSMTP_DNS_SERVER_MAX_QUERY);
+		std::vector<char> responses(_FSMTP_DNS_SERVER_BATCH * _FSMTP_DNS_SERVER_MAX_RESPONSE);
+
+		memset(in, 0, sizeof (in));
+		memset(out, 0, sizeof (out));
+		for (std::size_t i = 0; i < _FSMTP_DNS_SERVER_BATCH; ++i)
+		{
+			inVec[i].iov_base = &queries[i * _FSMTP_DNS_SERVER_MAX_QUERY];
+			inVec[i].iov_len = _FSMTP_DNS_SERVER_MAX_QUERY;
+			in[i].msg_hdr.msg_iov = &inVec[i];
+			in[i].msg_hdr.msg_iovlen = 1;
+			in[i].msg_hdr.msg_name = &addresses[i];
+			out[i].msg_hdr.msg_iov = &outVec[i];
+			out[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		while (this->s_Run)
+		{
+			for (std::size_t i = 0; i < _FSMTP_DNS_SERVER_BATCH; ++i)
+				in[i].msg_hdr.msg_namelen = sizeof (struct sockaddr_in);
+
+			// Waits for the first datagram, and takes the ones which are
+			//  already queued with it, the receive timeout makes us check
+			//  if we should stop
+			int32_t received = recvmmsg(socket->s_SocketFD, in, _FSMTP_DNS_SERVER_BATCH, MSG_WAITFORONE, nullptr);
+			if (received <= 0) continue;
+
+			// The zone is loaded once per batch, so it may be replaced while
+			//  we are answering, without locking
+			std::shared_ptr<const Zone> zone = std::atomic_load(&this->s_Zone);
+			DNSServerStats stats = {};
+			std::size_t count = 0;
+			for (int32_t i = 0; i < received; ++i)
+			{
+				if (in[i].msg_hdr.msg_flags & MSG_TRUNC)
+				{
+					++stats.queries;
+					++stats.errors;
+					continue;
+				}
+
+				char *response = &responses[count * _FSMTP_DNS_SERVER_MAX_RESPONSE];
+				std::size_t len = DNSServer::handleQuery(*zone, &queries[i * _FSMTP_DNS_SERVER_MAX_QUERY],
+					in[i].msg_len, response, stats);
+				if (len == 0) continue;
+
+				outVec[count].iov_base = response;
+				outVec[count].iov_len = len;
+				out[count].msg_hdr.msg_name = &addresses[i];
+				out[count].msg_hdr.msg_namelen = in[i].msg_hdr.msg_namelen;
+				++count;
 			}
 
-			// Prints the response
-			logger << " - RESPONSE - " << ENDL;
-			response.log(logger);
+			// Sends the responses, sendmmsg stops at the first failing datagram,
+			//  which we skip so one unreachable client does not drop the rest
+			for (std::size_t sent = 0; sent < count;)
+			{
+				int32_t rc = sendmmsg(socket->s_SocketFD, &out[sent], count - sent, 0);
+				if (rc > 0) sent += rc;
+				else if (errno != EINTR)
+				{
+					++stats.errors;
+					++sent;
+				}
+			}
+
+			this->s_Queries += stats.queries;
+			this->s_Answers += stats.answers;
+			this->s_Negative += stats.negative;
+			this->s_Refused += stats.refused;
+			this->s_Errors += stats.errors;
+		}
+	}
+
+	void DNSServer::streamThread(void)
+	{
+		std::vector<char> response(_FSMTP_DNS_SERVER_MAX_STREAM_RESPONSE);
+		std::vector<DNSServerConnection> connections;
+		char buffer[16384];
+
+		while (this->s_Run)
+		{
+			std::vector<struct pollfd> pfds;
+			pfds.push_back(pollfd { this->s_StreamSocket->s_SocketFD, POLLIN, 0 });
+			for (const DNSServerConnection &connection : connections)
+				pfds.push_back(pollfd { connection.c_FD, static_cast<short>(POLLIN | (connection.c_Out.empty() ? 0 : POLLOUT)), 0 });
+
+			// The timeout makes us check if we should stop, and close
+			//  the idle connections
+			if (poll(pfds.data(), pfds.size(), 200) < 0 && errno != EINTR) continue;
 
-	 		// Writes the response header
-	 		sendto(server->s_SocketFD, response.d_Buffer, 
-	 			response.d_BufferULen, MSG_CONFIRM, 
-	 			reinterpret_cast<struct sockaddr *>(&clientAddr), clientAddrLen);
+			std::shared_ptr<const Zone> zone = std::atomic_load(&this->s_Zone);
+			const auto now = std::chrono::steady_clock::now();
+			DNSServerStats stats = {};
 
- 	 		// Prints that the connection is closed
-	 		logger << "Connection terminated, awaiting next" << ENDL;
- 		}
- 	}
+			// Handles the connections before accepting new ones, since the
+			//  poll results match the current list
+			for (std::size_t i = 0; i < connections.size(); ++i)
+			{
+				DNSServerConnection &connection = connections[i];
+				bool alive = true;
+
+				if (pfds[i + 1].revents & (POLLIN | POLLHUP | POLLERR))
+				{
+					ssize_t rc = recv(connection.c_FD, buffer, sizeof (buffer), MSG_DONTWAIT);
+					if (rc > 0)
+					{
+						connection.c_In.append(buffer, rc);
+						connection.c_LastActive = now;
+					} else if (rc == 0 || (errno != EAGAIN && errno != EINTR)) alive = false;
+				}
+
+				// Answers every complete query, each is prefixed with its length,
+				//  the responses are queued in the same order
+				std::size_t offset = 0;
+				while (alive && connection.c_In.size() - offset >= 2)
+				{
+					const uint8_t *prefix = reinterpret_cast<const uint8_t *>(&connection.c_In[offset]);
+					const std::size_t len = (prefix[0] << 8) | prefix[1];
+					if (connection.c_In.size() - offset - 2 < len) break;
+
+					std::size_t responseLen = DNSServer::handleQuery(*zone, &connection.c_In[offset + 2],
+						len, response.data(), stats, true);
+					offset += 2 + len;
+					if (responseLen == 0) continue;
+
+					connection.c_Out += static_cast<char>(responseLen >> 8);
+					connection.c_Out += static_cast<char>(responseLen & 0xFF);
+					connection.c_Out.append(response.data(), responseLen);
+				}
+				connection.c_In.erase(0, offset);
+
+				if (alive && !connection.c_Out.empty())
+				{
+					ssize_t rc = send(connection.c_FD, connection.c_Out.data(), connection.c_Out.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+					if (rc > 0)
+					{
+						connection.c_Out.erase(0, rc);
+						connection.c_LastActive = now;
+					} else if (rc < 0 && errno != EAGAIN && errno != EINTR) alive = false;
+				}
+
+				if (now - connection.c_LastActive > std::chrono::milliseconds(_FSMTP_DNS_SERVER_IDLE_TIMEOUT))
+					alive = false;
+
+				if (!alive)
+				{
+					close(connection.c_FD);
+					connection.c_FD = -1;
+				}
+			}
+
+			connections.erase(std::remove_if(connections.begin(), connections.end(), [](const DNSServerConnection &connection) {
+				return connection.c_FD < 0;
+			}), connections.end());
+
+			// Accepts the new connections, the ones over the limit are
+			//  closed right away, so a flood can not exhaust the descriptors
+			if (pfds[0].revents & POLLIN)
+			{
+				int32_t fd;
+				while ((fd = accept4(this->s_StreamSocket->s_SocketFD, nullptr, nullptr, SOCK_NONBLOCK)) >= 0)
+				{
+					if (connections.size() >= _FSMTP_DNS_SERVER_MAX_CONNECTIONS)
+					{
+						++stats.errors;
+						close(fd);
+						continue;
+					}
+
+					connections.push_back(DNSServerConnection { fd, "", "", now });
+				}
+			}
+
+			this->s_Queries += stats.queries;
+			this->s_Answers += stats.answers;
+			this->s_Negative += stats.negative;
+			this->s_Refused += stats.refused;
+			this->s_Errors += stats.errors;
+		}
+
+		for (DNSServerConnection &connection : connections) close(connection.c_FD);
+	}
 }
@@ -21,20 +21,99 @@
 #include "DNSHeader.src.h"
 #include "DNSZone.src.h"
 
+// The largest datagram we accept and send, larger responses are truncated
+//  so the client retries over TCP, the latter is the advised EDNS size
+#define _FSMTP_DNS_SERVER_MAX_QUERY 512
+#define _FSMTP_DNS_SERVER_MAX_RESPONSE 1232
+#define _FSMTP_DNS_SERVER_BATCH 32
+
+// Responses over TCP are only limited by their length prefix, idle and
+//  surplus connections are closed ( RFC 7766 )
+#define _FSMTP_DNS_SERVER_MAX_STREAM_RESPONSE 65535
+#define _FSMTP_DNS_SERVER_MAX_CONNECTIONS 256
+#define _FSMTP_DNS_SERVER_IDLE_TIMEOUT 10000
+
 namespace FSMTP::DNS
 {
+	struct DNSServerStats
+	{
+		std::size_t queries;
+		std::size_t answers;
+		std::size_t negative;
+		std::size_t refused;
+		std::size_t errors;
+	};
+
+	/**
+	 * Authoritative DNS server for the zones of the config, each worker
+	 *  thread receives and sends the datagrams in batches on its own socket,
+	 *  an extra thread serves TCP, for the answers which did not fit.
+	 *  The zone is either compiled from the config, or mapped from an image
+	 *  which is compiled from the zone file, and swapped when either changes
+	 */
 	class DNSServer
 	{
 	public:
-		DNSServer(const int32_t port);
+		DNSServer(const int32_t port, const std::size_t threads = 1);
+		~DNSServer(void);
+
+		/**
+		 * Replaces the zone, the workers pick it up at their next batch
+		 */
+		void setZone(std::shared_ptr<const Zone> zone);
 
-		static void acceptorCallback(DNSServerSocket *server, void *u);
+		/**
+		 * Recompiles the zone file if it is newer than its image, and maps
+		 *  the image, if anything fails the current zone is kept
+		 */
+		void reload(void);
 
-		const Domain &findDomain(const std::string &domain);
+		/**
+		 * Checks if the zone file or image changed since the last reload
+		 */
+		bool zoneChanged(void);
+
+		static void requestReload(void) noexcept;
+		static bool reloadRequested(void) noexcept;
+
+		DNSServerStats getStats(void);
+
+		/**
+		 * Builds the response to an query into the response buffer, returns
+		 *  zero if the query must be dropped, the buffer must be able to hold
+		 *  _FSMTP_DNS_SERVER_MAX_RESPONSE bytes, or for TCP queries
+		 *  _FSMTP_DNS_SERVER_MAX_STREAM_RESPONSE bytes
+		 *
+		 * @Param {const Zone &} zone
+		 * @Param {const char *} query
+		 * @Param {const std::size_t} len
+		 * @Param {char *} response
+		 * @Param {DNSServerStats &} stats
+		 * @Param {const bool} stream
+		 * @Return {std::size_t}
+		 */
+		static std::size_t handleQuery(const Zone &zone, const char *query,
+			const std::size_t len, char *response, DNSServerStats &stats,
+			const bool stream = false);
 	private:
-		DNSServerSocket s_Socket;
+		void workerThread(DNSServerSocket *socket);
+		void streamThread(void);
+
+		std::vector<std::unique_ptr<DNSServerSocket>> s_Sockets;
+		std::unique_ptr<DNSServerSocket> s_StreamSocket;
+		std::vector<std::thread> s_Threads;
 		std::atomic<bool> s_Run;
-		std::atomic<bool> s_Running;
-		std::vector<Domain> s_Domains;
+		std::shared_ptr<const Zone> s_Zone;
+
+		std::mutex s_ReloadMutex;
+		std::string s_ZoneFile;
+		std::string s_ZoneCompiled;
+		std::string s_ZoneVersion;
+
+		std::atomic<std::size_t> s_Queries;
+		std::atomic<std::size_t> s_Answers;
+		std::atomic<std::size_t> s_Negative;
+		std::atomic<std::size_t> s_Refused;
+		std::atomic<std::size_t> s_Errors;
 	};
-}
\ No newline at end of file
+}
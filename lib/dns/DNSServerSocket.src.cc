@@ -18,8 +18,7 @@
 
 namespace FSMTP::DNS
 {
-	DNSServerSocket::DNSServerSocket(const int32_t port):
-		s_Logger("DNSServerSock", LoggerLevel::INFO)
+	DNSServerSocket::DNSServerSocket(const int32_t port, const bool stream)
 	{
 		int32_t rc;
 
@@ -30,7 +29,7 @@ namespace FSMTP::DNS
 		this->s_SocketAddr.sin_port = htons(port);
 
 		// Creates the socket and checks for errors
-		this->s_SocketFD = socket(AF_INET, SOCK_DGRAM, 0x0);
+		this->s_SocketFD = socket(AF_INET, stream ? SOCK_STREAM | SOCK_NONBLOCK : SOCK_DGRAM, 0x0);
 		if (this->s_SocketFD < 0)
 		{
 			std::string error = "socket() failed: ";
@@ -38,13 +37,20 @@ namespace FSMTP::DNS
 			throw runtime_error(error);
 		}
 
-		// Sets the socket to reuse the old address
+		// Sets the socket to reuse the old address, and allows the other
+		//  workers to bind the same port, an timeout on receiving makes the
+		//  workers check if they should stop
 		int32_t opt = 0x1;
-		rc = setsockopt(this->s_SocketFD, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char *>(&opt), sizeof (opt));
-		if (rc < 0)
+		struct timeval timeout = { 0, 200000 };
+		if (
+			setsockopt(this->s_SocketFD, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<char *>(&opt), sizeof (opt)) < 0 ||
+			setsockopt(this->s_SocketFD, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<char *>(&opt), sizeof (opt)) < 0 ||
+			setsockopt(this->s_SocketFD, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<char *>(&timeout), sizeof (timeout)) < 0
+		)
 		{
 			std::string error = "setsockopt() failed: ";
-			error += strerror(rc);
+			error += strerror(errno);
+			close(this->s_SocketFD);
 			throw std::runtime_error(error);
 		}
 
@@ -58,40 +64,21 @@ namespace FSMTP::DNS
 		{
 			std::string error = "bind() failed: ";
 			error += strerror(errno);
+			close(this->s_SocketFD);
 			throw runtime_error(error);
 		}
-	}
-
-	void DNSServerSocket::startAcceptorSync(
-		std::atomic<bool> *run,
-		std::atomic<bool> *running,
-		const std::function<void(DNSServerSocket *, void *)> cb,
-		void *u
-	)
-	{
-		// Creates the thread and detaches
-		std::thread t(&DNSServerSocket::syncAcceptorThread, this, 
-			run, running, cb, u);
-		t.detach();
-	}
 
-	void DNSServerSocket::syncAcceptorThread(
-		std::atomic<bool> *run,
-		std::atomic<bool> *running,
-		const std::function<void(DNSServerSocket *, void *)> cb,
-		void *u
-	)
-	{
-		// Sets running to true, and loops while we're saying
-		// - it should
-		*running = true;
-		while (*run == true)
+		if (stream && listen(this->s_SocketFD, 128) < 0)
 		{
-			cb(this, u);
+			std::string error = "listen() failed: ";
+			error += strerror(errno);
+			close(this->s_SocketFD);
+			throw runtime_error(error);
 		}
+	}
 
-		// Sets running to false, and gives a short delay
-		*running = false;
-		std::this_thread::sleep_for(std::chrono::milliseconds(120));
+	DNSServerSocket::~DNSServerSocket(void)
+	{
+		close(this->s_SocketFD);
 	}
-}
\ No newline at end of file
+}
@@ -20,27 +20,18 @@
 
 namespace FSMTP::DNS
 {
+	/**
+	 * An UDP socket of the DNS server, each worker thread has its own
+	 *  socket bound with SO_REUSEPORT, so the kernel spreads the
+	 *  queries over the workers, or the non blocking TCP listener
+	 */
 	class DNSServerSocket
 	{
 	public:
-		DNSServerSocket(const int32_t port);
-
-		void startAcceptorSync(
-			std::atomic<bool> *run,
-			std::atomic<bool> *running,
-			const std::function<void(DNSServerSocket *, void *)> cb,
-			void *u
-		);
-
-		void syncAcceptorThread(
-			std::atomic<bool> *run,
-			std::atomic<bool> *running,
-			const std::function<void(DNSServerSocket *, void *)> cb,
-			void *u
-		);
+		DNSServerSocket(const int32_t port, const bool stream = false);
+		~DNSServerSocket(void);
 
 		int32_t s_SocketFD;
 		struct sockaddr_in s_SocketAddr;
-		Logger s_Logger;
 	};
-}
\ No newline at end of file
+}
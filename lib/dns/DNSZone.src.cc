@@ -1,14 +1,85 @@
 #include "DNSZone.src.h"
 
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 namespace FSMTP::DNS
 {
+	/**
+	 * Appends an integer in network byte order
+	 */
+	static void __zoneAppend16(std::string &ret, const uint16_t value)
+	{
+		ret += static_cast<char>(value >> 8);
+		ret += static_cast<char>(value & 0xFF);
+	}
+
+	static void __zoneAppend32(std::string &ret, const uint32_t value)
+	{
+		__zoneAppend16(ret, static_cast<uint16_t>(value >> 16));
+		__zoneAppend16(ret, static_cast<uint16_t>(value & 0xFFFF));
+	}
+
+	/**
+	 * Appends the type, class, TTL and data of an record, the owner
+	 *  must already be in the buffer
+	 */
+	static void __zoneAppendRecord(std::string &ret, const uint16_t type,
+		const uint16_t cls, const uint32_t ttl, const std::string &data)
+	{
+		if (data.size() > 0xFFFF)
+			throw std::runtime_error(EXCEPT_DEBUG("Record data exceeds 65535 bytes"));
+
+		__zoneAppend16(ret, type);
+		__zoneAppend16(ret, cls);
+		__zoneAppend32(ret, ttl);
+		__zoneAppend16(ret, static_cast<uint16_t>(data.size()));
+		ret += data;
+	}
+
+	/**
+	 * Encodes an domain name into its wire format, an sequence of
+	 *  length prefixed labels terminated by the root label
+	 *
+	 * @Param {const std::string &} name
+	 * @Return {std::string}
+	 */
+	std::string encodeDomainName(const std::string &name)
+	{
+		std::string ret;
+		std::size_t start = 0, end = name.size();
+
+		// Ignores the trailing dot of an fully qualified name
+		if (end > 0 && name[end - 1] == '.') --end;
+
+		while (start < end)
+		{
+			std::size_t dot = name.find('.', start);
+			if (dot == std::string::npos || dot > end) dot = end;
+
+			if (dot == start || dot - start > 63)
+				throw std::runtime_error(EXCEPT_DEBUG("Invalid label in domain name: " + name));
+
+			ret += static_cast<char>(dot - start);
+			ret.append(name, start, dot - start);
+			start = dot + 1;
+		}
+
+		ret += '\0';
+		if (ret.size() > 255)
+			throw std::runtime_error(EXCEPT_DEBUG("Domain name exceeds 255 bytes: " + name));
+
+		return ret;
+	}
+
 	/**
 	 * Default empty constructor for domain
 	 *
 	 * @Param {void}
 	 * @Return {void}
 	 */
-	Domain::Domain(void)
+	Domain::Domain(void):
+		d_MinimumTTL(300)
 	{}
 
 	/**
@@ -20,24 +91,32 @@ namespace FSMTP::DNS
 	void Domain::log(Logger &logger)
 	{
 		logger << DEBUG;
-
 		logger << "[Domain]: " << ENDL;
 		logger << "- Domain: " << this->d_Domain << ENDL;
-		logger << "- Records[type: A, len: " << this->d_ARecords.size() << "]: " << ENDL;
-		for (const DNSRecord &record : this->d_ARecords)
+		logger << "- Records[len: " << this->d_Records.size() << "]: " << ENDL;
+		for (const DNSRecord &record : this->d_Records)
 		{
-			logger << "\tRecord[type: A]: " << ENDL;
+			logger << "\tRecord[type: " << responseRecordTypeToInt(record.r_Type) << "]: " << ENDL;
 			logger << "\t- Data: " << record.r_Data << ENDL;
 			logger << "\t- DataLen: " << record.r_Data.size() << ENDL;
 			logger << "\t- Root: " << record.r_Root << ENDL;
 			logger << "\t- TTL: " << record.r_TTL << ENDL;
 			logger << "\t- Class: " << record.r_Class << ENDL;
-			logger << "\t- Type: " << record.r_Type << ENDL;
 		}
-
 		logger << CLASSIC;
 	}
 
+	/**
+	 * Default empty constructor of an record
+	 *
+	 * @Param {void}
+	 * @Return {void}
+	 */
+	DNSRecord::DNSRecord(void):
+		r_TTL(0), r_Type(ResponseRecordType::REC_TYPE_UNKNOWN),
+		r_Class(QueryClass::QUERY_CLASS_INTERNET), r_Priority(0)
+	{}
+
 	/**
 	 * The constructor for an record
 	 *
@@ -46,63 +125,84 @@ namespace FSMTP::DNS
 	 * @Param {const int32_t} r_TTL,
 	 * @Param {const ResponseRecordType} r_Type
 	 * @Param {const QueryClass r_Class}
+	 * @Param {const uint16_t} r_Priority
 	 * @Return {void}
 	 */
 	DNSRecord::DNSRecord(const std::string &r_Data, const std::string &r_Root,
-		const int32_t r_TTL, const ResponseRecordType r_Type, 
-		const QueryClass r_Class):
+		const int32_t r_TTL, const ResponseRecordType r_Type,
+		const QueryClass r_Class, const uint16_t r_Priority):
 		r_Data(r_Data), r_Root(r_Root), r_TTL(r_TTL), r_Type(r_Type),
-		r_Class(r_Class)
+		r_Class(r_Class), r_Priority(r_Priority)
 	{}
 
 	/**
-	 * Builds an response record
+	 * Builds an record in wire format without its owner name, since
+	 *  that depends on where in the response the record is placed
 	 *
-	 * @Param {char *} ret
-	 * @Return {std::size_t}
+	 * @Param {void}
+	 * @Return {std::string}
 	 */
-	std::size_t DNSRecord::build(char *ret) const
+	std::string DNSRecord::build(void) const
 	{
-		std::size_t retIndex = 0;
+		std::string data;
 
-		// Adds the query index
-		int16_t namePtr = 0b1100000000000000;
-		namePtr |= htons(12);
-		memcpy(reinterpret_cast<void *>(&ret[retIndex]), &namePtr, sizeof (uint16_t));
-		retIndex += sizeof (uint16_t);
-
-		// Sets the record type
-		int16_t recordTypeCode = htons(responseRecordTypeToInt(this->r_Type));
-		memcpy(reinterpret_cast<void *>(&ret[retIndex]), &recordTypeCode, sizeof (int16_t));
-		retIndex += sizeof (int16_t);
-
-		// Sets the record class
-		int16_t recordClassCode = htons(queryClassToInt(this->r_Class));
-		memcpy(reinterpret_cast<void *>(&ret[retIndex]), &recordClassCode, sizeof (int16_t));
-		retIndex += sizeof (int16_t);
-
-		// Adds the TTL
-		uint32_t ttl = htons(this->r_TTL);
-		memcpy(reinterpret_cast<void *>(&ret[retIndex]), &ttl, sizeof (uint32_t));
-		retIndex += sizeof (uint32_t);
+		switch (this->r_Type)
+		{
+			case ResponseRecordType::REC_TYPE_A:
+			case ResponseRecordType::REC_TYPE_AAAA:
+			{
+				const int32_t family = this->r_Type == ResponseRecordType::REC_TYPE_A ? AF_INET : AF_INET6;
+				char address[16];
 
-		// Adds the RD len
-		uint16_t dataLen = htons(4);
-		memcpy(reinterpret_cast<void *>(&ret[retIndex]), &dataLen, sizeof (uint16_t));
-		retIndex += sizeof (uint16_t);
+				if (inet_pton(family, this->r_Data.c_str(), address) != 1)
+					throw std::runtime_error(EXCEPT_DEBUG("Invalid address: " + this->r_Data));
 
-		// Adds the address, and splits it on the dots
-		std::stringstream s(this->r_Data);
-		std::string tok;
-		while (std::getline(s, tok, '.'))
-		{
-			int addrNumInt = std::atoi(tok.c_str());
-			uint8_t addrNum = static_cast<uint8_t>(addrNumInt);
-			memcpy(reinterpret_cast<void *>(&ret[retIndex]), &addrNum, 1);
-			retIndex++;
+				data.assign(address, family == AF_INET ? 4 : 16);
+				break;
+			}
+			case ResponseRecordType::REC_TYPE_MX:
+			{
+				__zoneAppend16(data, this->r_Priority);
+				data += encodeDomainName(this->r_Data);
+				break;
+			}
+			case ResponseRecordType::REC_TYPE_CNAME:
+			{
+				data = encodeDomainName(this->r_Data);
+				break;
+			}
+			case ResponseRecordType::REC_TYPE_TXT:
+			{
+				// Splits the text into character strings of at most 255 bytes, an
+				//  empty text still gets an single empty string
+				std::size_t i = 0;
+				do {
+					const std::size_t len = std::min<std::size_t>(this->r_Data.size() - i, 255);
+					data += static_cast<char>(len);
+					data.append(this->r_Data, i, len);
+					i += len;
+				} while (i < this->r_Data.size());
+				break;
+			}
+			default: throw std::runtime_error(EXCEPT_DEBUG("Unsupported record type"));
 		}
 
-		return retIndex;
+		std::string ret;
+		__zoneAppendRecord(ret, responseRecordTypeToInt(this->r_Type),
+			queryClassToInt(this->r_Class), this->r_TTL, data);
+		return ret;
+	}
+
+	/**
+	 * Gets the owner name of the record, relative to the domain
+	 *
+	 * @Param {const std::string &} domain
+	 * @Return {std::string}
+	 */
+	std::string DNSRecord::getOwner(const std::string &domain) const
+	{
+		if (this->r_Root.empty() || this->r_Root == "@") return domain;
+		return this->r_Root + '.' + domain;
 	}
 
 	/**
@@ -115,11 +215,12 @@ namespace FSMTP::DNS
 	{
 		switch (type)
 		{
-			case ResponseRecordType::REC_TYPE_A: return 0;
-			case ResponseRecordType::REC_TYPE_AAAA: return 18;
+			case ResponseRecordType::REC_TYPE_A: return 1;
+			case ResponseRecordType::REC_TYPE_AAAA: return 28;
 			case ResponseRecordType::REC_TYPE_MX: return 15;
 			case ResponseRecordType::REC_TYPE_SOA: return 6;
 			case ResponseRecordType::REC_TYPE_TXT: return 16;
+			case ResponseRecordType::REC_TYPE_CNAME: return 5;
 			default: case ResponseRecordType::REC_TYPE_UNKNOWN: return 255;
 		}
 	}
@@ -132,38 +233,520 @@ namespace FSMTP::DNS
 	 */
 	std::vector<Domain> readConfig(void)
 	{
-		auto &conf = Global::getConfig();
+		return readDomains(Global::getConfig()["zone"]);
+	}
 
+	/**
+	 * Reads the domains from an JSON array, in the format of the
+	 *  zone in the config
+	 *
+	 * @Param {const Json::Value &} zones
+	 * @Return {std::vector<Domain>}
+	 */
+	std::vector<Domain> readDomains(const Json::Value &zones)
+	{
 		Logger logger("DNSCFG", LoggerLevel::INFO);
 		std::vector<Domain> result = {};
+		std::size_t records = 0;
+
+		const std::pair<const char *, ResponseRecordType> types[] = {
+			{ "a", ResponseRecordType::REC_TYPE_A },
+			{ "aaaa", ResponseRecordType::REC_TYPE_AAAA },
+			{ "mx", ResponseRecordType::REC_TYPE_MX },
+			{ "txt", ResponseRecordType::REC_TYPE_TXT },
+			{ "cname", ResponseRecordType::REC_TYPE_CNAME }
+		};
 
-		// Starts reading the zones
-		logger << "Reading configuration zones ..." << ENDL;
 		Json::Value defaultValue;
-		for (std::size_t i = 0; i < conf["zone"].size(); i++)
+		for (Json::ArrayIndex i = 0; i < zones.size(); i++)
 		{
-			Json::Value val = conf["zone"].get(i, defaultValue);
+			Json::Value val = zones.get(i, defaultValue);
 			Domain domain;
 			domain.d_Domain = val["domain"].asString();
+			domain.d_MName = val["soa"].get("mname", domain.d_Domain).asString();
+			domain.d_RName = val["soa"].get("rname", "hostmaster." + domain.d_Domain).asString();
+			domain.d_MinimumTTL = val["soa"].get("minimum", 300).asInt();
 
-			// Gets the records
-			for (std::size_t j = 0; j < val["records"]["a"].size(); j++)
+			// Gets the records of each type
+			for (const auto &type : types)
 			{
-				Json::Value record = val["records"]["a"].get(j, defaultValue);
-				domain.d_ARecords.push_back(DNSRecord(
-					record["record_data"].asString(),
-					record["record_root"].asString(),
-					record["record_ttl"].asInt(),
-					ResponseRecordType::REC_TYPE_A,
-					QueryClass::QUERY_CLASS_INTERNET
-				));
+				const Json::Value &records = val["records"][type.first];
+				for (Json::ArrayIndex j = 0; j < records.size(); j++)
+				{
+					Json::Value record = records.get(j, defaultValue);
+					domain.d_Records.push_back(DNSRecord(
+						record["record_data"].asString(),
+						record["record_root"].asString(),
+						record["record_ttl"].asInt(),
+						type.second,
+						QueryClass::QUERY_CLASS_INTERNET,
+						static_cast<uint16_t>(record["record_priority"].asUInt())
+					));
+				}
 			}
 
-			// Prints the domain, and pushes it to the result
-			domain.log(logger);
+			records += domain.d_Records.size();
 			result.push_back(domain);
 		}
 
+		logger << "Read " << result.size() << " domains with " << records << " records" << ENDL;
 		return result;
 	}
-}
\ No newline at end of file
+
+	/**
+	 * Reads an zone file, which contains the JSON array of domains
+	 *
+	 * @Param {const std::string &} path
+	 * @Return {std::vector<Domain>}
+	 */
+	std::vector<Domain> readZoneFile(const std::string &path)
+	{
+		std::ifstream stream(path);
+		if (!stream.is_open())
+			throw std::runtime_error(EXCEPT_DEBUG("Could not open zone file: '" + path + '\''));
+
+		Json::Value zones;
+		Json::CharReaderBuilder builder;
+		std::string errors;
+		if (!Json::parseFromStream(builder, stream, &zones, &errors) || !zones.isArray())
+			throw std::runtime_error(EXCEPT_DEBUG("Invalid zone file '" + path + "': " + errors));
+
+		return readDomains(zones);
+	}
+
+	// ==================================
+	// Compiling
+	// ==================================
+
+	static uint32_t __zoneHash(const char *name, const std::size_t len)
+	{
+		uint32_t hash = 2166136261u;
+		for (std::size_t i = 0; i < len; ++i)
+		{
+			hash ^= static_cast<uint8_t>(name[i]);
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	struct ZoneBuildNode
+	{
+		std::vector<std::pair<uint16_t, std::vector<std::string>>> answers;
+		std::string target;
+		std::size_t soa;
+	};
+
+	static std::vector<std::string> *__zoneBuildAnswer(ZoneBuildNode &node, const uint16_t type)
+	{
+		for (auto &answer : node.answers)
+			if (answer.first == type) return &answer.second;
+		return nullptr;
+	}
+
+	/**
+	 * Builds the image of the domains, the records of an name are stored
+	 *  with an pointer to the question as owner, and an CNAME is followed
+	 *  within the zone for each type its target has
+	 */
+	static std::string __zoneBuildImage(const std::vector<Domain> &domains)
+	{
+		Logger logger("DNSZone", LoggerLevel::INFO);
+		std::unordered_map<std::string, ZoneBuildNode> nodes;
+		std::vector<std::string> soas;
+
+		const uint16_t cnameType = responseRecordTypeToInt(ResponseRecordType::REC_TYPE_CNAME);
+		for (const Domain &domain : domains)
+		{
+			std::string apex;
+			try {
+				apex = encodeDomainName(domain.d_Domain);
+				std::transform(apex.begin(), apex.end(), apex.begin(), ::tolower);
+			} catch (const std::runtime_error &e)
+			{
+				logger << WARN << "Skipping domain: " << e.what() << ENDL << CLASSIC;
+				continue;
+			}
+
+			// Creates the apex with its SOA record, which is sent in the authority
+			//  section of negative answers, so resolvers may cache them
+			auto apexNode = nodes.find(apex);
+			if (apexNode == nodes.end() || soas[apexNode->second.soa].compare(0, apex.size(), apex) != 0)
+			{
+				std::string soa = apex, data;
+				try {
+					data += encodeDomainName(domain.d_MName);
+					data += encodeDomainName(domain.d_RName);
+				} catch (const std::runtime_error &e)
+				{
+					logger << WARN << "Skipping domain " << domain.d_Domain << ", invalid SOA: " << e.what() << ENDL << CLASSIC;
+					continue;
+				}
+
+				__zoneAppend32(data, static_cast<uint32_t>(time(nullptr)));
+				__zoneAppend32(data, 3600);
+				__zoneAppend32(data, 600);
+				__zoneAppend32(data, 604800);
+				__zoneAppend32(data, domain.d_MinimumTTL);
+				__zoneAppendRecord(soa, responseRecordTypeToInt(ResponseRecordType::REC_TYPE_SOA),
+					queryClassToInt(QueryClass::QUERY_CLASS_INTERNET), domain.d_MinimumTTL, data);
+
+				soas.push_back(soa);
+				nodes[apex].soa = soas.size() - 1;
+			}
+			const std::size_t soaIndex = nodes[apex].soa;
+
+			for (const DNSRecord &record : domain.d_Records)
+			{
+				std::string owner, wire;
+				try {
+					owner = encodeDomainName(record.getOwner(domain.d_Domain));
+					std::transform(owner.begin(), owner.end(), owner.begin(), ::tolower);
+					wire = record.build();
+				} catch (const std::runtime_error &e)
+				{
+					logger << WARN << "Skipping record of " << domain.d_Domain << ": " << e.what() << ENDL << CLASSIC;
+					continue;
+				}
+
+				// Creates the names between the owner and the apex as well, so
+				//  an query for them gets NODATA instead of NXDOMAIN
+				for (std::size_t i = 0; i + apex.size() <= owner.size(); i += static_cast<uint8_t>(owner[i]) + 1)
+				{
+					if (owner.compare(i, std::string::npos, apex) == 0) break;
+					nodes.emplace(owner.substr(i), ZoneBuildNode{ {}, "", soaIndex });
+				}
+
+				// An name with an CNAME may not have any other records, not even
+				//  another CNAME
+				const uint16_t type = responseRecordTypeToInt(record.r_Type);
+				ZoneBuildNode &node = nodes[owner];
+				if (
+					(type == cnameType && !node.answers.empty()) ||
+					(type != cnameType && !node.target.empty())
+				)
+				{
+					logger << WARN << "Skipping record of " << domain.d_Domain << ": '"
+						<< record.getOwner(domain.d_Domain) << "' already has an CNAME or other records" << ENDL << CLASSIC;
+					continue;
+				}
+
+				if (type == cnameType)
+				{
+					node.target = encodeDomainName(record.r_Data);
+					std::transform(node.target.begin(), node.target.end(), node.target.begin(), ::tolower);
+				}
+
+				std::vector<std::string> *answer = __zoneBuildAnswer(node, type);
+				if (!answer)
+				{
+					node.answers.push_back(std::make_pair(type, std::vector<std::string>()));
+					answer = &node.answers.back().second;
+				}
+				answer->push_back(wire);
+			}
+		}
+
+		// ==================================
+		// Serializes the nodes
+		// ==================================
+
+		std::vector<ZoneFileNode> fileNodes;
+		std::vector<ZoneFileAnswer> fileAnswers;
+		std::vector<uint32_t> soaOffsets;
+		std::string data;
+
+		for (const std::string &soa : soas)
+		{
+			soaOffsets.push_back(static_cast<uint32_t>(data.size()));
+			data += soa;
+		}
+
+		auto addAnswer = [&](const uint16_t type, const uint16_t count, const std::string &records)
+		{
+			fileAnswers.push_back(ZoneFileAnswer{
+				static_cast<uint32_t>(data.size()), static_cast<uint32_t>(records.size()), type, count
+			});
+			data += records;
+		};
+
+		for (auto &pair : nodes)
+		{
+			const std::string &name = pair.first;
+			ZoneBuildNode &node = pair.second;
+
+			ZoneFileNode fileNode;
+			memset(&fileNode, 0, sizeof (fileNode));
+			fileNode.name = static_cast<uint32_t>(data.size());
+			fileNode.nameLength = static_cast<uint16_t>(name.size());
+			fileNode.soa = soaOffsets[node.soa];
+			fileNode.soaLength = static_cast<uint16_t>(soas[node.soa].size());
+			fileNode.answers = static_cast<uint32_t>(fileAnswers.size());
+			data += name;
+
+			for (const auto &answer : node.answers)
+			{
+				std::string records;
+				for (const std::string &wire : answer.second) records += "\xC0\x0C" + wire;
+				addAnswer(answer.first, static_cast<uint16_t>(answer.second.size()), records);
+			}
+
+			// Follows the CNAME within the zone, and precompiles the answer for each
+			//  type the final name has, the records of the chain have their full
+			//  name as owner, the default answer is the CNAME alone
+			if (!node.target.empty())
+			{
+				std::string chain = "\xC0\x0C" + node.answers.front().second.front();
+				uint16_t chainCount = 1;
+				std::string current = node.target;
+
+				for (std::size_t depth = 0; depth < 8; ++depth)
+				{
+					auto target = nodes.find(current);
+					if (target == nodes.end() || target->first == name) break;
+
+					if (!target->second.target.empty())
+					{
+						chain += current + target->second.answers.front().second.front();
+						++chainCount;
+						current = target->second.target;
+						continue;
+					}
+
+					for (const auto &answer : target->second.answers)
+					{
+						std::string records = chain;
+						for (const std::string &wire : answer.second) records += current + wire;
+						addAnswer(answer.first, static_cast<uint16_t>(chainCount + answer.second.size()), records);
+					}
+					break;
+				}
+			}
+
+			fileNode.answerCount = static_cast<uint16_t>(fileAnswers.size() - fileNode.answers);
+			fileNodes.push_back(fileNode);
+		}
+
+		if (data.size() > UINT32_MAX)
+			throw std::runtime_error(EXCEPT_DEBUG("Zone exceeds 4GB"));
+
+		// Builds the hash table, it is at most half full so lookups stay short,
+		//  and there always is an empty slot to end an failed lookup
+		uint32_t tableSize = 16;
+		while (tableSize < fileNodes.size() * 2) tableSize <<= 1;
+
+		std::vector<uint32_t> table(tableSize, 0);
+		for (std::size_t i = 0; i < fileNodes.size(); ++i)
+		{
+			uint32_t slot = __zoneHash(&data[fileNodes[i].name], fileNodes[i].nameLength) & (tableSize - 1);
+			while (table[slot] != 0) slot = (slot + 1) & (tableSize - 1);
+			table[slot] = static_cast<uint32_t>(i + 1);
+		}
+
+		ZoneFileHeader header = {
+			_FSMTP_ZONE_MAGIC, _FSMTP_ZONE_VERSION, static_cast<uint32_t>(fileNodes.size()), tableSize,
+			static_cast<uint32_t>(fileAnswers.size()), static_cast<uint32_t>(data.size())
+		};
+
+		std::string image;
+		image.reserve(sizeof (header) + table.size() * sizeof (uint32_t) + fileNodes.size() * sizeof (ZoneFileNode)
+			+ fileAnswers.size() * sizeof (ZoneFileAnswer) + data.size());
+		image.append(reinterpret_cast<const char *>(&header), sizeof (header));
+		image.append(reinterpret_cast<const char *>(table.data()), table.size() * sizeof (uint32_t));
+		image.append(reinterpret_cast<const char *>(fileNodes.data()), fileNodes.size() * sizeof (ZoneFileNode));
+		image.append(reinterpret_cast<const char *>(fileAnswers.data()), fileAnswers.size() * sizeof (ZoneFileAnswer));
+		image += data;
+
+		logger << "Compiled zone with " << fileNodes.size() << " names, " << image.size() << " bytes" << ENDL;
+		return image;
+	}
+
+	void Zone::compile(const std::vector<Domain> &domains, const std::string &path)
+	{
+		const std::string image = __zoneBuildImage(domains);
+
+		// Writes to an temporary file first, and renames it over the old one, so the
+		//  old image stays intact for the workers which still have it mapped
+		const std::string tempPath = path + ".tmp";
+		std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open())
+			throw std::runtime_error(EXCEPT_DEBUG("Could not open '" + tempPath + "' for writing"));
+
+		out.write(image.data(), image.size());
+		out.close();
+
+		if (!out.good() || rename(tempPath.c_str(), path.c_str()) != 0)
+			throw std::runtime_error(EXCEPT_DEBUG("Could not write compiled zone to: '" + path + '\''));
+	}
+
+	std::shared_ptr<const Zone> Zone::fromDomains(const std::vector<Domain> &domains)
+	{
+		const std::string image = __zoneBuildImage(domains);
+
+		char *copy = new char[image.size()];
+		memcpy(copy, image.data(), image.size());
+
+		try {
+			return std::make_shared<const Zone>(copy, image.size(), false);
+		} catch (...)
+		{
+			delete[] copy;
+			throw;
+		}
+	}
+
+	// ==================================
+	// Loading
+	// ==================================
+
+	std::shared_ptr<const Zone> Zone::map(const std::string &path)
+	{
+		int fd = open(path.c_str(), O_RDONLY);
+		if (fd < 0) throw std::runtime_error(EXCEPT_DEBUG("Could not open: '" + path + '\''));
+		DEFER(close(fd));
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof (ZoneFileHeader)))
+			throw std::runtime_error(EXCEPT_DEBUG("Invalid compiled zone: '" + path + '\''));
+
+		void *image = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (image == MAP_FAILED) throw std::runtime_error(EXCEPT_DEBUG("mmap() failed: " + std::string(strerror(errno))));
+
+		try {
+			return std::make_shared<const Zone>(reinterpret_cast<const char *>(image), st.st_size, true);
+		} catch (const std::runtime_error &e)
+		{
+			munmap(image, st.st_size);
+			throw std::runtime_error(std::string(e.what()) + ": '" + path + '\'');
+		}
+	}
+
+	Zone::Zone(const char *image, const std::size_t size, const bool mapped):
+		z_Image(image), z_Size(size), z_Mapped(mapped)
+	{
+		// Validates the header, the table, the nodes and the answers, so lookups
+		//  can trust the offsets in the image without checking them again
+		this->z_Header = reinterpret_cast<const ZoneFileHeader *>(image);
+		const ZoneFileHeader &header = *this->z_Header;
+		if (
+			size < sizeof (ZoneFileHeader)
+			|| header.magic != _FSMTP_ZONE_MAGIC || header.version != _FSMTP_ZONE_VERSION
+			|| header.tableSize <= header.nodeCount || (header.tableSize & (header.tableSize - 1)) != 0
+			|| sizeof (ZoneFileHeader) + static_cast<uint64_t>(header.tableSize) * sizeof (uint32_t)
+				+ static_cast<uint64_t>(header.nodeCount) * sizeof (ZoneFileNode)
+				+ static_cast<uint64_t>(header.answerCount) * sizeof (ZoneFileAnswer) + header.dataSize != size
+		) throw std::runtime_error(EXCEPT_DEBUG("Invalid compiled zone"));
+
+		this->z_Table = reinterpret_cast<const uint32_t *>(this->z_Header + 1);
+		this->z_Nodes = reinterpret_cast<const ZoneFileNode *>(this->z_Table + header.tableSize);
+		this->z_Answers = reinterpret_cast<const ZoneFileAnswer *>(this->z_Nodes + header.nodeCount);
+		this->z_Data = reinterpret_cast<const char *>(this->z_Answers + header.answerCount);
+
+		bool emptySlot = false;
+		for (uint32_t i = 0; i < header.tableSize; ++i)
+		{
+			if (this->z_Table[i] == 0) emptySlot = true;
+			else if (this->z_Table[i] > header.nodeCount)
+				throw std::runtime_error(EXCEPT_DEBUG("Invalid slot in compiled zone"));
+		}
+
+		// An table without empty slots would make an failed lookup loop forever,
+		//  more slots than names does not ensure that, since slots may repeat
+		if (!emptySlot) throw std::runtime_error(EXCEPT_DEBUG("Invalid table in compiled zone"));
+
+		for (uint32_t i = 0; i < header.nodeCount; ++i)
+		{
+			const ZoneFileNode &node = this->z_Nodes[i];
+			if (
+				static_cast<uint64_t>(node.name) + node.nameLength > header.dataSize
+				|| static_cast<uint64_t>(node.soa) + node.soaLength > header.dataSize
+				|| static_cast<uint64_t>(node.answers) + node.answerCount > header.answerCount
+			) throw std::runtime_error(EXCEPT_DEBUG("Invalid name in compiled zone"));
+		}
+
+		for (uint32_t i = 0; i < header.answerCount; ++i)
+		{
+			const ZoneFileAnswer &answer = this->z_Answers[i];
+			if (static_cast<uint64_t>(answer.records) + answer.length > header.dataSize)
+				throw std::runtime_error(EXCEPT_DEBUG("Invalid answer in compiled zone"));
+		}
+	}
+
+	Zone::~Zone(void)
+	{
+		if (this->z_Mapped) munmap(const_cast<char *>(this->z_Image), this->z_Size);
+		else delete[] this->z_Image;
+	}
+
+	const ZoneFileNode *Zone::find(const char *name, const std::size_t len) const
+	{
+		const uint32_t mask = this->z_Header->tableSize - 1;
+		for (uint32_t slot = __zoneHash(name, len) & mask; this->z_Table[slot] != 0; slot = (slot + 1) & mask)
+		{
+			const ZoneFileNode *node = &this->z_Nodes[this->z_Table[slot] - 1];
+			if (node->nameLength == len && memcmp(&this->z_Data[node->name], name, len) == 0) return node;
+		}
+
+		return nullptr;
+	}
+
+	/**
+	 * Looks up an name, which must be lowercased and in wire format,
+	 *  negative answers get the SOA record of the enclosing zone
+	 *
+	 * @Param {const char *} name
+	 * @Param {const std::size_t} len
+	 * @Param {const uint16_t} type
+	 * @Return {ZoneLookup}
+	 */
+	ZoneLookup Zone::lookup(const char *name, const std::size_t len, const uint16_t type) const
+	{
+		const ZoneFileNode *node = this->find(name, len);
+		if (node)
+		{
+			// Looks for the type, an CNAME answers all types its target lacks
+			const ZoneFileAnswer *answer = nullptr;
+			for (uint16_t i = 0; i < node->answerCount; ++i)
+			{
+				const ZoneFileAnswer *candidate = &this->z_Answers[node->answers + i];
+				if (candidate->type == type)
+				{
+					answer = candidate;
+					break;
+				}
+
+				if (candidate->type == 5) answer = candidate;
+			}
+
+			if (answer)
+			{
+				return ZoneLookup{
+					ZONE_LOOKUP_FOUND, &this->z_Data[answer->records], answer->length, answer->count,
+					nullptr, 0
+				};
+			}
+
+			return ZoneLookup{ ZONE_LOOKUP_NODATA, nullptr, 0, 0, &this->z_Data[node->soa], node->soaLength };
+		}
+
+		// Walks up the labels, the first existing parent tells us if the
+		//  name is in one of our zones, since all names below the apex exist
+		for (std::size_t i = static_cast<uint8_t>(name[0]) + 1; i < len && name[i] != '\0'; i += static_cast<uint8_t>(name[i]) + 1)
+		{
+			node = this->find(&name[i], len - i);
+			if (node) return ZoneLookup{ ZONE_LOOKUP_NXDOMAIN, nullptr, 0, 0, &this->z_Data[node->soa], node->soaLength };
+		}
+
+		return ZoneLookup{ ZONE_LOOKUP_REFUSED, nullptr, 0, 0, nullptr, 0 };
+	}
+
+	/**
+	 * Gets the number of names in the zone
+	 *
+	 * @Param {void}
+	 * @Return {std::size_t}
+	 */
+	std::size_t Zone::getNameCount(void) const
+	{
+		return this->z_Header->nodeCount;
+	}
+}
@@ -19,6 +19,9 @@
 #include "DNS.src.h"
 #include "DNSHeader.src.h"
 
+#define _FSMTP_ZONE_MAGIC 0x4e4f5a46
+#define _FSMTP_ZONE_VERSION 1
+
 namespace FSMTP::DNS
 {
 	typedef enum : uint8_t
@@ -28,6 +31,7 @@ namespace FSMTP::DNS
 		REC_TYPE_MX,
 		REC_TYPE_SOA,
 		REC_TYPE_TXT,
+		REC_TYPE_CNAME,
 		REC_TYPE_UNKNOWN
 	} ResponseRecordType;
 
@@ -39,6 +43,15 @@ namespace FSMTP::DNS
 	 */
 	int16_t responseRecordTypeToInt(const ResponseRecordType type);
 
+	/**
+	 * Encodes an domain name into its wire format, an sequence of
+	 *  length prefixed labels terminated by the root label
+	 *
+	 * @Param {const std::string &} name
+	 * @Return {std::string}
+	 */
+	std::string encodeDomainName(const std::string &name);
+
 	class DNSRecord
 	{
 	public:
@@ -58,25 +71,36 @@ namespace FSMTP::DNS
 		 * @Param {const int32_t} r_TTL,
 		 * @Param {const ResponseRecordType} r_Type
 		 * @Param {const QueryClass r_Class}
+		 * @Param {const uint16_t} r_Priority
 		 * @Return {void}
 		 */
 		DNSRecord(const std::string &r_Data, const std::string &r_Root,
 			const int32_t r_TTL, const ResponseRecordType r_Type, 
-			const QueryClass r_Class);
+			const QueryClass r_Class, const uint16_t r_Priority = 0);
 
 		/**
-		 * Builds an response record
+		 * Builds an record in wire format without its owner name, since
+		 *  that depends on where in the response the record is placed
 		 *
-		 * @Param {char *} ret
-		 * @Return {std::size_t}
+		 * @Param {void}
+		 * @Return {std::string}
 		 */
-		std::size_t build(char *ret) const;
+		std::string build(void) const;
+
+		/**
+		 * Gets the owner name of the record, relative to the domain
+		 *
+		 * @Param {const std::string &} domain
+		 * @Return {std::string}
+		 */
+		std::string getOwner(const std::string &domain) const;
 
 		std::string r_Data;
 		std::string r_Root;
 		int32_t r_TTL;
 		ResponseRecordType r_Type;
 		QueryClass r_Class;
+		uint16_t r_Priority;
 	};
 
 	class Domain
@@ -99,7 +123,10 @@ namespace FSMTP::DNS
 		void log(Logger &logger);
 
 		std::string d_Domain;
-		std::vector<DNSRecord> d_ARecords;
+		std::string d_MName;
+		std::string d_RName;
+		int32_t d_MinimumTTL;
+		std::vector<DNSRecord> d_Records;
 	};
 
 	/**
@@ -110,9 +137,145 @@ namespace FSMTP::DNS
 	 */
 	std::vector<Domain> readConfig(void);
 
+	/**
+	 * Reads the domains from an JSON array, in the format of the
+	 *  zone in the config
+	 *
+	 * @Param {const Json::Value &} zones
+	 * @Return {std::vector<Domain>}
+	 */
+	std::vector<Domain> readDomains(const Json::Value &zones);
+
+	/**
+	 * Reads an zone file, which contains the JSON array of domains
+	 *
+	 * @Param {const std::string &} path
+	 * @Return {std::vector<Domain>}
+	 */
+	std::vector<Domain> readZoneFile(const std::string &path);
+
+	typedef enum : uint8_t
+	{
+		ZONE_LOOKUP_FOUND = 0,
+		ZONE_LOOKUP_NODATA,
+		ZONE_LOOKUP_NXDOMAIN,
+		ZONE_LOOKUP_REFUSED
+	} ZoneLookupStatus;
+
+	/**
+	 * The answer to an lookup, the records point into the zone image, and
+	 *  are valid as long as the zone is
+	 */
+	struct ZoneLookup
+	{
+		ZoneLookupStatus l_Status;
+		const char *l_Records;
+		uint32_t l_RecordsLength;
+		uint16_t l_Count;
+		const char *l_SOA;
+		uint16_t l_SOALength;
+	};
+
+	// The compiled zone image, the header is followed by the hash table of
+	//  the names, the names, their answers and the data they point into
+
+	struct ZoneFileHeader
+	{
+		uint32_t magic;
+		uint32_t version;
+		uint32_t nodeCount;
+		uint32_t tableSize;
+		uint32_t answerCount;
+		uint32_t dataSize;
+	};
+
+	struct ZoneFileNode
+	{
+		uint32_t name;
+		uint32_t soa;
+		uint32_t answers;
+		uint16_t nameLength;
+		uint16_t soaLength;
+		uint16_t answerCount;
+		uint16_t reserved;
+	};
+
+	struct ZoneFileAnswer
+	{
+		uint32_t records;
+		uint32_t length;
+		uint16_t type;
+		uint16_t count;
+	};
+
+	/**
+	 * The zones we are authoritative for, compiled into an image which is
+	 *  memory mapped, the names are hashed on their lowercased wire format,
+	 *  and each name holds the answers for its types in wire format, so an
+	 *  query only has to copy them after the question
+	 */
 	class Zone
 	{
 	public:
+		/**
+		 * Maps an compiled zone image, and validates it
+		 *
+		 * @Param {const std::string &} path
+		 * @Return {std::shared_ptr<const Zone>}
+		 */
+		static std::shared_ptr<const Zone> map(const std::string &path);
+
+		/**
+		 * Compiles the domains into an zone in memory
+		 *
+		 * @Param {const std::vector<Domain> &} domains
+		 * @Return {std::shared_ptr<const Zone>}
+		 */
+		static std::shared_ptr<const Zone> fromDomains(const std::vector<Domain> &domains);
+
+		/**
+		 * Compiles the domains into an zone image, invalid records are
+		 *  skipped, the image is written to an temporary file first
+		 *  and renamed, so an mapped image is never modified
+		 *
+		 * @Param {const std::vector<Domain> &} domains
+		 * @Param {const std::string &} path
+		 * @Return {void}
+		 */
+		static void compile(const std::vector<Domain> &domains, const std::string &path);
+
+		/**
+		 * Looks up an name, which must be lowercased and in wire format,
+		 *  negative answers get the SOA record of the enclosing zone
+		 *
+		 * @Param {const char *} name
+		 * @Param {const std::size_t} len
+		 * @Param {const uint16_t} type
+		 * @Return {ZoneLookup}
+		 */
+		ZoneLookup lookup(const char *name, const std::size_t len, const uint16_t type) const;
+
+		/**
+		 * Gets the number of names in the zone
+		 *
+		 * @Param {void}
+		 * @Return {std::size_t}
+		 */
+		std::size_t getNameCount(void) const;
+
+		Zone(const char *image, const std::size_t size, const bool mapped);
+		~Zone(void);
 	private:
+		const ZoneFileNode *find(const char *name, const std::size_t len) const;
+
+		const char *z_Image;
+		std::size_t z_Size;
+		bool z_Mapped;
+
+		const ZoneFileHeader *z_Header;
+		const uint32_t *z_Table;
+		const ZoneFileNode *z_Nodes;
+		const ZoneFileAnswer *z_Answers;
+		const char *z_Data;
 	};
-}
\ No newline at end of file
+}
@@ -59,18 +59,165 @@ namespace FSMTP::DNS {
 
 	RR::~RR() = default;
 
+	static struct sockaddr_in resolverNameserver;
+	static atomic<bool> resolverNameserverSet(false);
+
 	Resolver::Resolver() {
 		res_ninit(&this->m_State);
+
+		// Uses the overridden nameserver if one is set, this is used
+		//  to point the resolver at a local server
+		if (resolverNameserverSet) {
+			this->m_State.nsaddr_list[0] = resolverNameserver;
+			this->m_State.nscount = 1;
+		}
+	}
+
+	void Resolver::useNameserver(const string &address, const int32_t port) {
+		memset(&resolverNameserver, 0, sizeof (resolverNameserver));
+		resolverNameserver.sin_family = AF_INET;
+		resolverNameserver.sin_port = htons(port);
+		if (inet_pton(AF_INET, address.c_str(), &resolverNameserver.sin_addr) != 1)
+			throw invalid_argument("Invalid nameserver address: " + address);
+
+		resolverNameserverSet = true;
+	}
+
+	vector<struct sockaddr_storage> Resolver::getNameservers() {
+		vector<struct sockaddr_storage> res;
+
+		// glibc keeps the IPv6 nameservers in the extension, their entry in the
+		//  IPv4 list has no family then
+		for (int32_t i = 0; i < this->m_State.nscount; ++i) {
+			struct sockaddr_storage ns;
+			memset(&ns, 0, sizeof (ns));
+
+			if (this->m_State.nsaddr_list[i].sin_family == AF_INET) {
+				memcpy(&ns, &this->m_State.nsaddr_list[i], sizeof (struct sockaddr_in));
+			} else if (this->m_State._u._ext.nsaddrs[i] != nullptr) {
+				memcpy(&ns, this->m_State._u._ext.nsaddrs[i], sizeof (struct sockaddr_in6));
+			} else continue;
+
+			res.push_back(ns);
+		}
+
+		return res;
 	}
 
 	Resolver &Resolver::query(const char *query, int32_t type) {
-		if ((this->m_AnswerLen = res_nquery(&this->m_State, query, ns_c_in, 
-			type, this->m_Buffer, sizeof (this->m_Buffer))
-		) < 0) throw runtime_error("Query has no results");
+		const string key = DNSCache::key(query, type);
+		string packet;
+
+		// Serves the answer from the cache if we have it, an empty packet
+		//  means the name or type does not exist, which is cached too
+		if (DNSCache::get(key, packet)) {
+			if (packet.empty()) throw NoResults("Query has no results");
 
+			memcpy(this->m_Buffer, packet.c_str(), packet.size());
+			this->m_AnswerLen = packet.size();
+			return *this;
+		}
+
+		uint32_t ttl = this->sendQuery(query, type);
+		if (this->m_AnswerLen < 0) {
+			DNSCache::put(key, "", ttl);
+			throw NoResults("Query has no results");
+		}
+
+		DNSCache::put(key, string(reinterpret_cast<char *>(this->m_Buffer), this->m_AnswerLen), ttl);
 		return *this;
 	}
 
+	/**
+	 * Gets the negative TTL of an answer, which is the minimum of the
+	 *  SOA TTL and its minimum field ( RFC 2308 section 5 )
+	 */
+	uint32_t getNegativeTTL(ns_msg &msg) {
+		ns_rr record;
+
+		for (int32_t i = 0; i < ns_msg_count(msg, ns_s_ns); ++i) {
+			if (ns_parserr(&msg, ns_s_ns, i, &record) < 0) break;
+			if (ns_rr_type(record) != ns_t_soa) continue;
+
+			// Skips the mname and rname, after which the serial, refresh,
+			//  retry, expire and minimum follow
+			const u_char *p = ns_rr_rdata(record);
+			const u_char *end = p + ns_rr_rdlen(record);
+			int32_t len;
+
+			if ((len = dn_skipname(p, end)) < 0) break;
+			p += len;
+			if ((len = dn_skipname(p, end)) < 0) break;
+			p += len;
+			if (end - p < 20) break;
+
+			uint32_t minimum = ns_get32(p + 16);
+			return min(static_cast<uint32_t>(ns_rr_ttl(record)), minimum);
+		}
+
+		return 60;
+	}
+
+	uint32_t Resolver::sendQuery(const char *query, int32_t type) {
+		u_char request[NS_PACKETSZ];
+		int32_t requestLen;
+		ns_msg msg;
+		ns_rr record;
+
+		if ((requestLen = res_nmkquery(&this->m_State, ns_o_query, query, ns_c_in,
+			type, nullptr, 0, nullptr, request, sizeof (request))) < 0)
+			throw runtime_error("Could not build query for: " + string(query));
+
+		requestLen = appendEDNS0(request, requestLen, sizeof (request));
+
+		// Sends the query ourselves instead of using res_nquery, since that one
+		//  hides the response of failed queries, which we need for the SOA
+		if ((this->m_AnswerLen = res_nsend(&this->m_State, request, requestLen,
+			this->m_Buffer, sizeof (this->m_Buffer))) < 0)
+			throw runtime_error("Query failed: " + string(query));
+
+		// Retries over TCP if the answer did not fit in an datagram, even
+		//  with the larger EDNS0 payload
+		if (this->m_AnswerLen >= static_cast<int32_t>(sizeof (HEADER)) &&
+			reinterpret_cast<HEADER *>(this->m_Buffer)->tc)
+		{
+			u_long options = this->m_State.options;
+			this->m_State.options |= RES_USEVC;
+			DEFER(this->m_State.options = options);
+
+			if ((this->m_AnswerLen = res_nsend(&this->m_State, request, requestLen,
+				this->m_Buffer, sizeof (this->m_Buffer))) < 0)
+				throw runtime_error("Query over TCP failed: " + string(query));
+		}
+
+		// The buffer may still be too small, in which case res_nsend returns
+		//  the full length while only the buffer was filled
+		if (this->m_AnswerLen > static_cast<int32_t>(sizeof (this->m_Buffer)))
+			throw runtime_error("Response too large for: " + string(query));
+
+		if (ns_initparse(this->m_Buffer, this->m_AnswerLen, &msg) < 0)
+			throw runtime_error("Invalid response for: " + string(query));
+
+		// Non existing names, and names without records of the type are
+		//  cached as negative, other errors ( like SERVFAIL ) are not cached
+		int32_t rcode = ns_msg_getflag(msg, ns_f_rcode);
+		if (rcode == ns_r_nxdomain || (rcode == ns_r_noerror && ns_msg_count(msg, ns_s_an) == 0)) {
+			this->m_AnswerLen = -1;
+			return getNegativeTTL(msg);
+		} else if (rcode != ns_r_noerror) {
+			throw runtime_error("Query failed with rcode " + to_string(rcode) + ": " + query);
+		}
+
+		// The answer is valid as long as its shortest living record
+		uint32_t ttl = numeric_limits<uint32_t>::max();
+		for (int32_t i = 0; i < ns_msg_count(msg, ns_s_an); ++i) {
+			if (ns_parserr(&msg, ns_s_an, i, &record) < 0) break;
+			ttl = min(ttl, static_cast<uint32_t>(ns_rr_ttl(record)));
+		}
+
+		return ttl;
+	}
+
 	Resolver &Resolver::initParse() {
 		ns_initparse(this->m_Buffer, this->m_AnswerLen, &this->m_NsMsg);
 		this->m_ResponseCount = ns_msg_count(this->m_NsMsg, ns_s_an);
@@ -101,18 +248,15 @@ namespace FSMTP::DNS {
 		ns_rr record;
 
 		for (int32_t i = 0; i < this->m_ResponseCount; ++i) {
-			ns_parserr(&this->m_NsMsg, ns_s_an, i, &record);
+			if (ns_parserr(&this->m_NsMsg, ns_s_an, i, &record) < 0) break;
+
+			// Skips the CNAME records which the server may include
+			//  when the name is an alias
+			if (ns_rr_type(record) != ns_t_txt) continue;
 
-			string raw(reinterpret_cast<const char *>(ns_rr_rdata(record) + 1), ns_rr_rdlen(record) - 1);
-			string data;
-			data.reserve(raw.length());
-			for (char c : raw) {
-				if (c >= 0 && c <= 127) data += c;
-			}
-			
 			result.push_back(RR(
 				ns_rr_ttl(record), ns_rr_class(record), ns_rr_type(record),
-				ns_rr_name(record), move(data)
+				ns_rr_name(record), joinCharacterStrings(ns_rr_rdata(record), ns_rr_rdlen(record))
 			));
 		}
 
@@ -130,51 +274,90 @@ namespace FSMTP::DNS {
 		res_nclose(&this->m_State);
 	}
 
-	string resolveHostname(const string &hostname, int32_t af) {
-		struct hostent *h = nullptr;
-		if ((h = gethostbyname2(hostname.c_str(), af)) == nullptr)
-			throw runtime_error("Could not resolve hostname: " + hostname);
-		
-		struct in_addr *p = reinterpret_cast<struct in_addr *>(h->h_addr);
-
-		// Checks AF, if it is AF_INET we will get the IPv4 address
-		//  else we will get the IPv6 address string, else runtime_error
-		switch (af) {
-			case AF_INET: {
-				char buffer[INET_ADDRSTRLEN];
+	string joinCharacterStrings(const u_char *rdata, const size_t rdlen) {
+		string result;
+		result.reserve(rdlen);
 
-				// Turns the IPv4 address into an string, if anything goes
-				//  wrong throw error
-				if (inet_ntop(AF_INET, p, buffer, INET_ADDRSTRLEN) == nullptr)
-					throw runtime_error(EXCEPT_DEBUG(
-						string("inet_ntop() failed: ") + strerror(errno)));
+		// Each string is prefixed with its length, long values like
+		//  DKIM keys are split over multiple strings ( RFC 7208 3.3 )
+		for (size_t i = 0; i < rdlen;) {
+			size_t len = rdata[i++];
+			if (len > rdlen - i)
+				throw runtime_error("Invalid character-string in TXT record");
 
-				return buffer;
-			}
-			case AF_INET6: {
-				char buffer[INET6_ADDRSTRLEN];
-
-				// Turns the IPv6 address into an string, if anything goes
-				//  wrong, throw an error
-				if (inet_ntop(AF_INET6, p, buffer, INET6_ADDRSTRLEN) == nullptr)
-					throw runtime_error(EXCEPT_DEBUG(
-						string("inet_ntop() failed: ") + strerror(errno)));
-				
-				return buffer;
-			}
-			default: throw invalid_argument("af needs to be either AF_INET or AF_INET6");
+			result.append(reinterpret_cast<const char *>(&rdata[i]), len);
+			i += len;
 		}
+
+		return result;
 	}
 
-	vector<string> resolveAllFromHostname(const string &hostname, int32_t af) {
-		vector<string> result = {};
+	size_t appendEDNS0(u_char *packet, const size_t len, const size_t size) {
+		if (len + 11 > size) return len;
+
+		// Appends an OPT pseudo record ( RFC 6891 ) with the root name, which
+		//  advertises the UDP payload size we accept in its class field
+		u_char *p = packet + len;
+		*p++ = 0;
+		ns_put16(ns_t_opt, p); p += 2;
+		ns_put16(_RESOLVER_EDNS0_PAYLOAD, p); p += 2;
+		ns_put32(0, p); p += 4;
+		ns_put16(0, p);
+
+		HEADER *header = reinterpret_cast<HEADER *>(packet);
+		header->arcount = htons(ntohs(header->arcount) + 1);
+		return len + 11;
+	}
 
-		struct hostent *h = nullptr;
-		if ((h = gethostbyname2(hostname.c_str(), af)) == nullptr)
-			throw runtime_error("Could not resolve jostname" + hostname);
+	vector<RR> parseAnswers(const u_char *packet, const int32_t len) {
+		vector<RR> result = {};
+		ns_msg msg;
+		ns_rr record;
 
-		struct in_addr **p = reinterpret_cast<struct in_addr **>(h->h_addr_list);
-		for (; *p != nullptr; ++p) result.push_back(inet_ntoa(**p));
+		if (ns_initparse(packet, len, &msg) < 0)
+			throw runtime_error("Invalid response");
+
+		for (int32_t i = 0; i < ns_msg_count(msg, ns_s_an); ++i) {
+			if (ns_parserr(&msg, ns_s_an, i, &record) < 0)
+				throw runtime_error("Invalid record in response");
+
+			const u_char *rdata = ns_rr_rdata(record);
+			const size_t rdlen = ns_rr_rdlen(record);
+			char data[NS_MAXDNAME];
+			string text;
+
+			switch (ns_rr_type(record)) {
+				case ns_t_a:
+					if (rdlen != 4 || !inet_ntop(AF_INET, rdata, data, sizeof (data))) continue;
+					text = data;
+					break;
+				case ns_t_aaaa:
+					if (rdlen != 16 || !inet_ntop(AF_INET6, rdata, data, sizeof (data))) continue;
+					text = data;
+					break;
+				case ns_t_mx:
+					if (rdlen < 3 || dn_expand(ns_msg_base(msg), ns_msg_end(msg), rdata + 2, data, sizeof (data)) < 0) continue;
+					text = data;
+					break;
+				case ns_t_ptr:
+				case ns_t_cname:
+				case ns_t_ns:
+					if (dn_expand(ns_msg_base(msg), ns_msg_end(msg), rdata, data, sizeof (data)) < 0) continue;
+					text = data;
+					break;
+				case ns_t_txt:
+					text = joinCharacterStrings(rdata, rdlen);
+					break;
+				default:
+					text.assign(reinterpret_cast<const char *>(rdata), rdlen);
+					break;
+			}
+
+			result.push_back(RR(
+				ns_rr_ttl(record), ns_rr_class(record), ns_rr_type(record),
+				ns_rr_name(record), move(text)
+			));
+		}
 
 		return result;
 	}
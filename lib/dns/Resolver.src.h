@@ -19,8 +19,20 @@
 
 #include "../default.h"
 #include "../general/Logger.src.h"
+#include "DNSCache.src.h"
+
+#define _RESOLVER_EDNS0_PAYLOAD 4096
 
 namespace FSMTP::DNS {
+	/**
+	 * Thrown when the name or type does not exist, so callers can tell
+	 *  an empty answer apart from an failed query
+	 */
+	class NoResults : public runtime_error {
+	public:
+		using runtime_error::runtime_error;
+	};
+
 	class RR {
 	public:
 		RR(int32_t ttl, int32_t cl, int32_t type, string &&name, string &&data);
@@ -48,17 +60,43 @@ namespace FSMTP::DNS {
 		vector<RR> getRecords();
 		vector<RR> getTXTRecords();
 		Resolver &reset();
+		vector<struct sockaddr_storage> getNameservers();
+
+		static void useNameserver(const string &address, const int32_t port);
 
 		~Resolver();
 	private:
+		uint32_t sendQuery(const char *query, int32_t type);
+
 		int32_t m_AnswerLen, m_ResponseCount;
-		u_char m_Buffer[8192];
+		u_char m_Buffer[NS_MAXMSG];
 		struct __res_state m_State;
 		ns_msg m_NsMsg;
 	};
 
-	string resolveHostname(const string &hostname, int32_t af = AF_INET);
-	
+	/**
+	 * Parses the answer section of an raw response, the data of each record
+	 *  is turned into text based on its type ( address, name or text )
+	 */
+	vector<RR> parseAnswers(const u_char *packet, const int32_t len);
+
+	/**
+	 * Joins the length prefixed character-strings of an TXT record
+	 */
+	string joinCharacterStrings(const u_char *rdata, const size_t rdlen);
+
+	/**
+	 * Appends an EDNS0 OPT record to an query, so the server may send answers
+	 *  larger than 512 bytes over UDP, returns the new length
+	 */
+	size_t appendEDNS0(u_char *packet, const size_t len, const size_t size);
+
+	/**
+	 * Gets the TTL for caching an negative answer, taken from the SOA
+	 *  in the authority section
+	 */
+	uint32_t getNegativeTTL(ns_msg &msg);
+
 	template<typename T>
 	string getHostnameByAddress(const T *a) {
 		char hostname[512];
@@ -71,7 +109,6 @@ namespace FSMTP::DNS {
 
 		return hostname;
 	}
-	vector<string> resolveAllFromHostname(const string &hostname, int32_t af = AF_INET);
 }
 
 #endif
@@ -0,0 +1,283 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "ReverseDNS.src.h"
+
+#define _FSMTP_RDNS_MAX_NAMES 10
+
+namespace FSMTP::DNS
+{
+	/**
+	 * State of an running lookup, the PTR answer starts the forward lookups
+	 *  of the names, and the last forward answer publishes the result
+	 */
+	struct ReverseDNSLookup {
+		mutex mtx;
+		string address;
+		int32_t type;
+		size_t remaining;
+		uint32_t ttl;
+		ReverseDNSResult result;
+		promise<ReverseDNSResult> published;
+	};
+
+	static mutex rdnsMutex;
+	static TTLCache<ReverseDNSResult> rdnsCache(65536);
+	static unordered_map<string, shared_future<ReverseDNSResult>> rdnsRunning;
+	static uint32_t rdnsNegativeTTL = 900, rdnsErrorTTL = 60;
+	static milliseconds rdnsTimeout(2000);
+	static atomic<size_t> rdnsHits(0);
+	static atomic<size_t> rdnsMisses(0);
+
+	void ReverseDNS::configure(const Json::Value &config) {
+		lock_guard<mutex> lock(rdnsMutex);
+
+		if (config.isMember("cache_entries")) rdnsCache.setMaxEntries(config["cache_entries"].asUInt64());
+		if (config.isMember("negative_ttl")) rdnsNegativeTTL = config["negative_ttl"].asUInt();
+		if (config.isMember("timeout_ms")) rdnsTimeout = milliseconds(config["timeout_ms"].asUInt());
+	}
+
+	/**
+	 * Stores the result, and removes the lookup from the running ones
+	 */
+	static void __rdnsFinish(ReverseDNSLookup &state) {
+		{
+			lock_guard<mutex> lock(rdnsMutex);
+			rdnsCache.put(state.address, state.result, state.ttl);
+			rdnsRunning.erase(state.address);
+		}
+
+		state.published.set_value(state.result);
+	}
+
+	/**
+	 * Handles the answer of an forward lookup, the first name which resolves
+	 *  back to the address becomes the hostname
+	 */
+	static void __rdnsForward(
+		shared_ptr<ReverseDNSLookup> state, const string &name,
+		vector<RR> &&records, exception_ptr error
+	) {
+		bool done;
+
+		{
+			lock_guard<mutex> lock(state->mtx);
+
+			if (!error) {
+				for (const RR &record : records) {
+					if (record.getType() != state->type || record.getData() != state->address) continue;
+
+					if (state->result.status != ReverseDNSPass) {
+						state->result.status = ReverseDNSPass;
+						state->result.hostname = name;
+					}
+
+					state->ttl = min<uint32_t>(state->ttl, record.getTTL());
+				}
+			} else {
+				try {
+					rethrow_exception(error);
+				} catch (const NoResults &e) {
+				} catch (...) {
+					state->ttl = min(state->ttl, rdnsErrorTTL);
+					if (state->result.status == ReverseDNSFail)
+						state->result.status = ReverseDNSTempError;
+				}
+			}
+
+			done = --state->remaining == 0;
+		}
+
+		if (done) __rdnsFinish(*state);
+	}
+
+	/**
+	 * Checks if the PTR target is an valid host name, so that an bogus
+	 *  record can not make the forward lookup fail
+	 */
+	static bool __rdnsValidName(const string &name) {
+		if (name.empty() || name.size() > 253) return false;
+
+		size_t start = 0;
+		while (start <= name.size()) {
+			size_t end = name.find('.', start);
+			if (end == string::npos) end = name.size();
+			if (end - start == 0 || end - start > 63) return false;
+			start = end + 1;
+		}
+
+		return true;
+	}
+
+	/**
+	 * Handles the PTR answer, and starts the forward lookups of the names
+	 */
+	static void __rdnsReverse(shared_ptr<ReverseDNSLookup> state, vector<RR> &&records, exception_ptr error) {
+		vector<string> names;
+
+		if (error) {
+			try {
+				rethrow_exception(error);
+			} catch (const NoResults &e) {
+				state->result.status = ReverseDNSNone;
+				state->ttl = rdnsNegativeTTL;
+			} catch (...) {
+				state->result.status = ReverseDNSTempError;
+				state->ttl = rdnsErrorTTL;
+			}
+
+			__rdnsFinish(*state);
+			return;
+		}
+
+		for (const RR &record : records) {
+			if (record.getType() != ns_t_ptr) continue;
+
+			string name = record.getData();
+			if (!name.empty() && name.back() == '.') name.pop_back();
+			if (!__rdnsValidName(name)) continue;
+
+			transform(name.begin(), name.end(), name.begin(), [](unsigned char c) {
+				return tolower(c);
+			});
+
+			if (find(names.begin(), names.end(), name) == names.end()) names.push_back(move(name));
+			state->ttl = min<uint32_t>(state->ttl, record.getTTL());
+			if (names.size() >= _FSMTP_RDNS_MAX_NAMES) break;
+		}
+
+		if (names.empty()) {
+			state->result.status = ReverseDNSNone;
+			state->ttl = rdnsNegativeTTL;
+			__rdnsFinish(*state);
+			return;
+		}
+
+		// The forward answers may arrive right away when they are cached, so
+		//  the state is complete before the first query is started
+		state->result.status = ReverseDNSFail;
+		state->result.names = names;
+		state->remaining = names.size();
+
+		// An query which fails to start is counted down like an failed
+		//  answer, otherwise the lookup would never complete
+		for (const string &name : names) {
+			try {
+				AsyncResolver::query(name, state->type, [state, name](vector<RR> &&records, exception_ptr error) {
+					__rdnsForward(state, name, move(records), error);
+				});
+			} catch (...) {
+				__rdnsForward(state, name, vector<RR>(), current_exception());
+			}
+		}
+	}
+
+	shared_future<ReverseDNSResult> ReverseDNS::lookup(const string &address) {
+		struct in_addr addr4;
+		struct in6_addr addr6;
+		char buffer[INET6_ADDRSTRLEN];
+		int32_t type;
+
+		// Normalizes the address, so that it can be compared to the forward
+		//  answers. IPv4 clients on an dual stack socket are looked up as IPv4
+		if (inet_pton(AF_INET, address.c_str(), &addr4) == 1) {
+			type = ns_t_a;
+		} else if (inet_pton(AF_INET6, address.c_str(), &addr6) == 1) {
+			if (IN6_IS_ADDR_V4MAPPED(&addr6)) {
+				memcpy(&addr4, addr6.s6_addr + 12, 4);
+				type = ns_t_a;
+			} else type = ns_t_aaaa;
+		} else throw invalid_argument("Invalid address: " + address);
+
+		if (type == ns_t_a) inet_ntop(AF_INET, &addr4, buffer, sizeof (buffer));
+		else inet_ntop(AF_INET6, &addr6, buffer, sizeof (buffer));
+		string normalized = buffer;
+
+		shared_ptr<ReverseDNSLookup> state;
+		shared_future<ReverseDNSResult> result;
+
+		{
+			lock_guard<mutex> lock(rdnsMutex);
+
+			const ReverseDNSResult *cached = rdnsCache.get(normalized);
+			if (cached) {
+				++rdnsHits;
+
+				promise<ReverseDNSResult> result;
+				result.set_value(*cached);
+				return result.get_future().share();
+			}
+
+			auto running = rdnsRunning.find(normalized);
+			if (running != rdnsRunning.end()) {
+				++rdnsHits;
+				return running->second;
+			}
+
+			++rdnsMisses;
+
+			state = make_shared<ReverseDNSLookup>();
+			state->address = normalized;
+			state->type = type;
+			state->remaining = 0;
+			state->ttl = UINT32_MAX;
+			state->result.status = ReverseDNSNone;
+
+			result = state->published.get_future().share();
+			rdnsRunning[normalized] = result;
+		}
+
+		// An query which fails to start is handled like an failed answer, which
+		//  publishes an temporary error and removes the lookup from the running
+		//  ones, otherwise everyone after us would wait for it until the timeout
+		try {
+			AsyncResolver::query(AsyncResolver::reverseName(normalized), ns_t_ptr, [state](vector<RR> &&records, exception_ptr error) {
+				__rdnsReverse(state, move(records), error);
+			});
+		} catch (...) {
+			__rdnsReverse(state, vector<RR>(), current_exception());
+		}
+
+		return result;
+	}
+
+	ReverseDNSResult ReverseDNS::wait(const shared_future<ReverseDNSResult> &result) {
+		if (!result.valid() || result.wait_for(rdnsTimeout) != future_status::ready)
+			return ReverseDNSResult { ReverseDNSTempError, "", {} };
+		return result.get();
+	}
+
+	const char *ReverseDNS::statusToString(const ReverseDNSStatus status) {
+		switch (status) {
+			case ReverseDNSPass: return "pass";
+			case ReverseDNSFail: return "fail";
+			case ReverseDNSTempError: return "temperror";
+			default: return "permerror";
+		}
+	}
+
+	ReverseDNSStats ReverseDNS::getStats() {
+		lock_guard<mutex> lock(rdnsMutex);
+		return ReverseDNSStats {
+			rdnsHits, rdnsMisses, rdnsCache.size()
+		};
+	}
+
+	void ReverseDNS::clear() {
+		lock_guard<mutex> lock(rdnsMutex);
+		rdnsCache.clear();
+	}
+}
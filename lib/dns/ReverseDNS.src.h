@@ -0,0 +1,81 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <future>
+
+#include "../default.h"
+#include "../general/Logger.src.h"
+#include "AsyncResolver.src.h"
+#include "../general/TTLCache.src.h"
+
+namespace FSMTP::DNS
+{
+	typedef enum : uint8_t {
+		ReverseDNSNone = 0,
+		ReverseDNSPass,
+		ReverseDNSFail,
+		ReverseDNSTempError
+	} ReverseDNSStatus;
+
+	/**
+	 * The names an address points to, the hostname is only set when one
+	 *  of the names resolves back to the address ( FCrDNS )
+	 */
+	struct ReverseDNSResult {
+		ReverseDNSStatus status;
+		string hostname;
+		vector<string> names;
+	};
+
+	struct ReverseDNSStats {
+		size_t hits;
+		size_t misses;
+		size_t entries;
+	};
+
+	/**
+	 * Resolves the PTR names of client addresses, and confirms them by
+	 *  resolving the names back to the address. The lookup starts when the
+	 *  client connects, and the result is cached per address for the lowest
+	 *  TTL of the answers
+	 */
+	class ReverseDNS {
+	public:
+		static void configure(const Json::Value &config);
+
+		/**
+		 * Starts the lookup of an address, if the result is cached or an lookup
+		 *  of the same address is running, that one is returned instead
+		 */
+		static shared_future<ReverseDNSResult> lookup(const string &address);
+
+		/**
+		 * Waits at most the configured timeout for the result, if the lookup
+		 *  did not finish in time, the result is an temporary error
+		 */
+		static ReverseDNSResult wait(const shared_future<ReverseDNSResult> &result);
+
+		/**
+		 * Gets the result as iprev method result ( RFC 8601 )
+		 */
+		static const char *statusToString(const ReverseDNSStatus status);
+
+		static ReverseDNSStats getStats();
+		static void clear();
+	};
+}
@@ -15,6 +15,7 @@
 */
 
 #include "AES256.src.h"
+#include "base64.src.h"
 
 namespace FSMTP::AES256
 {
@@ -126,27 +127,8 @@ namespace FSMTP::AES256
 		// Turns the ciphertext into base64
 		// ======================================
 
-		BIO *base64 = nullptr, *bio = nullptr;
-		BUF_MEM *bufMem = nullptr;
-
-		// Initializes the BIO's and sets the flags
-		base64 = BIO_new(BIO_f_base64());
-		bio = BIO_new(BIO_s_mem());
-		bio = BIO_push(base64, bio);
-		BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-
-		// Performs the encoding
-		BIO_write(bio, ret, ciptherTextLen);
-		BIO_flush(bio);
-		BIO_get_mem_ptr(bio, &bufMem);
-
-		// Creates the encrypted string, and frees
-		// - the bios
-		std::string encrypted(bufMem->data, bufMem->length);
-		BIO_free_all(bio);
-
 		// Creates the result, with the iv and salt
-		std::string result = encrypted;
+		std::string result = Encoding::encodeBase64(reinterpret_cast<const char *>(ret), ciptherTextLen);
 		result += '.';
 		result += std::string(reinterpret_cast<const char *>(iv), _AES256_IV_SIZE_BYTES);
 		result += '.';
@@ -204,18 +186,9 @@ namespace FSMTP::AES256
 		// Decodes the Base64 string to bytes
 		// ======================================
 
-		BIO *base64 = nullptr, *bio = nullptr;
-		std::string toDecode = encrypted.substr(0, ivIndex);
-		unsigned char *decoded = new unsigned char[toDecode.size()];
-
-		// Prepares the decoder
-		base64 = BIO_new(BIO_f_base64());
-		bio = BIO_new_mem_buf(toDecode.c_str(), toDecode.size());
-		bio = BIO_push(base64, bio);
-		BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-
-		// Reads the decoded base64 data
-		decodedLen = BIO_read(bio, decoded, toDecode.size());
+		// The ciphertext is in front of the iv
+		std::string decoded = Encoding::decodeBase64(encrypted.c_str(), ivIndex);
+		decodedLen = decoded.size();
 
 		// ======================================
 		// Decrypts
@@ -229,8 +202,6 @@ namespace FSMTP::AES256
 		ctx = EVP_CIPHER_CTX_new();
 		if (!ctx)
 		{
-			BIO_free_all(bio);
-			delete[] decoded;
 			throw std::runtime_error("EVP_CIPHER_CTX_new() failed");
 		}
 
@@ -239,8 +210,6 @@ namespace FSMTP::AES256
 		if (rc != 1)
 		{
 			EVP_CIPHER_CTX_free(ctx);
-			BIO_free_all(bio);
-			delete[] decoded;
 			throw std::runtime_error("EVP_DecryptInit() failed");
 		}
 
@@ -249,14 +218,12 @@ namespace FSMTP::AES256
 			ctx,
 			ret,
 			&len,
-			decoded,
+			reinterpret_cast<const unsigned char *>(decoded.c_str()),
 			decodedLen
 		);
 		if (rc != 1)
 		{
 			EVP_CIPHER_CTX_free(ctx);
-			BIO_free_all(bio);
-			delete[] decoded;
 			throw std::runtime_error("EVP_DecryptUpdate() failed");
 		}
 		plainTextLen = len;
@@ -266,8 +233,6 @@ namespace FSMTP::AES256
 		if (rc != 1)
 		{
 			EVP_CIPHER_CTX_free(ctx);
-			BIO_free_all(bio);
-			delete[] decoded;
 			throw std::runtime_error("EVP_DecryptFinal_ex() failed");
 		}
 		plainTextLen += len;
@@ -275,8 +240,6 @@ namespace FSMTP::AES256
 		// Creates the result, frees the memory and returns
 		std::string result(reinterpret_cast<const char *>(ret), plainTextLen);
 		EVP_CIPHER_CTX_free(ctx);
-		BIO_free_all(bio);
-		delete[] decoded;
 		return result;
 	}
 }
\ No newline at end of file
@@ -50,14 +50,32 @@ Json::Value &Global::getConfig() noexcept {
 	return _global_config;
 }
 
-unique_ptr<CassandraConnection> Global::getCassandra() {
+shared_ptr<CassandraConnection> Global::getCassandra() {
+	static mutex cassandraMutex;
+	static shared_ptr<CassandraConnection> cassandra;
 	const Json::Value &conf = _global_config;
 
-	return make_unique<CassandraConnection>(
+	// The session is thread safe and keeps its own connection pool, so
+	//  the whole process shares one, which is created on first use
+	lock_guard<mutex> lock(cassandraMutex);
+	if (cassandra) return cassandra;
+
+	CassandraOptions options;
+	options.ioThreads = conf["database"]["cassandra_io_threads"].asUInt();
+	options.connectionsPerHost = conf["database"]["cassandra_connections_per_host"].asUInt();
+	options.tokenAware = conf["database"].get("cassandra_token_aware", true).asBool();
+	options.latencyAware = conf["database"]["cassandra_latency_aware"].asBool();
+	options.speculativeDelay = conf["database"]["cassandra_speculative_delay_ms"].asInt64();
+	options.speculativeExecutions = conf["database"]["cassandra_speculative_executions"].asInt();
+
+	cassandra = make_shared<CassandraConnection>(
 		conf["database"]["cassandra_hosts"].asCString(),
 		conf["database"]["cassandra_username"].asCString(),
-		conf["database"]["cassandra_password"].asCString()
+		conf["database"]["cassandra_password"].asCString(),
+		options
 	);
+
+	return cassandra;
 }
 unique_ptr<RedisConnection> Global::getRedis() {
 	const Json::Value &conf = _global_config;
@@ -33,7 +33,7 @@ namespace FSMTP
     static void configure();
     static void readConfig(const char *config, const char *fallbackConfig);
     static Json::Value &getConfig() noexcept;
-    static unique_ptr<CassandraConnection> getCassandra();
+    static shared_ptr<CassandraConnection> getCassandra();
     static unique_ptr<RedisConnection> getRedis();
 		static unique_ptr<SSLContext> getSSLContext(const SSL_METHOD *method);
   };
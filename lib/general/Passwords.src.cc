@@ -15,6 +15,7 @@
 */
 
 #include "Passwords.src.h"
+#include "base64.src.h"
 
 namespace FSMTP {
 	static char _saltDict[] = {
@@ -87,25 +88,6 @@ namespace FSMTP {
 		// Encodes
 		// ====================================
 
-		BIO *bio = nullptr, *base64 = nullptr;
-		BUF_MEM *bufMem = nullptr;
-
-		// Initializes the base64 encoder and sets the flags
-		base64 = BIO_new(BIO_f_base64());
-		bio = BIO_new(BIO_s_mem());
-		bio = BIO_push(base64, bio);
-		BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-
-		// Generates the bsae64 encoded string
-		BIO_write(bio, out, sizeof(out));
-		BIO_flush(bio);
-		BIO_get_mem_ptr(bio, &bufMem);
-
-		// Creates the result and frees the memory
-		string res(bufMem->data, bufMem->length);
-		BIO_free_all(bio);
-
-		// Frees the memory
-		return res;
+		return Encoding::encodeBase64(reinterpret_cast<char *>(out), sizeof (out));
 	}
 }
\ No newline at end of file
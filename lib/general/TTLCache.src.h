@@ -0,0 +1,80 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <unordered_map>
+
+#include "../default.h"
+
+namespace FSMTP
+{
+	/**
+	 * Map of values which expire after their TTL, bounded by an number of
+	 *  entries. When it is full the expired entries are removed first, and
+	 *  else an arbitrary one, a limit of zero disables the cache. It is not
+	 *  thread safe, the owner keeps it behind its own lock
+	 */
+	template<typename V>
+	class TTLCache
+	{
+	public:
+		explicit TTLCache(const size_t maxEntries): c_MaxEntries(maxEntries) {}
+
+		/**
+		 * Gets the value if it is present and not expired, else nullptr,
+		 *  the pointer is valid until the cache is changed
+		 */
+		const V *get(const string &key) const {
+			auto it = this->c_Entries.find(key);
+			if (it == this->c_Entries.end() || it->second.expires <= steady_clock::now()) return nullptr;
+			return &it->second.value;
+		}
+
+		void put(const string &key, const V &value, const uint32_t ttl) {
+			if (this->c_MaxEntries == 0) return;
+
+			auto now = steady_clock::now();
+			if (this->c_Entries.size() >= this->c_MaxEntries && this->c_Entries.find(key) == this->c_Entries.end()) {
+				for (auto it = this->c_Entries.begin(); it != this->c_Entries.end();) {
+					if (it->second.expires <= now) it = this->c_Entries.erase(it);
+					else ++it;
+				}
+
+				if (this->c_Entries.size() >= this->c_MaxEntries && !this->c_Entries.empty())
+					this->c_Entries.erase(this->c_Entries.begin());
+			}
+
+			this->c_Entries[key] = Entry { value, now + seconds(max<uint32_t>(ttl, 1)) };
+		}
+
+		void setMaxEntries(const size_t maxEntries) {
+			this->c_MaxEntries = maxEntries;
+			if (maxEntries == 0) this->c_Entries.clear();
+		}
+
+		size_t size(void) const { return this->c_Entries.size(); }
+		void clear(void) { this->c_Entries.clear(); }
+	private:
+		struct Entry {
+			V value;
+			steady_clock::time_point expires;
+		};
+
+		unordered_map<string, Entry> c_Entries;
+		size_t c_MaxEntries;
+	};
+}
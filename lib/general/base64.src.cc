@@ -0,0 +1,415 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "base64.src.h"
+#include "whitespace.src.h"
+
+#include <array>
+
+#if defined(__x86_64__)
+#define _BASE64_X86
+#include <immintrin.h>
+#endif
+
+#define _BASE64_WSP 0x40
+#define _BASE64_PAD 0x41
+#define _BASE64_INVALID 0xFF
+
+// The AVX2 decoder stores 32 bytes for each 24 it decodes
+#define _BASE64_DECODE_SLACK 32
+
+namespace FSMTP::Encoding
+{
+	static const char *base64Alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+	/**
+	 * Maps each character to its value, whitespace and padding get an value
+	 *  above 63, so an quad is only valid when none of them has bit 6 or 7 set
+	 */
+	static const array<uint8_t, 256> base64Values = []() {
+		array<uint8_t, 256> values;
+		values.fill(_BASE64_INVALID);
+
+		for (uint8_t i = 0; i < 64; ++i) values[static_cast<uint8_t>(base64Alphabet[i])] = i;
+		for (const char c : { ' ', '\t', '\r', '\n' }) values[static_cast<uint8_t>(c)] = _BASE64_WSP;
+		values['='] = _BASE64_PAD;
+
+		return values;
+	}();
+
+	// ==================================
+	// Scalar kernels
+	// ==================================
+
+	static size_t encodeScalar(const uint8_t *data, const size_t len, char *out) {
+		char *start = out;
+		size_t i = 0;
+
+		for (; i + 3 <= len; i += 3) {
+			const uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+			*out++ = base64Alphabet[v >> 18];
+			*out++ = base64Alphabet[(v >> 12) & 0x3F];
+			*out++ = base64Alphabet[(v >> 6) & 0x3F];
+			*out++ = base64Alphabet[v & 0x3F];
+		}
+
+		if (i < len) {
+			const uint32_t v = (data[i] << 16) | (i + 1 < len ? data[i + 1] << 8 : 0);
+			*out++ = base64Alphabet[v >> 18];
+			*out++ = base64Alphabet[(v >> 12) & 0x3F];
+			*out++ = i + 1 < len ? base64Alphabet[(v >> 6) & 0x3F] : '=';
+			*out++ = '=';
+		}
+
+		return out - start;
+	}
+
+	/**
+	 * Decodes whole quads until one contains whitespace, padding or an
+	 *  invalid character, returns the number of bytes consumed
+	 */
+	static size_t decodeQuadsScalar(const uint8_t *data, const size_t len, char *&out) {
+		size_t i = 0;
+
+		for (; i + 4 <= len; i += 4) {
+			const uint32_t a = base64Values[data[i]], b = base64Values[data[i + 1]];
+			const uint32_t c = base64Values[data[i + 2]], d = base64Values[data[i + 3]];
+			if ((a | b | c | d) & 0xC0) break;
+
+			const uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+			*out++ = static_cast<char>(v >> 16);
+			*out++ = static_cast<char>(v >> 8);
+			*out++ = static_cast<char>(v);
+		}
+
+		return i;
+	}
+
+#ifdef _BASE64_X86
+	// ==================================
+	// AVX2 kernels
+	// ==================================
+
+	// Based on the vectorized codecs of Wojciech Muła and Daniel Lemire, each
+	//  block of 24 bytes is spread over 32 lanes of 6 bits and translated with
+	//  an lookup of the offset to add, and decoding does the reverse. There is
+	//  no SSE2 variant, since the lookups need pshufb ( SSSE3 )
+
+	__attribute__((target("avx2")))
+	static inline __m256i encodeReshuffleAVX2(const __m256i block) {
+		const __m256i in = _mm256_shuffle_epi8(block, _mm256_set_epi8(
+			10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+			14, 15, 13, 14, 11, 12, 10, 11, 8, 9, 7, 8, 5, 6, 4, 5
+		));
+
+		const __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00));
+		const __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		const __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0));
+		const __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		return _mm256_or_si256(t1, t3);
+	}
+
+	__attribute__((target("avx2")))
+	static inline __m256i encodeTranslateAVX2(const __m256i in) {
+		const __m256i offsets = _mm256_setr_epi8(
+			65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0,
+			65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0
+		);
+
+		// Values 0-25 use the first offset, 26-51 the second, and the rest
+		//  the offset for their own value
+		__m256i indices = _mm256_subs_epu8(in, _mm256_set1_epi8(51));
+		indices = _mm256_sub_epi8(indices, _mm256_cmpgt_epi8(in, _mm256_set1_epi8(25)));
+		return _mm256_add_epi8(in, _mm256_shuffle_epi8(offsets, indices));
+	}
+
+	/**
+	 * Encodes blocks of 24 bytes, each block is loaded 4 bytes early so the
+	 *  shuffle can move bytes between the two lanes, returns the bytes consumed
+	 */
+	__attribute__((target("avx2")))
+	static size_t encodeAVX2(const uint8_t *data, const size_t len, char *out) {
+		if (len < 28) return 0;
+
+		// The first load masks the 4 bytes in front of the data
+		__m256i block = _mm256_maskload_epi32(
+			reinterpret_cast<const int *>(data - 4),
+			_mm256_set_epi32(-1, -1, -1, -1, -1, -1, -1, 0)
+		);
+
+		size_t i = 0;
+		for (;;) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(out), encodeTranslateAVX2(encodeReshuffleAVX2(block)));
+			out += 32;
+			i += 24;
+
+			if (i + 28 > len) break;
+			block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i - 4));
+		}
+
+		return i;
+	}
+
+	/**
+	 * Decodes blocks of 32 characters into 24 bytes, until an block contains
+	 *  anything but the alphabet, returns the number of characters consumed
+	 */
+	__attribute__((target("avx2")))
+	static size_t decodeAVX2(const uint8_t *data, const size_t len, char *&out) {
+		const __m256i lutLow = _mm256_setr_epi8(
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+		);
+		const __m256i lutHigh = _mm256_setr_epi8(
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+		);
+		const __m256i lutRoll = _mm256_setr_epi8(
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+			0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+		);
+		const __m256i mask2F = _mm256_set1_epi8(0x2F);
+
+		size_t i = 0;
+		for (; i + 32 <= len; i += 32) {
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+
+			// An character is valid when the bits of its low and high nibble
+			//  in the lookups do not overlap
+			const __m256i highNibbles = _mm256_and_si256(_mm256_srli_epi32(block, 4), mask2F);
+			const __m256i low = _mm256_shuffle_epi8(lutLow, _mm256_and_si256(block, mask2F));
+			const __m256i high = _mm256_shuffle_epi8(lutHigh, highNibbles);
+			if (!_mm256_testz_si256(low, high)) break;
+
+			const __m256i eq2F = _mm256_cmpeq_epi8(block, mask2F);
+			block = _mm256_add_epi8(block, _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(eq2F, highNibbles)));
+
+			// Packs the 6 bit values into 3 bytes for each 4 lanes
+			const __m256i merged = _mm256_maddubs_epi16(block, _mm256_set1_epi32(0x01400140));
+			__m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+			packed = _mm256_shuffle_epi8(packed, _mm256_setr_epi8(
+				2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+				2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+			));
+			packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, -1, -1));
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(out), packed);
+			out += 24;
+		}
+
+		return i;
+	}
+#endif
+
+	// ==================================
+	// Dispatch
+	// ==================================
+
+	/**
+	 * Decodes the data into out, the quad which is not complete at the end is
+	 *  kept in the state, returns the number of bytes written
+	 */
+	static size_t decodeChunk(
+		const uint8_t *data, const size_t len, char *out,
+		uint32_t &quad, size_t &quadLength, size_t &padding
+	) {
+		const Cleanup::SIMDLevel level = Cleanup::getSIMDLevel();
+		char *start = out;
+		size_t i = 0;
+
+		while (i < len) {
+			// Takes the fast paths when we're at the start of an quad, these stop
+			//  at the first line break or padding. An line break is skipped as a
+			//  whole, so the next line starts on the fast paths again
+			if (quadLength == 0 && padding == 0) {
+				#ifdef _BASE64_X86
+				if (level == Cleanup::SIMDAVX2) i += decodeAVX2(data + i, len - i, out);
+				#endif
+				i += decodeQuadsScalar(data + i, len - i, out);
+
+				const size_t skipped = i;
+				while (i < len && base64Values[data[i]] == _BASE64_WSP) ++i;
+				if (i != skipped) continue;
+				if (i >= len) break;
+			}
+
+			const uint8_t value = base64Values[data[i++]];
+			if (value == _BASE64_WSP) continue;
+			else if (value == _BASE64_INVALID) {
+				throw runtime_error(EXCEPT_DEBUG("Invalid base64 character"));
+			} else if (value == _BASE64_PAD) {
+				if (quadLength < 2 || quadLength + ++padding > 4)
+					throw runtime_error(EXCEPT_DEBUG("Invalid base64 padding"));
+
+				// The padding completes the quad, only the bytes in front
+				//  of it are written
+				if (quadLength + padding == 4) {
+					quad <<= 6 * (4 - quadLength);
+					*out++ = static_cast<char>(quad >> 16);
+					if (quadLength == 3) *out++ = static_cast<char>(quad >> 8);
+					quad = 0;
+					quadLength = 0;
+				}
+
+				continue;
+			}
+
+			if (padding) throw runtime_error(EXCEPT_DEBUG("Invalid base64 data after padding"));
+
+			quad = (quad << 6) | value;
+			if (++quadLength == 4) {
+				*out++ = static_cast<char>(quad >> 16);
+				*out++ = static_cast<char>(quad >> 8);
+				*out++ = static_cast<char>(quad);
+				quad = 0;
+				quadLength = 0;
+			}
+		}
+
+		return out - start;
+	}
+
+	size_t base64EncodedLength(const size_t len) {
+		return (len + 2) / 3 * 4;
+	}
+
+	size_t encodeBase64(const char *data, const size_t len, char *out) {
+		const uint8_t *in = reinterpret_cast<const uint8_t *>(data);
+		size_t i = 0, written = 0;
+
+		#ifdef _BASE64_X86
+		if (Cleanup::getSIMDLevel() == Cleanup::SIMDAVX2) {
+			i = encodeAVX2(in, len, out);
+			written = i / 3 * 4;
+		}
+		#endif
+
+		return written + encodeScalar(in + i, len - i, out + written);
+	}
+
+	string encodeBase64(const char *data, const size_t len) {
+		string res(base64EncodedLength(len), '\0');
+		encodeBase64(data, len, &res[0]);
+		return res;
+	}
+
+	string encodeBase64(const string &raw) {
+		return encodeBase64(raw.c_str(), raw.size());
+	}
+
+	string decodeBase64(const char *data, const size_t len) {
+		string res;
+		Base64Decoder decoder;
+		decoder.update(data, len, res);
+		decoder.finish(res);
+		return res;
+	}
+
+	string decodeBase64(const string &raw) {
+		return decodeBase64(raw.c_str(), raw.size());
+	}
+
+	// ==================================
+	// Streaming
+	// ==================================
+
+	Base64Encoder::Base64Encoder(const size_t lineLength):
+		m_LineLength(lineLength == 0 ? 0 : max<size_t>(lineLength / 4 * 4, 4)),
+		m_Column(0), m_PendingLength(0)
+	{}
+
+	/**
+	 * Encodes the data, and breaks the lines when they are full
+	 */
+	void Base64Encoder::write(const char *data, size_t len, string &out) {
+		while (len > 0) {
+			size_t n = len;
+			if (this->m_LineLength) n = min(n, (this->m_LineLength - this->m_Column) / 4 * 3);
+
+			const size_t old = out.size();
+			out.resize(old + base64EncodedLength(n));
+			this->m_Column += encodeBase64(data, n, &out[old]);
+			data += n;
+			len -= n;
+
+			if (this->m_LineLength && this->m_Column >= this->m_LineLength) {
+				out += "\r\n";
+				this->m_Column = 0;
+			}
+		}
+	}
+
+	void Base64Encoder::update(const char *data, size_t len, string &out) {
+		// Completes the bytes left from the previous piece first, so that
+		//  only the last piece may have an partial group
+		if (this->m_PendingLength > 0) {
+			while (this->m_PendingLength < 3 && len > 0) {
+				this->m_Pending[this->m_PendingLength++] = *data++;
+				--len;
+			}
+
+			if (this->m_PendingLength < 3) return;
+			this->write(this->m_Pending, 3, out);
+			this->m_PendingLength = 0;
+		}
+
+		const size_t whole = len / 3 * 3;
+		this->write(data, whole, out);
+
+		memcpy(this->m_Pending, data + whole, len - whole);
+		this->m_PendingLength = len - whole;
+	}
+
+	void Base64Encoder::finish(string &out) {
+		this->write(this->m_Pending, this->m_PendingLength, out);
+		if (this->m_LineLength && this->m_Column > 0) out += "\r\n";
+
+		this->m_PendingLength = 0;
+		this->m_Column = 0;
+	}
+
+	Base64Decoder::Base64Decoder():
+		m_Quad(0), m_QuadLength(0), m_Padding(0)
+	{}
+
+	void Base64Decoder::update(const char *data, const size_t len, string &out) {
+		const size_t old = out.size();
+		out.resize(old + (len + this->m_QuadLength) / 4 * 3 + _BASE64_DECODE_SLACK);
+
+		const size_t written = decodeChunk(
+			reinterpret_cast<const uint8_t *>(data), len, &out[old],
+			this->m_Quad, this->m_QuadLength, this->m_Padding
+		);
+		out.resize(old + written);
+	}
+
+	void Base64Decoder::finish(string &out) {
+		DEFER_M({
+			this->m_Quad = 0;
+			this->m_QuadLength = 0;
+			this->m_Padding = 0;
+		});
+
+		// Data without padding is accepted, as long as the last quad
+		//  contains at least one whole byte
+		if (this->m_QuadLength == 1) throw runtime_error(EXCEPT_DEBUG("Invalid base64 length"));
+		if (this->m_QuadLength == 0) return;
+
+		const uint32_t quad = this->m_Quad << (6 * (4 - this->m_QuadLength));
+		out += static_cast<char>(quad >> 16);
+		if (this->m_QuadLength == 3) out += static_cast<char>(quad >> 8);
+	}
+}
@@ -0,0 +1,75 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include "../default.h"
+
+namespace FSMTP::Encoding
+{
+	/**
+	 * Gets the length of the encoded data, without line breaks
+	 */
+	size_t base64EncodedLength(const size_t len);
+
+	/**
+	 * Encodes the data into out, which must have room for the encoded
+	 *  length, returns the number of bytes written
+	 */
+	size_t encodeBase64(const char *data, const size_t len, char *out);
+	string encodeBase64(const char *data, const size_t len);
+	string encodeBase64(const string &raw);
+
+	/**
+	 * Decodes the data, whitespace and line breaks are skipped, so folded
+	 *  header values and MIME bodies can be decoded as they are
+	 */
+	string decodeBase64(const char *data, const size_t len);
+	string decodeBase64(const string &raw);
+
+	/**
+	 * Encodes data which arrives in pieces, when an line length is given
+	 *  an CRLF is inserted after each line ( 76 for MIME )
+	 */
+	class Base64Encoder {
+	public:
+		Base64Encoder(const size_t lineLength = 0);
+
+		void update(const char *data, const size_t len, string &out);
+		void finish(string &out);
+	private:
+		void write(const char *data, const size_t len, string &out);
+
+		size_t m_LineLength, m_Column;
+		char m_Pending[3];
+		size_t m_PendingLength;
+	};
+
+	/**
+	 * Decodes data which arrives in pieces, an quad may be split over
+	 *  multiple pieces, throws an runtime_error on invalid data
+	 */
+	class Base64Decoder {
+	public:
+		Base64Decoder();
+
+		void update(const char *data, const size_t len, string &out);
+		void finish(string &out);
+	private:
+		uint32_t m_Quad;
+		size_t m_QuadLength, m_Padding;
+	};
+}
@@ -19,20 +19,9 @@
 namespace FSMTP::Cleanup
 {
 	void reduceWhitespace(const std::string &raw, std::string &ret) {
-		bool lww = false;
-		for (const char &c : raw)
-		{
-			if (c == ' ')
-			{
-				if (lww) continue;
-				ret += c;
-				lww = true;
-			} else
-			{
-				ret += c;
-				lww = false;
-			}
-		}
+		size_t offset = ret.size();
+		ret.resize(offset + raw.size());
+		ret.resize(offset + collapseWhitespace(raw.c_str(), raw.size(), &ret[offset], false));
 
 		removeFirstAndLastWhite(ret);
 	}
@@ -19,6 +19,8 @@
 #include <string>
 #include <cstdint>
 
+#include "whitespace.src.h"
+
 namespace FSMTP::Cleanup
 {
 	void reduceWhitespace(const std::string &raw, std::string &ret);
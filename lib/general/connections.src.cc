@@ -18,7 +18,10 @@
 
 namespace FSMTP::Connections
 {
-	CassandraConnection::CassandraConnection(const char *hosts, const char *username, const char *password)
+	CassandraConnection::CassandraConnection(
+		const char *hosts, const char *username, const char *password,
+		const CassandraOptions &options
+	)
 	{
 		this->c_Cluster = cass_cluster_new();
 		this->c_ConnectFuture = nullptr;
@@ -27,6 +30,23 @@ namespace FSMTP::Connections
 		cass_cluster_set_contact_points(this->c_Cluster, hosts);
 		if (username != nullptr && password != nullptr)
 			cass_cluster_set_credentials(this->c_Cluster, username, password);
+
+		// Applies the tuning, the speculative executions are only used for
+		// - statements which are marked as idempotent ( the reads )
+		if (options.ioThreads > 0)
+			cass_cluster_set_num_threads_io(this->c_Cluster, options.ioThreads);
+		if (options.connectionsPerHost > 0)
+		{
+			cass_cluster_set_core_connections_per_host(this->c_Cluster, options.connectionsPerHost);
+			cass_cluster_set_max_connections_per_host(this->c_Cluster, options.connectionsPerHost);
+		}
+
+		cass_cluster_set_token_aware_routing(this->c_Cluster, options.tokenAware ? cass_true : cass_false);
+		cass_cluster_set_latency_aware_routing(this->c_Cluster, options.latencyAware ? cass_true : cass_false);
+
+		if (options.speculativeExecutions > 0)
+			cass_cluster_set_constant_speculative_execution_policy(
+				this->c_Cluster, options.speculativeDelay, options.speculativeExecutions);
 		this->c_ConnectFuture = cass_session_connect(this->c_Session, this->c_Cluster);
 
 		if (cass_future_error_code(this->c_ConnectFuture) != CASS_OK)
@@ -25,12 +25,28 @@
 
 namespace FSMTP::Connections
 {
+	/**
+	 * Tuning of the cassandra cluster, zero values keep the
+	 *  defaults of the driver
+	 */
+	struct CassandraOptions {
+		unsigned ioThreads = 0;
+		unsigned connectionsPerHost = 0;
+		bool tokenAware = true;
+		bool latencyAware = false;
+		int64_t speculativeDelay = 0;
+		int speculativeExecutions = 0;
+	};
+
 	class CassandraConnection
 	{
 	public:
 		static std::string getError(CassFuture *future);
 
-		CassandraConnection(const char *hosts, const char *username, const char *password);
+		CassandraConnection(
+			const char *hosts, const char *username, const char *password,
+			const CassandraOptions &options = CassandraOptions()
+		);
 		~CassandraConnection();
 
 		CassSession *c_Session;
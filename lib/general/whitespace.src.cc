@@ -0,0 +1,327 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "whitespace.src.h"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__)
+#define _WHITESPACE_X86
+#include <immintrin.h>
+#endif
+
+namespace FSMTP::Cleanup
+{
+	// ==================================
+	// Scalar kernels
+	// ==================================
+
+	static size_t findLineBreakScalar(const char *data, const size_t len) {
+		for (size_t i = 0; i < len; ++i)
+			if (data[i] == '\r' || data[i] == '\n') return i;
+		return len;
+	}
+
+	static inline bool isFoldable(const char c) {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	static size_t findWhitespaceFoldScalar(const char *data, const size_t len) {
+		for (size_t i = 0; i < len; ++i) {
+			const char c = data[i];
+			if (c == '\t' || c == '\r' || c == '\n') return i;
+			if (c == ' ' && (i + 1 == len || isFoldable(data[i + 1]))) return i;
+		}
+
+		return len;
+	}
+
+	static size_t collapseWhitespaceScalar(
+		const char *data, const size_t len, char *out,
+		const bool tabs, bool &lastWasSpace
+	) {
+		char *start = out;
+
+		for (size_t i = 0; i < len; ++i) {
+			const char c = data[i];
+
+			if (c == ' ' || (tabs && c == '\t')) {
+				if (!lastWasSpace) *out++ = ' ';
+				lastWasSpace = true;
+			} else {
+				*out++ = c;
+				lastWasSpace = false;
+			}
+		}
+
+		return out - start;
+	}
+
+	static size_t collapseWhitespaceScalar(const char *data, const size_t len, char *out, const bool tabs) {
+		bool lastWasSpace = false;
+		return collapseWhitespaceScalar(data, len, out, tabs, lastWasSpace);
+	}
+
+	static size_t trimTrailingWhitespaceScalar(const char *data, size_t len) {
+		while (len > 0 && (data[len - 1] == ' ' || data[len - 1] == '\t')) --len;
+		return len;
+	}
+
+#ifdef _WHITESPACE_X86
+	// ==================================
+	// SSE2 kernels
+	// ==================================
+
+	// Each kernel builds an bitmask of the interesting bytes in a block of 16
+	//  ( or 32 ) bytes, and only falls back to the scalar code for the tail,
+	//  or for blocks that actually need to be changed
+
+	static inline uint32_t lineBreakMaskSSE2(const __m128i block) {
+		return _mm_movemask_epi8(_mm_or_si128(
+			_mm_cmpeq_epi8(block, _mm_set1_epi8('\r')),
+			_mm_cmpeq_epi8(block, _mm_set1_epi8('\n'))
+		));
+	}
+
+	static inline uint32_t wspMaskSSE2(const __m128i block, const bool tabs) {
+		__m128i mask = _mm_cmpeq_epi8(block, _mm_set1_epi8(' '));
+		if (tabs) mask = _mm_or_si128(mask, _mm_cmpeq_epi8(block, _mm_set1_epi8('\t')));
+		return _mm_movemask_epi8(mask);
+	}
+
+	static size_t findLineBreakSSE2(const char *data, const size_t len) {
+		size_t i = 0;
+
+		for (; i + 16 <= len; i += 16) {
+			uint32_t mask = lineBreakMaskSSE2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+			if (mask) return i + __builtin_ctz(mask);
+		}
+
+		return i + findLineBreakScalar(data + i, len - i);
+	}
+
+	static size_t findWhitespaceFoldSSE2(const char *data, const size_t len) {
+		size_t i = 0;
+
+		// Compares each block with the same block shifted by one byte, so we
+		//  know for every space if whitespace or an line break follows it
+		for (; i + 17 <= len; i += 16) {
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+			__m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 1));
+
+			uint32_t breaks = lineBreakMaskSSE2(block) | static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\t'))));
+			uint32_t spaces = _mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')));
+			uint32_t mask = breaks | (spaces & (lineBreakMaskSSE2(next) | wspMaskSSE2(next, true)));
+			if (mask) return i + __builtin_ctz(mask);
+		}
+
+		return i + findWhitespaceFoldScalar(data + i, len - i);
+	}
+
+	static inline void collapseBlockSSE2(const char *data, char *&out, const bool tabs, bool &lastWasSpace) {
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+		uint32_t wsp = wspMaskSSE2(block, tabs);
+
+		// Blocks without tabs and without two adjacent spaces ( also across
+		//  the previous block ) stay the same, so they are copied as a whole
+		uint32_t tabsMask = tabs ? static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, _mm_set1_epi8('\t')))) : 0;
+		if (!tabsMask && !(wsp & ((wsp << 1) | (lastWasSpace ? 1 : 0)))) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(out), block);
+			out += 16;
+			lastWasSpace = wsp & 0x8000;
+			return;
+		}
+
+		out += collapseWhitespaceScalar(data, 16, out, tabs, lastWasSpace);
+	}
+
+	static size_t collapseWhitespaceSSE2(const char *data, const size_t len, char *out, const bool tabs) {
+		char *start = out;
+		bool lastWasSpace = false;
+		size_t i = 0;
+
+		for (; i + 16 <= len; i += 16) collapseBlockSSE2(data + i, out, tabs, lastWasSpace);
+
+		out += collapseWhitespaceScalar(data + i, len - i, out, tabs, lastWasSpace);
+		return out - start;
+	}
+
+	static size_t trimTrailingWhitespaceSSE2(const char *data, size_t len) {
+		while (len >= 16) {
+			__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + len - 16));
+			uint32_t other = ~wspMaskSSE2(block, true) & 0xFFFF;
+			if (other) return len - 16 + (31 - __builtin_clz(other)) + 1;
+			len -= 16;
+		}
+
+		return trimTrailingWhitespaceScalar(data, len);
+	}
+
+	// ==================================
+	// AVX2 kernels
+	// ==================================
+
+	__attribute__((target("avx2")))
+	static inline uint32_t lineBreakMaskAVX2(const __m256i block) {
+		return _mm256_movemask_epi8(_mm256_or_si256(
+			_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\r')),
+			_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\n'))
+		));
+	}
+
+	__attribute__((target("avx2")))
+	static inline uint32_t wspMaskAVX2(const __m256i block, const bool tabs) {
+		__m256i mask = _mm256_cmpeq_epi8(block, _mm256_set1_epi8(' '));
+		if (tabs) mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t')));
+		return _mm256_movemask_epi8(mask);
+	}
+
+	__attribute__((target("avx2")))
+	static size_t findLineBreakAVX2(const char *data, const size_t len) {
+		size_t i = 0;
+
+		for (; i + 32 <= len; i += 32) {
+			uint32_t mask = lineBreakMaskAVX2(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i)));
+			if (mask) return i + __builtin_ctz(mask);
+		}
+
+		return i + findLineBreakSSE2(data + i, len - i);
+	}
+
+	__attribute__((target("avx2")))
+	static size_t findWhitespaceFoldAVX2(const char *data, const size_t len) {
+		size_t i = 0;
+
+		for (; i + 33 <= len; i += 32) {
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+			__m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i + 1));
+
+			uint32_t breaks = lineBreakMaskAVX2(block) | static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t'))));
+			uint32_t spaces = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8(' ')));
+			uint32_t mask = breaks | (spaces & (lineBreakMaskAVX2(next) | wspMaskAVX2(next, true)));
+			if (mask) return i + __builtin_ctz(mask);
+		}
+
+		return i + findWhitespaceFoldSSE2(data + i, len - i);
+	}
+
+	__attribute__((target("avx2")))
+	static size_t collapseWhitespaceAVX2(const char *data, const size_t len, char *out, const bool tabs) {
+		char *start = out;
+		bool lastWasSpace = false;
+		size_t i = 0;
+
+		for (; i + 32 <= len; i += 32) {
+			__m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+			uint32_t wsp = wspMaskAVX2(block, tabs);
+
+			uint32_t tabsMask = tabs ? static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, _mm256_set1_epi8('\t')))) : 0;
+			if (!tabsMask && !(wsp & ((wsp << 1) | (lastWasSpace ? 1 : 0)))) {
+				_mm256_storeu_si256(reinterpret_cast<__m256i *>(out), block);
+				out += 32;
+				lastWasSpace = wsp & 0x80000000;
+				continue;
+			}
+
+			// Only the half that needs to be changed goes
+			//  through the scalar code
+			collapseBlockSSE2(data + i, out, tabs, lastWasSpace);
+			collapseBlockSSE2(data + i + 16, out, tabs, lastWasSpace);
+		}
+
+		for (; i + 16 <= len; i += 16) collapseBlockSSE2(data + i, out, tabs, lastWasSpace);
+
+		out += collapseWhitespaceScalar(data + i, len - i, out, tabs, lastWasSpace);
+		return out - start;
+	}
+#endif
+
+	// ==================================
+	// Dispatch
+	// ==================================
+
+	static SIMDLevel detectSIMDLevel() {
+		#ifdef _WHITESPACE_X86
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) return SIMDAVX2;
+		if (__builtin_cpu_supports("sse2")) return SIMDSSE2;
+		#endif
+		return SIMDNone;
+	}
+
+	static const SIMDLevel supportedLevel = detectSIMDLevel();
+	static std::atomic<SIMDLevel> activeLevel(supportedLevel);
+
+	SIMDLevel getSIMDLevel() {
+		return activeLevel;
+	}
+
+	SIMDLevel setSIMDLevel(const SIMDLevel level) {
+		activeLevel = level > supportedLevel ? supportedLevel : level;
+		return activeLevel;
+	}
+
+	const char *simdLevelToString(const SIMDLevel level) {
+		switch (level) {
+			case SIMDAVX2: return "AVX2";
+			case SIMDSSE2: return "SSE2";
+			default: return "scalar";
+		}
+	}
+
+	size_t findLineBreak(const char *data, const size_t len) {
+		switch (activeLevel.load(std::memory_order_relaxed)) {
+			#ifdef _WHITESPACE_X86
+			case SIMDAVX2: return findLineBreakAVX2(data, len);
+			case SIMDSSE2: return findLineBreakSSE2(data, len);
+			#endif
+			default: return findLineBreakScalar(data, len);
+		}
+	}
+
+	size_t findWhitespaceFold(const char *data, const size_t len) {
+		switch (activeLevel.load(std::memory_order_relaxed)) {
+			#ifdef _WHITESPACE_X86
+			case SIMDAVX2: return findWhitespaceFoldAVX2(data, len);
+			case SIMDSSE2: return findWhitespaceFoldSSE2(data, len);
+			#endif
+			default: return findWhitespaceFoldScalar(data, len);
+		}
+	}
+
+	size_t collapseWhitespace(const char *data, const size_t len, char *out, const bool tabs) {
+		switch (activeLevel.load(std::memory_order_relaxed)) {
+			#ifdef _WHITESPACE_X86
+			case SIMDAVX2: return collapseWhitespaceAVX2(data, len, out, tabs);
+			case SIMDSSE2: return collapseWhitespaceSSE2(data, len, out, tabs);
+			#endif
+			default: return collapseWhitespaceScalar(data, len, out, tabs);
+		}
+	}
+
+	size_t trimTrailingWhitespace(const char *data, const size_t len) {
+		// Trailing whitespace is rarely longer than a few bytes, so
+		//  16 byte blocks are enough for both SIMD levels
+		switch (activeLevel.load(std::memory_order_relaxed)) {
+			#ifdef _WHITESPACE_X86
+			case SIMDAVX2:
+			case SIMDSSE2: return trimTrailingWhitespaceSSE2(data, len);
+			#endif
+			default: return trimTrailingWhitespaceScalar(data, len);
+		}
+	}
+}
@@ -0,0 +1,61 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace FSMTP::Cleanup
+{
+	typedef enum : uint8_t {
+		SIMDNone = 0,
+		SIMDSSE2,
+		SIMDAVX2
+	} SIMDLevel;
+
+	/**
+	 * Gets the kernels in use, these are picked once from the features of
+	 *  the CPU, setSIMDLevel() may lower the level ( used by benchmarks ), but
+	 *  never above what the CPU supports
+	 */
+	SIMDLevel getSIMDLevel();
+	SIMDLevel setSIMDLevel(const SIMDLevel level);
+	const char *simdLevelToString(const SIMDLevel level);
+
+	/**
+	 * Gets the index of the first CR or LF, or len if there is none
+	 */
+	size_t findLineBreak(const char *data, const size_t len);
+
+	/**
+	 * Gets the index of the first byte where relaxed canonicalization may change
+	 *  something, an CR, LF, tab, or space followed by whitespace, an line break
+	 *  or the end of the data, single spaces between words are skipped
+	 */
+	size_t findWhitespaceFold(const char *data, const size_t len);
+
+	/**
+	 * Reduces every run of spaces ( and tabs, if tabs is set ) to one space,
+	 *  out must have room for len bytes, returns the number of bytes written
+	 */
+	size_t collapseWhitespace(const char *data, const size_t len, char *out, const bool tabs);
+
+	/**
+	 * Gets the length without the trailing spaces and tabs
+	 */
+	size_t trimTrailingWhitespace(const char *data, const size_t len);
+}
@@ -70,20 +70,17 @@ namespace FSMTP::IMAP
 		// ========================================
 		// Connects to the databases
 		//
-		// Connects to Redis and Cassandra so we
-		// - can receive users, messages etc
+		// Gets the shared Cassandra session and
+		// - connects to Redis so we can receive
+		// - users, messages etc
 		// ========================================
 
-		std::unique_ptr<CassandraConnection> cassandra;
+		std::shared_ptr<CassandraConnection> cassandra;
 		std::unique_ptr<RedisConnection> redis;
 
 		try
 		{
-			cassandra = std::make_unique<CassandraConnection>(
-				_config["database"]["cassandra_hosts"].asCString(),
-        _config["database"]["cassandra_username"].asCString(),
-        _config["database"]["cassandra_password"].asCString()
-			);
+			cassandra = Global::getCassandra();
 		} catch (const std::runtime_error &e)
 		{
 			logger << FATAL << "Could not connect to Cassandra: " << e.what() << ENDL << CLASSIC;
@@ -17,6 +17,7 @@
 #pragma once
 
 #include "IMAP.src.h"
+#include "../general/Global.src.h"
 #include "IMAPResponse.src.h"
 #include "IMAPCommand.src.h"
 #include "IMAPAuthHandler.src.h"
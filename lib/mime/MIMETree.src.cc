@@ -0,0 +1,312 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "MIMETree.src.h"
+#include "mimev2.src.h"
+#include "../general/base64.src.h"
+
+namespace FSMTP::MIME {
+  static inline bool __isSpace(const char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  static string_view __trim(string_view view) {
+    while (!view.empty() && __isSpace(view.front())) view.remove_prefix(1);
+    while (!view.empty() && __isSpace(view.back())) view.remove_suffix(1);
+    return view;
+  }
+
+  /**
+   * Gets the line at the position without its line break, and moves the
+   *  position to the start of the next line
+   */
+  static inline string_view __nextLine(string_view raw, size_t &pos) {
+    size_t end = raw.find('\n', pos), next;
+    if (end == string_view::npos) end = next = raw.size();
+    else next = end + 1;
+
+    string_view line = raw.substr(pos, end - pos);
+    if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+
+    pos = next;
+    return line;
+  }
+
+  bool MIMETree::equals(string_view a, string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i)
+      if (tolower(static_cast<unsigned char>(a[i])) != tolower(static_cast<unsigned char>(b[i]))) return false;
+    return true;
+  }
+
+  MIMETree::MIMETree(string_view message):
+    m_Message(message)
+  {
+    this->m_Nodes.reserve(8);
+    this->parse(message, _MIME_TREE_NONE, 0);
+  }
+
+  /**
+   * Parses the headers and body of an node, and the parts of it when it is an
+   *  multipart node, returns the index of the node
+   */
+  size_t MIMETree::parse(string_view raw, const size_t parent, const size_t depth) {
+    const size_t index = this->m_Nodes.size();
+    this->m_Nodes.push_back(MIMENode {
+      {}, raw, {}, {}, {}, {},
+      EmailContentType::ECT_TEXT_PLAIN, EmailTransferEncoding::ETE_7BIT,
+      depth, parent, _MIME_TREE_NONE, _MIME_TREE_NONE
+    });
+
+    // ================================
+    // Parses the headers
+    // ================================
+
+    // The headers end at the first empty line, continuation lines start with
+    //  whitespace and extend the value of the previous header. A line which is
+    //  no header at all is treated as the start of the body
+    vector<MIMEHeaderView> headers;
+    size_t pos = 0, bodyStart = raw.size();
+    while (pos < raw.size()) {
+      const size_t lineStart = pos;
+      string_view line = __nextLine(raw, pos);
+
+      if (line.empty()) {
+        bodyStart = pos;
+        break;
+      }
+
+      if (line[0] == ' ' || line[0] == '\t') {
+        if (headers.empty()) continue;
+
+        const char *valueStart = headers.back().value.data();
+        headers.back().value = string_view(valueStart, raw.data() + lineStart + line.size() - valueStart);
+        continue;
+      }
+
+      size_t sep = line.find(':');
+      if (sep == string_view::npos) {
+        bodyStart = lineStart;
+        break;
+      }
+
+      string_view key = line.substr(0, sep), value = line.substr(sep + 1);
+      while (!key.empty() && (key.back() == ' ' || key.back() == '\t')) key.remove_suffix(1);
+      while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+
+      headers.push_back(MIMEHeaderView { key, value });
+    }
+
+    MIMENode &node = this->m_Nodes[index];
+    node.body = raw.substr(bodyStart);
+
+    // ================================
+    // Gets the content type and
+    //  the transfer encoding
+    // ================================
+
+    for (const MIMEHeaderView &header : headers) {
+      if (MIMETree::equals(header.key, "content-transfer-encoding")) {
+        string_view encoding = __trim(header.value);
+        if (MIMETree::equals(encoding, "7bit")) node.encoding = EmailTransferEncoding::ETE_7BIT;
+        else if (MIMETree::equals(encoding, "8bit")) node.encoding = EmailTransferEncoding::ETE_8BIT;
+        else if (MIMETree::equals(encoding, "base64")) node.encoding = EmailTransferEncoding::ETE_BASE64;
+        else if (MIMETree::equals(encoding, "quoted-printable")) node.encoding = EmailTransferEncoding::ETE_QUOTED_PRINTABLE;
+        else node.encoding = EmailTransferEncoding::ETE_NOT_FUCKING_KNOWN;
+        continue;
+      } else if (!MIMETree::equals(header.key, "content-type")) continue;
+
+      const string_view value = header.value;
+      size_t semi = value.find(';');
+      node.contentType = __trim(value.substr(0, semi));
+
+      if (MIMETree::equals(node.contentType, "text/plain")) node.type = EmailContentType::ECT_TEXT_PLAIN;
+      else if (MIMETree::equals(node.contentType, "text/html")) node.type = EmailContentType::ECT_TEXT_HTML;
+      else if (MIMETree::equals(node.contentType, "multipart/alternative")) node.type = EmailContentType::ECT_MULTIPART_ALTERNATIVE;
+      else if (MIMETree::equals(node.contentType, "multipart/mixed")) node.type = EmailContentType::ECT_MULTIPART_MIXED;
+      else node.type = EmailContentType::ECT_NOT_FUCKING_KNOWN;
+
+      // Gets the parameters, semicolons inside of quoted values are
+      //  part of the value
+      while (semi != string_view::npos) {
+        size_t start = semi + 1, end = start;
+        for (bool quoted = false; end < value.size(); ++end) {
+          if (value[end] == '"') quoted = !quoted;
+          else if (value[end] == ';' && !quoted) break;
+        }
+        semi = end < value.size() ? end : string_view::npos;
+
+        string_view param = value.substr(start, end - start);
+        size_t eq = param.find('=');
+        if (eq == string_view::npos) continue;
+
+        string_view paramKey = __trim(param.substr(0, eq)), paramValue = __trim(param.substr(eq + 1));
+        if (paramValue.size() >= 2 && paramValue.front() == '"' && paramValue.back() == '"')
+          paramValue = paramValue.substr(1, paramValue.size() - 2);
+
+        if (MIMETree::equals(paramKey, "boundary")) node.boundary = paramValue;
+        else if (MIMETree::equals(paramKey, "charset")) node.charset = paramValue;
+      }
+    }
+
+    node.headers = move(headers);
+
+    const string_view body = node.body, boundary = node.boundary;
+    const bool multipart = node.contentType.size() > 10 && MIMETree::equals(node.contentType.substr(0, 10), "multipart/");
+    if (!multipart || boundary.empty() || depth >= _MIME_TREE_MAX_DEPTH) return index;
+
+    // ================================
+    // Parses the parts
+    // ================================
+
+    // Finds the delimiter lines, which may be followed by whitespace. The line
+    //  break in front of an delimiter belongs to it, and not to the part
+    size_t partStart = string_view::npos, lastChild = _MIME_TREE_NONE;
+    auto addPart = [&](const size_t end) {
+      const size_t child = this->parse(body.substr(partStart, end - partStart), index, depth + 1);
+      if (lastChild == _MIME_TREE_NONE) this->m_Nodes[index].firstChild = child;
+      else this->m_Nodes[lastChild].nextSibling = child;
+      lastChild = child;
+    };
+
+    pos = 0;
+    while (pos < body.size()) {
+      const size_t lineStart = pos;
+      string_view line = __nextLine(body, pos);
+
+      if (line.size() < boundary.size() + 2 || line[0] != '-' || line[1] != '-') continue;
+      if (line.compare(2, boundary.size(), boundary) != 0) continue;
+
+      string_view rest = line.substr(boundary.size() + 2);
+      const bool close = rest.size() >= 2 && rest[0] == '-' && rest[1] == '-';
+      if (close) rest.remove_prefix(2);
+      if (!__trim(rest).empty()) continue;
+
+      if (partStart != string_view::npos) {
+        size_t end = lineStart;
+        if (end > partStart && body[end - 1] == '\n') --end;
+        if (end > partStart && body[end - 1] == '\r') --end;
+        addPart(end);
+      }
+
+      if (close) {
+        partStart = string_view::npos;
+        break;
+      }
+
+      partStart = pos;
+    }
+
+    // An message without closing delimiter still gets its last part
+    if (partStart != string_view::npos && partStart < body.size()) addPart(body.size());
+
+    return index;
+  }
+
+  const vector<MIMENode> &MIMETree::getNodes() const {
+    return this->m_Nodes;
+  }
+
+  const MIMENode &MIMETree::getRoot() const {
+    return this->m_Nodes.front();
+  }
+
+  string_view MIMETree::getHeader(const MIMENode &node, string_view key) {
+    for (const MIMEHeaderView &header : node.headers)
+      if (MIMETree::equals(header.key, key)) return header.value;
+    return string_view();
+  }
+
+  /**
+   * Unfolds an header value, and replaces each run of whitespace with
+   *  a single space
+   */
+  string MIMETree::unfold(string_view value) {
+    string result;
+    result.reserve(value.size());
+
+    bool space = false;
+    for (const char c : value) {
+      if (__isSpace(c)) {
+        space = true;
+        continue;
+      }
+
+      if (space && !result.empty()) result += ' ';
+      space = false;
+      result += c;
+    }
+
+    return result;
+  }
+
+  /**
+   * Gets the body of an node without its transfer encoding, only base64 is
+   *  decoded, other bodies are returned as they are
+   */
+  string MIMETree::decodeBody(const MIMENode &node) {
+    if (node.encoding == EmailTransferEncoding::ETE_BASE64)
+      return Encoding::decodeBase64(node.body.data(), node.body.size());
+    return string(node.body);
+  }
+
+  /**
+   * Copies the tree into an FullEmail, each node without parts becomes
+   *  an body section
+   */
+  void MIMETree::toFullEmail(FullEmail &email) const {
+    const MIMENode &root = this->getRoot();
+
+    for (const MIMEHeaderView &header : root.headers) {
+      string value = MIMETree::unfold(header.value);
+
+      for (const char *key : { "subject", "message-id", "date", "from", "to" })
+        if (MIMETree::equals(header.key, key)) parseMIMEDataFromHeaders(key, value, email);
+
+      email.e_Headers.push_back(MIMEHeader { string(header.key), move(value) });
+    }
+
+    for (const MIMENode &node : this->m_Nodes) {
+      if (node.firstChild != _MIME_TREE_NONE) continue;
+
+      vector<MIMEHeader> headers;
+      headers.reserve(node.headers.size());
+      for (const MIMEHeaderView &header : node.headers)
+        headers.push_back(MIMEHeader { string(header.key), MIMETree::unfold(header.value) });
+
+      // Text encoded as base64 is decoded, so the snippet can be made from
+      //  it, other parts such as attachments stay encoded
+      string content;
+      EmailTransferEncoding encoding = node.encoding;
+      if (encoding == EmailTransferEncoding::ETE_BASE64 && (
+        node.type == EmailContentType::ECT_TEXT_PLAIN || node.type == EmailContentType::ECT_TEXT_HTML
+      )) {
+        try {
+          content = MIMETree::decodeBody(node);
+          encoding = EmailTransferEncoding::ETE_8BIT;
+        } catch (const runtime_error &e) {
+          content = string(node.body);
+        }
+      } else content = string(node.body);
+      if (!content.empty() && content.back() != '\n') content += "\r\n";
+
+      email.e_BodySections.push_back(EmailBodySection {
+        move(content), node.type, move(headers),
+        static_cast<int32_t>(node.depth), encoding
+      });
+    }
+  }
+}
@@ -0,0 +1,78 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef _LIB_MIME_TREE_H
+#define _LIB_MIME_TREE_H
+
+#include <string_view>
+
+#include "../default.h"
+#include "../models/Email.src.h"
+
+#define _MIME_TREE_MAX_DEPTH 32
+#define _MIME_TREE_NONE SIZE_MAX
+
+using namespace FSMTP::Models;
+
+namespace FSMTP::MIME {
+  /**
+   * An header as it is in the message, the value still contains the folding
+   *  line breaks, use MIMETree::unfold() to get it as one line
+   */
+  struct MIMEHeaderView {
+    string_view key, value;
+  };
+
+  /**
+   * An node of the MIME tree, all views point into the parsed message, the
+   *  children are linked by index to keep the nodes in one vector
+   */
+  struct MIMENode {
+    vector<MIMEHeaderView> headers;
+    string_view raw, body;
+    string_view contentType, boundary, charset;
+    EmailContentType type;
+    EmailTransferEncoding encoding;
+    size_t depth;
+    size_t parent, firstChild, nextSibling;
+  };
+
+  /**
+   * Parses an message into an tree of nodes in one pass over the buffer, without
+   *  copying any of it. The message must outlive the tree
+   */
+  class MIMETree {
+  public:
+    MIMETree(string_view message);
+
+    const vector<MIMENode> &getNodes() const;
+    const MIMENode &getRoot() const;
+
+    static string_view getHeader(const MIMENode &node, string_view key);
+    static string unfold(string_view value);
+    static string decodeBody(const MIMENode &node);
+    static bool equals(string_view a, string_view b);
+
+    void toFullEmail(FullEmail &email) const;
+  private:
+    size_t parse(string_view raw, const size_t parent, const size_t depth);
+
+    string_view m_Message;
+    vector<MIMENode> m_Nodes;
+  };
+}
+
+#endif
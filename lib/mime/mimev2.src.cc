@@ -15,6 +15,7 @@
 */
 
 #include "mimev2.src.h"
+#include "MIMETree.src.h"
 
 namespace FSMTP::MIME {
   /**
@@ -447,11 +448,10 @@ namespace FSMTP::MIME {
     Timer timer("parseMIME()", logger);
     #endif
 
-    // Splits the message into lines, which later can be used
-    //  to iterate over in the different rounds
-    vector<string> lines = getMIMELines(raw);
-
-    parseMIMERecursive(email, 0, lines.begin(), lines.end());
+    // Parses the message into an tree which references the raw message, and
+    //  only copies what the email needs out of it
+    MIMETree tree(raw);
+    tree.toFullEmail(email);
   }
 
   /**
@@ -95,6 +95,7 @@ namespace FSMTP::Models
 
     statement = cass_statement_new(query, 4);
     DEFER(cass_statement_free(statement));
+    cass_statement_set_is_idempotent(statement, cass_true);
     cass_statement_bind_string(statement, 0, domain.c_str());
     cass_statement_bind_string(statement, 1, mailbox.c_str());
     cass_statement_bind_uuid(statement, 2, uuid);
@@ -122,43 +123,115 @@ namespace FSMTP::Models
     });
 
     while(cass_iterator_next(resultIterator)) {
-      const CassRow *row = cass_iterator_get_row(resultIterator);
-      EmailShortcut shortcut;
-      const char *domain, *subject, *preview, *mailbox, *from;
-      domain = subject = preview = mailbox = from = nullptr;
-      size_t domainLen, subjectLen, previewLen, mailboxLen, fromLen;
-
-      // Gets the values from the result, and puts them into the variables
-      
-      cass_value_get_string(cass_row_get_column_by_name(row, "e_domain"), &domain, &domainLen);
-      cass_value_get_string(cass_row_get_column_by_name(row, "e_subject"), &subject, &subjectLen);
-      cass_value_get_string(cass_row_get_column_by_name(row, "e_preview"), &preview, &previewLen);
-      cass_value_get_uuid(cass_row_get_column_by_name(row, "e_owners_uuid"), &shortcut.e_OwnersUUID);
-      cass_value_get_uuid(cass_row_get_column_by_name(row, "e_email_uuid"), &shortcut.e_EmailUUID);
-      cass_value_get_int64(cass_row_get_column_by_name(row, "e_owners_uuid"), &shortcut.e_Bucket);
-      cass_value_get_string(cass_row_get_column_by_name(row, "e_mailbox"), &mailbox, &mailboxLen);
-      cass_value_get_int64(cass_row_get_column_by_name(row, "e_size_octets"), &shortcut.e_SizeOctets);
-      cass_value_get_int32(cass_row_get_column_by_name(row, "e_uid"), &shortcut.e_UID);
-      cass_value_get_int32(cass_row_get_column_by_name(row, "e_flags"), &shortcut.e_Flags);
-      cass_value_get_string(cass_row_get_column_by_name(row, "e_from"), &from, &fromLen);
-
-      // Turns the buffers into real strings, and starts appending
-      //  them to the current shortcut, this is done with the length
-      //  returned by the get string of cassandra. After this we push
-      //  the result in to the vector
-
-      shortcut.e_Domain.append(domain, domainLen);
-      shortcut.e_Preview.append(preview, previewLen);
-      shortcut.e_Subject.append(subject, subjectLen);
-      shortcut.e_Mailbox.append(mailbox, mailboxLen);
-      shortcut.e_From.append(from, fromLen);
-
-      ret.push_back(shortcut);
+      ret.push_back(EmailShortcut::fromRow(cass_iterator_get_row(resultIterator)));
     }
 
     return ret;
   }
 
+  vector<EmailShortcut> EmailShortcut::gatherPage(
+    CassandraConnection *cassandra, const string &domain,
+    const string &mailbox, const CassUuid &uuid,
+    const int32_t pageSize, string &cursor
+  ) {
+    vector<EmailShortcut> ret = {};
+
+    const char *query = "SELECT * FROM fannst.email_shortcuts WHERE e_domain=? AND e_owners_uuid=? AND e_mailbox=?";
+    CassStatement *statement = nullptr;
+    CassFuture *future = nullptr;
+
+    // =======================================
+    // Performs the query
+    // =======================================
+
+    // The rows are clustered by the time uuid of the email, so the pages
+    //  are in a stable order ( newest first ), and the cursor is the paging
+    //  state of the driver, which tells cassandra where to continue
+    statement = cass_statement_new(query, 3);
+    DEFER(cass_statement_free(statement));
+    cass_statement_set_is_idempotent(statement, cass_true);
+    cass_statement_bind_string(statement, 0, domain.c_str());
+    cass_statement_bind_uuid(statement, 1, uuid);
+    cass_statement_bind_string(statement, 2, mailbox.c_str());
+    cass_statement_set_paging_size(statement, pageSize);
+
+    if (!cursor.empty()) {
+      cass_statement_set_paging_state_token(statement, cursor.c_str(), cursor.size());
+    }
+
+    future = cass_session_execute(cassandra->c_Session, statement);
+    DEFER(cass_future_free(future));
+    cass_future_wait(future);
+
+    if (cass_future_error_code(future) != CASS_OK) {
+      string error = "cass_session_execute() failed: ";
+      error += CassandraConnection::getError(future);
+      throw DatabaseException(EXCEPT_DEBUG(error));
+    }
+
+    // =======================================
+    // Handles the data
+    // =======================================
+
+    const CassResult *result = cass_future_get_result(future);
+    CassIterator *resultIterator = cass_iterator_from_result(result);
+    DEFER_M({
+      cass_result_free(result);
+      cass_iterator_free(resultIterator);
+    });
+
+    ret.reserve(cass_result_row_count(result));
+    while(cass_iterator_next(resultIterator)) {
+      ret.push_back(EmailShortcut::fromRow(cass_iterator_get_row(resultIterator)));
+    }
+
+    // Stores the cursor of the next page, or clears it when this
+    //  was the last one
+    cursor.clear();
+    if (cass_result_has_more_pages(result)) {
+      const char *token = nullptr;
+      size_t tokenLen;
+
+      cass_result_paging_state_token(result, &token, &tokenLen);
+      cursor.append(token, tokenLen);
+    }
+
+    return ret;
+  }
+
+  EmailShortcut EmailShortcut::fromRow(const CassRow *row) {
+    EmailShortcut shortcut;
+    const char *domain, *subject, *preview, *mailbox, *from;
+    domain = subject = preview = mailbox = from = nullptr;
+    size_t domainLen, subjectLen, previewLen, mailboxLen, fromLen;
+
+    // Gets the values from the result, and puts them into the variables
+    
+    cass_value_get_string(cass_row_get_column_by_name(row, "e_domain"), &domain, &domainLen);
+    cass_value_get_string(cass_row_get_column_by_name(row, "e_subject"), &subject, &subjectLen);
+    cass_value_get_string(cass_row_get_column_by_name(row, "e_preview"), &preview, &previewLen);
+    cass_value_get_uuid(cass_row_get_column_by_name(row, "e_owners_uuid"), &shortcut.e_OwnersUUID);
+    cass_value_get_uuid(cass_row_get_column_by_name(row, "e_email_uuid"), &shortcut.e_EmailUUID);
+    cass_value_get_int64(cass_row_get_column_by_name(row, "e_bucket"), &shortcut.e_Bucket);
+    cass_value_get_string(cass_row_get_column_by_name(row, "e_mailbox"), &mailbox, &mailboxLen);
+    cass_value_get_int64(cass_row_get_column_by_name(row, "e_size_octets"), &shortcut.e_SizeOctets);
+    cass_value_get_int32(cass_row_get_column_by_name(row, "e_uid"), &shortcut.e_UID);
+    cass_value_get_int32(cass_row_get_column_by_name(row, "e_flags"), &shortcut.e_Flags);
+    cass_value_get_string(cass_row_get_column_by_name(row, "e_from"), &from, &fromLen);
+
+    // Turns the buffers into real strings, and starts appending
+    //  them to the current shortcut, this is done with the length
+    //  returned by the get string of cassandra
+
+    shortcut.e_Domain.append(domain, domainLen);
+    shortcut.e_Preview.append(preview, previewLen);
+    shortcut.e_Subject.append(subject, subjectLen);
+    shortcut.e_Mailbox.append(mailbox, mailboxLen);
+    shortcut.e_From.append(from, fromLen);
+
+    return shortcut;
+  }
+
   pair<int64_t, size_t> EmailShortcut::getStat(
     CassandraConnection *cassandra, const int32_t skip,
     int32_t limit, const string &domain,
@@ -183,6 +256,7 @@ namespace FSMTP::Models
 
     statement = cass_statement_new(query, 4);
     DEFER(cass_statement_free(statement));
+    cass_statement_set_is_idempotent(statement, cass_true);
     cass_statement_bind_string(statement, 0, domain.c_str());
     cass_statement_bind_string(statement, 1, mailbox.c_str());
     cass_statement_bind_uuid(statement, 2, uuid);
@@ -262,6 +336,7 @@ namespace FSMTP::Models
 
     statement = cass_statement_new(query, 3);
     DEFER(cass_statement_free(statement));
+    cass_statement_set_is_idempotent(statement, cass_true);
     cass_statement_bind_string(statement, 0, domain.c_str());
     cass_statement_bind_string(statement, 1, mailbox.c_str());
     cass_statement_bind_uuid(statement, 2, uuid);
@@ -55,6 +55,19 @@ namespace FSMTP::Models
       const bool deleted
     );
 
+    /**
+     * Gets one page of shortcuts, newest first, pass an empty cursor
+     *  for the first page, the cursor is then updated to point to the
+     *  next page, and is empty once there are no more pages
+     */
+    static vector<EmailShortcut> gatherPage(
+      CassandraConnection *cassandra, const string &domain,
+      const string &mailbox, const CassUuid &uuid,
+      const int32_t pageSize, string &cursor
+    );
+
+    static EmailShortcut fromRow(const CassRow *row);
+
     static pair<int64_t, size_t> getStat(
       CassandraConnection *cassandra, const int32_t skip,
       int32_t limit, const string &domain,
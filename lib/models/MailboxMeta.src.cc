@@ -0,0 +1,163 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "MailboxMeta.src.h"
+
+namespace FSMTP::Models
+{
+	MailboxMeta::MailboxMeta(void) noexcept:
+		e_Bucket(0), e_MaxUID(0)
+	{}
+
+	MailboxMeta::MailboxMeta(
+		const int64_t e_Bucket, const string &e_Domain,
+		const CassUuid &e_UUID, const string &e_MailboxPath,
+		const int32_t e_MaxUID
+	) noexcept:
+		e_Bucket(e_Bucket), e_Domain(e_Domain), e_UUID(e_UUID),
+		e_MailboxPath(e_MailboxPath), e_MaxUID(e_MaxUID)
+	{}
+
+	/**
+	 * Writes the largest UID with an lightweight transaction, which is only applied
+	 *  if the stored UID is smaller ( or missing when ifNull is set ), returns if it
+	 *  was applied, and otherwise the stored UID, which is -1 when missing
+	 */
+	static bool __conditionalMaxUID(
+		CassandraConnection *cassandra, const MailboxMeta &meta,
+		const bool ifNull, int32_t &current
+	) {
+		const char *query = ifNull
+			? R"(UPDATE fannst.mailbox_meta SET e_max_uid=?
+			WHERE e_bucket=? AND e_domain=? AND e_uuid=? AND e_mailbox_path=?
+			IF e_max_uid=null)"
+			: R"(UPDATE fannst.mailbox_meta SET e_max_uid=?
+			WHERE e_bucket=? AND e_domain=? AND e_uuid=? AND e_mailbox_path=?
+			IF e_max_uid<?)";
+		CassStatement *statement = nullptr;
+		CassFuture *future = nullptr;
+
+		statement = cass_statement_new(query, ifNull ? 5 : 6);
+		DEFER(cass_statement_free(statement));
+		cass_statement_bind_int32(statement, 0, meta.e_MaxUID);
+		cass_statement_bind_int64(statement, 1, meta.e_Bucket);
+		cass_statement_bind_string(statement, 2, meta.e_Domain.c_str());
+		cass_statement_bind_uuid(statement, 3, meta.e_UUID);
+		cass_statement_bind_string(statement, 4, meta.e_MailboxPath.c_str());
+		if (!ifNull) cass_statement_bind_int32(statement, 5, meta.e_MaxUID);
+
+		future = cass_session_execute(cassandra->c_Session, statement);
+		DEFER(cass_future_free(future));
+		cass_future_wait(future);
+
+		if (cass_future_error_code(future) != CASS_OK) {
+			string error = "cass_session_execute() failed: ";
+			error += CassandraConnection::getError(future);
+			throw DatabaseException(EXCEPT_DEBUG(error));
+		}
+
+		// The first column is always [applied], when it was not applied the
+		//  current value of the conditional column follows
+		const CassResult *result = cass_future_get_result(future);
+		DEFER(cass_result_free(result));
+		const CassRow *row = cass_result_first_row(result);
+		if (!row) throw DatabaseException(EXCEPT_DEBUG("Conditional update returned no row"));
+
+		cass_bool_t applied = cass_false;
+		cass_value_get_bool(cass_row_get_column(row, 0), &applied);
+
+		const CassValue *value = cass_row_get_column_by_name(row, "e_max_uid");
+		current = -1;
+		if (value && !cass_value_is_null(value)) cass_value_get_int32(value, &current);
+
+		return applied == cass_true;
+	}
+
+	void MailboxMeta::saveMaxUID(CassandraConnection *cassandra) {
+		// Multiple storage workers write the same row, and the one with the smaller
+		//  UID may finish last, so the UID is only written when it is larger than
+		//  the stored one. An missing UID can not be compared, so that gets its
+		//  own condition, after which the comparison is tried again
+
+		for (size_t i = 0; i < _MAILBOX_META_ATTEMPTS; ++i) {
+			int32_t current;
+
+			if (__conditionalMaxUID(cassandra, *this, false, current)) return;
+			if (current >= this->e_MaxUID) return;
+			if (current == -1 && __conditionalMaxUID(cassandra, *this, true, current)) return;
+		}
+
+		throw DatabaseException(EXCEPT_DEBUG("Could not update the largest UID, too much contention"));
+	}
+
+	vector<MailboxMeta> MailboxMeta::gatherAll(
+		CassandraConnection *cassandra, const int64_t bucket,
+		const string &domain, const CassUuid &uuid
+	) {
+		const char *query = R"(SELECT e_mailbox_path, e_max_uid
+		FROM fannst.mailbox_meta WHERE e_bucket=? AND e_domain=? AND e_uuid=?)";
+		CassFuture *future = nullptr;
+		CassStatement *statement = nullptr;
+		vector<MailboxMeta> res = {};
+
+		// Reads all the meta rows of the user, one per mailbox, which are
+		//  stored in the same partition
+
+		statement = cass_statement_new(query, 3);
+		DEFER(cass_statement_free(statement));
+		cass_statement_set_is_idempotent(statement, cass_true);
+		cass_statement_bind_int64(statement, 0, bucket);
+		cass_statement_bind_string(statement, 1, domain.c_str());
+		cass_statement_bind_uuid(statement, 2, uuid);
+
+		future = cass_session_execute(cassandra->c_Session, statement);
+		DEFER(cass_future_free(future));
+		cass_future_wait(future);
+
+		if (cass_future_error_code(future) != CASS_OK) {
+			string error = "cass_session_execute() failed: ";
+			error += CassandraConnection::getError(future);
+			throw DatabaseException(EXCEPT_DEBUG(error));
+		}
+
+		const CassResult *result = cass_future_get_result(future);
+		CassIterator *iterator = cass_iterator_from_result(result);
+		DEFER_M({
+			cass_result_free(result);
+			cass_iterator_free(iterator);
+		});
+
+		while (cass_iterator_next(iterator)) {
+			const CassRow *row = cass_iterator_get_row(iterator);
+			MailboxMeta meta;
+			const char *mailboxPath = nullptr;
+			size_t mailboxPathLen;
+
+			meta.e_Bucket = bucket;
+			meta.e_Domain = domain;
+			meta.e_UUID = uuid;
+
+			cass_value_get_string(cass_row_get_column_by_name(row, "e_mailbox_path"), &mailboxPath, &mailboxPathLen);
+			meta.e_MailboxPath.assign(mailboxPath, mailboxPathLen);
+
+			cass_value_get_int32(cass_row_get_column_by_name(row, "e_max_uid"), &meta.e_MaxUID);
+
+			res.push_back(move(meta));
+		}
+
+		return res;
+	}
+}
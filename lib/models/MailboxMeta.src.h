@@ -0,0 +1,57 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#define _MAILBOX_META_ATTEMPTS 8
+
+#include "../default.h"
+#include "../general/connections.src.h"
+#include "../general/exceptions.src.h"
+
+using namespace FSMTP::Connections;
+
+namespace FSMTP::Models
+{
+	/**
+	 * Persistent per-mailbox largest UID, this is kept next to the redis status
+	 *  so that the UID holder can be restored with a single partition read
+	 */
+	class MailboxMeta
+	{
+	public:
+		explicit MailboxMeta(void) noexcept;
+
+		MailboxMeta(
+			const int64_t e_Bucket, const string &e_Domain,
+			const CassUuid &e_UUID, const string &e_MailboxPath,
+			const int32_t e_MaxUID
+		) noexcept;
+
+		void saveMaxUID(CassandraConnection *cassandra);
+
+		static vector<MailboxMeta> gatherAll(
+			CassandraConnection *cassandra, const int64_t bucket,
+			const string &domain, const CassUuid &uuid
+		);
+
+		int64_t e_Bucket;
+		string e_Domain;
+		CassUuid e_UUID;
+		string e_MailboxPath;
+		int32_t e_MaxUID;
+	};
+}
@@ -33,6 +33,46 @@ namespace FSMTP::Models
 		);
 	}
 
+	static int32_t incrementField(
+		RedisConnection *redis,
+		const char *prefix,
+		const char *field
+	) {
+		char command[1024];
+		sprintf(command, "%s %s %s %d", "HINCRBY", prefix, field, 1);
+
+		redisReply *reply = reinterpret_cast<redisReply *>(redisCommand(
+			redis->r_Session, command
+		));
+		DEFER(freeReplyObject(reply));
+
+		if (reply->type == REDIS_REPLY_ERROR) {
+			string error = "redisCommand() failed: ";
+			error += string(reply->str, reply->len);
+			throw DatabaseException(EXCEPT_DEBUG(error));
+		}
+
+		return static_cast<int32_t>(reply->integer);
+	}
+
+	static bool statusExists(RedisConnection *redis, const char *prefix) {
+		char command[1024];
+		sprintf(command, "%s %s", "EXISTS", prefix);
+
+		redisReply *reply = reinterpret_cast<redisReply *>(redisCommand(
+			redis->r_Session, command
+		));
+		DEFER(freeReplyObject(reply));
+
+		if (reply->type == REDIS_REPLY_ERROR) {
+			string error = "redisCommand() failed: ";
+			error += string(reply->str, reply->len);
+			throw DatabaseException(EXCEPT_DEBUG(error));
+		}
+
+		return reply->integer > 0;
+	}
+
 	MailboxStatus::MailboxStatus(void):
 		s_Recent(0), s_Total(0), s_Flags(0x0),
 		s_PerfmaFlags(0x0), s_Unseen(0),
@@ -172,22 +212,44 @@ namespace FSMTP::Models
 		const CassUuid &uuid,
 		const string &mailboxPath
 	) {
-		const char *query = R"(SELECT e_flags, e_uid FROM fannst.email_shortcuts 
-		WHERE e_domain=? AND e_owners_uuid=? AND e_mailbox=?)";
 		MailboxStatus res;
-		cass_bool_t hasMorePages;
 
 		res.s_Bucket = bucket;
 		res.s_Domain = domain;
 		res.s_UUID = uuid;
 
-		// Gets the mailbox itself, to set the flags and message count
-		//  because this is already stored inside of cassandra
+		// Gets the mailbox itself, to set the flags because this
+		//  is already stored inside of cassandra
 
 		Mailbox mailbox = Mailbox::get(cassandra, bucket, domain, uuid, mailboxPath);
-		res.s_Total = mailbox.e_MessageCount;
 		res.s_Flags = mailbox.e_Flags;
 
+		// Counts the shortcuts to get the counters, nothing keeps persistent
+		//  counters up to date with deletes and flag changes. The largest UID is
+		//  written to the meta, so restoring the UID holder does not have to scan
+		//  the shortcuts again
+
+		const int32_t maxUID = MailboxStatus::scanShortcuts(
+			cassandra, bucket, domain, uuid, mailboxPath, res
+		);
+		MailboxMeta(bucket, domain, uuid, mailboxPath, maxUID).saveMaxUID(cassandra);
+
+		return res;
+	}
+
+	int32_t MailboxStatus::scanShortcuts(
+		CassandraConnection *cassandra,
+		const int64_t bucket,
+		const string &domain,
+		const CassUuid &uuid,
+		const string &mailboxPath,
+		MailboxStatus &status
+	) {
+		const char *query = R"(SELECT e_flags, e_uid FROM fannst.email_shortcuts 
+		WHERE e_domain=? AND e_owners_uuid=? AND e_mailbox=?)";
+		int32_t maxUID = 0;
+		cass_bool_t hasMorePages;
+
 		// Prepares the statement, we will not execute it yet because
 		//  this will be done with pages, and not a single one
 
@@ -212,8 +274,8 @@ namespace FSMTP::Models
 				throw DatabaseException(error);
 			}
 
-			// Starts looping over the result, and building the final status
-			//  instance, which will later be stored in redis
+			// Starts looping over the result, and building the final counters
+			//  and the largest UID
 
 			const CassResult *result = cass_future_get_result(future);
 			CassIterator *iterator = cass_iterator_from_result(result);
@@ -230,8 +292,11 @@ namespace FSMTP::Models
 				cass_value_get_int32(cass_row_get_column_by_name(row, "e_uid"), &uid);
 
 				if (!(BINARY_COMPARE(flags, _EMAIL_FLAG_SEEN))) {
-					++res.s_Unseen;
+					++status.s_Unseen;
 				}
+
+				if (uid > maxUID) maxUID = uid;
+				++status.s_Total;
 			}
 
 			hasMorePages = cass_result_has_more_pages(result);
@@ -240,10 +305,7 @@ namespace FSMTP::Models
 			}
 		} while (hasMorePages);
 
-		// Sets the next uuid as the largest one incremented
-		//  after this we return the constructed status object
-
-		return res;
+		return maxUID;
 	}
 
 	void MailboxStatus::addOneMessage(
@@ -254,35 +316,24 @@ namespace FSMTP::Models
 		const CassUuid &uuid,
 		const string &mailboxPath
 	) {
-		// Gets the old message status, and increments
-		//  the next uuid, the total, the recent and unseen
-		//  these are all effected when a new message is received 
-
-		MailboxStatus old = MailboxStatus::get(redis, cassandra, s_Bucket, s_Domain, uuid, mailboxPath);
-		old.s_Total++;
-		old.s_Recent++;
-		old.s_Unseen++;
-
-		// Updates the specified values, these will not be updated in cassandra, but only inside
-		//  redis, since cassandra is not meant for so many updates
-
-		char prefix[512], command[1024];
+		char prefix[512];
 		getPrefix(s_Bucket, s_Domain.c_str(), uuid, mailboxPath.c_str(), prefix);
-		sprintf(
-			command, "%s %s v2 %d v3 %d v5 %d",
-			"HMSET", prefix,
-			old.s_Unseen, old.s_Total, old.s_Recent
-		);
 
-		redisReply *reply = reinterpret_cast<redisReply *>(redisCommand(
-			redis->r_Session, command
-		));
-		DEFER(freeReplyObject(reply));
+		// Restores the status from cassandra when redis does not have it, this
+		//  is called after the shortcut is saved, so the restored counters
+		//  already include the new message
 
-		if (reply->type == REDIS_REPLY_ERROR) {
-			string error = "redisCommand() failed: ";
-			error += string(reply->str, reply->len);
-			throw DatabaseException(EXCEPT_DEBUG(error));
+		if (!statusExists(redis, prefix)) {
+			MailboxStatus::get(redis, cassandra, s_Bucket, s_Domain, uuid, mailboxPath);
+			return;
 		}
+
+		// Increments the total, the recent and unseen, these are all effected when
+		//  a new message is received. We use HINCRBY since multiple storage workers
+		//  may add messages to the same mailbox at the same time
+
+		incrementField(redis, prefix, "v2");
+		incrementField(redis, prefix, "v3");
+		incrementField(redis, prefix, "v5");
 	}
 }
\ No newline at end of file
@@ -19,6 +19,7 @@
 #include "../default.h"
 #include "Mailbox.src.h"
 #include "EmailShortcut.src.h"
+#include "MailboxMeta.src.h"
 
 namespace FSMTP::Models
 {
@@ -52,6 +53,12 @@ namespace FSMTP::Models
 			const string &mailboxPath
 		);
 
+		static int32_t scanShortcuts(
+			CassandraConnection *cassandra, const int64_t bucket,
+			const string &domain, const CassUuid &uuid,
+			const string &mailboxPath, MailboxStatus &status
+		);
+
 		int64_t s_Bucket;
 		string s_Domain;
 		CassUuid s_UUID;
@@ -0,0 +1,411 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "RawBlob.src.h"
+
+namespace FSMTP::Models
+{
+	static void executeStatement(CassandraConnection *cassandra, CassStatement *statement) {
+		CassFuture *future = cass_session_execute(cassandra->c_Session, statement);
+		DEFER(cass_future_free(future));
+		cass_future_wait(future);
+
+		if (cass_future_error_code(future) != CASS_OK) {
+			string error = "cass_session_execute() failed: ";
+			error += CassandraConnection::getError(future);
+			throw DatabaseException(EXCEPT_DEBUG(error));
+		}
+	}
+
+	/**
+	 * Gets the current time in microseconds, which is used as the write
+	 *  timestamp of the blob rows and their deletion
+	 */
+	static int64_t writeTimestamp(void) {
+		return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+	}
+
+	string RawBlob::hash(const string &content) {
+		uint8_t digest[SHA256_DIGEST_LENGTH];
+		SHA256(reinterpret_cast<const uint8_t *>(content.c_str()), content.size(), digest);
+
+		// Turns the digest into hex, this is used as the key of the blob
+		static const char *hex = "0123456789abcdef";
+		string res;
+		res.reserve(SHA256_DIGEST_LENGTH * 2);
+		for (size_t i = 0; i < SHA256_DIGEST_LENGTH; ++i) {
+			res += hex[digest[i] >> 4];
+			res += hex[digest[i] & 0x0F];
+		}
+
+		return res;
+	}
+
+	RawBlobReader::RawBlobReader(const string &content) noexcept:
+		r_Cassandra(nullptr), r_Content(content), r_Size(content.size()),
+		r_Chunks(0), r_Next(0)
+	{}
+
+	RawBlobReader::RawBlobReader(
+		CassandraConnection *cassandra, const string &hash,
+		const int64_t size, const int32_t chunks
+	) noexcept:
+		r_Cassandra(cassandra), r_Hash(hash), r_Size(size),
+		r_Chunks(chunks), r_Next(0)
+	{}
+
+	bool RawBlobReader::next(string &chunk) {
+		// Inline bodies are handed out at once, chunked ones are fetched
+		//  one chunk at a time, so we never hold more than one in memory
+		if (this->r_Chunks == 0) {
+			if (this->r_Next++ > 0) return false;
+			chunk = move(this->r_Content);
+			return true;
+		}
+
+		if (this->r_Next >= this->r_Chunks) return false;
+		chunk = RawBlob::getChunk(this->r_Cassandra, this->r_Hash, this->r_Next++);
+		return true;
+	}
+
+	string RawBlobReader::readAll(void) {
+		string res, chunk;
+		res.reserve(this->r_Size);
+
+		while (this->next(chunk)) res += chunk;
+		return res;
+	}
+
+	int64_t RawBlobReader::size(void) const {
+		return this->r_Size;
+	}
+
+	bool RawBlobReader::isChunked(void) const {
+		return this->r_Chunks > 0;
+	}
+
+	/**
+	 * Deflates the piece of body if it is large enough, and returns if
+	 *  the compressed version is the one that should be stored
+	 */
+	static bool compressIfSmaller(const string &raw, string &res, const size_t compressThreshold) {
+		if (raw.size() < compressThreshold) return false;
+
+		res = RawBlob::compress(raw);
+		return res.size() < raw.size();
+	}
+
+	void RawBlob::save(
+		CassandraConnection *cassandra, const string &hash,
+		const string &content, const size_t compressThreshold,
+		const size_t chunkSize
+	) {
+		const char *query = R"(INSERT INTO fannst.raw_blobs (
+			e_hash, e_compressed, e_size, e_chunks, e_content
+		) VALUES (
+			?, ?, ?, ?, ?
+		))";
+		const char *chunkQuery = R"(INSERT INTO fannst.raw_blob_chunks (
+			e_hash, e_index, e_compressed, e_size, e_content
+		) VALUES (
+			?, ?, ?, ?, ?
+		))";
+		const int64_t timestamp = writeTimestamp();
+		int32_t chunks = 0;
+		bool compressed = false;
+		string stored;
+
+		// ===================================
+		// Writes the chunks
+		// ===================================
+
+		// Large bodies are split into fixed size chunks, each compressed on
+		//  its own so they can be inflated one at a time by the reader, the
+		//  chunks are written before the head row which references them
+		if (chunkSize > 0 && content.size() > chunkSize) {
+			for (size_t off = 0; off < content.size(); off += chunkSize, ++chunks) {
+				const string piece = content.substr(off, chunkSize);
+				const bool pieceCompressed = compressIfSmaller(piece, stored, compressThreshold);
+				const string &body = pieceCompressed ? stored : piece;
+
+				CassStatement *statement = cass_statement_new(chunkQuery, 5);
+				DEFER(cass_statement_free(statement));
+				cass_statement_bind_string(statement, 0, hash.c_str());
+				cass_statement_bind_int32(statement, 1, chunks);
+				cass_statement_bind_bool(statement, 2, pieceCompressed ? cass_true : cass_false);
+				cass_statement_bind_int32(statement, 3, piece.size());
+				cass_statement_bind_bytes(statement, 4,
+					reinterpret_cast<const cass_byte_t *>(body.c_str()), body.size());
+				cass_statement_set_timestamp(statement, timestamp);
+
+				executeStatement(cassandra, statement);
+			}
+
+			stored.clear();
+		} else {
+			compressed = compressIfSmaller(content, stored, compressThreshold);
+		}
+
+		// ===================================
+		// Writes the head row
+		// ===================================
+
+		// Since the blob is keyed by its hash, writing the same body twice
+		//  simply overwrites the row with the exact same data, the timestamp is
+		//  taken after the reference, see release() for why that matters
+		const string &body = (chunks > 0 || compressed) ? stored : content;
+
+		CassStatement *statement = cass_statement_new(query, 5);
+		DEFER(cass_statement_free(statement));
+		cass_statement_bind_string(statement, 0, hash.c_str());
+		cass_statement_bind_bool(statement, 1, compressed ? cass_true : cass_false);
+		cass_statement_bind_int64(statement, 2, content.size());
+		cass_statement_bind_int32(statement, 3, chunks);
+		cass_statement_bind_bytes(statement, 4,
+			reinterpret_cast<const cass_byte_t *>(body.c_str()), body.size());
+		cass_statement_set_timestamp(statement, timestamp);
+
+		executeStatement(cassandra, statement);
+	}
+
+	string RawBlob::get(CassandraConnection *cassandra, const string &hash) {
+		return RawBlob::open(cassandra, hash).readAll();
+	}
+
+	RawBlobReader RawBlob::open(CassandraConnection *cassandra, const string &hash) {
+		const char *query = R"(SELECT e_compressed, e_size, e_chunks, e_content
+		FROM fannst.raw_blobs WHERE e_hash=?)";
+		CassStatement *statement = nullptr;
+		CassFuture *future = nullptr;
+
+		// ===================================
+		// Prepares and executes
+		// ===================================
+
+		statement = cass_statement_new(query, 1);
+		DEFER(cass_statement_free(statement));
+		cass_statement_set_is_idempotent(statement, cass_true);
+		cass_statement_bind_string(statement, 0, hash.c_str());
+
+		future = cass_session_execute(cassandra->c_Session, statement);
+		DEFER(cass_future_free(future));
+		cass_future_wait(future);
+
+		if (cass_future_error_code(future) != CASS_OK) {
+			string error = "cass_session_execute() failed: ";
+			error += CassandraConnection::getError(future);
+			throw DatabaseException(EXCEPT_DEBUG(error));
+		}
+
+		// ===================================
+		// Gets the head row
+		// ===================================
+
+		const CassResult *result = cass_future_get_result(future);
+		DEFER(cass_result_free(result));
+		const CassRow *row = cass_result_first_row(result);
+
+		if (!row) {
+			throw EmptyQuery(EXCEPT_DEBUG("Could not find raw blob"));
+		}
+
+		cass_bool_t compressed;
+		int64_t size;
+		int32_t chunks = 0;
+		const cass_byte_t *content = nullptr;
+		size_t contentLen;
+
+		cass_value_get_bool(cass_row_get_column_by_name(row, "e_compressed"), &compressed);
+		cass_value_get_int64(cass_row_get_column_by_name(row, "e_size"), &size);
+
+		const CassValue *chunksValue = cass_row_get_column_by_name(row, "e_chunks");
+		if (!cass_value_is_null(chunksValue)) {
+			cass_value_get_int32(chunksValue, &chunks);
+		}
+
+		// Chunked bodies are read lazily by the reader, small ones are in
+		//  the head row itself
+		if (chunks > 0) {
+			return RawBlobReader(cassandra, hash, size, chunks);
+		}
+
+		cass_value_get_bytes(cass_row_get_column_by_name(row, "e_content"), &content, &contentLen);
+
+		string body(reinterpret_cast<const char *>(content), contentLen);
+		if (compressed == cass_true) {
+			return RawBlobReader(RawBlob::decompress(body, size));
+		}
+
+		return RawBlobReader(body);
+	}
+
+	string RawBlob::getChunk(
+		CassandraConnection *cassandra, const string &hash,
+		const int32_t index
+	) {
+		const char *query = R"(SELECT e_compressed, e_size, e_content
+		FROM fannst.raw_blob_chunks WHERE e_hash=? AND e_index=?)";
+		CassStatement *statement = nullptr;
+		CassFuture *future = nullptr;
+
+		statement = cass_statement_new(query, 2);
+		DEFER(cass_statement_free(statement));
+		cass_statement_set_is_idempotent(statement, cass_true);
+		cass_statement_bind_string(statement, 0, hash.c_str());
+		cass_statement_bind_int32(statement, 1, index);
+
+		future = cass_session_execute(cassandra->c_Session, statement);
+		DEFER(cass_future_free(future));
+		cass_future_wait(future);
+
+		if (cass_future_error_code(future) != CASS_OK) {
+			string error = "cass_session_execute() failed: ";
+			error += CassandraConnection::getError(future);
+			throw DatabaseException(EXCEPT_DEBUG(error));
+		}
+
+		const CassResult *result = cass_future_get_result(future);
+		DEFER(cass_result_free(result));
+		const CassRow *row = cass_result_first_row(result);
+
+		if (!row) {
+			throw EmptyQuery(EXCEPT_DEBUG("Could not find raw blob chunk " + to_string(index)));
+		}
+
+		cass_bool_t compressed;
+		int32_t size;
+		const cass_byte_t *content = nullptr;
+		size_t contentLen;
+
+		cass_value_get_bool(cass_row_get_column_by_name(row, "e_compressed"), &compressed);
+		cass_value_get_int32(cass_row_get_column_by_name(row, "e_size"), &size);
+		cass_value_get_bytes(cass_row_get_column_by_name(row, "e_content"), &content, &contentLen);
+
+		string body(reinterpret_cast<const char *>(content), contentLen);
+		if (compressed == cass_true) {
+			return RawBlob::decompress(body, size);
+		}
+
+		return body;
+	}
+
+	void RawBlob::reference(CassandraConnection *cassandra, const string &hash) {
+		const char *query = "UPDATE fannst.raw_blob_refs SET e_refs = e_refs + 1 WHERE e_hash=?";
+		CassStatement *statement = nullptr;
+
+		statement = cass_statement_new(query, 1);
+		DEFER(cass_statement_free(statement));
+		cass_statement_bind_string(statement, 0, hash.c_str());
+
+		executeStatement(cassandra, statement);
+	}
+
+	void RawBlob::release(CassandraConnection *cassandra, const string &hash) {
+		const int64_t timestamp = writeTimestamp();
+		CassStatement *statement = nullptr;
+		CassFuture *future = nullptr;
+		int64_t refs = 0;
+
+		// ===================================
+		// Decrements the reference count
+		// ===================================
+
+		statement = cass_statement_new("UPDATE fannst.raw_blob_refs SET e_refs = e_refs - 1 WHERE e_hash=?", 1);
+		DEFER(cass_statement_free(statement));
+		cass_statement_bind_string(statement, 0, hash.c_str());
+		executeStatement(cassandra, statement);
+
+		// ===================================
+		// Reads the remaining references
+		// ===================================
+
+		CassStatement *select = cass_statement_new("SELECT e_refs FROM fannst.raw_blob_refs WHERE e_hash=?", 1);
+		DEFER(cass_statement_free(select));
+		cass_statement_bind_string(select, 0, hash.c_str());
+
+		future = cass_session_execute(cassandra->c_Session, select);
+		DEFER(cass_future_free(future));
+		cass_future_wait(future);
+
+		if (cass_future_error_code(future) != CASS_OK) {
+			string error = "cass_session_execute() failed: ";
+			error += CassandraConnection::getError(future);
+			throw DatabaseException(EXCEPT_DEBUG(error));
+		}
+
+		const CassResult *result = cass_future_get_result(future);
+		DEFER(cass_result_free(result));
+		const CassRow *row = cass_result_first_row(result);
+		if (row) {
+			cass_value_get_int64(cass_row_get_column_by_name(row, "e_refs"), &refs);
+		}
+
+		// ===================================
+		// Deletes the blob if unused
+		// ===================================
+
+		// The decrement, the read and the delete are not atomic, a store may
+		//  take a new reference right after we read zero, and rewrite the blob
+		//  before our delete arrives. The delete therefore carries the timestamp
+		//  from before the read, the store writes with one taken after its
+		//  reference, so the tombstone only covers the rows written before
+		//  and never the new ones. This assumes the clocks of the workers are
+		//  synchronized well within the time between reading and storing.
+		//  The counter row itself is kept, counters may not be reused after deletion
+		if (refs > 0) return;
+
+		// The head row goes first, so a failure in between leaves at most some
+		//  unreachable chunks, instead of a head row without its chunks
+		CassStatement *remove = cass_statement_new("DELETE FROM fannst.raw_blobs WHERE e_hash=?", 1);
+		DEFER(cass_statement_free(remove));
+		cass_statement_bind_string(remove, 0, hash.c_str());
+		cass_statement_set_timestamp(remove, timestamp);
+		executeStatement(cassandra, remove);
+
+		CassStatement *removeChunks = cass_statement_new("DELETE FROM fannst.raw_blob_chunks WHERE e_hash=?", 1);
+		DEFER(cass_statement_free(removeChunks));
+		cass_statement_bind_string(removeChunks, 0, hash.c_str());
+		cass_statement_set_timestamp(removeChunks, timestamp);
+		executeStatement(cassandra, removeChunks);
+	}
+
+	string RawBlob::compress(const string &raw) {
+		uLongf len = compressBound(raw.size());
+		string res(len, '\0');
+
+		int rc = compress2(reinterpret_cast<Bytef *>(&res[0]), &len,
+			reinterpret_cast<const Bytef *>(raw.c_str()), raw.size(), Z_BEST_SPEED);
+		if (rc != Z_OK) {
+			throw runtime_error(EXCEPT_DEBUG("compress2() failed: " + to_string(rc)));
+		}
+
+		res.resize(len);
+		return res;
+	}
+
+	string RawBlob::decompress(const string &compressed, const size_t size) {
+		uLongf len = size;
+		string res(len, '\0');
+
+		int rc = uncompress(reinterpret_cast<Bytef *>(&res[0]), &len,
+			reinterpret_cast<const Bytef *>(compressed.c_str()), compressed.size());
+		if (rc != Z_OK || len != size) {
+			throw runtime_error(EXCEPT_DEBUG("uncompress() failed: " + to_string(rc)));
+		}
+
+		return res;
+	}
+}
@@ -0,0 +1,90 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <zlib.h>
+#include <openssl/sha.h>
+
+#include "../default.h"
+#include "../general/connections.src.h"
+#include "../general/exceptions.src.h"
+
+#define _RAW_BLOB_CHUNK_SIZE_DEFAULT 262144
+
+using namespace FSMTP::Connections;
+
+namespace FSMTP::Models
+{
+	/**
+	 * Reads a raw body piece by piece, large bodies are stored in chunks
+	 *  which are only fetched ( and inflated ) once the caller asks for
+	 *  them, small ones are handed out in one piece
+	 */
+	class RawBlobReader
+	{
+	public:
+		explicit RawBlobReader(const string &content) noexcept;
+
+		RawBlobReader(
+			CassandraConnection *cassandra, const string &hash,
+			const int64_t size, const int32_t chunks
+		) noexcept;
+
+		bool next(string &chunk);
+		string readAll(void);
+
+		int64_t size(void) const;
+		bool isChunked(void) const;
+	private:
+		CassandraConnection *r_Cassandra;
+		string r_Hash;
+		string r_Content;
+		int64_t r_Size;
+		int32_t r_Chunks;
+		int32_t r_Next;
+	};
+
+	/**
+	 * Raw message body stored once, keyed by the SHA256 of its contents, the
+	 *  raw email rows of each recipient point to it by hash, and a counter
+	 *  table keeps track of how many of them there are
+	 */
+	class RawBlob
+	{
+	public:
+		static string hash(const string &content);
+
+		static void save(
+			CassandraConnection *cassandra, const string &hash,
+			const string &content, const size_t compressThreshold,
+			const size_t chunkSize
+		);
+
+		static string get(CassandraConnection *cassandra, const string &hash);
+		static RawBlobReader open(CassandraConnection *cassandra, const string &hash);
+		static string getChunk(
+			CassandraConnection *cassandra, const string &hash,
+			const int32_t index
+		);
+
+		static void reference(CassandraConnection *cassandra, const string &hash);
+		static void release(CassandraConnection *cassandra, const string &hash);
+
+		static string compress(const string &raw);
+		static string decompress(const string &compressed, const size_t size);
+	};
+}
@@ -22,33 +22,36 @@ RawEmail::RawEmail() {}
 
 RawEmail::RawEmail(
   int64_t bucket, const string &domain, const CassUuid &owner,
-  const CassUuid &email, const string &content
+  const CassUuid &email, const string &content,
+  const string &blobHash
 ):
   e_Bucket(bucket), e_Domain(domain), e_OwnersUUID(owner),
-  e_EmailUUID(email), e_Content(content)
+  e_EmailUUID(email), e_Content(content), e_BlobHash(blobHash)
 {}
 
 void RawEmail::save(CassandraConnection *cassandra) {
   const char *query = R"(INSERT INTO fannst.raw_emails (
     e_domain, e_bucket, e_owners_uuid,
-    e_email_uuid, e_content
+    e_email_uuid, e_content, e_blob_hash
   ) VALUES (
     ?, ?, ?,
-    ?, ?
+    ?, ?, ?
   ))";
   CassFuture *future = nullptr;
   CassStatement *statement = nullptr;
 
   // Prepares the statement and binds the value, after which we execute
-  //  and check if any errors have occured
+  //  and check if any errors have occured, when the body is stored as
+  //  a shared blob the content is left empty, and only the hash is stored
 
-  statement = cass_statement_new(query, 5);
+  statement = cass_statement_new(query, 6);
   DEFER(cass_statement_free(statement));
   cass_statement_bind_string(statement, 0, this->e_Domain.c_str());
   cass_statement_bind_int64(statement, 1, this->e_Bucket);
   cass_statement_bind_uuid(statement, 2, this->e_OwnersUUID);
   cass_statement_bind_uuid(statement, 3, this->e_EmailUUID);
   cass_statement_bind_string(statement, 4, this->e_Content.c_str());
+  cass_statement_bind_string(statement, 5, this->e_BlobHash.c_str());
 
   future = cass_session_execute(cassandra->c_Session, statement);
   DEFER(cass_future_free(future));
@@ -68,7 +71,66 @@ RawEmail RawEmail::get(
   const CassUuid &emailUuid,
   const int64_t bucket
 ) {
-  const char *query = "SELECT e_content FROM fannst.raw_emails WHERE e_bucket=? AND e_domain=? AND e_owners_uuid=? AND e_email_uuid=?";
+  const string cacheKey = RawEmailCache::key(domain, ownersUuid, emailUuid, bucket);
+  RawEmail ret;
+
+  // Checks the cache first, on an hit we do not touch cassandra at all
+  if (RawEmailCache::get(cacheKey, ret.e_Content)) {
+    ret.e_Domain = domain;
+    ret.e_OwnersUUID = ownersUuid;
+    ret.e_EmailUUID = emailUuid;
+    ret.e_Bucket = bucket;
+    return ret;
+  }
+
+  ret = RawEmail::getReference(cassandra, domain, ownersUuid, emailUuid, bucket);
+  if (!ret.e_BlobHash.empty()) {
+    ret.e_Content = RawBlob::get(cassandra, ret.e_BlobHash);
+  }
+
+  RawEmailCache::put(cacheKey, ret.e_Content);
+  return ret;
+}
+
+RawBlobReader RawEmail::stream(
+  CassandraConnection *cassandra,
+  const string &domain,
+  const CassUuid &ownersUuid,
+  const CassUuid &emailUuid,
+  const int64_t bucket
+) {
+  const string cacheKey = RawEmailCache::key(domain, ownersUuid, emailUuid, bucket);
+  string content;
+
+  if (RawEmailCache::get(cacheKey, content)) {
+    return RawBlobReader(content);
+  }
+
+  RawEmail ref = RawEmail::getReference(cassandra, domain, ownersUuid, emailUuid, bucket);
+
+  // Shared blobs may be chunked, and will then be read chunk by chunk, those
+  //  are too large to be cached, older rows still have the body inline
+  if (!ref.e_BlobHash.empty()) {
+    RawBlobReader reader = RawBlob::open(cassandra, ref.e_BlobHash);
+    if (reader.isChunked()) return reader;
+
+    content = reader.readAll();
+  } else {
+    content = move(ref.e_Content);
+  }
+
+  RawEmailCache::put(cacheKey, content);
+  return RawBlobReader(content);
+}
+
+RawEmail RawEmail::getReference(
+  CassandraConnection *cassandra,
+  const string &domain,
+  const CassUuid &ownersUuid,
+  const CassUuid &emailUuid,
+  const int64_t bucket
+) {
+  const char *query = "SELECT e_content, e_blob_hash FROM fannst.raw_emails WHERE e_bucket=? AND e_domain=? AND e_owners_uuid=? AND e_email_uuid=?";
   CassStatement *statement = nullptr;
   CassFuture *future = nullptr;
   const char *content = nullptr;
@@ -80,6 +142,7 @@ RawEmail RawEmail::get(
 
   statement = cass_statement_new(query, 4);
   DEFER(cass_statement_free(statement));
+  cass_statement_set_is_idempotent(statement, cass_true);
   cass_statement_bind_int64(statement, 0, bucket);
   cass_statement_bind_string(statement, 1, domain.c_str());
   cass_statement_bind_uuid(statement, 2, ownersUuid);
@@ -107,8 +170,16 @@ RawEmail RawEmail::get(
   }
 
   cass_value_get_string(cass_row_get_column_by_name(row, "e_content"), &content, &contentLen);
-
   ret.e_Content.append(content, contentLen);
+
+  // Checks if the body is stored as an shared blob, older rows have
+  //  no hash, and keep the body in the row itself
+  const CassValue *blobHash = cass_row_get_column_by_name(row, "e_blob_hash");
+  if (!cass_value_is_null(blobHash)) {
+    cass_value_get_string(blobHash, &content, &contentLen);
+    ret.e_BlobHash.append(content, contentLen);
+  }
+
   ret.e_Domain = domain;
   ret.e_OwnersUUID = ownersUuid;
   ret.e_EmailUUID = emailUuid;
@@ -127,6 +198,48 @@ void RawEmail::deleteOne(
   const char *query = "DELETE FROM fannst.raw_emails WHERE e_bucket=? AND e_domain=? AND e_owners_uuid=? AND e_email_uuid=?";
   CassStatement *statement = nullptr;
   CassFuture *future = nullptr;
+  string blobHash;
+
+  RawEmailCache::invalidate(RawEmailCache::key(domain, ownersUuid, emailUuid, bucket));
+
+  // Reads the hash of the shared blob, so we can release our reference
+  //  to it after the row itself is deleted
+
+  {
+    const char *select = "SELECT e_blob_hash FROM fannst.raw_emails WHERE e_bucket=? AND e_domain=? AND e_owners_uuid=? AND e_email_uuid=?";
+    CassStatement *readStatement = cass_statement_new(select, 4);
+    DEFER(cass_statement_free(readStatement));
+    cass_statement_set_is_idempotent(readStatement, cass_true);
+    cass_statement_bind_int64(readStatement, 0, bucket);
+    cass_statement_bind_string(readStatement, 1, domain.c_str());
+    cass_statement_bind_uuid(readStatement, 2, ownersUuid);
+    cass_statement_bind_uuid(readStatement, 3, emailUuid);
+
+    CassFuture *readFuture = cass_session_execute(cassandra->c_Session, readStatement);
+    DEFER(cass_future_free(readFuture));
+    cass_future_wait(readFuture);
+
+    if (cass_future_error_code(readFuture) != CASS_OK) {
+      string error = "Could not read raw email: ";
+      error += CassandraConnection::getError(readFuture);
+      throw DatabaseException(error);
+    }
+
+    const CassResult *result = cass_future_get_result(readFuture);
+    DEFER(cass_result_free(result));
+    const CassRow *row = cass_result_first_row(result);
+
+    if (row) {
+      const CassValue *value = cass_row_get_column_by_name(row, "e_blob_hash");
+      const char *hash = nullptr;
+      size_t hashLen;
+
+      if (!cass_value_is_null(value)) {
+        cass_value_get_string(value, &hash, &hashLen);
+        blobHash.append(hash, hashLen);
+      }
+    }
+  }
 
   // Prepares the statement, binds the values and performs
   //  the delete operation, after which we check if anything went wrong
@@ -147,4 +260,8 @@ void RawEmail::deleteOne(
     error += CassandraConnection::getError(future);
     throw DatabaseException(error);
   }
+
+  if (!blobHash.empty()) {
+    RawBlob::release(cassandra, blobHash);
+  }
 }
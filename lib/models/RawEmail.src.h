@@ -19,6 +19,8 @@
 #include "../default.h"
 #include "../general/connections.src.h"
 #include "../general/exceptions.src.h"
+#include "RawBlob.src.h"
+#include "RawEmailCache.src.h"
 
 using namespace FSMTP::Connections;
 
@@ -27,7 +29,8 @@ namespace FSMTP::Models {
   public:
     RawEmail();
     RawEmail(int64_t bucket, const string &domain, const CassUuid &owner,
-      const CassUuid &email, const string &content);
+      const CassUuid &email, const string &content,
+      const string &blobHash = "");
 
     void save(CassandraConnection *cassandra);
 
@@ -37,6 +40,18 @@ namespace FSMTP::Models {
       const int64_t bucket
     );
 
+    static RawBlobReader stream(
+      CassandraConnection *cassandra, const string &domain,
+      const CassUuid &ownersUuid, const CassUuid &emailUuid,
+      const int64_t bucket
+    );
+
+    static RawEmail getReference(
+      CassandraConnection *cassandra, const string &domain,
+      const CassUuid &ownersUuid, const CassUuid &emailUuid,
+      const int64_t bucket
+    );
+
     static void deleteOne(
       CassandraConnection *cassandra, const string &domain,
       const CassUuid &ownersUuid, const CassUuid &emailUuid,
@@ -48,5 +63,6 @@ namespace FSMTP::Models {
     CassUuid e_OwnersUUID;
     CassUuid e_EmailUUID;
     string e_Content;
+    string e_BlobHash;
   };
 }
@@ -0,0 +1,131 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "RawEmailCache.src.h"
+
+namespace FSMTP::Models
+{
+	typedef list<pair<string, string>> CacheList;
+
+	static mutex cacheMutex;
+	static CacheList cacheList;
+	static unordered_map<string, CacheList::iterator> cacheIndex;
+	static size_t cacheBytes = 0;
+	static size_t cacheMaxBytes = 0;
+
+	static atomic<size_t> cacheHits(0);
+	static atomic<size_t> cacheMisses(0);
+	static atomic<size_t> cacheEvictions(0);
+
+	/**
+	 * Removes the least recently used entries until the cache fits
+	 *  within the limit, requires the mutex to be locked
+	 */
+	static void evict(void) {
+		while (cacheBytes > cacheMaxBytes && !cacheList.empty()) {
+			auto &back = cacheList.back();
+
+			cacheBytes -= back.second.size();
+			cacheIndex.erase(back.first);
+			cacheList.pop_back();
+			++cacheEvictions;
+		}
+	}
+
+	void RawEmailCache::configure(const size_t maxBytes) {
+		lock_guard<mutex> lock(cacheMutex);
+
+		cacheMaxBytes = maxBytes;
+		evict();
+	}
+
+	bool RawEmailCache::get(const string &key, string &content) {
+		lock_guard<mutex> lock(cacheMutex);
+
+		auto it = cacheIndex.find(key);
+		if (it == cacheIndex.end()) {
+			++cacheMisses;
+			return false;
+		}
+
+		// Moves the entry to the front, since it is now the most
+		//  recently used one
+		cacheList.splice(cacheList.begin(), cacheList, it->second);
+		content = it->second->second;
+		++cacheHits;
+
+		return true;
+	}
+
+	void RawEmailCache::put(const string &key, const string &content) {
+		lock_guard<mutex> lock(cacheMutex);
+
+		// Bodies which would take more than an eighth of the cache are
+		//  not cached, else one large message flushes everything else
+		if (content.size() > cacheMaxBytes / 8) return;
+
+		auto it = cacheIndex.find(key);
+		if (it != cacheIndex.end()) {
+			cacheBytes -= it->second->second.size();
+			cacheList.erase(it->second);
+			cacheIndex.erase(it);
+		}
+
+		cacheList.emplace_front(key, content);
+		cacheIndex[key] = cacheList.begin();
+		cacheBytes += content.size();
+
+		evict();
+	}
+
+	void RawEmailCache::invalidate(const string &key) {
+		lock_guard<mutex> lock(cacheMutex);
+
+		auto it = cacheIndex.find(key);
+		if (it == cacheIndex.end()) return;
+
+		cacheBytes -= it->second->second.size();
+		cacheList.erase(it->second);
+		cacheIndex.erase(it);
+	}
+
+	string RawEmailCache::key(
+		const string &domain, const CassUuid &ownersUuid,
+		const CassUuid &emailUuid, const int64_t bucket
+	) {
+		char owner[CASS_UUID_STRING_LENGTH], email[CASS_UUID_STRING_LENGTH];
+		cass_uuid_string(ownersUuid, owner);
+		cass_uuid_string(emailUuid, email);
+
+		string res = domain;
+		res += '/';
+		res += owner;
+		res += '/';
+		res += email;
+		res += '/';
+		res += to_string(bucket);
+		return res;
+	}
+
+	RawEmailCacheStats RawEmailCache::getStats(void) {
+		lock_guard<mutex> lock(cacheMutex);
+
+		return RawEmailCacheStats {
+			cacheHits.load(), cacheMisses.load(), cacheEvictions.load(),
+			cacheList.size(), cacheBytes
+		};
+	}
+}
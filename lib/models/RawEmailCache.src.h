@@ -0,0 +1,58 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+
+#include "../default.h"
+#include "../general/connections.src.h"
+
+namespace FSMTP::Models
+{
+	struct RawEmailCacheStats {
+		size_t hits;
+		size_t misses;
+		size_t evictions;
+		size_t entries;
+		size_t bytes;
+	};
+
+	/**
+	 * Process wide LRU cache of raw email bodies, bounded by the number of
+	 *  bytes of the cached bodies, shared by all the services which read
+	 *  raw emails ( POP3, IMAP and HTTP )
+	 */
+	class RawEmailCache
+	{
+	public:
+		static void configure(const size_t maxBytes);
+
+		static bool get(const string &key, string &content);
+		static void put(const string &key, const string &content);
+		static void invalidate(const string &key);
+
+		static string key(
+			const string &domain, const CassUuid &ownersUuid,
+			const CassUuid &emailUuid, const int64_t bucket
+		);
+
+		static RawEmailCacheStats getStats(void);
+	};
+}
@@ -17,29 +17,47 @@ int32_t UIDHolder::getAndIncrement(
     const int64_t bucket, const string &domain,
     const CassUuid &uuid
 ) {
-    int32_t largestUID;
+    char prefix[512], command[768];
+
+    // Restores the UID from cassandra if redis does not have it, this is only
+    //  stored when no other worker has restored it in the meantime
 
     try {
-        largestUID = UIDHolder::getRedis(redis, bucket, domain, uuid);
+        UIDHolder::getRedis(redis, bucket, domain, uuid);
     } catch (const EmptyQuery &e) {
-        largestUID = UIDHolder::restoreFromCassandra(cass, redis, bucket, domain, uuid);
+        int32_t largestUID = UIDHolder::restoreFromCassandra(cass, redis, bucket, domain, uuid);
+        UIDHolder::saveRedis(redis, bucket, domain, uuid, largestUID, true);
     }
 
-    largestUID++;
-    UIDHolder::saveRedis(redis, bucket, domain, uuid, largestUID);;
+    // Increments the UID atomically, since multiple storage workers may
+    //  store messages for the same user at the same time
 
-    return largestUID;
+    UIDHolder::getPrefix(bucket, domain, uuid, prefix);
+    sprintf(command, "INCR %s", prefix);
+
+    redisReply *reply = reinterpret_cast<redisReply *>(redisCommand(
+        redis->r_Session, command
+    ));
+    DEFER(freeReplyObject(reply));
+
+    if (reply->type == REDIS_REPLY_ERROR) {
+        string error = "redisCommand() failed: ";
+        error += string(reply->str, reply->len);
+        throw DatabaseException(EXCEPT_DEBUG(error));
+    }
+
+    return static_cast<int32_t>(reply->integer);
 }
 
 void UIDHolder::saveRedis(
     RedisConnection *redis, const int64_t bucket,
     const string &domain, const CassUuid &uuid,
-    const int32_t num
+    const int32_t num, const bool onlyIfMissing
 ) {
     char prefix[512], command[768];
 
     UIDHolder::getPrefix(bucket, domain, uuid, prefix);
-    sprintf(command, "SET %s %d", prefix, num);
+    sprintf(command, "SET %s %d%s", prefix, num, (onlyIfMissing ? " NX" : ""));
 
     redisReply *reply = reinterpret_cast<redisReply *>(redisCommand(
         redis->r_Session, command
@@ -80,6 +98,33 @@ int32_t UIDHolder::restoreFromCassandra(
     CassandraConnection *cass, RedisConnection *redis,
     const int64_t bucket, const string &domain,
     const CassUuid &uuid
+) {
+    // Attempts to get the largest UID from the mailbox meta, which is a single
+    //  partition read. Meta rows are only created for the mailboxes which are used
+    //  since the meta table exists, so unless every mailbox of the user has one,
+    //  the shortcuts are still scanned for UIDs the meta does not know about
+
+    vector<MailboxMeta> metas = MailboxMeta::gatherAll(cass, bucket, domain, uuid);
+    vector<Mailbox> mailboxes = Mailbox::gatherAll(cass, bucket, domain, uuid, false);
+
+    int32_t largestUID = 0;
+    for (const MailboxMeta &meta : metas)
+        largestUID = max(largestUID, meta.e_MaxUID);
+
+    bool complete = !metas.empty();
+    for (const Mailbox &mailbox : mailboxes) {
+        complete = complete && any_of(metas.begin(), metas.end(), [&](const MailboxMeta &meta) {
+            return meta.e_MailboxPath == mailbox.e_MailboxPath;
+        });
+    }
+
+    if (complete) return largestUID;
+    return max(largestUID, UIDHolder::scanShortcuts(cass, domain, uuid));
+}
+
+int32_t UIDHolder::scanShortcuts(
+    CassandraConnection *cass, const string &domain,
+    const CassUuid &uuid
 ) {
     const char *query = R"(SELECT e_uid FROM fannst.email_shortcuts
     WHERE e_domain=? AND e_owners_uuid=? ALLOW FILTERING)";
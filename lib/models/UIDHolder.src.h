@@ -20,6 +20,8 @@
 #include "../default.h"
 #include "../general/connections.src.h"
 #include "../general/exceptions.src.h"
+#include "MailboxMeta.src.h"
+#include "Mailbox.src.h"
 
 using namespace FSMTP::Connections;
 
@@ -45,7 +47,7 @@ namespace FSMTP::Models {
 		static void saveRedis(
 			RedisConnection *redis, const int64_t bucket,
 			const string &domain, const CassUuid &uuid,
-			const int32_t num
+			const int32_t num, const bool onlyIfMissing = false
 		);
 
   	static int32_t restoreFromCassandra(
@@ -53,6 +55,10 @@ namespace FSMTP::Models {
   		const int64_t bucket, const string &domain,
   		const CassUuid &uuid
   	);
+  	static int32_t scanShortcuts(
+  		CassandraConnection *cass, const string &domain,
+  		const CassUuid &uuid
+  	);
   	static int32_t increment();
   };
 }
@@ -0,0 +1,70 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "PrefixTrie.src.h"
+
+#define _PREFIX_TRIE_NONE 0xFFFFFFFF
+
+namespace FSMTP::Networking
+{
+	PrefixTrie::PrefixTrie(void):
+		t_Nodes(1, Node { { 0, 0 }, _PREFIX_TRIE_NONE }), t_Prefixes(0)
+	{}
+
+	void PrefixTrie::insert(const uint8_t *address, const size_t prefixLength, const uint32_t value) {
+		uint32_t node = 0;
+
+		// Walks down the bits of the prefix, and creates the nodes which do
+		//  not exist yet, index zero is the root so it never is an child
+		for (size_t i = 0; i < prefixLength; ++i) {
+			const uint8_t bit = (address[i / 8] >> (7 - i % 8)) & 1;
+
+			if (this->t_Nodes[node].children[bit] == 0) {
+				this->t_Nodes[node].children[bit] = this->t_Nodes.size();
+				this->t_Nodes.push_back(Node { { 0, 0 }, _PREFIX_TRIE_NONE });
+			}
+
+			node = this->t_Nodes[node].children[bit];
+		}
+
+		if (this->t_Nodes[node].value == _PREFIX_TRIE_NONE) ++this->t_Prefixes;
+		this->t_Nodes[node].value = min(this->t_Nodes[node].value, value);
+	}
+
+	bool PrefixTrie::match(const uint8_t *address, const size_t bits, uint32_t &value) const {
+		uint32_t node = 0, best = this->t_Nodes[0].value;
+
+		for (size_t i = 0; i < bits; ++i) {
+			const uint8_t bit = (address[i / 8] >> (7 - i % 8)) & 1;
+			if ((node = this->t_Nodes[node].children[bit]) == 0) break;
+
+			best = min(best, this->t_Nodes[node].value);
+		}
+
+		if (best == _PREFIX_TRIE_NONE) return false;
+
+		value = best;
+		return true;
+	}
+
+	bool PrefixTrie::empty(void) const {
+		return this->t_Prefixes == 0;
+	}
+
+	size_t PrefixTrie::size(void) const {
+		return this->t_Prefixes;
+	}
+}
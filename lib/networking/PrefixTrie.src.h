@@ -0,0 +1,52 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include "../default.h"
+
+namespace FSMTP::Networking
+{
+	/**
+	 * Binary trie of address prefixes ( IPv4 or IPv6, in network order ), each
+	 *  prefix has an value, and lookups walk at most one node per address bit
+	 *  instead of comparing against every CIDR one after another
+	 */
+	class PrefixTrie
+	{
+	public:
+		PrefixTrie(void);
+
+		void insert(const uint8_t *address, const size_t prefixLength, const uint32_t value);
+
+		/**
+		 * Gets the smallest value of all prefixes containing the address, so when
+		 *  the values are positions in an list, this is the first match
+		 */
+		bool match(const uint8_t *address, const size_t bits, uint32_t &value) const;
+
+		bool empty(void) const;
+		size_t size(void) const;
+	private:
+		struct Node {
+			uint32_t children[2];
+			uint32_t value;
+		};
+
+		vector<Node> t_Nodes;
+		size_t t_Prefixes;
+	};
+}
@@ -244,7 +244,7 @@ namespace FSMTP::POP3
 				// Gets the UUID from the specified message, and then
 				// - query's the raw message
 				const CassUuid &uuid = get<0>(session.s_References[i]);
-				RawEmail raw = RawEmail::get(
+				RawBlobReader reader = RawEmail::stream(
 					cassandra, 
 					session.s_Account.a_Domain,
 					session.s_Account.a_UUID,
@@ -252,11 +252,29 @@ namespace FSMTP::POP3
 					get<2>(session.s_References[i])
 				);
 
+				// Reads chunks until we have the headers and the requested number
+				//  of body lines, so the rest of a large message is never fetched
+				string content, chunk;
+				while (reader.next(chunk)) {
+					content += chunk;
+
+					size_t headersEndPos = content.find("\r\n\r\n");
+					if (headersEndPos == string::npos) continue;
+
+					size_t lines = 0, pos = headersEndPos + 4;
+					while (lines <= line && (pos = content.find('\n', pos)) != string::npos) {
+						++pos;
+						++lines;
+					}
+
+					if (lines > line) break;
+				}
+
 				// Prepares the email contents, and splits the message
 				// - into the headers and body
 				string headers, body;
 				strvec_it headersBegin, headersEnd, bodyBegin, bodyEnd;
-				vector<string> lines = MIME::getMIMELines(raw.e_Content);
+				vector<string> lines = MIME::getMIMELines(content);
 				tie(headersBegin, headersEnd, bodyBegin,
 					bodyEnd) = MIME::splitMIMEBodyAndHeaders(lines.begin(), lines.end());
 				
@@ -624,7 +642,7 @@ namespace FSMTP::POP3
 				// Gets the UUID from the specified message, and then
 				// - query's the raw message
 				const CassUuid &uuid = get<0>(session.s_References[i]);
-				RawEmail raw = RawEmail::get(
+				RawBlobReader reader = RawEmail::stream(
 					cassandra, 
 					session.s_Account.a_Domain,
 					session.s_Account.a_UUID,
@@ -632,15 +650,9 @@ namespace FSMTP::POP3
 					get<2>(session.s_References[i])
 				);
 
-				// Prepares the email contents
-				if (raw.e_Content[raw.e_Content.size() - 1] != '\n' && 
-						raw.e_Content[raw.e_Content.size() - 2] != '\r') {
-					raw.e_Content += "\r\n";
-				}
-
-				raw.e_Content += ".\r\n";
-
-				// Sends the email contents
+				// Sends the email contents, large messages are streamed chunk
+				//  by chunk, so we keep track of the last two bytes to check
+				//  if the message already ends with an CRLF
 				client->write(P3Response(
 					true,
 					POP3ResponseType::PRT_RETR,
@@ -648,7 +660,19 @@ namespace FSMTP::POP3
 					nullptr, nullptr,
 					reinterpret_cast<void *>(&get<1>(session.s_References[i]))
 				).build());
-				client->write(raw.e_Content);
+
+				string chunk, tail;
+				while (reader.next(chunk)) {
+					if (chunk.empty()) continue;
+
+					tail += chunk.substr(chunk.size() < 2 ? 0 : chunk.size() - 2);
+					if (tail.size() > 2) tail.erase(0, tail.size() - 2);
+
+					client->write(chunk);
+				}
+
+				if (tail != "\r\n") client->write("\r\n.\r\n");
+				else client->write(".\r\n");
 
 				break;
 			}
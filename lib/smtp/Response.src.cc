@@ -67,6 +67,9 @@ string ServerResponse::getMessage(const SMTPResponseType c_Type) {
 		case SMTPResponseType::SRC_SPF_REJECT:
 			stream << "Server not authorized, rejecting message.";
 			break;
+		case SMTPResponseType::SRC_DMARC_REJECT:
+			stream << "Message rejected due to DMARC policy of sender domain.";
+			break;
 		case SMTPResponseType::SRC_ORDER_ERR:
 			stream << "Invalid order, why: [unknown]";
 			break;
@@ -102,6 +105,7 @@ string ServerResponse::getMessage(const SMTPResponseType c_Type) {
 			stream << "Access denied, closing transmission channel.";
 			break;
 		case SMTPResponseType::SRC_MESSAGE_TOO_LARGE: stream << "Message too large"; break;
+		case SMTPResponseType::SRC_LOCAL_ERROR: stream << "Local error in processing, try again later"; break;
 		case SMTPResponseType::SRC_GREETING: {
 			struct tm *timeInfo = nullptr;
 			char dateBuffer[128];
@@ -168,7 +172,9 @@ int32_t ServerResponse::getCode(const SMTPResponseType c_Type) {
 		case SMTPResponseType::SRC_SU_DENIED: return 651;
 		case SMTPResponseType::SRC_FCAPA_RESP: return 601;
 		case SMTPResponseType::SRC_SPF_REJECT: return 550;
+		case SMTPResponseType::SRC_DMARC_REJECT: return 550;
 		case SMTPResponseType::SRC_MESSAGE_TOO_LARGE: return 556;
+		case SMTPResponseType::SRC_LOCAL_ERROR: return 451;
 		default: throw std::runtime_error("getCode() invalid type");
 	}
 }
@@ -198,7 +204,9 @@ const char *ServerResponse::getEnchancedCode(const SMTPResponseType &c_Type) {
 		case SMTPResponseType::SRC_AUTH_NOT_ALLOWED: return "5.5.0 ";
 		case SMTPResponseType::SRC_FCAPA_RESP: return "6.1.1 ";
 		case SMTPResponseType::SRC_SPF_REJECT: return "5.7.23 ";
+		case SMTPResponseType::SRC_DMARC_REJECT: return "5.7.1 ";
 		case SMTPResponseType::SRC_MESSAGE_TOO_LARGE: return "5.3.4 ";
+		case SMTPResponseType::SRC_LOCAL_ERROR: return "4.3.0 ";
 		default: throw std::runtime_error("getCode() invalid type");
 	}
 }
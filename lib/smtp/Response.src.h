@@ -50,7 +50,9 @@ namespace FSMTP::SMTP
 		SRC_SU_DENIED,
 		SRC_FCAPA_RESP,
 		SRC_SPF_REJECT,
-		SRC_MESSAGE_TOO_LARGE
+		SRC_DMARC_REJECT,
+		SRC_MESSAGE_TOO_LARGE,
+		SRC_LOCAL_ERROR
 	} SMTPResponseType;
 
 	typedef struct {
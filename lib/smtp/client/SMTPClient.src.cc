@@ -37,28 +37,36 @@ namespace FSMTP::Mailer::Client {
 		auto &conf = Global::getConfig();
 
 		vector<SMTPClientServer> servers = {};
-		DNS::Resolver resolver;
 
 		// Parses the MX records, so we can later start resolving
 		//  the IPv4 / IPv6 addresses of them
-		vector<DNS::RR> records = resolver.query(domain.c_str(), ns_t_mx).initParse().getRecords();
+		vector<DNS::RR> records = DNS::AsyncResolver::resolveMX(domain).get();
 
-		// If IPv6 enabled, first try to resolve all the IPv6 addresses
-		//  if this ends up as an empty array, then we will resolve IPv4
-		if (conf["ipv6"].asBool()) {
-			DEBUG_ONLY(logger << DEBUG << "IPv6 enabled, attempting AF_INET6 resolving .." << ENDL << CLASSIC);
+		// Resolves the addresses of all the exchangers at once, and then
+		//  collects them in the order of the MX records, taking the first
+		//  address of each exchanger
+		auto resolveAll = [&](const int32_t type, const Networking::IP::Protocol protocol) {
+			vector<future<vector<DNS::RR>>> pending;
+			for (const DNS::RR &rr : records)
+				pending.push_back(DNS::AsyncResolver::query(rr.getData(), type));
 
-			// Loops over the records, and attempts AF_INET6 address resolving
-			//  this will override the default AF_INET
-			for_each(records.begin(), records.end(), [&](const DNS::RR &rr) {
+			for (future<vector<DNS::RR>> &f : pending) {
 				try {
+					vector<DNS::RR> addresses = f.get();
+					if (addresses.empty()) continue;
+
 					servers.push_back(SMTPClientServer {
-						DNS::resolveHostname(rr.getData(), AF_INET6),
-						Networking::IP::Protocol::Protocol_IPv6
+						addresses[0].getData(), protocol
 					});
 				} catch (...) {}
-			});
+			}
+		};
 
+		// If IPv6 enabled, first try to resolve all the IPv6 addresses
+		//  if this ends up as an empty array, then we will resolve IPv4
+		if (conf["ipv6"].asBool()) {
+			DEBUG_ONLY(logger << DEBUG << "IPv6 enabled, attempting AF_INET6 resolving .." << ENDL << CLASSIC);
+			resolveAll(ns_t_aaaa, Networking::IP::Protocol::Protocol_IPv6);
 			DEBUG_ONLY(logger << DEBUG << "Resolved " << servers.size() << " IPv6 addresses .." << ENDL << CLASSIC);
 		}
 
@@ -73,16 +81,7 @@ namespace FSMTP::Mailer::Client {
 				DEBUG_ONLY(logger << DEBUG << "IPv6 disabled, attempting AF_INET resolving .." << ENDL << CLASSIC);
 			}
 
-			// Starts looping over the records, and attempting the AF_INET address
-			//  resolving method
-			for_each(records.begin(), records.end(), [&](const DNS::RR &rr) {
-				try {
-					servers.push_back(SMTPClientServer {
-						DNS::resolveHostname(rr.getData(), AF_INET),
-						Networking::IP::Protocol::Protocol_IPv4
-					});
-				} catch (...) {}
-			});
+			resolveAll(ns_t_a, Networking::IP::Protocol::Protocol_IPv4);
 		}
 
 		// Checks if we're in debug, and prints the servers if it is the case
@@ -94,23 +93,18 @@ namespace FSMTP::Mailer::Client {
 		return servers;
 	}
 
-	SMTPClient &SMTPClient::sign(const string &message) {
-		auto &conf = Global::getConfig();
-
+	SMTPClient &SMTPClient::sign(const string &message, const string &domain) {
 		// Gets the current time so that we can set the signing
 		//  expire and sign date
 		int64_t now = duration_cast<milliseconds>(high_resolution_clock::now().time_since_epoch()).count();
 
-		// Prepares the signer, by setting the default parameters
-		//  which will be used in the signing process
+		// Prepares the signer with the preloaded keys of the sending domain,
+		//  this may be both an RSA and Ed25519 key, which will each sign
 		DKIM::DKIMSigner sign;
-		sign.setDomain(conf["dkim"]["domain"].asString())
-			.setKeySelector(conf["dkim"]["keyselector"].asString())
-			.setPrivateKeyPath(conf["dkim"]["dkim_private"].asString())
+		sign.setKeys(DKIM::DKIMKeyStore::get(domain))
 			.setSignTime(now)
 			.setExpireTime(now + (1000 * 60 * 60))
 			.setAlgoPair(DKIM::DKIMHeaderCanonAlgPair::RelaxedRelaxed)
-			.setSignAlgo(DKIM::DKIMHeaderAlgorithm::HeaderAlgoritmRSA_SHA256)
 			.headerFilterPush("subject").headerFilterPush("from")
 			.headerFilterPush("to").headerFilterPush("date")
 			.headerFilterPush("mime-version").headerFilterPush("message-id");
@@ -127,7 +121,7 @@ namespace FSMTP::Mailer::Client {
 	) {
 		if (!s_Silent) this->s_Logger << "Voorbereiden ..." << ENDL;
 
-		this->sign(message);
+		this->sign(message, from[0].getDomain());
 		this->s_MailFrom = from[0];
 
 		this->configureRecipients(to);
@@ -163,7 +157,7 @@ namespace FSMTP::Mailer::Client {
 	SMTPClient &SMTPClient::prepare(MailComposerConfig &config) {
 		if (!s_Silent) this->s_Logger << "Voorbereiden ..." << ENDL;
 
-		this->sign(compose(config));
+		this->sign(compose(config), config.m_From[0].getDomain());
 		this->s_MailFrom = config.m_From[0];
 
 		this->configureRecipients(config.m_To);
@@ -25,6 +25,7 @@
 #include "../../models/Email.src.h"
 #include "../../general/Logger.src.h"
 #include "../../dns/Resolver.src.h"
+#include "../../dns/AsyncResolver.src.h"
 #include "../../dkim/DKIMSigner.src.h"
 #include "../Response.src.h"
 #include "../Command.src.h"
@@ -81,7 +82,7 @@ namespace FSMTP::Mailer::Client {
 		SMTPClient &printReceived(const int32_t code, const string &args);
 		SMTPClient &printSent(const string &mess);
 		SMTPClient &reset();
-		SMTPClient &sign(const string &message);
+		SMTPClient &sign(const string &message, const string &domain);
 
 		bool s_Silent;
 		Logger s_Logger;
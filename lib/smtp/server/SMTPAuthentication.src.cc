@@ -20,45 +20,19 @@ namespace FSMTP::Server
 {
 	tuple<string, string> getUserAndPassB64(const string &hash) {
 		auto &conf = Global::getConfig();
-		char *decoded = new char[hash.size()];
-		BIO *base64 = nullptr, *bio = nullptr;
-		int32_t rc;
 
-		// Decodes the base64 string, this will be done with openssl
-		//  since it is faster than the one i wrote. If this fails
-		//  we free the memory and throw an runtime_error.
+		// Decodes the PLAIN credentials ( RFC 4616 ), these are the authorization
+		//  identity, the username and the password, separated by null chars
+		string decoded = Encoding::decodeBase64(hash);
 
-		base64 = BIO_new(BIO_f_base64());
-		bio = BIO_new_mem_buf(hash.c_str(), hash.size());
-		bio = BIO_push(base64, bio);
-		BIO_set_flags(bio, BIO_FLAGS_BASE64_NO_NL);
-
-		rc = BIO_read(bio, decoded, hash.size());
-		if (rc < 0) {
-			BIO_free_all(bio);
-			delete[] decoded;
-			throw runtime_error("Could not decode base64");
-		}
-
-		// Finds the null termination char, this will separate the password from
-		//  the username, we cannot use str.find() since this will assume that the
-		//  null terminator is the end of the string.
-
-		char *c = decoded;
-		c++;
-		int32_t i;
-		for (i = 0; i < rc; i++)
-		{
-			if (*c == '\0') break;
-			else c++;
-		}
-		if (i == 0) {
+		size_t first = decoded.find('\0');
+		size_t second = first == string::npos ? string::npos : decoded.find('\0', first + 1);
+		if (second == string::npos || second == first + 1) {
 			throw runtime_error("Could not find separator");
 		}
 
-		// Parses the username and password into one string,
-		// - frees the memory and returns
-		string username(decoded+1, i), password(c+1, rc-i-2);
+		string username = decoded.substr(first + 1, second - first - 1);
+		string password = decoded.substr(second + 1);
 
 		// Adds the default domain if not specified
 		if (username.find_first_of('@') == string::npos)
@@ -66,8 +40,6 @@ namespace FSMTP::Server
 			username += '@';
 			username += conf["domain"].asCString();
 		}
-		delete[] decoded;
-		BIO_free_all(bio);
 		return tuple<string, string>(username, password);
 	}
 
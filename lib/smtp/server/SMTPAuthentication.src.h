@@ -21,6 +21,7 @@
 
 #include "../../general/connections.src.h"
 #include "../../general/Passwords.src.h"
+#include "../../general/base64.src.h"
 #include "../../models/LocalDomain.src.h"
 #include "../../models/Account.src.h"
 #include "../../models/Email.src.h"
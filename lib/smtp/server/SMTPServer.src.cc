@@ -51,7 +51,7 @@ SMTPServer &SMTPServer::connectDatabases() {
 		cass = Global::getCassandra();
 		logger << _BASH_SUCCESS_MARK << "Connected to cassandra" << ENDL;
 	} catch (const runtime_error &err) {
-		throw runtime_error(EXCEPT_DEBUG(CassandraConnection::getError(cass->c_ConnectFuture)));
+		throw runtime_error(EXCEPT_DEBUG(err.what()));
 	}
 
 	try {
@@ -120,6 +120,16 @@ SMTPServer &SMTPServer::startHandler(const bool newThread) {
 		Logger clogger("ESMTP[" + client->getPrefix() + ']', LoggerLevel::DEBUG);
 		DEBUG_ONLY(clogger << "Client connected" << ENDL);
 
+		// Starts the blocklist checks and the reverse lookup of the client, these
+		//  run while the client sends the greeting, so the verdict is there before
+		//  MAIL FROM, and the hostname before the Received header is built
+		try {
+			session->setDNSBLVerdict(SpamDetection::DNSBL::check(client->getPrefix()));
+			session->setReverseDNS(DNS::ReverseDNS::lookup(client->getPrefix()));
+		} catch (const invalid_argument &e) {
+			clogger << ERROR << "Could not check client in blocklists: " << e.what() << ENDL << CLASSIC;
+		}
+
 		try {
 			ServerResponse response(SMTPResponseType::SRC_GREETING);
 			client->write(response.build());
@@ -235,6 +245,7 @@ bool SMTPServer::handleCommand(
 			client->write(response.build());
 
 			session->setAction(_SMTP_SERV_PA_HELO);
+			session->setHeloDomain(command.c_Arguments[0]);
 			break;
 		}
 		// ========================================
@@ -259,6 +270,7 @@ bool SMTPServer::handleCommand(
 			client->write(response.build());
 
 			session->setAction(_SMTP_SERV_PA_HELO);
+			session->setHeloDomain(command.c_Arguments[0]);
 			break;
 		}
 		// ========================================
@@ -313,6 +325,23 @@ bool SMTPServer::handleCommand(
 				throw SMTPSyntaxException(string("Invalid email address: ") + err.what());
 			}
 
+			// Rejects clients which are on an blocklist, before any of the message is
+			//  transferred, authenticated clients are allowed since they may
+			//  connect from ranges which are listed, such as dynamic ones
+
+			if (!session->getFlag(_SMTP_SERV_SESSION_AUTH_FLAG) && !session->getFlag(_SMTP_SERV_SESSION_SU)) {
+				SpamDetection::DNSBLVerdict verdict = SpamDetection::DNSBL::wait(session->getDNSBLVerdict());
+
+				if (verdict.listed) {
+					string message = "rejected; Blocked using";
+					for (const string &zone : verdict.zones) message += ' ' + zone;
+
+					DEBUG_ONLY(clogger << WARN << "Client listed, " << message << ENDL << CLASSIC);
+					client->write(ServerResponse(SMTPResponseType::SRC_SPAM_ALERT, message, nullptr, nullptr).build());
+					return true;
+				}
+			}
+
 			// Checks if the message is from an different server, or if the message
 			//  comes from one of this servers domains. If it is one from our server
 			//  we want to require the user to authenticate first.
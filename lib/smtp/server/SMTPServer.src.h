@@ -65,7 +65,7 @@ namespace FSMTP::Server
 	private:
 		unique_ptr<ServerSocket> s_SSLSocket, s_PlainSocket;
 		unique_ptr<SSLContext> s_SSLContext;
-		unique_ptr<CassandraConnection> s_Cassandra;
+		shared_ptr<CassandraConnection> s_Cassandra;
 		unique_ptr<RedisConnection> s_Redis;
 		Logger s_Logger;
 	};
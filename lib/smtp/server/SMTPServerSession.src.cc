@@ -18,7 +18,8 @@
 
 namespace FSMTP::Server {
 	SMTPServerSession::SMTPServerSession():
-		m_Flags(0x0), m_PerformedActions(0x0), m_PossibleSpam(false)
+		m_Flags(0x0), m_PerformedActions(0x0), m_PossibleSpam(false),
+		m_SpoolID(0)
 	{}
 
 	void SMTPServerSession::setFlag(int64_t mask) { this->m_Flags |= mask; }
@@ -112,11 +113,48 @@ namespace FSMTP::Server {
 
 	SMTPServerSession &SMTPServerSession::setPossibleSpam(bool v) {
 		this->m_PossibleSpam = v;
+		return *this;
+	}
+
+	SMTPServerSession &SMTPServerSession::setSpoolID(uint64_t id) {
+		this->m_SpoolID = id;
+		return *this;
 	}
 
 	bool SMTPServerSession::getPossibleSpam() {
 		return this->m_PossibleSpam;
 	}
 
+	uint64_t SMTPServerSession::getSpoolID() {
+		return this->m_SpoolID;
+	}
+
+	SMTPServerSession &SMTPServerSession::setHeloDomain(const string &domain) {
+		this->m_HeloDomain = domain;
+		return *this;
+	}
+
+	const string &SMTPServerSession::getHeloDomain() {
+		return this->m_HeloDomain;
+	}
+
+	SMTPServerSession &SMTPServerSession::setDNSBLVerdict(const shared_future<SpamDetection::DNSBLVerdict> &verdict) {
+		this->m_DNSBLVerdict = verdict;
+		return *this;
+	}
+
+	const shared_future<SpamDetection::DNSBLVerdict> &SMTPServerSession::getDNSBLVerdict() {
+		return this->m_DNSBLVerdict;
+	}
+
+	SMTPServerSession &SMTPServerSession::setReverseDNS(const shared_future<DNS::ReverseDNSResult> &result) {
+		this->m_ReverseDNS = result;
+		return *this;
+	}
+
+	const shared_future<DNS::ReverseDNSResult> &SMTPServerSession::getReverseDNS() {
+		return this->m_ReverseDNS;
+	}
+
 	SMTPServerSession::~SMTPServerSession() = default;
 }
\ No newline at end of file
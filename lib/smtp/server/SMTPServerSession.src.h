@@ -20,6 +20,8 @@
 #include "../../models/Email.src.h"
 #include "../../models/Account.src.h"
 #include "../../xfannst/XFannstFlags.src.h"
+#include "SMTPSpamDetection.src.h"
+#include "../../dns/ReverseDNS.src.h"
 
 #define _SMTP_SERV_SESSION_AUTH_FLAG 1
 #define _SMTP_SERV_SESSION_SSL_FLAG 2
@@ -95,15 +97,25 @@ namespace FSMTP::Server {
 		const string &getSnippet();
 
 		SMTPServerSession &setPossibleSpam(bool v);
+		SMTPServerSession &setSpoolID(uint64_t id);
+		SMTPServerSession &setHeloDomain(const string &domain);
+		SMTPServerSession &setDNSBLVerdict(const shared_future<SpamDetection::DNSBLVerdict> &verdict);
+		SMTPServerSession &setReverseDNS(const shared_future<DNS::ReverseDNSResult> &result);
 
 		bool getPossibleSpam();
+		uint64_t getSpoolID();
+		const string &getHeloDomain();
+		const shared_future<SpamDetection::DNSBLVerdict> &getDNSBLVerdict();
+		const shared_future<DNS::ReverseDNSResult> &getReverseDNS();
 
 		AccountShortcut s_SendingAccount;
 
 		~SMTPServerSession();
 	private:
 		XFannst::XFannstFlags m_XFannstFlags;
-		string m_MessageID, m_Subject, m_Snippet;
+		string m_MessageID, m_Subject, m_Snippet, m_HeloDomain;
+		shared_future<SpamDetection::DNSBLVerdict> m_DNSBLVerdict;
+		shared_future<DNS::ReverseDNSResult> m_ReverseDNS;
 		vector<EmailAddress> m_TransportTo;
 		EmailAddress m_TransportFrom;
 		EmailAddress m_From;
@@ -113,6 +125,7 @@ namespace FSMTP::Server {
 		vector<SMTPServerRelayTask> m_RelayTasks;
 		int64_t m_PerformedActions;
 		bool m_PossibleSpam;
+		uint64_t m_SpoolID;
 		int32_t m_Flags;
 		string m_Raw;
 	};
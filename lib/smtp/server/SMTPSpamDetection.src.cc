@@ -17,43 +17,195 @@
 #include "SMTPSpamDetection.src.h"
 
 namespace FSMTP::Server::SpamDetection {
-	bool checkSpamhaus(string ip) {
-		// Reverses the remote address, this is required since zen some or another
-		//  way works like this
-		vector<string> segments = {};
-		stringstream ss(ip);
-		string segment;
-
-		while(getline(ss, segment, '.')) {
-			segments.push_back(segment);
+	/**
+	 * State of an running check, the answers of the zones arrive on the
+	 *  resolver thread, the last one publishes the verdict
+	 */
+	struct DNSBLCheck {
+		mutex mtx;
+		string address;
+		size_t remaining;
+		uint32_t ttl;
+		DNSBLVerdict verdict;
+		promise<DNSBLVerdict> result;
+	};
+
+	static mutex dnsblMutex;
+	static TTLCache<DNSBLVerdict> dnsblCache(65536);
+	static unordered_map<string, shared_future<DNSBLVerdict>> dnsblRunning;
+	static vector<string> dnsblZones = { "zen.spamhaus.org" };
+	static uint32_t dnsblNegativeTTL = 900, dnsblErrorTTL = 60;
+	static milliseconds dnsblTimeout(1500);
+	static atomic<size_t> dnsblHits(0);
+	static atomic<size_t> dnsblMisses(0);
+
+	void DNSBL::configure(const Json::Value &config) {
+		lock_guard<mutex> lock(dnsblMutex);
+
+		if (config.isMember("zones")) {
+			dnsblZones.clear();
+			for (const Json::Value &zone : config["zones"]) dnsblZones.push_back(zone.asString());
 		}
 
-		reverse(segments.begin(), segments.end());
+		if (config.isMember("cache_entries")) dnsblCache.setMaxEntries(config["cache_entries"].asUInt64());
+		if (config.isMember("negative_ttl")) dnsblNegativeTTL = config["negative_ttl"].asUInt();
+		if (config.isMember("timeout_ms")) dnsblTimeout = milliseconds(config["timeout_ms"].asUInt());
+	}
+
+	string DNSBL::reverseAddress(const string &address) {
+		struct in_addr addr4;
+		struct in6_addr addr6;
+		char buffer[64], *p = buffer;
 
-		// Builds the final address, with the reverse and the zen address
-		//  appended to it, when this is done we resolve the DNS records
+		// An IPv4 client on an dual stack socket shows up as an mapped IPv6
+		//  address, those are checked as IPv4 addresses
+		const uint8_t *octets = nullptr;
+		if (inet_pton(AF_INET, address.c_str(), &addr4) == 1) {
+			octets = reinterpret_cast<const uint8_t *>(&addr4);
+		} else if (inet_pton(AF_INET6, address.c_str(), &addr6) == 1) {
+			if (!IN6_IS_ADDR_V4MAPPED(&addr6)) {
+				static const char *hex = "0123456789abcdef";
+				for (int32_t i = 15; i >= 0; --i) {
+					*p++ = hex[addr6.s6_addr[i] & 0x0F];
+					*p++ = '.';
+					*p++ = hex[addr6.s6_addr[i] >> 4];
+					*p++ = '.';
+				}
 
-		string address;
-		for_each(segments.begin(), segments.end(), [&](auto &seg) {
-			address += seg;
-			address += '.';
-		});
-		address += "zen.spamhaus.org";
-
-		// Checks if any records are found for the specified ip address, if so we classify
-		//  it as an spam address
-
-		struct __res_state state;
-		res_ninit(&state);
-		DEFER(res_nclose(&state));
-
-		unsigned char output[1024];
-		int32_t len = res_nquery(&state, address.c_str(), ns_c_in, ns_t_a, output, sizeof(output));
-
-		if (len == -1) {
-			return false;
-		} else {
-			return true;
+				return string(buffer, p - buffer - 1);
+			}
+
+			octets = addr6.s6_addr + 12;
+		} else throw invalid_argument("Invalid address: " + address);
+
+		p += sprintf(p, "%u.%u.%u.%u", octets[3], octets[2], octets[1], octets[0]);
+		return string(buffer, p - buffer);
+	}
+
+	/**
+	 * Stores the verdict, and removes the check from the running ones
+	 */
+	static void __dnsblFinish(DNSBLCheck &state) {
+		{
+			lock_guard<mutex> lock(dnsblMutex);
+			dnsblCache.put(state.address, state.verdict, state.ttl);
+			dnsblRunning.erase(state.address);
+		}
+
+		state.result.set_value(state.verdict);
+	}
+
+	/**
+	 * Handles the answer of one zone, the lowest TTL of the answers is used for
+	 *  the verdict, and failed queries are retried soon
+	 */
+	static void __dnsblAnswer(shared_ptr<DNSBLCheck> state, const string &zone, vector<DNS::RR> &&records, exception_ptr error) {
+		bool done;
+
+		{
+			lock_guard<mutex> lock(state->mtx);
+
+			if (!error) {
+				for (const DNS::RR &record : records) {
+					// 127.255.255.0/24 is used by some zones for errors, such as
+					//  queries through an public resolver, those are no listing
+					const string &data = record.getData();
+					if (data.compare(0, 4, "127.") != 0 || data.compare(0, 12, "127.255.255.") == 0) continue;
+
+					if (!state->verdict.listed || state->verdict.zones.back() != zone)
+						state->verdict.zones.push_back(zone);
+					state->verdict.listed = true;
+					state->ttl = min<uint32_t>(state->ttl, record.getTTL());
+				}
+			} else {
+				try {
+					rethrow_exception(error);
+				} catch (const DNS::NoResults &e) {
+				} catch (...) {
+					state->ttl = min(state->ttl, dnsblErrorTTL);
+				}
+			}
+
+			done = --state->remaining == 0;
+		}
+
+		if (done) __dnsblFinish(*state);
+	}
+
+	shared_future<DNSBLVerdict> DNSBL::check(const string &address) {
+		string reversed = DNSBL::reverseAddress(address);
+		vector<string> zones;
+		shared_ptr<DNSBLCheck> state;
+		shared_future<DNSBLVerdict> result;
+
+		{
+			lock_guard<mutex> lock(dnsblMutex);
+
+			const DNSBLVerdict *cached = dnsblCache.get(address);
+			if (cached) {
+				++dnsblHits;
+
+				promise<DNSBLVerdict> result;
+				result.set_value(*cached);
+				return result.get_future().share();
+			}
+
+			auto running = dnsblRunning.find(address);
+			if (running != dnsblRunning.end()) {
+				++dnsblHits;
+				return running->second;
+			}
+
+			++dnsblMisses;
+			zones = dnsblZones;
+
+			state = make_shared<DNSBLCheck>();
+			state->address = address;
+			state->remaining = zones.size();
+			state->ttl = dnsblNegativeTTL;
+			state->verdict.listed = false;
+
+			result = state->result.get_future().share();
+			if (zones.empty()) {
+				state->result.set_value(state->verdict);
+				return result;
+			}
+
+			dnsblRunning[address] = result;
+		}
+
+		// Queries all zones at once, the callbacks may run right away when the answer
+		//  is cached, so no lock is held while starting the queries. An query which
+		//  fails to start is counted down like an failed answer, otherwise the
+		//  check would never finish and stay in the running ones
+		for (const string &zone : zones) {
+			try {
+				DNS::AsyncResolver::query(reversed + '.' + zone, ns_t_a, [state, zone](vector<DNS::RR> &&records, exception_ptr error) {
+					__dnsblAnswer(state, zone, move(records), error);
+				});
+			} catch (...) {
+				__dnsblAnswer(state, zone, vector<DNS::RR>(), current_exception());
+			}
 		}
+
+		return result;
+	}
+
+	DNSBLVerdict DNSBL::wait(const shared_future<DNSBLVerdict> &verdict) {
+		if (!verdict.valid() || verdict.wait_for(dnsblTimeout) != future_status::ready)
+			return DNSBLVerdict { false, {} };
+		return verdict.get();
+	}
+
+	DNSBLStats DNSBL::getStats() {
+		lock_guard<mutex> lock(dnsblMutex);
+		return DNSBLStats {
+			dnsblHits, dnsblMisses, dnsblCache.size()
+		};
+	}
+
+	void DNSBL::clear() {
+		lock_guard<mutex> lock(dnsblMutex);
+		dnsblCache.clear();
 	}
 }
@@ -16,8 +16,57 @@
 
 #pragma once
 
+#include <future>
+
 #include "../../default.h"
+#include "../../general/Logger.src.h"
+#include "../../dns/AsyncResolver.src.h"
+#include "../../general/TTLCache.src.h"
 
 namespace FSMTP::Server::SpamDetection {
-	bool checkSpamhaus(string ip);
+	/**
+	 * The verdict for an client address, with the zones which listed it, an
+	 *  address is only listed when an zone answers with 127.0.0.0/8
+	 */
+	struct DNSBLVerdict {
+		bool listed;
+		vector<string> zones;
+	};
+
+	struct DNSBLStats {
+		size_t hits;
+		size_t misses;
+		size_t entries;
+	};
+
+	/**
+	 * Checks client addresses against the configured DNS blocklists, all zones
+	 *  are queried at once through the async resolver when the client connects,
+	 *  and the verdict is cached per address for the lowest TTL of the answers
+	 */
+	class DNSBL {
+	public:
+		static void configure(const Json::Value &config);
+
+		/**
+		 * Starts the check of an address, if the verdict is cached or an check of
+		 *  the same address is running, that one is returned instead
+		 */
+		static shared_future<DNSBLVerdict> check(const string &address);
+
+		/**
+		 * Waits at most the configured timeout for an verdict, if the zones
+		 *  did not answer in time, the address is treated as not listed
+		 */
+		static DNSBLVerdict wait(const shared_future<DNSBLVerdict> &verdict);
+
+		/**
+		 * Builds the name to query in an zone, the octets of an IPv4 address or
+		 *  the nibbles of an IPv6 address in reverse order
+		 */
+		static string reverseAddress(const string &address);
+
+		static DNSBLStats getStats();
+		static void clear();
+	};
 }
@@ -48,36 +48,81 @@ std::cout << session->raw() << std::endl;
 		DEBUG_ONLY(clogger << DEBUG << "MIME-Message received in " << timeDifference
 			<< " seconds, with " << kbsec << "kb/sec" << ENDL << CLASSIC);
 
+		// ========================================
+		// Parses the headers from the message
+		// ========================================
+
+		// Splits the raw body into lines, so we can perform
+		//  further processing on it later
+		vector<string> lines = MIME::getMIMELines(session->raw());
+
+		// Splits the headers and the body, so we can append our
+		//  own headers to it
+		strvec_it headersBegin, headersEnd, bodyBegin, bodyEnd;
+		tie(
+			headersBegin, headersEnd,
+			bodyBegin, bodyEnd
+		) = MIME::splitMIMEBodyAndHeaders(lines.begin(), lines.end());
+
+		// Joins the header lines, so they will not contain any non-wantend
+		//  indentions, after which we parse them
+		vector<string> joinedHeaders = MIME::joinHeaders(headersBegin, headersEnd);
+
 		// ========================================
 		// Performs the security checks
 		// ========================================
 
+		// Gets the reverse lookup which started when the client connected, the
+		//  hostname is only trusted when it resolves back to the client
+		DNS::ReverseDNSResult rdns = DNS::ReverseDNS::wait(session->getReverseDNS());
+		DEBUG_ONLY(clogger << DEBUG << "Reverse DNS: " << DNS::ReverseDNS::statusToString(rdns.status)
+			<< (rdns.hostname.empty() ? "" : " (" + rdns.hostname + ')') << ENDL << CLASSIC);
+
 		vector<pair<string, string>> authResults = {};
 		if (!session->getFlag(_SMTP_SERV_SESSION_AUTH_FLAG)) {
-			// Creates the DMARC resolve query
-			string dmarcQuery = "_dmarc.";
-			dmarcQuery += session->getTransportFrom().getDomain();
-
-			// Resolves the DMARC record, if this fails we set the
-			//  check dmarc false, so that we will not verify further 
-			//  actions on the system
-			DMARC::DMARCRecord dmarcRecord;
-			bool dmarcFound = false;
-			try {
-				dmarcRecord = DMARC::DMARCRecord::fromDNS(dmarcQuery.c_str());
-				dmarcFound = true;
-				DEBUG_ONLY(dmarcRecord.print(clogger));
-			} catch (const runtime_error &e) {
-				DEBUG_ONLY(clogger << ERROR << "Failed to resolve dmarc from query: '"
-					<< dmarcQuery << "', error: " << e.what() << ENDL << CLASSIC);
-			} catch (...) {
-				DEBUG_ONLY(clogger << ERROR << "Failed to resolve dmarc from query: '"
-					<< dmarcQuery << "', error unknown" << ENDL << CLASSIC);
+			// Gets the RFC5322.From domain, which is the domain DMARC protects, messages
+			//  without exactly one From header, with an unparsable one or with authors
+			//  of different domains can not be checked ( RFC 7489 6.6.1 ), these are
+			//  only rejected when configured, since bounces and group syntax have no
+			//  author domain, otherwise DMARC is evaluated as none
+			string fromDomain;
+			size_t fromHeaders = 0;
+			bool fromValid = true;
+
+			for (const string &header : joinedHeaders) {
+				if (header.size() < 5 || strncasecmp(header.c_str(), "from:", 5) != 0) continue;
+				if (++fromHeaders > 1) break;
+
+				try {
+					vector<EmailAddress> authors = EmailAddress::parseAddressList(header.substr(5));
+
+					for (const EmailAddress &author : authors) {
+						const string domain = author.getDomain();
+						if (fromDomain.empty()) fromDomain = domain;
+						else if (strcasecmp(domain.c_str(), fromDomain.c_str()) != 0) fromValid = false;
+					}
+				} catch (const runtime_error &e) {
+					DEBUG_ONLY(clogger << DEBUG << "Could not parse From header: " << e.what() << ENDL << CLASSIC);
+					fromValid = false;
+				}
+			}
+
+			if (fromHeaders != 1 || !fromValid || fromDomain.empty()) {
+				if (Global::getConfig()["dmarc"]["reject_invalid_from"].asBool()) {
+					DEBUG_ONLY(clogger << DEBUG << "Rejecting message with " << fromHeaders << " From headers" << ENDL << CLASSIC);
+					client->write(ServerResponse(SMTPResponseType::SRC_DMARC_REJECT,
+						"Message must have one From header with authors of one domain", nullptr, nullptr).build());
+					return true;
+				}
+
+				DEBUG_ONLY(clogger << DEBUG << "No usable From domain in " << fromHeaders << " From headers" << ENDL << CLASSIC);
+				fromDomain.clear();
 			}
 
 			// Performs the SPF validation
 			SPF::SPFValidator spfValidator;
 			spfValidator.setProtocol(client->getRealProtocol());
+			spfValidator.setSender(session->getTransportFrom().e_Address, session->getHeloDomain());
 			spfValidator.safeValidate(session->getTransportFrom().getDomain(), client->getPrefix());
 
 			// Checks the outcome of the spf validation, and sets the SPF valid boolean
@@ -95,89 +140,69 @@ std::cout << session->raw() << std::endl;
 					break;
 			}
 
-			// Checks if the dmarc record exists, and if so check if the policy says
-			//  anything about how we should treat the message
-			bool dmarcSpfValid;
-			if (dmarcFound && !spfValid) {
-				switch (dmarcRecord.getPolicy()) {
-					case DMARC::DMARCPolicy::PolicyNone:
-						session->setPossibleSpam(true);
-						dmarcSpfValid = true;
-						break;
-					case DMARC::DMARCPolicy::PolicyQuarantine:
-						session->setPossibleSpam(true);
-						dmarcSpfValid = false;
-						break;
-					case DMARC::DMARCPolicy::PolicyReject: {
-						client->write(ServerResponse(SMTPResponseType::SRC_SPF_REJECT).build());
-						return true;
-						break;
-					}
-				}
-			} else if (!spfValid && !dmarcFound) session->setPossibleSpam(true);
-			else if(dmarcFound) dmarcSpfValid = true;
-
 			// Validates the DKIM record
 			DKIM::DKIMValidator dkimValidator;
 			dkimValidator.validate(session->raw());
 
 			// Checks the result of the dkim validator, and prints it to
 			//  the console, while setting the valid boolean based on the result
-			bool dkimValid;
 			switch (dkimValidator.getResult().type) {
 				case DKIM::DKIMValidatorResultType::DKIMValidationPass:
 					DEBUG_ONLY(clogger << DEBUG << "Validator found one or more valid signatures" << ENDL << CLASSIC);
-					dkimValid = true;
 					break;
 				case DKIM::DKIMValidatorResultType::DKIMValidationNeutral:
 					DEBUG_ONLY(clogger << DEBUG << "Validator returned neutral" << ENDL << CLASSIC);
-					dkimValid = true;
 					break;
 				case DKIM::DKIMValidatorResultType::DKIMValidationSystemError:
 					DEBUG_ONLY(clogger << DEBUG << "An system error occured while validating DKIM" << ENDL << CLASSIC);
-					dkimValid = false;
 					break;
 				case DKIM::DKIMValidatorResultType::DKIMValidationFail:
 					DEBUG_ONLY(clogger << DEBUG << "All of the signatures are invalid" << ENDL << CLASSIC);
-					dkimValid = false;
 					break;
 			}
 
-			// Checks the result of the DKIM validator, and how we should
-			//  treat it according to the dmarc record
-			bool dmarcDkimValid;
-			if (dmarcFound && !dkimValid) {
-				switch (dmarcRecord.getPolicy()) {
-					case DMARC::DMARCPolicy::PolicyNone:
-						dmarcDkimValid = true;
-						break;
-					// TODO: Make DKIM reliable to reject clients if this fails
-					case DMARC::DMARCPolicy::PolicyQuarantine:
-					case DMARC::DMARCPolicy::PolicyReject:
-						dmarcDkimValid = false;
-						break;
+			// Checks if the passing SPF and DKIM domains are aligned with the From
+			//  domain, and applies the DMARC policy of it if none of them is
+			DMARC::DMARCValidator dmarcValidator;
+			dmarcValidator.setFromDomain(fromDomain);
+			if (spfValid) dmarcValidator.setSPFDomain(session->getTransportFrom().getDomain());
+			for (const string &domain : dkimValidator.getValidDomains())
+				dmarcValidator.addDKIMDomain(domain);
+			dmarcValidator.validate();
+
+			switch (dmarcValidator.getResult().type) {
+				case DMARC::DMARCResultType::DMARCResultPass: break;
+				case DMARC::DMARCResultType::DMARCResultFail: {
+					switch (dmarcValidator.getResult().policy) {
+						case DMARC::DMARCPolicy::PolicyNone: break;
+						case DMARC::DMARCPolicy::PolicyQuarantine:
+							session->setPossibleSpam(true);
+							break;
+						case DMARC::DMARCPolicy::PolicyReject:
+							client->write(ServerResponse(SMTPResponseType::SRC_DMARC_REJECT).build());
+							return true;
+					}
+					break;
 				}
-			} else if (dmarcFound) dmarcDkimValid = true;
-
-
-			// Builds the dmarc result header value, this will not be generated
-			//  since the validation of dmarc happens here;
-			if (dmarcFound) {
-				// Prints the policy, subdomain policy and the query into the buffer
-				//  which will be inserted into the final headers
-				sprintf(buffer, "%s (p:%s sp:%s) query:%s", 
-					(!dmarcSpfValid || !dmarcDkimValid ? "fail" : "pass"), dmarcRecord.getPolicyString(),
-					dmarcRecord.getSubdomainPolicyString(), dmarcQuery.c_str());
-			} else {
-				// Prints that dmarc is neutral, since there was no record found
-				sprintf(buffer, "fail (no record) query:%s", dmarcQuery.c_str());
+				case DMARC::DMARCResultType::DMARCResultNone:
+				case DMARC::DMARCResultType::DMARCResultTempError:
+					if (!spfValid) session->setPossibleSpam(true);
+					break;
 			}
 
+			DEBUG_ONLY(clogger << DEBUG << "DMARC result: " << dmarcValidator.getResultString() << ENDL << CLASSIC);
+
 			// Builds the auth result header map, which will contain
 			//  some basic auth results
 			authResults.push_back(make_pair("spf", spfValidator.getResultString()));
 			authResults.push_back(make_pair("dkim", dkimValidator.getResultString()));
-			authResults.push_back(make_pair("dmarc", buffer));
+			authResults.push_back(make_pair("dmarc", dmarcValidator.getResultString()));
+			authResults.push_back(make_pair("iprev", DNS::ReverseDNS::statusToString(rdns.status)));
+
+			// Clients without confirmed reverse DNS are mostly dynamic ranges, when
+			//  configured their messages are marked as possible spam
+			if (rdns.status != DNS::ReverseDNSPass && Global::getConfig()["rdns"]["require_fcrdns"].asBool())
+				session->setPossibleSpam(true);
 
 			// Checks if the client was using using SU, if so add the SU
 			//  header to the authResults
@@ -185,26 +210,6 @@ std::cout << session->raw() << std::endl;
 				authResults.push_back(make_pair("su", "pass (to: [" + client->getPrefix() + "]:" + to_string(client->getPort()) + ")"));
 		} else authResults.push_back(make_pair("auth", "pass"));
 
-		// ========================================
-		// Parses the headers from the message
-		// ========================================
-
-		// Splits the raw body into lines, so we can perform
-		//  further processing on it later
-		vector<string> lines = MIME::getMIMELines(session->raw());
-
-		// Splits the headers and the body, so we can append our
-		//  own headers to it
-		strvec_it headersBegin, headersEnd, bodyBegin, bodyEnd;
-		tie(
-			headersBegin, headersEnd,
-			bodyBegin, bodyEnd
-		) = MIME::splitMIMEBodyAndHeaders(lines.begin(), lines.end());
-
-		// Joins the header lines, so they will not contain any non-wantend
-		//  indentions, after which we parse them
-		vector<string> joinedHeaders = MIME::joinHeaders(headersBegin, headersEnd);
-
 		// ========================================
 		// Builds the headers
 		// ========================================
@@ -220,7 +225,7 @@ std::cout << session->raw() << std::endl;
 		// Generates the received header, this will indicate that the message
 		//  went through the FSMTP-V2 Server
 		joinedHeaders.push_back("Received: " + SMTP::Server::Headers::buildReceived(
-			client->getReverseLookup(), client->getPrefix(),
+			rdns.status == DNS::ReverseDNSPass ? rdns.hostname : "unknown", client->getPrefix(),
 			session->getTransportFrom().e_Address, client->getPort()
 		));
 
@@ -266,7 +271,11 @@ std::cout << session->raw() << std::endl;
 		// Starts storing the basic values of the email inside of the current session
 		session->setMessageID(email.e_MessageID);
 		session->setSubject(email.e_Subject);
-		session->setFrom(email.e_From[0]);
+
+		// Without reject_invalid_from an message may have no From header at
+		//  all, the envelope sender is used for it then
+		if (!email.e_From.empty()) session->setFrom(email.e_From[0]);
+		else session->setFrom(session->getTransportFrom());
 
 		// Finds an useful section of the message body for the snippet
 		//  we want it to be text/plain
@@ -289,6 +298,20 @@ std::cout << session->raw() << std::endl;
 		//  message as sent, if so remove the Sent target from the storage tasks
 		if (session->xfannst().getNoStore()) session->removeSentTasks();
 
+		// ========================================
+		// Writes the message to the spool
+		// ========================================
+
+		// Stores the message on disk before we tell the client it is queued, if
+		//  this fails we let the client try again later, since we could lose it
+		try {
+			Workers::Spool::append(session);
+		} catch (const runtime_error &e) {
+			clogger << ERROR << "Could not write message to spool: " << e.what() << ENDL << CLASSIC;
+			client->write(ServerResponse(SMTPResponseType::SRC_LOCAL_ERROR).build());
+			return false;
+		}
+
 		// ========================================
 		// Sends the response
 		// ========================================
@@ -23,6 +23,7 @@
 #include "../../../spf/SPFValidator.src.h"
 #include "../../../dkim/DKIMValidator.src.h"
 #include "../../../dmarc/DMARCRecord.src.h"
+#include "../../../dmarc/DMARCValidator.src.h"
 #include "../../../networking/sockets/ClientSocket.src.h"
 #include "../../../mime/mimev2.src.h"
 #include "../../../builders/mimev2.src.h"
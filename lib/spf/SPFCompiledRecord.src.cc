@@ -0,0 +1,889 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include "SPFCompiledRecord.src.h"
+
+#define _SPF_LOOKUP_LIMIT 10
+#define _SPF_VOID_LOOKUP_LIMIT 2
+#define _SPF_MX_LIMIT 10
+#define _SPF_PTR_LIMIT 10
+#define _SPF_ERROR_TTL 60
+#define _SPF_NO_MATCH 0xFFFFFFFF
+
+namespace FSMTP::SPF {
+  const char *__spfResultToString(SPFResult r) {
+    switch (r) {
+      case SPFResult::SPFResultNone: return "none";
+      case SPFResult::SPFResultNeutral: return "neutral";
+      case SPFResult::SPFResultPass: return "pass";
+      case SPFResult::SPFResultFail: return "fail";
+      case SPFResult::SPFResultSoftFail: return "softfail";
+      case SPFResult::SPFResultTempError: return "temperror";
+      case SPFResult::SPFResultPermError: return "permerror";
+    }
+
+    return "none";
+  }
+
+  struct SPFPendingAddresses {
+    future<vector<DNS::RR>> a;
+    future<vector<DNS::RR>> aaaa;
+  };
+
+  static mutex spfCacheMutex;
+  static TTLCache<shared_ptr<const SPFCompiledRecord>> spfCache(4096);
+  static atomic<size_t> spfCacheHits(0);
+  static atomic<size_t> spfCacheMisses(0);
+
+  static string toLower(string s) {
+    transform(s.begin(), s.end(), s.begin(), [](const char c) { return tolower(c); });
+    return s;
+  }
+
+  // The mechanisms which count towards the DNS lookup limit
+  static bool isLookup(const SPFMechanism mechanism) {
+    switch (mechanism) {
+      case SPFMechanism::MechanismA:
+      case SPFMechanism::MechanismMX:
+      case SPFMechanism::MechanismPTR:
+      case SPFMechanism::MechanismExists:
+      case SPFMechanism::MechanismInclude:
+        return true;
+      default: return false;
+    }
+  }
+
+  /**
+   * Checks if the name is an valid domain, all labels need to be between
+   *  1 and 63 characters, and the whole name may not exceed 253
+   */
+  static bool validDomain(string name) {
+    if (!name.empty() && name.back() == '.') name.pop_back();
+    if (name.empty() || name.size() > 253) return false;
+
+    for (size_t start = 0; start <= name.size();) {
+      size_t end = name.find('.', start);
+      if (end == string::npos) end = name.size();
+      if (end - start == 0 || end - start > 63) return false;
+      start = end + 1;
+    }
+
+    return true;
+  }
+
+  /**
+   * Checks an domain-spec without macros, besides being an valid domain
+   *  it needs to end with an top label which is not numeric ( RFC 7208 7.1 )
+   */
+  static bool validDomainSpec(string spec) {
+    if (!validDomain(spec)) return false;
+    if (spec.back() == '.') spec.pop_back();
+
+    const size_t dot = spec.find_last_of('.');
+    if (dot == string::npos) return false;
+
+    const string top = spec.substr(dot + 1);
+    if (top.front() == '-' || top.back() == '-') return false;
+    if (top.find_first_not_of("abcdefghijklmnopqrstuvwxyz0123456789-") != string::npos) return false;
+    return top.find_first_not_of("0123456789-") != string::npos;
+  }
+
+  static bool prefixMatch(const uint8_t *a, const uint8_t *b, const int32_t bits) {
+    const int32_t bytes = bits / 8, rest = bits % 8;
+
+    if (memcmp(a, b, bytes) != 0) return false;
+    if (rest == 0) return true;
+
+    const uint8_t mask = 0xFF << (8 - rest);
+    return (a[bytes] & mask) == (b[bytes] & mask);
+  }
+
+  /**
+   * Splits the dual CIDR length ( "/24//64" ) off the end of an
+   *  domain-spec, the lengths stay the default if not specified
+   */
+  static void parseDualCIDR(string &spec, int32_t &cidr4, int32_t &cidr6) {
+    size_t pos = spec.find("//");
+    if (pos != string::npos) {
+      cidr6 = stoi(spec.substr(pos + 2));
+      spec.erase(pos);
+    }
+
+    pos = spec.find('/');
+    if (pos != string::npos) {
+      cidr4 = stoi(spec.substr(pos + 1));
+      spec.erase(pos);
+    }
+
+    if (cidr4 < 0 || cidr4 > 32 || cidr6 < 0 || cidr6 > 128)
+      throw invalid_argument("Invalid CIDR length");
+  }
+
+  /**
+   * Parses an ip4 / ip6 mechanism value, with an optional prefix
+   *  length, into an address and the prefix length
+   */
+  static bool parseNetwork(const string &value, const int32_t family, uint8_t *address, int32_t &prefixLength) {
+    size_t pos = value.find('/');
+    prefixLength = family == AF_INET ? 32 : 128;
+
+    if (pos != string::npos) {
+      try {
+        prefixLength = stoi(value.substr(pos + 1));
+      } catch (...) {
+        return false;
+      }
+
+      if (prefixLength < 0 || prefixLength > (family == AF_INET ? 32 : 128)) return false;
+    }
+
+    return inet_pton(family, value.substr(0, pos).c_str(), address) == 1;
+  }
+
+  /**
+   * Starts the A and AAAA lookups of an name, so the lookups of multiple
+   *  names can be in flight at the same time
+   */
+  static SPFPendingAddresses lookupAddresses(const string &name) {
+    return SPFPendingAddresses {
+      DNS::AsyncResolver::resolveA(name),
+      DNS::AsyncResolver::resolveAAAA(name)
+    };
+  }
+
+  /**
+   * Waits for the lookups and inserts the addresses into the tries, returns
+   *  false if one of the lookups failed, found is set if there was any address
+   */
+  static bool insertAddresses(
+    SPFPendingAddresses &pending, const int32_t cidr4, const int32_t cidr6, const uint32_t index,
+    Networking::PrefixTrie &ipv4, Networking::PrefixTrie &ipv6, uint32_t &ttl, bool &found
+  ) {
+    bool ok = true;
+
+    auto insert = [&](future<vector<DNS::RR>> &f, const int32_t family) {
+      try {
+        for (const DNS::RR &rr : f.get()) {
+          uint8_t address[16];
+          if (inet_pton(family, rr.getData().c_str(), address) != 1) continue;
+
+          if (family == AF_INET) ipv4.insert(address, cidr4, index);
+          else ipv6.insert(address, cidr6, index);
+          ttl = min(ttl, static_cast<uint32_t>(rr.getTTL()));
+          found = true;
+        }
+      } catch (const DNS::NoResults &e) {
+      } catch (...) {
+        ok = false;
+      }
+    };
+
+    insert(pending.a, AF_INET);
+    insert(pending.aaaa, AF_INET6);
+    return ok;
+  }
+
+  /**
+   * Maps the result of an included record to the result of the include
+   *  mechanism ( RFC 7208 section 5.2 ), none means it did not match
+   */
+  static SPFResult includeResult(const SPFResult result, const SPFResult qualifier) {
+    switch (result) {
+      case SPFResult::SPFResultPass: return qualifier;
+      case SPFResult::SPFResultTempError: return SPFResult::SPFResultTempError;
+      case SPFResult::SPFResultPermError:
+      case SPFResult::SPFResultNone: return SPFResult::SPFResultPermError;
+      default: return SPFResult::SPFResultNone;
+    }
+  }
+
+  SPFCompiledRecord::SPFCompiledRecord():
+    c_Valid(true), c_Error(SPFResult::SPFResultNone), c_TTL(_SPF_ERROR_TTL),
+    c_Budget(_SPF_LOOKUP_LIMIT), c_Lookups(0)
+  {}
+
+  SPFResult SPFCompiledRecord::evaluate(const string &address, const string &sender, const string &helo) const {
+    struct in_addr ipv4;
+    struct in6_addr ipv6;
+
+    if (inet_pton(AF_INET, address.c_str(), &ipv4) == 1) return this->evaluate(ipv4, sender, helo);
+    if (inet_pton(AF_INET6, address.c_str(), &ipv6) == 1) return this->evaluate(ipv6, sender, helo);
+
+    throw invalid_argument(EXCEPT_DEBUG("Invalid address: '" + address + '\''));
+  }
+
+  SPFResult SPFCompiledRecord::evaluate(const struct in_addr &address, const string &sender, const string &helo) const {
+    SPFContext context = { reinterpret_cast<const uint8_t *>(&address), AF_INET, sender, helo, 0, 0 };
+    return this->evaluate(context);
+  }
+
+  SPFResult SPFCompiledRecord::evaluate(const struct in6_addr &address, const string &sender, const string &helo) const {
+    SPFContext context = { reinterpret_cast<const uint8_t *>(&address), AF_INET6, sender, helo, 0, 0 };
+    return this->evaluate(context);
+  }
+
+  SPFResult SPFCompiledRecord::evaluate(SPFContext &context) const {
+    if (!this->c_Valid) return this->c_Error;
+
+    // Gets the first address based mechanism which matches, the terms before
+    //  it still need to be checked, since they might match first
+    uint32_t first = _SPF_NO_MATCH;
+    if (context.family == AF_INET) this->c_IPv4.match(context.address, 32, first);
+    else this->c_IPv6.match(context.address, 128, first);
+
+    for (uint32_t i = 0; i < this->c_Terms.size() && i <= first; ++i) {
+      const SPFTerm &term = this->c_Terms[i];
+
+      if (isLookup(term.mechanism) && ++context.lookups > _SPF_LOOKUP_LIMIT)
+        return SPFResult::SPFResultPermError;
+      if (term.error != SPFResult::SPFResultNone) return term.error;
+      if (term.voidLookup && ++context.voidLookups > _SPF_VOID_LOOKUP_LIMIT)
+        return SPFResult::SPFResultPermError;
+
+      if (term.deferred) {
+        SPFResult result = this->evaluateDeferred(term, context);
+        if (result != SPFResult::SPFResultNone) return result;
+        continue;
+      }
+
+      switch (term.mechanism) {
+        case SPFMechanism::MechanismAll: return term.qualifier;
+        case SPFMechanism::MechanismExists:
+          if (term.matches) return term.qualifier;
+          break;
+        case SPFMechanism::MechanismPTR:
+          if (this->matchPTR(context, term.domain)) return term.qualifier;
+          break;
+        case SPFMechanism::MechanismInclude: {
+          SPFResult result = includeResult(term.include->evaluate(context), term.qualifier);
+          if (result != SPFResult::SPFResultNone) return result;
+          break;
+        }
+        default:
+          if (i == first) return term.qualifier;
+          break;
+      }
+    }
+
+    // ================================
+    // Follows the redirect
+    // ================================
+
+    if (!this->c_RedirectDomain.empty()) {
+      if (++context.lookups > _SPF_LOOKUP_LIMIT) return SPFResult::SPFResultPermError;
+
+      shared_ptr<const SPFCompiledRecord> redirect = this->c_Redirect;
+      if (!redirect) {
+        try {
+          const string target = SPFCompiledRecord::expand(this->c_RedirectDomain, context, this->c_Domain);
+          if (!validDomain(target)) return SPFResult::SPFResultPermError;
+          redirect = SPFCompiledRecord::get(target, _SPF_LOOKUP_LIMIT - context.lookups);
+        } catch (const invalid_argument &e) {
+          return SPFResult::SPFResultPermError;
+        }
+      }
+
+      SPFResult result = redirect->evaluate(context);
+      return result == SPFResult::SPFResultNone ? SPFResult::SPFResultPermError : result;
+    }
+
+    return SPFResult::SPFResultNeutral;
+  }
+
+  SPFResult SPFCompiledRecord::evaluateDeferred(const SPFTerm &term, SPFContext &context) const {
+    const int32_t type = context.family == AF_INET ? ns_t_a : ns_t_aaaa;
+    const int32_t cidr = context.family == AF_INET ? term.cidr4 : term.cidr6;
+    string domain;
+
+    try {
+      domain = SPFCompiledRecord::expand(term.domain, context, this->c_Domain);
+    } catch (const invalid_argument &e) {
+      return SPFResult::SPFResultPermError;
+    }
+
+    if (!validDomain(domain)) return SPFResult::SPFResultPermError;
+
+    // Empty answers count as void lookups, once there are too many
+    //  of those the record is broken
+    auto voidLookup = [&]() {
+      return ++context.voidLookups > _SPF_VOID_LOOKUP_LIMIT
+        ? SPFResult::SPFResultPermError : SPFResult::SPFResultNone;
+    };
+
+    auto matchAddresses = [&](const vector<DNS::RR> &records) {
+      for (const DNS::RR &rr : records) {
+        uint8_t address[16];
+        if (inet_pton(context.family, rr.getData().c_str(), address) != 1) continue;
+        if (prefixMatch(address, context.address, cidr)) return true;
+      }
+
+      return false;
+    };
+
+    try {
+      switch (term.mechanism) {
+        case SPFMechanism::MechanismA:
+          return matchAddresses(DNS::AsyncResolver::query(domain, type).get())
+            ? term.qualifier : SPFResult::SPFResultNone;
+        case SPFMechanism::MechanismExists:
+          return !DNS::AsyncResolver::resolveA(domain).get().empty()
+            ? term.qualifier : SPFResult::SPFResultNone;
+        case SPFMechanism::MechanismPTR:
+          return this->matchPTR(context, domain) ? term.qualifier : SPFResult::SPFResultNone;
+        case SPFMechanism::MechanismInclude:
+          return includeResult(SPFCompiledRecord::get(domain, _SPF_LOOKUP_LIMIT - context.lookups)
+            ->evaluate(context), term.qualifier);
+        case SPFMechanism::MechanismMX: {
+          vector<DNS::RR> exchangers = DNS::AsyncResolver::resolveMX(domain).get();
+          if (exchangers.size() > _SPF_MX_LIMIT) return SPFResult::SPFResultPermError;
+
+          for (const DNS::RR &rr : exchangers)
+            if (!validDomain(rr.getData())) return SPFResult::SPFResultPermError;
+
+          vector<future<vector<DNS::RR>>> pending;
+          for (const DNS::RR &rr : exchangers)
+            pending.push_back(DNS::AsyncResolver::query(rr.getData(), type));
+
+          for (future<vector<DNS::RR>> &f : pending) {
+            try {
+              if (matchAddresses(f.get())) return term.qualifier;
+            } catch (const DNS::NoResults &e) {}
+          }
+
+          return SPFResult::SPFResultNone;
+        }
+        default: return SPFResult::SPFResultNone;
+      }
+    } catch (const DNS::NoResults &e) {
+      return voidLookup();
+    } catch (...) {
+      return SPFResult::SPFResultTempError;
+    }
+  }
+
+  bool SPFCompiledRecord::matchPTR(SPFContext &context, const string &domain) const {
+    char text[INET6_ADDRSTRLEN];
+    if (!inet_ntop(context.family, context.address, text, sizeof (text))) return false;
+
+    vector<DNS::RR> names;
+    try {
+      names = DNS::AsyncResolver::resolvePTR(text).get();
+    } catch (const DNS::NoResults &e) {
+      ++context.voidLookups;
+      return false;
+    } catch (...) {
+      return false;
+    }
+
+    // Only names within the domain count, and only if they resolve
+    //  back to the address ( RFC 7208 section 5.5 )
+    for (size_t i = 0; i < names.size() && i < _SPF_PTR_LIMIT; ++i) {
+      string name = toLower(names[i].getData());
+      if (name != domain && (name.length() <= domain.length() ||
+        name.compare(name.length() - domain.length() - 1, string::npos, '.' + domain) != 0))
+        continue;
+
+      try {
+        future<vector<DNS::RR>> f = context.family == AF_INET
+          ? DNS::AsyncResolver::resolveA(name) : DNS::AsyncResolver::resolveAAAA(name);
+
+        for (const DNS::RR &rr : f.get()) {
+          uint8_t resolved[16];
+          if (inet_pton(context.family, rr.getData().c_str(), resolved) != 1) continue;
+          if (memcmp(resolved, context.address, context.family == AF_INET ? 4 : 16) == 0) return true;
+        }
+      } catch (...) {}
+    }
+
+    return false;
+  }
+
+  string SPFCompiledRecord::expand(const string &spec, const SPFContext &context, const string &domain) {
+    string res;
+
+    // Splits the sender into the local part and domain, an empty
+    //  sender means the bounce address postmaster@helo
+    string sender = context.sender.empty() ? "postmaster@" + context.helo : context.sender;
+    size_t at = sender.find_last_of('@');
+    if (at == string::npos) sender = "postmaster@" + sender, at = 10;
+    else if (at == 0) sender = "postmaster" + sender, at = 10;
+
+    for (size_t i = 0; i < spec.size(); ++i) {
+      if (spec[i] != '%') {
+        res += spec[i];
+        continue;
+      }
+
+      if (++i >= spec.size()) throw invalid_argument("Incomplete macro");
+      switch (spec[i]) {
+        case '%': res += '%'; continue;
+        case '_': res += ' '; continue;
+        case '-': res += "%20"; continue;
+        case '{': break;
+        default: throw invalid_argument("Invalid macro");
+      }
+
+      const size_t end = spec.find('}', i);
+      if (end == string::npos || end == i + 1) throw invalid_argument("Invalid macro");
+
+      const string macro = spec.substr(i + 1, end - i - 1);
+      i = end;
+
+      // ================================
+      // Gets the value of the letter
+      // ================================
+
+      string value;
+      switch (tolower(macro[0])) {
+        case 's': value = sender; break;
+        case 'l': value = sender.substr(0, at); break;
+        case 'o': value = sender.substr(at + 1); break;
+        case 'd': value = domain; break;
+        case 'h': value = context.helo; break;
+        case 'p': value = "unknown"; break;
+        case 'v': value = context.family == AF_INET ? "in-addr" : "ip6"; break;
+        case 'i': {
+          if (context.family == AF_INET) {
+            char text[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, context.address, text, sizeof (text));
+            value = text;
+          } else {
+            static const char *hex = "0123456789abcdef";
+            for (size_t j = 0; j < 16; ++j) {
+              value += hex[context.address[j] >> 4];
+              value += '.';
+              value += hex[context.address[j] & 0x0F];
+              value += '.';
+            }
+            value.pop_back();
+          }
+          break;
+        }
+        default: throw invalid_argument("Invalid macro letter");
+      }
+
+      // ================================
+      // Applies the transformers
+      // ================================
+
+      size_t j = 1, keep = 0;
+      while (j < macro.size() && isdigit(macro[j])) {
+        keep = min<size_t>(keep * 10 + (macro[j++] - '0'), 128);
+        if (keep == 0) throw invalid_argument("Invalid macro transformer");
+      }
+
+      bool reverse = false;
+      if (j < macro.size() && tolower(macro[j]) == 'r') {
+        reverse = true;
+        ++j;
+      }
+
+      string delimiters = macro.substr(j);
+      if (delimiters.find_first_not_of(".-+,/_=") != string::npos)
+        throw invalid_argument("Invalid macro delimiter");
+      if (delimiters.empty()) delimiters = ".";
+
+      vector<string> parts;
+      for (size_t start = 0;;) {
+        size_t pos = value.find_first_of(delimiters, start);
+        parts.push_back(value.substr(start, pos - start));
+        if (pos == string::npos) break;
+        start = pos + 1;
+      }
+
+      if (reverse) std::reverse(parts.begin(), parts.end());
+      if (keep > 0 && keep < parts.size()) parts.erase(parts.begin(), parts.end() - keep);
+
+      value.clear();
+      for (const string &part : parts) value += part + '.';
+      value.pop_back();
+
+      // Uppercase letters mean the value is URL escaped
+      if (isupper(macro[0])) {
+        string escaped;
+        for (const char c : value) {
+          if (isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~') escaped += c;
+          else {
+            char buffer[4];
+            snprintf(buffer, sizeof (buffer), "%%%02X", static_cast<uint8_t>(c));
+            escaped += buffer;
+          }
+        }
+        value = escaped;
+      }
+
+      res += value;
+    }
+
+    // Names which are too long are shortened from the left ( RFC 7208 7.3 )
+    while (res.size() > 253) {
+      size_t dot = res.find('.');
+      if (dot == string::npos) break;
+      res.erase(0, dot + 1);
+    }
+
+    return res;
+  }
+
+  const string &SPFCompiledRecord::getDomain() const { return this->c_Domain; }
+  const vector<SPFTerm> &SPFCompiledRecord::getTerms() const { return this->c_Terms; }
+  uint32_t SPFCompiledRecord::getTTL() const { return this->c_TTL; }
+  size_t SPFCompiledRecord::getLookups() const { return this->c_Lookups; }
+
+  shared_ptr<const SPFCompiledRecord> SPFCompiledRecord::get(const string &domain) {
+    return SPFCompiledRecord::get(domain, _SPF_LOOKUP_LIMIT);
+  }
+
+  shared_ptr<const SPFCompiledRecord> SPFCompiledRecord::get(const string &domain, const size_t budget) {
+    string key = toLower(domain);
+    if (!key.empty() && key.back() == '.') key.pop_back();
+
+    // Records compiled with an smaller budget have more deferred terms, those
+    //  still evaluate correctly, but are compiled again for an larger budget
+    {
+      lock_guard<mutex> lock(spfCacheMutex);
+      const shared_ptr<const SPFCompiledRecord> *cached = spfCache.get(key);
+      if (cached && (*cached)->c_Budget >= budget) {
+        ++spfCacheHits;
+        return *cached;
+      }
+    }
+
+    ++spfCacheMisses;
+    shared_ptr<const SPFCompiledRecord> record = SPFCompiledRecord::compile(key, budget);
+
+    // Temporary errors are not cached, the next message should
+    //  try again
+    if (!record->c_Valid && record->c_Error == SPFResult::SPFResultTempError)
+      return record;
+
+    lock_guard<mutex> lock(spfCacheMutex);
+    spfCache.put(key, record, record->c_TTL);
+    return record;
+  }
+
+  shared_ptr<const SPFCompiledRecord> SPFCompiledRecord::compile(const string &domain, const size_t budget) {
+    auto record = make_shared<SPFCompiledRecord>();
+    record->c_Domain = domain;
+    record->c_Budget = budget;
+
+    auto fail = [&](const SPFResult result) {
+      record->c_Valid = false;
+      record->c_Error = result;
+      record->c_TTL = _SPF_ERROR_TTL;
+      return record;
+    };
+
+    // An malformed domain has no record at all ( RFC 7208 4.3 )
+    if (!validDomain(domain)) return fail(SPFResult::SPFResultNone);
+
+    // ================================
+    // Gets the SPF record
+    // ================================
+
+    vector<DNS::RR> records;
+    try {
+      records = DNS::AsyncResolver::resolveTXT(domain).get();
+    } catch (const DNS::NoResults &e) {
+      return fail(SPFResult::SPFResultNone);
+    } catch (...) {
+      return fail(SPFResult::SPFResultTempError);
+    }
+
+    string raw;
+    size_t found = 0;
+    uint32_t ttl = numeric_limits<uint32_t>::max();
+
+    for (const DNS::RR &rr : records) {
+      const string &data = rr.getData();
+      if (data.length() < 6 || toLower(data.substr(0, 6)) != "v=spf1") continue;
+      if (data.length() > 6 && data[6] != ' ') continue;
+
+      raw = data;
+      ttl = min(ttl, static_cast<uint32_t>(rr.getTTL()));
+      ++found;
+    }
+
+    if (found == 0) return fail(SPFResult::SPFResultNone);
+    else if (found > 1) return fail(SPFResult::SPFResultPermError);
+
+    // ================================
+    // Parses the terms
+    // ================================
+
+    // The context used to check the syntax of macros, the values
+    //  do not matter, only whether it expands
+    const uint8_t dummyAddress[16] = { 0 };
+    const SPFContext dummy = { dummyAddress, AF_INET, "", "", 0, 0 };
+
+    stringstream stream(raw.substr(6));
+    string token, redirect;
+    bool hasAll = false;
+
+    while (stream >> token) {
+      string lower = toLower(token);
+
+      // Modifiers have the form name=value, of which we only use the
+      //  redirect, unknown modifiers must be ignored
+      size_t eq = lower.find('='), colon = lower.find_first_of(":/");
+      if (eq != string::npos && (colon == string::npos || eq < colon)) {
+        if (lower.substr(0, eq) != "redirect") continue;
+        if (!redirect.empty() || eq + 1 == lower.size()) return fail(SPFResult::SPFResultPermError);
+
+        redirect = lower.substr(eq + 1);
+        continue;
+      }
+
+      SPFTerm term = {
+        SPFResult::SPFResultPass, SPFMechanism::MechanismAll, "", 32, 128,
+        false, false, false, SPFResult::SPFResultNone, nullptr
+      };
+
+      switch (lower[0]) {
+        case '+': lower.erase(0, 1); break;
+        case '-': term.qualifier = SPFResult::SPFResultFail; lower.erase(0, 1); break;
+        case '~': term.qualifier = SPFResult::SPFResultSoftFail; lower.erase(0, 1); break;
+        case '?': term.qualifier = SPFResult::SPFResultNeutral; lower.erase(0, 1); break;
+      }
+
+      size_t sep = lower.find_first_of(":/");
+      string name = lower.substr(0, sep);
+      string value = sep == string::npos ? "" : lower.substr(sep + (lower[sep] == ':' ? 1 : 0));
+      const uint32_t index = record->c_Terms.size();
+      bool spec = !value.empty() && value[0] != '/';
+
+      try {
+        if (name == "all") {
+          if (!value.empty()) return fail(SPFResult::SPFResultPermError);
+          hasAll = true;
+        } else if (name == "ip4" || name == "ip6") {
+          const int32_t family = name == "ip4" ? AF_INET : AF_INET6;
+          uint8_t address[16];
+          int32_t prefixLength;
+
+          if (!parseNetwork(value, family, address, prefixLength))
+            return fail(SPFResult::SPFResultPermError);
+
+          term.mechanism = family == AF_INET ? SPFMechanism::MechanismIP4 : SPFMechanism::MechanismIP6;
+          term.domain = value;
+          spec = false;
+          (family == AF_INET ? record->c_IPv4 : record->c_IPv6).insert(address, prefixLength, index);
+        } else if (name == "a" || name == "mx") {
+          if (value.empty() || value[0] == '/') value = domain + value;
+          parseDualCIDR(value, term.cidr4, term.cidr6);
+
+          term.mechanism = name == "a" ? SPFMechanism::MechanismA : SPFMechanism::MechanismMX;
+          term.domain = value;
+        } else if (name == "ptr") {
+          term.mechanism = SPFMechanism::MechanismPTR;
+          term.domain = value.empty() ? domain : value;
+        } else if (name == "include" || name == "exists") {
+          if (value.empty()) return fail(SPFResult::SPFResultPermError);
+
+          term.mechanism = name == "include" ? SPFMechanism::MechanismInclude : SPFMechanism::MechanismExists;
+          term.domain = value;
+        } else {
+          return fail(SPFResult::SPFResultPermError);
+        }
+
+        // Domains with macros depend on the sender, so these are
+        //  expanded, checked and resolved when evaluated, the others
+        //  are checked right away, before any lookup is done
+        if (term.domain.find('%') != string::npos) {
+          SPFCompiledRecord::expand(term.domain, dummy, domain);
+          term.deferred = true;
+        } else if (spec && !validDomainSpec(term.domain)) {
+          return fail(SPFResult::SPFResultPermError);
+        }
+      } catch (const invalid_argument &e) {
+        return fail(SPFResult::SPFResultPermError);
+      } catch (const out_of_range &e) {
+        return fail(SPFResult::SPFResultPermError);
+      }
+
+      record->c_Terms.push_back(move(term));
+    }
+
+    if (hasAll) redirect.clear();
+    if (redirect.find('%') != string::npos) {
+      try {
+        SPFCompiledRecord::expand(redirect, dummy, domain);
+      } catch (const invalid_argument &e) {
+        return fail(SPFResult::SPFResultPermError);
+      }
+    } else if (!redirect.empty() && !validDomainSpec(redirect)) {
+      return fail(SPFResult::SPFResultPermError);
+    }
+
+    // ================================
+    // Starts the lookups
+    // ================================
+
+    // The lookups of the terms do not depend on each other, so all of them are
+    //  started at once, for includes and the redirect this fetches their record
+    //  into the DNS cache, so compiling them later does not wait on the network
+    vector<SPFTerm> &terms = record->c_Terms;
+    vector<SPFPendingAddresses> addresses(terms.size());
+    vector<future<vector<DNS::RR>>> lookups(terms.size());
+    size_t started = 0;
+
+    for (size_t i = 0; i < terms.size(); ++i) {
+      if (!isLookup(terms[i].mechanism)) continue;
+      if (++started > budget) break;
+      if (terms[i].deferred) continue;
+
+      switch (terms[i].mechanism) {
+        case SPFMechanism::MechanismA: addresses[i] = lookupAddresses(terms[i].domain); break;
+        case SPFMechanism::MechanismMX: lookups[i] = DNS::AsyncResolver::resolveMX(terms[i].domain); break;
+        case SPFMechanism::MechanismExists: lookups[i] = DNS::AsyncResolver::resolveA(terms[i].domain); break;
+        case SPFMechanism::MechanismInclude: lookups[i] = DNS::AsyncResolver::resolveTXT(terms[i].domain); break;
+        default: break;
+      }
+    }
+
+    if (!redirect.empty() && redirect.find('%') == string::npos && started < budget)
+      DNS::AsyncResolver::resolveTXT(redirect);
+
+    // ================================
+    // Compiles the terms
+    // ================================
+
+    // Counts the lookups in the order they would be evaluated, the terms
+    //  past the budget are deferred, since an evaluation which does not
+    //  enter all includes might still reach them within the limit
+    size_t used = 0;
+
+    for (size_t i = 0; i < terms.size(); ++i) {
+      SPFTerm &term = terms[i];
+      if (!isLookup(term.mechanism)) continue;
+
+      if (used >= budget) {
+        term.deferred = true;
+        continue;
+      }
+
+      ++used;
+      if (term.deferred) continue;
+
+      switch (term.mechanism) {
+        case SPFMechanism::MechanismA: {
+          bool found = false;
+          if (!insertAddresses(addresses[i], term.cidr4, term.cidr6, i, record->c_IPv4, record->c_IPv6, ttl, found))
+            term.error = SPFResult::SPFResultTempError;
+          else if (!found) term.voidLookup = true;
+          break;
+        }
+        case SPFMechanism::MechanismMX: {
+          vector<DNS::RR> exchangers;
+          try {
+            exchangers = lookups[i].get();
+          } catch (const DNS::NoResults &e) {
+            term.voidLookup = true;
+          } catch (...) {
+            term.error = SPFResult::SPFResultTempError;
+          }
+
+          if (exchangers.size() > _SPF_MX_LIMIT) {
+            term.error = SPFResult::SPFResultPermError;
+            break;
+          }
+
+          // An exchanger which is not an valid domain breaks the record,
+          //  this is checked before any of their lookups is started
+          bool valid = true;
+          for (const DNS::RR &rr : exchangers) valid = valid && validDomain(rr.getData());
+
+          if (!valid) {
+            term.error = SPFResult::SPFResultPermError;
+            break;
+          }
+
+          // Starts the lookups of all the exchangers before waiting on
+          //  any of them
+          vector<SPFPendingAddresses> pending;
+          for (const DNS::RR &rr : exchangers) {
+            ttl = min(ttl, static_cast<uint32_t>(rr.getTTL()));
+            pending.push_back(lookupAddresses(rr.getData()));
+          }
+
+          for (SPFPendingAddresses &p : pending) {
+            bool found = false;
+            if (!insertAddresses(p, term.cidr4, term.cidr6, i, record->c_IPv4, record->c_IPv6, ttl, found))
+              term.error = SPFResult::SPFResultTempError;
+          }
+          break;
+        }
+        case SPFMechanism::MechanismExists: {
+          try {
+            vector<DNS::RR> res = lookups[i].get();
+            term.matches = !res.empty();
+            for (const DNS::RR &rr : res) ttl = min(ttl, static_cast<uint32_t>(rr.getTTL()));
+          } catch (const DNS::NoResults &e) {
+            term.voidLookup = true;
+          } catch (...) {
+            term.error = SPFResult::SPFResultTempError;
+          }
+          break;
+        }
+        case SPFMechanism::MechanismInclude: {
+          term.include = SPFCompiledRecord::get(term.domain, budget - used);
+          used += term.include->c_Lookups;
+          ttl = min(ttl, term.include->c_TTL);
+          break;
+        }
+        default: break;
+      }
+    }
+
+    // ================================
+    // Compiles the redirect
+    // ================================
+
+    record->c_RedirectDomain = redirect;
+    if (!redirect.empty() && redirect.find('%') == string::npos && used < budget) {
+      ++used;
+      record->c_Redirect = SPFCompiledRecord::get(redirect, budget - used);
+      used += record->c_Redirect->c_Lookups;
+      ttl = min(ttl, record->c_Redirect->c_TTL);
+    }
+
+    record->c_Lookups = used;
+    record->c_TTL = max<uint32_t>(ttl, 1);
+    return record;
+  }
+
+  void SPFCompiledRecord::configure(const size_t maxEntries) {
+    // Without spf.cache_entries in the config the value is zero, which keeps the default
+    if (maxEntries == 0) return;
+
+    lock_guard<mutex> lock(spfCacheMutex);
+    spfCache.setMaxEntries(maxEntries);
+  }
+
+  void SPFCompiledRecord::clear() {
+    lock_guard<mutex> lock(spfCacheMutex);
+    spfCache.clear();
+  }
+
+  SPFCompiledRecordStats SPFCompiledRecord::getStats() {
+    lock_guard<mutex> lock(spfCacheMutex);
+    return SPFCompiledRecordStats {
+      spfCacheHits, spfCacheMisses, spfCache.size()
+    };
+  }
+
+  SPFCompiledRecord::~SPFCompiledRecord() = default;
+}
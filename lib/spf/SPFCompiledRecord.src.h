@@ -0,0 +1,123 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#ifndef _LIB_SPF_COMPILED_RECORD_H
+#define _LIB_SPF_COMPILED_RECORD_H
+
+#include "../default.h"
+#include "../dns/AsyncResolver.src.h"
+#include "../networking/PrefixTrie.src.h"
+#include "../general/TTLCache.src.h"
+
+namespace FSMTP::SPF {
+  enum SPFResult {
+    SPFResultNone, SPFResultNeutral, SPFResultPass, SPFResultFail,
+    SPFResultSoftFail, SPFResultTempError, SPFResultPermError
+  };
+
+  const char *__spfResultToString(SPFResult r);
+
+  enum SPFMechanism {
+    MechanismAll, MechanismInclude, MechanismA, MechanismMX,
+    MechanismPTR, MechanismIP4, MechanismIP6, MechanismExists
+  };
+
+  class SPFCompiledRecord;
+
+  /**
+   * An single mechanism, deferred terms ( with macros, or past the lookup
+   *  limit while compiling ) are resolved when they are evaluated
+   */
+  struct SPFTerm {
+    SPFResult qualifier;
+    SPFMechanism mechanism;
+    string domain;
+    int32_t cidr4, cidr6;
+    bool deferred;
+    bool matches;
+    bool voidLookup;
+    SPFResult error;
+    shared_ptr<const SPFCompiledRecord> include;
+  };
+
+  /**
+   * The state of an single check, the sender and HELO name are used for
+   *  macro expansion, the counters enforce the limits of RFC 7208 4.6.4
+   */
+  struct SPFContext {
+    const uint8_t *address;
+    int32_t family;
+    string sender;
+    string helo;
+    size_t lookups;
+    size_t voidLookups;
+  };
+
+  struct SPFCompiledRecordStats {
+    size_t hits;
+    size_t misses;
+    size_t entries;
+  };
+
+  /**
+   * An SPF record with its include and redirect chain resolved, the ip4, ip6,
+   *  a and mx mechanisms are stored in prefix tries, so the record can be
+   *  evaluated for an address without any DNS lookups ( except for ptr and
+   *  terms with macros ). The compiled records are cached for the shortest
+   *  TTL of the chain
+   */
+  class SPFCompiledRecord {
+  public:
+    SPFCompiledRecord();
+
+    SPFResult evaluate(const string &address, const string &sender = "", const string &helo = "") const;
+    SPFResult evaluate(const struct in_addr &address, const string &sender = "", const string &helo = "") const;
+    SPFResult evaluate(const struct in6_addr &address, const string &sender = "", const string &helo = "") const;
+    SPFResult evaluate(SPFContext &context) const;
+
+    const string &getDomain() const;
+    const vector<SPFTerm> &getTerms() const;
+    uint32_t getTTL() const;
+    size_t getLookups() const;
+
+    static shared_ptr<const SPFCompiledRecord> get(const string &domain);
+    static shared_ptr<const SPFCompiledRecord> get(const string &domain, const size_t budget);
+    static shared_ptr<const SPFCompiledRecord> compile(const string &domain, const size_t budget);
+
+    static string expand(const string &spec, const SPFContext &context, const string &domain);
+
+    static void configure(const size_t maxEntries);
+    static void clear();
+    static SPFCompiledRecordStats getStats();
+
+    ~SPFCompiledRecord();
+  private:
+    SPFResult evaluateDeferred(const SPFTerm &term, SPFContext &context) const;
+    bool matchPTR(SPFContext &context, const string &domain) const;
+
+    string c_Domain;
+    vector<SPFTerm> c_Terms;
+    Networking::PrefixTrie c_IPv4, c_IPv6;
+    string c_RedirectDomain;
+    shared_ptr<const SPFCompiledRecord> c_Redirect;
+    bool c_Valid;
+    SPFResult c_Error;
+    uint32_t c_TTL;
+    size_t c_Budget, c_Lookups;
+  };
+}
+
+#endif
@@ -19,6 +19,7 @@
 
 #include "../default.h"
 #include "SPFRecord.src.h"
+#include "SPFCompiledRecord.src.h"
 #include "../general/Logger.src.h"
 #include "../networking/IP.src.h"
 #include "../networking/IPv4.src.h"
@@ -41,23 +42,20 @@ namespace FSMTP::SPF {
 
     bool validate(const string &query, const string &cmp);
     bool safeValidate(const string &query, string cmp);
-    
-    bool validateIPv6(const string &query, const struct in6_addr &addr, const vector<string> &compareAddresses);
-    bool validateIPv4(const string &query, const struct in_addr &addr, const vector<string> &compareAddresses);
-    bool validateMX(DNS::Resolver &resolver, const void *cmp, const string &domain);
-    bool validateA(DNS::Resolver &resolver, const void *cmp, const string &query);
-    bool validatePTR(const void *cmp, const vector<string> &names);
-    bool compare(const void *addr, const string &cmp);
 
     const SPFValidatorResult &getResult();
+    SPFResult getSPFResult();
     string getResultString();
 
     SPFValidator &setProtocol(Networking::IP::Protocol p);
+    SPFValidator &setSender(const string &sender, const string &helo);
 
     ~SPFValidator();
   private:
     Networking::IP::Protocol m_Protocol;
     SPFValidatorResult m_Result;
+    SPFResult m_SPFResult;
+    string m_Sender, m_Helo;
     Logger m_Logger;
   };
 }
@@ -17,13 +17,13 @@
 
 #include "DatabaseWorker.src.h"
 
-mutex databaseMutex;
-deque<shared_ptr<SMTPServerSession>> databaseQueue;
+// The session with the number of failed attempts before
+static FSMTP::Workers::WorkQueue<pair<shared_ptr<SMTPServerSession>, uint32_t>> databaseQueue;
 
 namespace FSMTP::Workers
 {
-	DatabaseWorker::DatabaseWorker(void):
-		Worker("FSMTP-V2/STORAGE", 900)
+	DatabaseWorker::DatabaseWorker(const size_t id):
+		Worker("FSMTP-V2/STORAGE#" + to_string(id), 900)
 	{}
 
 	void DatabaseWorker::startupTask(void) {
@@ -37,9 +37,15 @@ namespace FSMTP::Workers
 	}
 
 	void DatabaseWorker::push(shared_ptr<SMTPServerSession> session) {
-		databaseMutex.lock();
-		databaseQueue.push_back(session);
-		databaseMutex.unlock();
+		databaseQueue.push(make_pair(session, 0));
+	}
+
+	size_t DatabaseWorker::getQueueDepth(void) {
+		return databaseQueue.size();
+	}
+
+	milliseconds DatabaseWorker::getQueueAge(void) {
+		return databaseQueue.oldestAge();
 	}
 
 	void DatabaseWorker::action(void *u) {
@@ -47,97 +53,111 @@ namespace FSMTP::Workers
 		auto *redis = this->d_Redis.get();
 		auto &logger = this->w_Logger;
 
-		for (;;) {
-			// ============================
-			// Gets the front of the queue
-			// ============================
+		// ============================
+		// Gets the front of the queue
+		// ============================
 
-			databaseMutex.lock(); // Locks the database mutex
+		// Waits for the next session to be pushed, if nothing arrived within
+		//  the interval we return, so the worker can check if it should stop
+		pair<shared_ptr<SMTPServerSession>, uint32_t> item;
+		milliseconds age;
+		if (!databaseQueue.pop(item, age, milliseconds(this->w_Interval))) {
+			return;
+		}
 
-			// Checks if there are any emails we have to process
-			//  else just exit the worker action
-			if (databaseQueue.size() <= 0) {
-				databaseMutex.unlock();
-				break;
+		shared_ptr<SMTPServerSession> session = item.first;
+		const uint32_t attempts = item.second;
+
+		DEBUG_ONLY(logger << DEBUG << "Got session from queue after " << age.count() << "ms" << ENDL << CLASSIC);
+
+		// ============================
+		// Stores the messages
+		// ============================
+
+		// Loops over the storage tasks, while we will
+		//  start storing the raw messages with the
+		//  shortcuts to them
+		auto storageTasks = session->getStorageTasks();
+		DEBUG_ONLY(logger << DEBUG << "Performing " << storageTasks.size() << " storage tasks .." << ENDL << CLASSIC);
+
+		// The body is stored only once for all the recipients, keyed by its
+		//  hash, each raw email row only references it
+		const string blobHash = RawBlob::hash(session->raw());
+		const size_t compressThreshold = Global::getConfig()["storage"]["compress_threshold"].asUInt64();
+		size_t chunkSize = Global::getConfig()["storage"]["chunk_size"].asUInt64();
+
+		// Older configs do not have the chunk size, a zero size would never
+		//  advance over the body, so we fall back to the default
+		if (chunkSize == 0) chunkSize = _RAW_BLOB_CHUNK_SIZE_DEFAULT;
+		bool blobStored = false;
+
+		// Keeps track of the tasks which were stored, the message is only marked
+		//  done in the spool once all of them are, so the others are stored
+		//  again when the spool is replayed
+		vector<uint32_t> storedTasks;
+		size_t failedTasks = 0;
+		uint32_t taskIndex = 0;
+
+		for_each(storageTasks.begin(), storageTasks.end(), [&](const SMTPServerStorageTask &task) {
+			const uint32_t index = taskIndex++;
+			if (Spool::isStored(session, index)) return;
+
+			CassUuid messageUUID;
+			int64_t messageBucket;
+			int32_t messageUID;
+			string messageMailbox;
+
+			// Checks the current storage target type, and to which mailbox name
+			//  it refers, after which we will set the mailbox string
+			switch (task.target) {
+				case SMTPServerStorageTarget::StorageTargetIncomming:
+					messageMailbox = "INBOX"; break;
+				case SMTPServerStorageTarget::StorageTargetSent:
+					messageMailbox = "INBOX.Sent"; break;
+				case SMTPServerStorageTarget::StorageTargetSpam:
+					messageMailbox = "INBOX.Spam"; break;
+				default:
+					messageMailbox = "INBOX"; break;
 			}
 
-			// Gets the last task from the queue, and pops it from it
-			//  so we will not have to process it again
-			shared_ptr<SMTPServerSession> session = databaseQueue.back();
-			databaseQueue.pop_back();
-
-			databaseMutex.unlock(); // Unlocks the database mutex
-
-			// ============================
-			// Stores the messages
-			// ============================
-
-			// Loops over the storage tasks, while we will
-			//  start storing the raw messages with the
-			//  shortcuts to them
-			auto storageTasks = session->getStorageTasks();
-			DEBUG_ONLY(logger << DEBUG << "Performing " << storageTasks.size() << " storage tasks .." << ENDL << CLASSIC);
-			for_each(storageTasks.begin(), storageTasks.end(), [&](const SMTPServerStorageTask &task) {
-				CassUuid messageUUID;
-				int64_t messageBucket;
-				int32_t messageUID;
-				string messageMailbox;
-
-				// Checks the current storage target type, and to which mailbox name
-				//  it refers, after which we will set the mailbox string
-				switch (task.target) {
-					case SMTPServerStorageTarget::StorageTargetIncomming:
-						messageMailbox = "INBOX"; break;
-					case SMTPServerStorageTarget::StorageTargetSent:
-						messageMailbox = "INBOX.Sent"; break;
-					case SMTPServerStorageTarget::StorageTargetSpam:
-						messageMailbox = "INBOX.Spam"; break;
-					default:
-						messageMailbox = "INBOX"; break;
-				}
-
-				// Increments the UID holder, and gets the UID for the current email
-				//  the UID holder keeps track of the unique id's
-				try {
-					messageUID = UIDHolder::getAndIncrement(cassandra, redis, 
-						task.account.getBucket(), task.account.getDomain(), task.account.getUUID());
-				} catch (const runtime_error &e) {
-					logger << ERROR << "Could not update/read UID, runtime error: " << e.what() << ENDL << CLASSIC;
-					return;
-				} catch (const DatabaseException &e) {
-					logger << ERROR << "Could not update/read UID, database exception: " << e.what() << ENDL << CLASSIC;
-					return;
-				} catch (...) {
-					logger << ERROR << "Could not update/read UID, error unknown" << ENDL << CLASSIC;
-					return;
-				}
-
-				// Increments the number of emails for the target mailbox
-				try {
-					MailboxStatus::addOneMessage(redis, cassandra, task.account.getBucket(),
-						task.account.getDomain(), task.account.getUUID(),
-						messageMailbox);
-				} catch (const runtime_error &e) {
-					logger << ERROR << "Could not update mailbox, runtime error: " << e.what() << ENDL << CLASSIC;
-					return;
-				} catch (const DatabaseException &e) {
-					logger << ERROR << "Could not update mailbox, database exception: " << e.what() << ENDL << CLASSIC;
-					return;
-				} catch (...) {
-					logger << ERROR << "Could not update mailbox, error unknown" << ENDL << CLASSIC;
-					return;
+			// Generates the bucket and TimeUUID for the current email
+			//  these will be used to quickly access each specified message
+			messageBucket = FullEmail::getBucket();
+			messageUUID = FullEmail::generateMessageUUID();
+
+			// Prints the message that we attempt to save one message
+			//  to the specified mailbox
+			DEBUG_ONLY(logger << DEBUG << "Saving message to mailbox: '" << 
+				messageMailbox << "', for user: '" << task.account.getUsername() << '@'
+				<< task.account.getDomain() << "'" << ENDL << CLASSIC);
+
+			RawEmail raw(messageBucket, task.account.getDomain(), task.account.getUUID(),
+				messageUUID, "", blobHash);
+
+			// Stores the message in the order in which an failure leaves nothing
+			//  visible, the body and the raw email first, then the shortcut which
+			//  makes it show up in the mailbox. The reference must be taken before
+			//  the blob is written, the write timestamp of the blob then keeps a
+			//  concurrent release from deleting it ( see RawBlob::release ). The UID
+			//  is written to the mailbox meta before the shortcut, so it is never
+			//  handed out again, an failure after taking it only leaves an gap
+			bool referenced = false, rawStored = false, failed = false;
+			try {
+				RawBlob::reference(cassandra, blobHash);
+				referenced = true;
+
+				if (!blobStored) {
+					RawBlob::save(cassandra, blobHash, session->raw(), compressThreshold, chunkSize);
+					blobStored = true;
 				}
 
-				// Generates the bucket and TimeUUID for the current email
-				//  these will be used to quickly access each specified message
-				messageBucket = FullEmail::getBucket();
-				messageUUID = FullEmail::generateMessageUUID();
+				raw.save(cassandra);
+				rawStored = true;
 
-				// Prints the message that we attempt to save one message
-				//  to the specified mailbox
-				DEBUG_ONLY(logger << DEBUG << "Saving message to mailbox: '" << 
-					messageMailbox << "', for user: '" << task.account.getUsername() << '@'
-					<< task.account.getDomain() << "'" << ENDL << CLASSIC);
+				messageUID = UIDHolder::getAndIncrement(cassandra, redis, 
+					task.account.getBucket(), task.account.getDomain(), task.account.getUUID());
+				MailboxMeta(task.account.getBucket(), task.account.getDomain(), task.account.getUUID(),
+					messageMailbox, messageUID).saveMaxUID(cassandra);
 
 				// Creates the email shortcut, this will be used to quickly
 				//  list all the emails in the databse, without the real
@@ -147,29 +167,85 @@ namespace FSMTP::Workers
 					session->getSnippet(), from.toString(), 
 					task.account.a_UUID, messageUUID, messageUID, 0x0, messageBucket,
 					messageMailbox, session->raw().size());
+				shortcut.save(cassandra);
+			} catch (const runtime_error &e) {
+				logger << ERROR << "Could not store message, runtime error: " << e.what() << ENDL << CLASSIC;
+				failed = true;
+			} catch (const DatabaseException &e) {
+				logger << ERROR << "Could not store message, database exception: " << e.what() << ENDL << CLASSIC;
+				failed = true;
+			} catch (...) {
+				logger << ERROR << "Could not store message, unknown error" << ENDL << CLASSIC;
+				failed = true;
+			}
 
-				RawEmail raw(messageBucket, task.account.getDomain(), task.account.getUUID(),
-					messageUUID, session->raw());
-
-				// Saves the shortcut and the raw email to the database, if any error
-				//  occures we will just log the error, and proceed with the next one
+			// Undoes the raw email and the reference, so the retry of the task
+			//  does not leave an orphan row, or an blob which is never released.
+			//  The release may delete the blob, so the next task writes it again
+			if (failed) {
 				try {
-					shortcut.save(cassandra);
-					raw.save(cassandra);
-				} catch (const runtime_error &e) {
-					logger << ERROR << "Could not store message, runtime error: " << e.what() << ENDL << CLASSIC;
-				} catch (const DatabaseException &e) {
-					logger << ERROR << "Could not store message, database exception: " << e.what() << ENDL << CLASSIC;
+					if (rawStored) {
+						RawEmail::deleteOne(cassandra, task.account.getDomain(),
+							task.account.getUUID(), messageUUID, messageBucket);
+					} else if (referenced) RawBlob::release(cassandra, blobHash);
 				} catch (...) {
-					logger << ERROR << "Could not store message, unknown error" << ENDL << CLASSIC;
+					logger << ERROR << "Could not undo the failed storage of the message" << ENDL << CLASSIC;
 				}
 
-				// Prints the final message to indicate that the message has been stored
-				//  and no errors occured
-				DEBUG_ONLY(logger << DEBUG << "Saved message to mailbox: '" << 
-					messageMailbox << "', for user: '" << task.account.getUsername() << '@'
-					<< task.account.getDomain() << "'" << ENDL << CLASSIC);
-			});
+				blobStored = false;
+				++failedTasks;
+				return;
+			}
+
+			storedTasks.push_back(index);
+
+			// Increments the number of emails for the target mailbox, the message is
+			//  stored by now, so an failure is only logged, storing it again would
+			//  create an duplicate
+			try {
+				MailboxStatus::addOneMessage(redis, cassandra, task.account.getBucket(),
+					task.account.getDomain(), task.account.getUUID(), messageMailbox);
+			} catch (const runtime_error &e) {
+				logger << ERROR << "Could not update mailbox, runtime error: " << e.what() << ENDL << CLASSIC;
+			} catch (const DatabaseException &e) {
+				logger << ERROR << "Could not update mailbox, database exception: " << e.what() << ENDL << CLASSIC;
+			} catch (...) {
+				logger << ERROR << "Could not update mailbox, error unknown" << ENDL << CLASSIC;
+			}
+
+			// Prints the final message to indicate that the message has been stored
+			//  and no errors occured
+			DEBUG_ONLY(logger << DEBUG << "Saved message to mailbox: '" << 
+				messageMailbox << "', for user: '" << task.account.getUsername() << '@'
+				<< task.account.getDomain() << "'" << ENDL << CLASSIC);
+		});
+
+		// Marks the storage as done in the spool, so the message will not be
+		//  stored again when the server restarts, if any of the tasks failed we
+		//  only record the ones which succeeded, and leave the rest for the replay
+		try {
+			if (failedTasks > 0) Spool::progress(session, storedTasks);
+			else Spool::complete(session, SpoolTaskStorage);
+		} catch (const runtime_error &e) {
+			logger << ERROR << "Could not mark storage as done in spool: " << e.what() << ENDL << CLASSIC;
+		}
+
+		// The failed tasks are tried again with an doubling delay, the stored
+		//  ones are skipped then, once the attempts run out the message waits
+		//  in the spool for the next restart
+		if (failedTasks > 0) {
+			if (attempts + 1 < _STORAGE_RETRY_LIMIT) {
+				milliseconds delay(min<int64_t>(
+					static_cast<int64_t>(_STORAGE_RETRY_DELAY) << attempts, _STORAGE_RETRY_DELAY_MAX
+				));
+
+				logger << WARN << failedTasks << " storage tasks failed, retrying in "
+					<< delay.count() << "ms" << ENDL << CLASSIC;
+				databaseQueue.defer(make_pair(session, attempts + 1), delay);
+			} else {
+				logger << ERROR << "Message kept in spool, " << failedTasks << " storage tasks failed "
+					<< _STORAGE_RETRY_LIMIT << " times" << ENDL << CLASSIC;
+			}
 		}
 	}
 }
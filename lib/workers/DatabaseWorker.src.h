@@ -23,6 +23,8 @@
 #include "../smtp/server/SMTPServerSession.src.h"
 
 #include "./Worker.src.h"
+#include "./WorkQueue.src.h"
+#include "./Spool.src.h"
 
 #include "../models/Email.src.h"
 #include "../models/RawEmail.src.h"
@@ -30,6 +32,10 @@
 #include "../models/UIDHolder.src.h"
 #include "../models/MailboxStatus.src.h"
 
+#define _STORAGE_RETRY_LIMIT 6
+#define _STORAGE_RETRY_DELAY 1000
+#define _STORAGE_RETRY_DELAY_MAX 60000
+
 using namespace FSMTP::Models;
 using namespace FSMTP::Server;
 using namespace FSMTP::Connections;
@@ -39,13 +45,15 @@ namespace FSMTP::Workers
 	class DatabaseWorker : public Worker
 	{
 	public:
-		DatabaseWorker(void);
+		DatabaseWorker(const size_t id);
 		virtual void startupTask(void);
 		virtual void action(void *u);
 
 		static void push(shared_ptr<SMTPServerSession> session);
+		static size_t getQueueDepth(void);
+		static milliseconds getQueueAge(void);
 	private:
-		unique_ptr<CassandraConnection> d_Cassandra;
+		shared_ptr<CassandraConnection> d_Cassandra;
 		unique_ptr<RedisConnection> d_Redis;
 	};
 }
@@ -0,0 +1,573 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <mutex>
+#include <condition_variable>
+#include <set>
+#include <zlib.h>
+
+#include "Spool.src.h"
+
+#define _SPOOL_RECORD_MAGIC 0x4C505346
+#define _SPOOL_RECORD_MESSAGE 1
+#define _SPOOL_RECORD_DONE 2
+#define _SPOOL_RECORD_STORED 3
+
+// Size of the magic, type, id and length before the payload, and the
+//  checksum after it
+#define _SPOOL_RECORD_HEADER_SIZE (4 + 1 + 8 + 4)
+#define _SPOOL_RECORD_TRAILER_SIZE 4
+
+// After an failed write, the spool is tried again at most this often
+#define _SPOOL_RETRY_INTERVAL 1000
+
+namespace FSMTP::Workers
+{
+	struct SpoolMessage {
+		uint64_t segment;
+		uint8_t tasks;
+		set<uint32_t> stored;
+	};
+
+	static mutex spoolMutex;
+	static condition_variable spoolCondition;
+
+	static string spoolPath;
+	static size_t spoolSegmentSize;
+	static bool spoolOpen = false, spoolBroken = false, spoolFlushing = false;
+	static steady_clock::time_point spoolRetryAt;
+
+	// The records which are not yet written, with the sequence of the last
+	//  record appended to it, and the sequence which is synced to disk
+	static string spoolBuffer;
+	static uint64_t spoolAppendedSeq = 0, spoolDurableSeq = 0;
+
+	static int spoolFd = -1;
+	static uint64_t spoolSegment = 0;
+	static size_t spoolSegmentUsed = 0;
+
+	static uint64_t spoolNextID = 1;
+	static map<uint64_t, size_t> spoolSegments;
+	static unordered_map<uint64_t, SpoolMessage> spoolMessages;
+
+	// ==================================
+	// Binary helpers
+	// ==================================
+
+	static void writeU8(string &out, const uint8_t v) {
+		out += static_cast<char>(v);
+	}
+
+	static void writeU32(string &out, const uint32_t v) {
+		out.append(reinterpret_cast<const char *>(&v), sizeof (v));
+	}
+
+	static void writeU64(string &out, const uint64_t v) {
+		out.append(reinterpret_cast<const char *>(&v), sizeof (v));
+	}
+
+	static void writeString(string &out, const string &v) {
+		writeU32(out, static_cast<uint32_t>(v.size()));
+		out += v;
+	}
+
+	static void writeUuid(string &out, const CassUuid &uuid) {
+		writeU64(out, uuid.time_and_version);
+		writeU64(out, uuid.clock_seq_and_node);
+	}
+
+	static void writeAddress(string &out, const EmailAddress &address) {
+		writeString(out, address.e_Name);
+		writeString(out, address.e_Address);
+	}
+
+	class SpoolReader {
+	public:
+		SpoolReader(const string &raw): r_Raw(raw), r_Pos(0) {}
+
+		const char *take(const size_t n) {
+			if (this->r_Raw.size() - this->r_Pos < n) {
+				throw runtime_error(EXCEPT_DEBUG("Spool record truncated"));
+			}
+
+			const char *p = this->r_Raw.c_str() + this->r_Pos;
+			this->r_Pos += n;
+			return p;
+		}
+
+		uint8_t readU8() { return static_cast<uint8_t>(*this->take(1)); }
+
+		uint32_t readU32() {
+			uint32_t v;
+			memcpy(&v, this->take(sizeof (v)), sizeof (v));
+			return v;
+		}
+
+		uint64_t readU64() {
+			uint64_t v;
+			memcpy(&v, this->take(sizeof (v)), sizeof (v));
+			return v;
+		}
+
+		string readString() {
+			uint32_t len = this->readU32();
+			return string(this->take(len), len);
+		}
+
+		CassUuid readUuid() {
+			CassUuid uuid;
+			uuid.time_and_version = this->readU64();
+			uuid.clock_seq_and_node = this->readU64();
+			return uuid;
+		}
+
+		EmailAddress readAddress() {
+			EmailAddress address;
+			address.e_Name = this->readString();
+			address.e_Address = this->readString();
+			return address;
+		}
+	private:
+		const string &r_Raw;
+		size_t r_Pos;
+	};
+
+	static string encodeRecord(const uint8_t type, const uint64_t id, const string &payload) {
+		string record;
+
+		writeU32(record, _SPOOL_RECORD_MAGIC);
+		writeU8(record, type);
+		writeU64(record, id);
+		writeU32(record, static_cast<uint32_t>(payload.size()));
+		record += payload;
+
+		uLong crc = crc32(0L, reinterpret_cast<const Bytef *>(record.c_str() + 4), record.size() - 4);
+		writeU32(record, static_cast<uint32_t>(crc));
+
+		return record;
+	}
+
+	static string getSegmentPath(const uint64_t segment) {
+		char name[64];
+		sprintf(name, "%016lx.spool", segment);
+		return spoolPath + '/' + name;
+	}
+
+	// ==================================
+	// Segment management
+	// ==================================
+
+	static int openSegment(const uint64_t segment) {
+		int fd = ::open(getSegmentPath(segment).c_str(), O_WRONLY | O_CREAT | O_APPEND, 0600);
+		if (fd < 0) {
+			throw runtime_error(EXCEPT_DEBUG(string("Could not open spool segment: ") + strerror(errno)));
+		}
+
+		// Syncs the directory, so the new segment itself survives
+		//  a crash, not only the data inside of it
+
+		int dirFd = ::open(spoolPath.c_str(), O_RDONLY | O_DIRECTORY);
+		if (dirFd >= 0) {
+			fsync(dirFd);
+			close(dirFd);
+		}
+
+		spoolSegments[segment] = 0;
+		return fd;
+	}
+
+	/**
+	 * Removes the oldest segments which have no pending messages anymore, we only
+	 *  remove from the front, since the done records of an message are always
+	 *  in the same or a newer segment than the message itself
+	 */
+	static void reclaimSegments() {
+		while (!spoolSegments.empty()) {
+			auto it = spoolSegments.begin();
+			if (it->second > 0 || it->first == spoolSegment) break;
+
+			unlink(getSegmentPath(it->first).c_str());
+			spoolSegments.erase(it);
+		}
+	}
+
+	/**
+	 * Waits until the record with the specified sequence is on disk, the first
+	 *  waiter writes and syncs everything appended until then, so all the
+	 *  records appended in the meantime share one fsync. Expects the lock
+	 */
+	static void commit(unique_lock<mutex> &lock, const uint64_t seq) {
+		while (spoolDurableSeq < seq) {
+			if (spoolFlushing) {
+				spoolCondition.wait(lock);
+				continue;
+			}
+
+			if (spoolBroken && steady_clock::now() < spoolRetryAt) {
+				throw runtime_error(EXCEPT_DEBUG("Spool is broken after earlier write failure"));
+			}
+
+			// Takes the buffer, and rotates the segment if it gets too large, new
+			//  records will then be assigned to the new segment immediately. After an
+			//  failed write the segment may end in an partial record, which ends the
+			//  replay of it, so the records are written again into an fresh one
+
+			spoolFlushing = true;
+			string buffer;
+			buffer.swap(spoolBuffer);
+			uint64_t lastSeq = spoolAppendedSeq;
+			int fd = spoolFd, oldFd = -1;
+			bool failed = false;
+
+			spoolSegmentUsed += buffer.size();
+			if (spoolBroken || spoolSegmentUsed >= spoolSegmentSize) {
+				try {
+					spoolFd = openSegment(spoolSegment + 1);
+					++spoolSegment;
+					spoolSegmentUsed = buffer.size();
+					oldFd = fd;
+					fd = spoolFd;
+				} catch (const runtime_error &e) {
+					// Keeps using the current segment, unless it is broken
+					failed = spoolBroken;
+				}
+			}
+
+			lock.unlock();
+
+			for (size_t written = 0; !failed && written < buffer.size();) {
+				ssize_t rc = write(fd, buffer.c_str() + written, buffer.size() - written);
+				if (rc < 0 && errno == EINTR) continue;
+				else if (rc <= 0) {
+					failed = true;
+					break;
+				}
+
+				written += rc;
+			}
+
+			if (!failed && fdatasync(fd) != 0) failed = true;
+			const int error = errno;
+			if (oldFd >= 0) close(oldFd);
+
+			lock.lock();
+			spoolFlushing = false;
+
+			// Puts the records back in front of the ones appended in the meantime,
+			//  so nothing is lost, and they are written again once the spool
+			//  recovers, until then the waiters get an error
+			if (failed) {
+				Logger logger("SPOOL", LoggerLevel::INFO);
+				logger << FATAL << "Could not write spool segment " << spoolSegment << ": " << strerror(error)
+					<< ", new messages are refused until it recovers" << ENDL << CLASSIC;
+
+				spoolBuffer.insert(0, buffer);
+				spoolBroken = true;
+				spoolRetryAt = steady_clock::now() + milliseconds(_SPOOL_RETRY_INTERVAL);
+			} else {
+				if (spoolBroken) {
+					Logger logger("SPOOL", LoggerLevel::INFO);
+					logger << "Spool recovered, continuing in segment " << spoolSegment << ENDL;
+				}
+
+				spoolBroken = false;
+				spoolDurableSeq = lastSeq;
+			}
+
+			spoolCondition.notify_all();
+		}
+	}
+
+	// ==================================
+	// Serialization
+	// ==================================
+
+	string Spool::serialize(shared_ptr<SMTPServerSession> session) {
+		string out;
+
+		writeString(out, session->getMessageID());
+		writeString(out, session->getSubject());
+		writeString(out, session->getSnippet());
+		writeAddress(out, session->getFrom());
+		writeAddress(out, session->getTransportFrom());
+		writeU8(out, session->xfannst().getMailerFlags());
+		writeU8(out, session->xfannst().getStorageFlags());
+		writeU8(out, session->getPossibleSpam() ? 1 : 0);
+
+		auto &storageTasks = session->getStorageTasks();
+		writeU32(out, static_cast<uint32_t>(storageTasks.size()));
+		for (const SMTPServerStorageTask &task : storageTasks) {
+			writeU64(out, static_cast<uint64_t>(task.account.a_Bucket));
+			writeString(out, task.account.a_Domain);
+			writeString(out, task.account.a_Username);
+			writeUuid(out, task.account.a_UUID);
+			writeU8(out, static_cast<uint8_t>(task.target));
+		}
+
+		auto &relayTasks = session->getRelayTasks();
+		writeU32(out, static_cast<uint32_t>(relayTasks.size()));
+		for (const SMTPServerRelayTask &task : relayTasks) {
+			writeAddress(out, task.target);
+		}
+
+		writeString(out, session->raw());
+		return out;
+	}
+
+	shared_ptr<SMTPServerSession> Spool::deserialize(const string &raw) {
+		shared_ptr<SMTPServerSession> session = make_shared<SMTPServerSession>();
+		SpoolReader reader(raw);
+
+		session->setMessageID(reader.readString());
+		session->setSubject(reader.readString());
+		session->setSnippet(reader.readString());
+		session->setFrom(reader.readAddress());
+		session->setTransformFrom(reader.readAddress());
+
+		uint8_t mailerFlags = reader.readU8();
+		uint8_t storageFlags = reader.readU8();
+		session->xfannst().setFlags(mailerFlags, storageFlags);
+		session->setPossibleSpam(reader.readU8() == 1);
+
+		for (uint32_t i = 0, n = reader.readU32(); i < n; ++i) {
+			SMTPServerStorageTask task;
+			task.account.a_Bucket = static_cast<int64_t>(reader.readU64());
+			task.account.a_Domain = reader.readString();
+			task.account.a_Username = reader.readString();
+			task.account.a_UUID = reader.readUuid();
+			task.target = static_cast<SMTPServerStorageTarget>(reader.readU8());
+			session->addStorageTask(task);
+		}
+
+		for (uint32_t i = 0, n = reader.readU32(); i < n; ++i) {
+			session->addRelayTask(SMTPServerRelayTask{ reader.readAddress() });
+		}
+
+		session->raw() = reader.readString();
+		return session;
+	}
+
+	// ==================================
+	// Spool
+	// ==================================
+
+	vector<SpoolEntry> Spool::open(const string &path, const size_t segmentSize) {
+		Logger logger("SPOOL", LoggerLevel::INFO);
+		lock_guard<mutex> guard(spoolMutex);
+		map<uint64_t, pair<shared_ptr<SMTPServerSession>, SpoolMessage>> pending;
+		vector<uint64_t> segments;
+
+		spoolPath = path;
+		spoolSegmentSize = segmentSize;
+		filesystem::create_directories(path);
+
+		// Finds the existing segments, the names are fixed width hex so
+		//  sorting them by name also sorts them by sequence
+
+		for (const auto &entry : filesystem::directory_iterator(path)) {
+			if (entry.path().extension() != ".spool") continue;
+			segments.push_back(stoull(entry.path().stem().string(), nullptr, 16));
+		}
+		sort(segments.begin(), segments.end());
+
+		// Reads all the records from the segments, a record which is cut off or
+		//  has an invalid checksum is the result of a crash during write, so we
+		//  stop reading the segment there
+
+		for (const uint64_t segment : segments) {
+			ifstream stream(getSegmentPath(segment), ios::binary);
+			string data((istreambuf_iterator<char>(stream)), istreambuf_iterator<char>());
+			size_t pos = 0;
+
+			spoolSegments[segment] = 0;
+			while (data.size() - pos >= _SPOOL_RECORD_HEADER_SIZE + _SPOOL_RECORD_TRAILER_SIZE) {
+				uint32_t magic, length, checksum;
+				uint64_t id;
+				uint8_t type;
+
+				memcpy(&magic, &data[pos], 4);
+				type = static_cast<uint8_t>(data[pos + 4]);
+				memcpy(&id, &data[pos + 5], 8);
+				memcpy(&length, &data[pos + 13], 4);
+
+				if (magic != _SPOOL_RECORD_MAGIC) break;
+				if (data.size() - pos - _SPOOL_RECORD_HEADER_SIZE - _SPOOL_RECORD_TRAILER_SIZE < length) break;
+
+				memcpy(&checksum, &data[pos + _SPOOL_RECORD_HEADER_SIZE + length], 4);
+				uLong crc = crc32(0L, reinterpret_cast<const Bytef *>(&data[pos + 4]), _SPOOL_RECORD_HEADER_SIZE - 4 + length);
+				if (static_cast<uint32_t>(crc) != checksum) break;
+
+				string payload = data.substr(pos + _SPOOL_RECORD_HEADER_SIZE, length);
+				pos += _SPOOL_RECORD_HEADER_SIZE + length + _SPOOL_RECORD_TRAILER_SIZE;
+
+				if (id >= spoolNextID) spoolNextID = id + 1;
+
+				try {
+					if (type == _SPOOL_RECORD_MESSAGE) {
+						shared_ptr<SMTPServerSession> session = Spool::deserialize(payload);
+						uint8_t tasks = 0;
+
+						if (session->getStorageTasks().size() > 0) tasks |= SpoolTaskStorage;
+						if (session->getRelayTasks().size() > 0) tasks |= SpoolTaskRelay;
+
+						session->setSpoolID(id);
+						pending[id] = make_pair(session, SpoolMessage{ segment, tasks, {} });
+					} else if (type == _SPOOL_RECORD_DONE && payload.size() == 1) {
+						auto it = pending.find(id);
+						if (it != pending.end()) it->second.second.tasks &= ~static_cast<uint8_t>(payload[0]);
+					} else if (type == _SPOOL_RECORD_STORED) {
+						auto it = pending.find(id);
+						SpoolReader reader(payload);
+
+						if (it != pending.end()) {
+							for (uint32_t i = 0, n = reader.readU32(); i < n; ++i) {
+								it->second.second.stored.insert(reader.readU32());
+							}
+						}
+					}
+				} catch (const runtime_error &e) {
+					logger << ERROR << "Skipping invalid record " << id << ": " << e.what() << ENDL << CLASSIC;
+				}
+			}
+
+			if (pos != data.size()) {
+				logger << WARN << "Segment " << segment << " has " << data.size() - pos
+					<< " trailing bytes, probably from a crash" << ENDL << CLASSIC;
+			}
+		}
+
+		// Builds the entries which still have to be processed, and keeps
+		//  track of them so their segments are kept until they're done
+
+		vector<SpoolEntry> entries;
+		for (auto &p : pending) {
+			if (p.second.second.tasks == 0) continue;
+
+			spoolMessages[p.first] = p.second.second;
+			++spoolSegments[p.second.second.segment];
+			entries.push_back(SpoolEntry{ p.second.first, p.second.second.tasks });
+		}
+
+		// Starts a new segment for the new records, we never append to an old
+		//  one, since it might end in a partially written record
+
+		spoolSegment = (segments.empty() ? 1 : segments.back() + 1);
+		spoolSegmentUsed = 0;
+		spoolFd = openSegment(spoolSegment);
+		spoolOpen = true;
+
+		reclaimSegments();
+
+		logger << "Opened spool at '" << path << "', replaying " << entries.size() << " messages" << ENDL;
+		return entries;
+	}
+
+	void Spool::append(shared_ptr<SMTPServerSession> session) {
+		string payload = Spool::serialize(session);
+		uint8_t tasks = 0;
+
+		if (session->getStorageTasks().size() > 0) tasks |= SpoolTaskStorage;
+		if (session->getRelayTasks().size() > 0) tasks |= SpoolTaskRelay;
+		if (tasks == 0) return;
+
+		unique_lock<mutex> lock(spoolMutex);
+		if (!spoolOpen) {
+			throw runtime_error(EXCEPT_DEBUG("Spool is not opened"));
+		}
+
+		// Appends the record to the buffer, and keeps track of the message
+		//  so the segment will not be removed before it is done
+
+		uint64_t id = spoolNextID++;
+		spoolBuffer += encodeRecord(_SPOOL_RECORD_MESSAGE, id, payload);
+		uint64_t seq = ++spoolAppendedSeq;
+
+		spoolMessages[id] = SpoolMessage{ spoolSegment, tasks, {} };
+		++spoolSegments[spoolSegment];
+		session->setSpoolID(id);
+
+		// When the spool is broken the record stays buffered, and is written once
+		//  it recovers, since the client is told to try again, the message is
+		//  marked done right away, so it is not delivered twice after an replay
+		try {
+			commit(lock, seq);
+		} catch (const runtime_error &e) {
+			auto it = spoolMessages.find(id);
+			if (it != spoolMessages.end()) {
+				spoolBuffer += encodeRecord(_SPOOL_RECORD_DONE, id, string(1, static_cast<char>(tasks)));
+				++spoolAppendedSeq;
+
+				--spoolSegments[it->second.segment];
+				spoolMessages.erase(it);
+			}
+
+			throw;
+		}
+	}
+
+	void Spool::progress(shared_ptr<SMTPServerSession> session, const vector<uint32_t> &stored) {
+		unique_lock<mutex> lock(spoolMutex);
+
+		auto it = spoolMessages.find(session->getSpoolID());
+		if (!spoolOpen || it == spoolMessages.end() || stored.empty()) return;
+
+		// Writes which storage tasks are done, so an replay of the message
+		//  only stores it for the recipients which are still missing
+
+		string payload;
+		writeU32(payload, static_cast<uint32_t>(stored.size()));
+		for (const uint32_t task : stored) {
+			writeU32(payload, task);
+			it->second.stored.insert(task);
+		}
+
+		spoolBuffer += encodeRecord(_SPOOL_RECORD_STORED, it->first, payload);
+		uint64_t seq = ++spoolAppendedSeq;
+
+		commit(lock, seq);
+	}
+
+	bool Spool::isStored(shared_ptr<SMTPServerSession> session, const uint32_t task) {
+		lock_guard<mutex> guard(spoolMutex);
+
+		auto it = spoolMessages.find(session->getSpoolID());
+		if (it == spoolMessages.end()) return false;
+
+		return it->second.stored.find(task) != it->second.stored.end();
+	}
+
+	void Spool::complete(shared_ptr<SMTPServerSession> session, const SpoolTask task) {
+		unique_lock<mutex> lock(spoolMutex);
+
+		auto it = spoolMessages.find(session->getSpoolID());
+		if (!spoolOpen || it == spoolMessages.end()) return;
+
+		// Writes the done record, and once all the tasks of the message are
+		//  done, the segment it is stored in may be removed
+
+		spoolBuffer += encodeRecord(_SPOOL_RECORD_DONE, it->first, string(1, static_cast<char>(task)));
+		uint64_t seq = ++spoolAppendedSeq;
+
+		it->second.tasks &= ~static_cast<uint8_t>(task);
+		if (it->second.tasks == 0) {
+			--spoolSegments[it->second.segment];
+			spoolMessages.erase(it);
+		}
+
+		commit(lock, seq);
+		reclaimSegments();
+	}
+}
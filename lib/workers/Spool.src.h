@@ -0,0 +1,59 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include "../default.h"
+#include "../general/Logger.src.h"
+#include "../smtp/server/SMTPServerSession.src.h"
+
+#define _SPOOL_PATH_DEFAULT "../env/spool"
+#define _SPOOL_SEGMENT_SIZE_DEFAULT 67108864
+
+using namespace FSMTP::Server;
+
+namespace FSMTP::Workers
+{
+	typedef enum : uint8_t {
+		SpoolTaskStorage = 1,
+		SpoolTaskRelay = 2
+	} SpoolTask;
+
+	struct SpoolEntry {
+		shared_ptr<SMTPServerSession> session;
+		uint8_t tasks;
+	};
+
+	/**
+	 * Append-only on disk queue of accepted messages, split into segments. A
+	 *  message is appended ( and synced ) before we reply to DATA, and marked
+	 *  done by the workers, segments are removed once all their messages are done
+	 */
+	class Spool
+	{
+	public:
+		static vector<SpoolEntry> open(const string &path, const size_t segmentSize);
+
+		static void append(shared_ptr<SMTPServerSession> session);
+		static void complete(shared_ptr<SMTPServerSession> session, const SpoolTask task);
+
+		static void progress(shared_ptr<SMTPServerSession> session, const vector<uint32_t> &stored);
+		static bool isStored(shared_ptr<SMTPServerSession> session, const uint32_t task);
+
+		static string serialize(shared_ptr<SMTPServerSession> session);
+		static shared_ptr<SMTPServerSession> deserialize(const string &raw);
+	};
+}
@@ -16,13 +16,13 @@
 
 #include "TransmissionWorker.src.h"
 
-static mutex queueMutex;
-static deque<shared_ptr<SMTPServerSession>> transmissionQueue;
+// The session with the number of failed attempts before
+static FSMTP::Workers::WorkQueue<pair<shared_ptr<SMTPServerSession>, uint32_t>> transmissionQueue;
 
 namespace FSMTP::Workers
 {
-	TransmissionWorker::TransmissionWorker():
-		Worker("TRANSMITTER", 120)
+	TransmissionWorker::TransmissionWorker(const size_t id):
+		Worker("TRANSMITTER#" + to_string(id), 900)
 	{}
 
 	void TransmissionWorker::startupTask(void) {
@@ -33,9 +33,15 @@ namespace FSMTP::Workers
 	}
 
 	void TransmissionWorker::push(shared_ptr<SMTPServerSession> session) {
-		queueMutex.lock();
-		transmissionQueue.push_back(session);
-		queueMutex.unlock();
+		transmissionQueue.push(make_pair(session, 0));
+	}
+
+	size_t TransmissionWorker::getQueueDepth(void) {
+		return transmissionQueue.size();
+	}
+
+	milliseconds TransmissionWorker::getQueueAge(void) {
+		return transmissionQueue.oldestAge();
 	}
 
 	static inja::Environment env;
@@ -70,77 +76,104 @@ namespace FSMTP::Workers
 		auto *cassandra = this->m_Cassandra.get();
 		auto &logger = this->w_Logger;
 
-		for (;;) {
-			// ============================
-			// Gets the front of the queue
-			// ============================
+		// ============================
+		// Gets the front of the queue
+		// ============================
 
-			queueMutex.lock(); // Locks the transmission mutex
-
-			// Checks if there is anything to transmit, else just
-			//  exit the worker action and wait
-			if (transmissionQueue.size() <= 0) {
-				queueMutex.unlock();
-				break;
-			}
+		// Waits for the next session to be pushed, if nothing arrived within
+		//  the interval we return, so the worker can check if it should stop
+		pair<shared_ptr<SMTPServerSession>, uint32_t> item;
+		milliseconds age;
+		if (!transmissionQueue.pop(item, age, milliseconds(this->w_Interval))) {
+			return;
+		}
 
-			// Gets the last task from the queue, and pops it of it
-			//  so we will not have to process it again
-			shared_ptr<SMTPServerSession> session = transmissionQueue.back();
-			transmissionQueue.pop_back();
-
-			queueMutex.unlock(); // Unlocks the transmission queue mutex
-
-			// ============================
-			// Transmits the email
-			// ============================
-
-			try {
-				// Creates an SMTP client, if we're in debug
-				//  we will enable verbose
-				#ifdef _SMTP_DEBUG
-				SMTPClient client(true);
-				#else
-				SMTPClient client(false);
-				#endif
-
-				// Builds the vector of addresses we will transmit the
-				//  message to, this is required for the prepare method
-				vector<EmailAddress> to = {};
-				auto &tasks = session->getRelayTasks();
-				for_each(tasks.begin(), tasks.end(), [&](const SMTPServerRelayTask &task) {
-					to.push_back(task.target);
-				});
-
-				// Prints the debug message to the console, which will
-				//  tell that we're transmitting one message
-				DEBUG_ONLY(logger << DEBUG << "Transmitting message to " << to.size() << " targets .." 
-					<< ENDL << CLASSIC);
-
-				// Prepares the client for the message transmission, after which we tell
-				//  the client to be social, and talk to the servers
-				client.prepare(to, {
-					session->getTransportFrom()
-				}, session->raw()).beSocial();
-
-				// Checks if there were any errors, if so transmit an error message to the
-				//  sender, since he/she will otherwise not know something went wrong.
-				if (client.s_ErrorCount > 0) {
-					if (!session->xfannst().getNoError()) {
-						DEBUG_ONLY(logger << ERROR << "Transmission failed, sending error message to sender .." << ENDL << CLASSIC);
-						this->sendErrorsToSender(client);
-					} else {
-						DEBUG_ONLY(logger << ERROR << "Transmission failed, sending no error message since 'nerror' flag is set" << ENDL << CLASSIC);
-					}
+		shared_ptr<SMTPServerSession> session = item.first;
+		const uint32_t attempts = item.second;
+
+		DEBUG_ONLY(logger << DEBUG << "Got session from queue after " << age.count() << "ms" << ENDL << CLASSIC);
+
+		// ============================
+		// Transmits the email
+		// ============================
+
+		// The message is only done once it is delivered, or the sender got
+		//  an bounce ( or asked not to get one ), else it stays in the spool
+		bool done = false;
+
+		try {
+			// Creates an SMTP client, if we're in debug
+			//  we will enable verbose
+			#ifdef _SMTP_DEBUG
+			SMTPClient client(true);
+			#else
+			SMTPClient client(false);
+			#endif
+
+			// Builds the vector of addresses we will transmit the
+			//  message to, this is required for the prepare method
+			vector<EmailAddress> to = {};
+			auto &tasks = session->getRelayTasks();
+			for_each(tasks.begin(), tasks.end(), [&](const SMTPServerRelayTask &task) {
+				to.push_back(task.target);
+			});
+
+			// Prints the debug message to the console, which will
+			//  tell that we're transmitting one message
+			DEBUG_ONLY(logger << DEBUG << "Transmitting message to " << to.size() << " targets .." 
+				<< ENDL << CLASSIC);
+
+			// Prepares the client for the message transmission, after which we tell
+			//  the client to be social, and talk to the servers
+			client.prepare(to, {
+				session->getTransportFrom()
+			}, session->raw()).beSocial();
+
+			// Checks if there were any errors, if so transmit an error message to the
+			//  sender, since he/she will otherwise not know something went wrong.
+			if (client.s_ErrorCount > 0) {
+				if (!session->xfannst().getNoError()) {
+					DEBUG_ONLY(logger << ERROR << "Transmission failed, sending error message to sender .." << ENDL << CLASSIC);
+					this->sendErrorsToSender(client);
 				} else {
-					// Prints the debug message that we successfully transmitted to the clients
-					DEBUG_ONLY(logger << DEBUG << "Transmission to " << to.size() << " targets was successfull !" << ENDL << CLASSIC);
+					DEBUG_ONLY(logger << ERROR << "Transmission failed, sending no error message since 'nerror' flag is set" << ENDL << CLASSIC);
 				}
-			} catch (const runtime_error &e) {
-				logger << ERROR << "Failed send message, runtime error: " << e.what() << ENDL << CLASSIC;
-			} catch (...) {
-				logger << ERROR << "Failed send message, unknown error" << ENDL << CLASSIC;
+			} else {
+				// Prints the debug message that we successfully transmitted to the clients
+				DEBUG_ONLY(logger << DEBUG << "Transmission to " << to.size() << " targets was successfull !" << ENDL << CLASSIC);
 			}
+
+			done = true;
+		} catch (const runtime_error &e) {
+			logger << ERROR << "Failed send message, runtime error: " << e.what() << ENDL << CLASSIC;
+		} catch (...) {
+			logger << ERROR << "Failed send message, unknown error" << ENDL << CLASSIC;
+		}
+
+		// Tries again later with an doubling delay, once the attempts run out
+		//  the message is left in the spool, and sent again after an restart
+		if (!done) {
+			if (attempts + 1 < _TRANSMISSION_RETRY_LIMIT) {
+				milliseconds delay(min<int64_t>(
+					static_cast<int64_t>(_TRANSMISSION_RETRY_DELAY) << attempts, _TRANSMISSION_RETRY_DELAY_MAX
+				));
+
+				logger << WARN << "Transmission will be retried in " << delay.count() / 1000 << " seconds" << ENDL << CLASSIC;
+				transmissionQueue.defer(make_pair(session, attempts + 1), delay);
+			} else {
+				logger << ERROR << "Transmission failed " << _TRANSMISSION_RETRY_LIMIT
+					<< " times, message kept in spool" << ENDL << CLASSIC;
+			}
+
+			return;
+		}
+
+		// Marks the relay as done in the spool, so the message will
+		//  not be transmitted again when the server restarts
+		try {
+			Spool::complete(session, SpoolTaskRelay);
+		} catch (const runtime_error &e) {
+			logger << ERROR << "Could not mark relay as done in spool: " << e.what() << ENDL << CLASSIC;
 		}
 	}
 }
\ No newline at end of file
@@ -23,9 +23,15 @@
 #include "../models/EmailShortcut.src.h"
 #include "../smtp/client/SMTPClient.src.h"
 #include "./Worker.src.h"
+#include "./WorkQueue.src.h"
+#include "./Spool.src.h"
 #include "../general/connections.src.h"
 #include "../smtp/server/SMTPServerSession.src.h"
 
+#define _TRANSMISSION_RETRY_LIMIT 8
+#define _TRANSMISSION_RETRY_DELAY 60000
+#define _TRANSMISSION_RETRY_DELAY_MAX 3600000
+
 using namespace FSMTP::Models;
 using namespace FSMTP::Connections;
 using namespace FSMTP::Mailer::Client;
@@ -35,13 +41,15 @@ namespace FSMTP::Workers
 {
 	class TransmissionWorker : public Worker {
 	public:
-		TransmissionWorker();
+		TransmissionWorker(const size_t id);
 		virtual void startupTask(void);
 		virtual void action(void *u);
 
 		static void sendErrorsToSender(SMTPClient &client);
 		static void push(shared_ptr<SMTPServerSession> session);
+		static size_t getQueueDepth(void);
+		static milliseconds getQueueAge(void);
 	private:
-		unique_ptr<CassandraConnection> m_Cassandra;
+		shared_ptr<CassandraConnection> m_Cassandra;
 	};
 }
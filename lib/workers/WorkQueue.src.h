@@ -0,0 +1,105 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#pragma once
+
+#include <mutex>
+#include <deque>
+#include <map>
+#include <condition_variable>
+
+#include "../default.h"
+
+namespace FSMTP::Workers
+{
+	/**
+	 * Blocking FIFO queue which may be pushed to and popped from by any
+	 *  number of threads, consumers sleep on the condition variable until
+	 *  an item is pushed, instead of polling the queue. Items can also be
+	 *  deferred, those are moved to the back of the queue once their delay
+	 *  passed, which is used to retry failed work with an backoff
+	 */
+	template<typename T>
+	class WorkQueue
+	{
+	public:
+		void push(const T &item) {
+			{
+				lock_guard<mutex> lock(this->q_Mutex);
+				this->q_Items.push_back(make_pair(item, steady_clock::now()));
+			}
+
+			this->q_Condition.notify_one();
+		}
+
+		void defer(const T &item, const milliseconds delay) {
+			{
+				lock_guard<mutex> lock(this->q_Mutex);
+				this->q_Deferred.emplace(steady_clock::now() + delay, item);
+			}
+
+			// Wakes an consumer, so it will wait for the new deadline if
+			//  that is earlier than the one it is waiting for
+			this->q_Condition.notify_one();
+		}
+
+		/**
+		 * Waits at most the timeout for an item, returns false if none
+		 *  arrived, else the item and the time it spent in the queue
+		 */
+		bool pop(T &item, milliseconds &age, const milliseconds timeout) {
+			unique_lock<mutex> lock(this->q_Mutex);
+			const auto deadline = steady_clock::now() + timeout;
+
+			for (;;) {
+				auto now = steady_clock::now();
+				while (!this->q_Deferred.empty() && this->q_Deferred.begin()->first <= now) {
+					this->q_Items.push_back(make_pair(this->q_Deferred.begin()->second, now));
+					this->q_Deferred.erase(this->q_Deferred.begin());
+				}
+
+				if (!this->q_Items.empty()) break;
+				else if (now >= deadline) return false;
+
+				auto wake = deadline;
+				if (!this->q_Deferred.empty()) wake = min(wake, this->q_Deferred.begin()->first);
+				this->q_Condition.wait_until(lock, wake);
+			}
+
+			item = this->q_Items.front().first;
+			age = duration_cast<milliseconds>(steady_clock::now() - this->q_Items.front().second);
+			this->q_Items.pop_front();
+
+			return true;
+		}
+
+		size_t size(void) {
+			lock_guard<mutex> lock(this->q_Mutex);
+			return this->q_Items.size() + this->q_Deferred.size();
+		}
+
+		milliseconds oldestAge(void) {
+			lock_guard<mutex> lock(this->q_Mutex);
+			if (this->q_Items.empty()) return milliseconds(0);
+			return duration_cast<milliseconds>(steady_clock::now() - this->q_Items.front().second);
+		}
+	private:
+		mutex q_Mutex;
+		condition_variable q_Condition;
+		deque<pair<T, steady_clock::time_point>> q_Items;
+		multimap<steady_clock::time_point, T> q_Deferred;
+	};
+}
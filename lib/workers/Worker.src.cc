@@ -87,7 +87,9 @@ namespace FSMTP::Workers
 		// Sets running to true,
 		//  and keeps running as long
 		//  as we do not stop, and if we stop
-		//  we set running to false
+		//  we set running to false. The action
+		//  itself blocks for at most the interval
+		//  while waiting for work, so we do not sleep
 
 		isRunning = true;
 		while(shouldRun) {
@@ -96,14 +98,13 @@ namespace FSMTP::Workers
 			} catch (const EmptyQuery &e) {
 				logger << ERROR << "Execution failed: " << e.what() << ENDL << CLASSIC;
 			} 
-
-			this_thread::sleep_for(milliseconds(this->w_Interval));
 		}
 		isRunning = false;
 	}
 
 	void Worker::action(void *u) {
 		cout << "Worker::action() is not implemented !" << endl;
+		this_thread::sleep_for(milliseconds(this->w_Interval));
 	}
 
 	void Worker::startupTask(void) {
@@ -34,9 +34,10 @@ namespace FSMTP::Workers
 		virtual void startupTask(void);
 
 		Logger w_Logger;
+	protected:
+		size_t w_Interval;
 	private:
 		atomic<bool> w_ShouldRun;
 		atomic<bool> w_IsRunning;
-		size_t w_Interval;
 	};
 }
\ No newline at end of file
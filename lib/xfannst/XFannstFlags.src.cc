@@ -124,6 +124,20 @@ namespace FSMTP::XFannst {
         return BINARY_COMPARE(this->m_MailerFlags, _FSMTP_XFANNST_FLAG_MAILER_NOERROR);
     }
 
+    uint8_t XFannstFlags::getMailerFlags() {
+        return this->m_MailerFlags;
+    }
+
+    uint8_t XFannstFlags::getStorageFlags() {
+        return this->m_StorageFlags;
+    }
+
+    XFannstFlags &XFannstFlags::setFlags(uint8_t mailerFlags, uint8_t storageFlags) {
+        this->m_MailerFlags = mailerFlags;
+        this->m_StorageFlags = storageFlags;
+        return *this;
+    }
+
     string XFannstFlags::getMailerFlagsString() {
         return __fannstMailerFlagsToString(this->m_MailerFlags);
     }
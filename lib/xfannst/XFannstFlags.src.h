@@ -37,6 +37,10 @@ namespace FSMTP::XFannst {
         bool getNoStore();
         bool getNoError();
 
+        uint8_t getMailerFlags();
+        uint8_t getStorageFlags();
+        XFannstFlags &setFlags(uint8_t mailerFlags, uint8_t storageFlags);
+
         string getMailerFlagsString();
         string getStorageFlagsString();
 
@@ -16,9 +16,14 @@
 
 #include "main.h"
 #include "lib/dns/Resolver.src.h"
+#include "lib/dns/DNSServer.src.h"
+#include "lib/dns/ReverseDNS.src.h"
 #include "lib/dmarc/DMARCRecord.src.h"
+#include "lib/dmarc/PublicSuffix.src.h"
 #include "lib/spf/SPFRecord.src.h"
 #include "lib/spf/SPFValidator.src.h"
+#include "lib/dkim/DKIMKeyCache.src.h"
+#include "lib/dkim/DKIMKeyStore.src.h"
 #include "lib/dkim/DKIMRecord.src.h"
 #include "lib/dkim/DKIMValidator.src.h"
 #include "lib/builders/mimev2.src.h"
@@ -31,6 +36,11 @@ static const char *FALLBACK_CONFIG_FILE = "../fallback/config.json";
 int main(const int argc, const char **argv)
 {
 	signal(SIGPIPE, SIG_IGN);
+	signal(SIGHUP, [](int) {
+		DKIM::DKIMKeyStore::requestReload();
+		DMARC::PublicSuffixList::requestReload();
+		DNS::DNSServer::requestReload();
+	});
 
 	// ==================================
 	// Default main
@@ -54,8 +64,42 @@ int main(const int argc, const char **argv)
 
 	FSMTP::Server::SMTPServer smtpServer;
 	POP3::P3Server pop3Server;
-	unique_ptr<Workers::TransmissionWorker> transmissionWorker = make_unique<Workers::TransmissionWorker>();
-	unique_ptr<Workers::DatabaseWorker> databaseWorker = make_unique<Workers::DatabaseWorker>();
+	vector<unique_ptr<Workers::TransmissionWorker>> transmissionWorkers;
+	vector<unique_ptr<Workers::DatabaseWorker>> databaseWorkers;
+	unique_ptr<DNS::DNSServer> dnsServer;
+	auto &config = Global::getConfig();
+
+	Models::RawEmailCache::configure(config["storage"]["cache_bytes"].asUInt64());
+	DNS::DNSCache::configure(config["dns"]["cache_bytes"].asUInt64(), config["dns"]["cache_max_ttl"].asUInt());
+	SPF::SPFCompiledRecord::configure(config["spf"]["cache_entries"].asUInt64());
+	DKIM::DKIMKeyCache::configure(config["dkim"]["key_cache_entries"].asUInt64());
+	DKIM::DKIMValidator::configure(config["dkim"]["verify_threads"].asUInt64());
+	DKIM::DKIMKeyStore::configure(config["dkim"]);
+	DMARC::PublicSuffixList::configure(config["dmarc"]);
+	FSMTP::Server::SpamDetection::DNSBL::configure(config["dnsbl"]);
+	DNS::ReverseDNS::configure(config["rdns"]);
+
+	// Opens the spool, and queues the messages which were accepted
+	//  but not yet stored or transmitted before the last shutdown, since
+	//  we can not accept any message without it, we stop if it fails
+
+	try {
+		string spoolPath = config["spool"]["path"].asString();
+		size_t spoolSegmentSize = config["spool"]["segment_size"].asUInt64();
+		if (spoolPath.empty()) spoolPath = _SPOOL_PATH_DEFAULT;
+		if (spoolSegmentSize == 0) spoolSegmentSize = _SPOOL_SEGMENT_SIZE_DEFAULT;
+
+		vector<Workers::SpoolEntry> entries = Workers::Spool::open(spoolPath, spoolSegmentSize);
+
+		for (const Workers::SpoolEntry &entry : entries) {
+			if (entry.tasks & Workers::SpoolTaskStorage) Workers::DatabaseWorker::push(entry.session);
+			if (entry.tasks & Workers::SpoolTaskRelay) Workers::TransmissionWorker::push(entry.session);
+		}
+	} catch (const exception &e) {
+		logger << FATAL << "Could not open spool, cannot accept messages";
+		logger << ", error: " << e.what() << ENDL << CLASSIC;
+		exit(-1);
+	}
 
 	try {
 		pop3Server
@@ -79,11 +123,92 @@ int main(const int argc, const char **argv)
 		logger << ", error: " << e.what() << ENDL << CLASSIC;
 	}
 
-	transmissionWorker->start(nullptr);
-	databaseWorker->start(nullptr);
+	// Serves the zones of the config, so the mail nodes can be authoritative
+	//  for their own MX, SPF and DKIM records
+
+	if (config["dns_server"]["enabled"].asBool()) {
+		try {
+			dnsServer = make_unique<DNS::DNSServer>(
+				config["dns_server"]["port"].asInt(),
+				config["dns_server"]["threads"].asUInt64()
+			);
+		} catch (const runtime_error &e) {
+			logger << FATAL << "Could not start service DNS server";
+			logger << ", error: " << e.what() << ENDL << CLASSIC;
+		}
+	}
+
+	// Starts the workers, each worker has its own database
+	//  connections, and they all consume the same queue
+
+	size_t transmissionWorkerCount = config["workers"]["transmission"].asUInt();
+	size_t databaseWorkerCount = config["workers"]["storage"].asUInt();
+	if (transmissionWorkerCount < 1) transmissionWorkerCount = 1;
+	if (databaseWorkerCount < 1) databaseWorkerCount = 1;
 
-	for (;;) {
+	for (size_t i = 0; i < transmissionWorkerCount; ++i) {
+		transmissionWorkers.push_back(make_unique<Workers::TransmissionWorker>(i));
+		transmissionWorkers.back()->start(nullptr);
+	}
+
+	for (size_t i = 0; i < databaseWorkerCount; ++i) {
+		databaseWorkers.push_back(make_unique<Workers::DatabaseWorker>(i));
+		databaseWorkers.back()->start(nullptr);
+	}
+
+	// Prints the state of the worker queues every minute, so
+	//  we can see if the workers keep up with the load
+
+	for (size_t i = 1;; ++i) {
 		this_thread::sleep_for(seconds(1));
+
+		// Reloads the signing keys, the public suffix list and the zones outside
+		//  of the signal handler, so they can be updated without an restart, the
+		//  zones are also reloaded when their files change
+		if (DKIM::DKIMKeyStore::reloadRequested()) DKIM::DKIMKeyStore::reload();
+		if (DMARC::PublicSuffixList::reloadRequested()) DMARC::PublicSuffixList::reload();
+		const bool zoneReload = DNS::DNSServer::reloadRequested();
+		if (dnsServer && (zoneReload || dnsServer->zoneChanged())) dnsServer->reload();
+
+		if (i % 60 == 0) {
+			logger << "Storage queue { depth: " << Workers::DatabaseWorker::getQueueDepth()
+				<< ", oldest: " << Workers::DatabaseWorker::getQueueAge().count() << "ms }, "
+				<< "Transmission queue { depth: " << Workers::TransmissionWorker::getQueueDepth()
+				<< ", oldest: " << Workers::TransmissionWorker::getQueueAge().count() << "ms }" << ENDL;
+
+			Models::RawEmailCacheStats cache = Models::RawEmailCache::getStats();
+			logger << "Raw email cache { hits: " << cache.hits << ", misses: " << cache.misses
+				<< ", evictions: " << cache.evictions << ", entries: " << cache.entries
+				<< ", bytes: " << cache.bytes << " }" << ENDL;
+
+			DNS::DNSCacheStats dnsCache = DNS::DNSCache::getStats();
+			logger << "DNS cache { hits: " << dnsCache.hits << ", negative hits: " << dnsCache.negativeHits
+				<< ", misses: " << dnsCache.misses << ", evictions: " << dnsCache.evictions
+				<< ", entries: " << dnsCache.entries << ", bytes: " << dnsCache.bytes << " }" << ENDL;
+
+			SPF::SPFCompiledRecordStats spfCache = SPF::SPFCompiledRecord::getStats();
+			logger << "SPF cache { hits: " << spfCache.hits << ", misses: " << spfCache.misses
+				<< ", entries: " << spfCache.entries << " }" << ENDL;
+
+			DKIM::DKIMKeyCacheStats dkimCache = DKIM::DKIMKeyCache::getStats();
+			logger << "DKIM key cache { hits: " << dkimCache.hits << ", misses: " << dkimCache.misses
+				<< ", entries: " << dkimCache.entries << " }" << ENDL;
+
+			FSMTP::Server::SpamDetection::DNSBLStats dnsblCache = FSMTP::Server::SpamDetection::DNSBL::getStats();
+			logger << "DNSBL cache { hits: " << dnsblCache.hits << ", misses: " << dnsblCache.misses
+				<< ", entries: " << dnsblCache.entries << " }" << ENDL;
+
+			DNS::ReverseDNSStats rdnsCache = DNS::ReverseDNS::getStats();
+			logger << "Reverse DNS cache { hits: " << rdnsCache.hits << ", misses: " << rdnsCache.misses
+				<< ", entries: " << rdnsCache.entries << " }" << ENDL;
+
+			if (dnsServer) {
+				DNS::DNSServerStats dnsServerStats = dnsServer->getStats();
+				logger << "DNS server { queries: " << dnsServerStats.queries << ", answers: " << dnsServerStats.answers
+					<< ", negative: " << dnsServerStats.negative << ", refused: " << dnsServerStats.refused
+					<< ", errors: " << dnsServerStats.errors << " }" << ENDL;
+			}
+		}
 	}
 
 	return 0;
@@ -0,0 +1,197 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <catch2/catch.hpp>
+#include <random>
+#include "../lib/general/base64.src.h"
+#include "../lib/general/whitespace.src.h"
+
+using namespace FSMTP::Encoding;
+using namespace FSMTP::Cleanup;
+
+// The straightforward encoder the kernels are compared against
+static string referenceBase64(const string &raw) {
+	static const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	string res;
+
+	for (size_t i = 0; i < raw.size(); i += 3) {
+		uint32_t v = static_cast<uint8_t>(raw[i]) << 16;
+		if (i + 1 < raw.size()) v |= static_cast<uint8_t>(raw[i + 1]) << 8;
+		if (i + 2 < raw.size()) v |= static_cast<uint8_t>(raw[i + 2]);
+
+		res += alphabet[v >> 18];
+		res += alphabet[(v >> 12) & 0x3F];
+		res += i + 1 < raw.size() ? alphabet[(v >> 6) & 0x3F] : '=';
+		res += i + 2 < raw.size() ? alphabet[v & 0x3F] : '=';
+	}
+
+	return res;
+}
+
+// Runs the test once for each level of kernels the CPU supports
+static void forEachSIMDLevel(const function<void()> &test) {
+	const SIMDLevel original = getSIMDLevel();
+
+	for (const SIMDLevel level : { SIMDNone, SIMDSSE2, SIMDAVX2 }) {
+		if (level > original) break;
+
+		setSIMDLevel(level);
+		INFO("SIMD level " << simdLevelToString(level));
+		test();
+	}
+
+	setSIMDLevel(original);
+}
+
+// ================================
+// Base64 encoding and decoding
+// ================================
+
+// The vectors from RFC 4648, each length leaves an different
+//  amount of padding
+
+TEST_CASE("Base64 round trips the RFC 4648 vectors") {
+	const vector<pair<string, string>> vectors = {
+		{ "", "" }, { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" },
+		{ "foob", "Zm9vYg==" }, { "fooba", "Zm9vYmE=" }, { "foobar", "Zm9vYmFy" }
+	};
+
+	forEachSIMDLevel([&]() {
+		for (const auto &v : vectors) {
+			REQUIRE(encodeBase64(v.first) == v.second);
+			REQUIRE(decodeBase64(v.second) == v.first);
+		}
+	});
+}
+
+// Data without padding is accepted, unless the last quad
+//  does not contain an whole byte
+
+TEST_CASE("Base64 decodes unpadded input") {
+	REQUIRE(decodeBase64("Zg") == "f");
+	REQUIRE(decodeBase64("Zm8") == "fo");
+	REQUIRE(decodeBase64("Zm9vYg") == "foob");
+	REQUIRE_THROWS(decodeBase64("Zm9vY"));
+}
+
+TEST_CASE("Base64 rejects data after padding") {
+	REQUIRE_THROWS(decodeBase64("Zg==Zg=="));
+	REQUIRE_THROWS(decodeBase64("Zm8=Zm9v"));
+	REQUIRE_THROWS(decodeBase64("Z==="));
+	REQUIRE_THROWS(decodeBase64("Zm9v="));
+}
+
+// An invalid character is rejected wherever it is, in the
+//  vectorized blocks as well as in the tail
+
+TEST_CASE("Base64 rejects invalid characters") {
+	forEachSIMDLevel([]() {
+		const string valid = encodeBase64(string(96, 'x'));
+
+		for (size_t i = 0; i < valid.size(); i += 7) {
+			for (const char c : { '*', '-', '_', '\0', '\x80' }) {
+				string data = valid;
+				data[i] = c;
+				REQUIRE_THROWS(decodeBase64(data));
+			}
+		}
+	});
+}
+
+// Whitespace and line breaks are skipped, also in the middle
+//  of an quad
+
+TEST_CASE("Base64 skips whitespace and line breaks") {
+	REQUIRE(decodeBase64("Zm9v\r\nYmFy") == "foobar");
+	REQUIRE(decodeBase64(" Zm 9v\tYm\r\nFy \r\n") == "foobar");
+	REQUIRE(decodeBase64("Zm8\r\n=") == "fo");
+}
+
+// Feeds the data in pieces of every size, so quads are split
+//  between the pieces in every possible way
+
+TEST_CASE("Base64Decoder decodes quads split over pieces") {
+	const string raw = "The quick brown fox jumps over the lazy dog, twice or more";
+	const string encoded = referenceBase64(raw);
+
+	forEachSIMDLevel([&]() {
+		for (size_t piece = 1; piece <= encoded.size(); ++piece) {
+			string out;
+			Base64Decoder decoder;
+
+			for (size_t i = 0; i < encoded.size(); i += piece)
+				decoder.update(encoded.c_str() + i, min(piece, encoded.size() - i), out);
+			decoder.finish(out);
+
+			INFO("piece size " << piece);
+			REQUIRE(out == raw);
+		}
+	});
+}
+
+// MIME bodies are wrapped at 76 columns with CRLF, also when
+//  the data arrives in pieces which do not end on an group
+
+TEST_CASE("Base64Encoder wraps lines at 76 columns") {
+	string raw;
+	for (size_t i = 0; i < 1000; ++i) raw += static_cast<char>(i * 7);
+	const string reference = referenceBase64(raw);
+
+	forEachSIMDLevel([&]() {
+		for (const size_t piece : { 1, 2, 5, 57, 100, 1000 }) {
+			string out;
+			Base64Encoder encoder(76);
+
+			for (size_t i = 0; i < raw.size(); i += piece)
+				encoder.update(raw.c_str() + i, min(piece, raw.size() - i), out);
+			encoder.finish(out);
+
+			string joined;
+			for (size_t start = 0; start < out.size();) {
+				const size_t end = out.find("\r\n", start);
+				REQUIRE(end != string::npos);
+				REQUIRE(end - start <= 76);
+				if (end + 2 < out.size()) REQUIRE(end - start == 76);
+
+				joined += out.substr(start, end - start);
+				start = end + 2;
+			}
+
+			INFO("piece size " << piece);
+			REQUIRE(joined == reference);
+			REQUIRE(decodeBase64(out) == raw);
+		}
+	});
+}
+
+// Random data of random lengths, compared against the reference
+//  encoder for each level of kernels
+
+TEST_CASE("Base64 matches the reference on random data") {
+	mt19937 rng(1234);
+
+	forEachSIMDLevel([&]() {
+		for (size_t n = 0; n < 500; ++n) {
+			string raw(uniform_int_distribution<size_t>(0, 300)(rng), '\0');
+			for (char &c : raw) c = static_cast<char>(rng());
+
+			const string encoded = encodeBase64(raw);
+			INFO("length " << raw.size());
+			REQUIRE(encoded == referenceBase64(raw));
+			REQUIRE(decodeBase64(encoded) == raw);
+		}
+	});
+}
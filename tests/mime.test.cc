@@ -0,0 +1,176 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <catch2/catch.hpp>
+#include "../lib/mime/MIMETree.src.h"
+#include "../lib/mime/mimev2.src.h"
+
+using namespace FSMTP::MIME;
+
+// Gets the children of an node in order
+static vector<const MIMENode *> childrenOf(const MIMETree &tree, const MIMENode &node) {
+	vector<const MIMENode *> children;
+	for (size_t i = node.firstChild; i != _MIME_TREE_NONE; i = tree.getNodes()[i].nextSibling)
+		children.push_back(&tree.getNodes()[i]);
+	return children;
+}
+
+// ================================
+// Header parsing
+// ================================
+
+// Folded values stay as they are in the view, unfolding joins
+//  the lines with a single space
+
+TEST_CASE("MIMETree unfolds header values with a space") {
+	const string message = "Subject: Hello\r\n\tthere,\r\n  world\r\nTo: a@b.c\r\n\r\nbody";
+	MIMETree tree(message);
+
+	const string_view subject = MIMETree::getHeader(tree.getRoot(), "subject");
+	REQUIRE(subject == "Hello\r\n\tthere,\r\n  world");
+	REQUIRE(MIMETree::unfold(subject) == "Hello there, world");
+	REQUIRE(MIMETree::getHeader(tree.getRoot(), "TO") == "a@b.c");
+	REQUIRE(tree.getRoot().body == "body");
+}
+
+// A line without colon in the headers does not throw, it is
+//  taken as the start of the body
+
+TEST_CASE("MIMETree starts the body at a line without colon") {
+	const string message = "Subject: Hi\r\nthis is no header\r\nSecond line";
+	MIMETree tree(message);
+
+	REQUIRE(tree.getRoot().headers.size() == 1);
+	REQUIRE(tree.getRoot().body == "this is no header\r\nSecond line");
+}
+
+TEST_CASE("MIMETree compares header names case-insensitively") {
+	REQUIRE(MIMETree::equals("Content-Type", "content-TYPE"));
+	REQUIRE_FALSE(MIMETree::equals("Content-Type", "Content-Typ"));
+	REQUIRE_FALSE(MIMETree::equals("\xC4", "\xE4"));
+	REQUIRE(MIMETree::equals("\xC4\xFF", "\xC4\xFF"));
+}
+
+// The boundary parameter is quoted and contains an semicolon,
+//  which must not end the parameter
+
+TEST_CASE("MIMETree reads a quoted boundary containing a semicolon") {
+	const string message =
+		"Content-Type: multipart/mixed; boundary=\"a;b\"; charset=utf-8\r\n\r\n"
+		"--a;b\r\n\r\none\r\n"
+		"--a;b--\r\n";
+	MIMETree tree(message);
+
+	REQUIRE(tree.getRoot().boundary == "a;b");
+	REQUIRE(tree.getRoot().charset == "utf-8");
+
+	auto children = childrenOf(tree, tree.getRoot());
+	REQUIRE(children.size() == 1);
+	REQUIRE(children[0]->body == "one");
+}
+
+// ================================
+// Multipart parsing
+// ================================
+
+// Every multipart type is split, not only alternative and mixed,
+//  and the preamble and epilogue are no parts
+
+TEST_CASE("MIMETree splits other multipart types into parts") {
+	const string message =
+		"Content-Type: multipart/related; boundary=rel\r\n\r\n"
+		"preamble\r\n"
+		"--rel\r\nContent-Type: text/html\r\n\r\n<img src=\"cid:x\">\r\n"
+		"--rel\r\nContent-Type: image/png\r\nContent-Transfer-Encoding: base64\r\n\r\naGk=\r\n"
+		"--rel--\r\nepilogue\r\n";
+	MIMETree tree(message);
+
+	auto children = childrenOf(tree, tree.getRoot());
+	REQUIRE(children.size() == 2);
+	REQUIRE(children[0]->type == EmailContentType::ECT_TEXT_HTML);
+	REQUIRE(children[0]->body == "<img src=\"cid:x\">");
+	REQUIRE(children[1]->contentType == "image/png");
+	REQUIRE(MIMETree::decodeBody(*children[1]) == "hi");
+}
+
+// The delimiter may be followed by whitespace, the line break in
+//  front of it belongs to the delimiter
+
+TEST_CASE("MIMETree allows transport padding after delimiters") {
+	const string message =
+		"Content-Type: multipart/alternative; boundary=b\r\n\r\n"
+		"--b \t\r\n\r\nfirst\r\n"
+		"--b\t\r\n\r\nsecond\r\n\r\n"
+		"--b-- \r\n";
+	MIMETree tree(message);
+
+	auto children = childrenOf(tree, tree.getRoot());
+	REQUIRE(children.size() == 2);
+	REQUIRE(children[0]->body == "first");
+	REQUIRE(children[1]->body == "second\r\n");
+}
+
+// An inner multipart is parsed recursively, and the outer one is
+//  never closed, so its last part runs to the end
+
+TEST_CASE("MIMETree parses nested and unclosed multipart") {
+	const string message =
+		"Content-Type: multipart/mixed; boundary=outer\r\n\r\n"
+		"--outer\r\nContent-Type: multipart/alternative; boundary=inner\r\n\r\n"
+		"--inner\r\nContent-Type: text/plain\r\n\r\nplain\r\n"
+		"--inner\r\nContent-Type: text/html\r\n\r\n<b>html</b>\r\n"
+		"--inner--\r\n"
+		"--outer\r\nContent-Type: text/plain\r\n\r\nlast part";
+	MIMETree tree(message);
+
+	auto outer = childrenOf(tree, tree.getRoot());
+	REQUIRE(outer.size() == 2);
+	REQUIRE(outer[0]->type == EmailContentType::ECT_MULTIPART_ALTERNATIVE);
+	REQUIRE(outer[1]->body == "last part");
+
+	auto inner = childrenOf(tree, *outer[0]);
+	REQUIRE(inner.size() == 2);
+	REQUIRE(inner[0]->depth == 2);
+	REQUIRE(inner[0]->body == "plain");
+	REQUIRE(inner[1]->body == "<b>html</b>");
+}
+
+// ================================
+// Full email adapter
+// ================================
+
+// The body sections keep the header names as they are in the
+//  message, the old parser lowercased them
+
+TEST_CASE("MIMETree keeps the case of body section header keys") {
+	const string message =
+		"Subject: Test\r\nContent-Type: multipart/alternative; boundary=b\r\n\r\n"
+		"--b\r\nContent-Type: text/plain\r\nX-Custom-Header: Value\r\n\r\nplain\r\n"
+		"--b--\r\n";
+	MIMETree tree(message);
+
+	FullEmail email;
+	tree.toFullEmail(email);
+
+	REQUIRE(email.e_Subject == "Test");
+	REQUIRE(email.e_BodySections.size() == 1);
+
+	const EmailBodySection &section = email.e_BodySections[0];
+	REQUIRE(section.e_Headers.size() == 2);
+	REQUIRE(section.e_Headers[0].key == "Content-Type");
+	REQUIRE(section.e_Headers[1].key == "X-Custom-Header");
+	REQUIRE(section.e_Headers[1].value == "Value");
+}
@@ -16,8 +16,10 @@
 
 #include <catch2/catch.hpp>
 #include "../lib/models/Email.src.h"
+#include "../lib/models/RawEmailCache.src.h"
 
 using FSMTP::Models::EmailAddress;
+using FSMTP::Models::RawEmailCache;
 
 // ================================
 // Default email address tests
@@ -90,3 +92,29 @@ TEST_CASE("EmailAddress parse 'Example Test <test@example.com>, Hello   World <h
 	REQUIRE(vec[0].e_Address == "test@example.com");
 	REQUIRE(vec[1].e_Address == "hello@world.com");
 }
+
+// ================================
+// Raw email cache tests
+// ================================
+
+// Fills the cache past its limit, the least recently used entry
+//  should be evicted, and the touched one should survive
+
+TEST_CASE("RawEmailCache evicts the least recently used body") {
+	string content;
+	RawEmailCache::configure(80);
+
+	RawEmailCache::put("a", string(10, 'a'));
+	RawEmailCache::put("b", string(10, 'b'));
+	REQUIRE(RawEmailCache::get("a", content));
+
+	for (size_t i = 0; i < 7; ++i) RawEmailCache::put("c" + to_string(i), string(10, 'c'));
+
+	REQUIRE(RawEmailCache::get("a", content));
+	REQUIRE(content == string(10, 'a'));
+	REQUIRE_FALSE(RawEmailCache::get("b", content));
+	REQUIRE(RawEmailCache::getStats().bytes <= 80);
+
+	RawEmailCache::invalidate("a");
+	REQUIRE_FALSE(RawEmailCache::get("a", content));
+}
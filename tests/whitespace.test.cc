@@ -0,0 +1,193 @@
+/*
+	Copyright [2020] [Luke A.C.A. Rieff]
+
+	Licensed under the Apache License, Version 2.0 (the "License");
+	you may not use this file except in compliance with the License.
+	You may obtain a copy of the License at
+
+	http://www.apache.org/licenses/LICENSE-2.0
+
+	Unless required by applicable law or agreed to in writing, software
+	distributed under the License is distributed on an "AS IS" BASIS,
+	WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+	See the License for the specific language governing permissions and
+	limitations under the License.
+*/
+
+#include <catch2/catch.hpp>
+#include <random>
+#include "../lib/general/whitespace.src.h"
+#include "../lib/dkim/DKIMCanonicalization.src.h"
+
+using namespace FSMTP::Cleanup;
+using namespace FSMTP::DKIM;
+
+// Runs the test once for each level of kernels the CPU supports
+static void forEachSIMDLevel(const function<void()> &test) {
+	const SIMDLevel original = getSIMDLevel();
+
+	for (const SIMDLevel level : { SIMDNone, SIMDSSE2, SIMDAVX2 }) {
+		if (level > original) break;
+
+		setSIMDLevel(level);
+		INFO("SIMD level " << simdLevelToString(level));
+		test();
+	}
+
+	setSIMDLevel(original);
+}
+
+// Builds inputs made mostly of whitespace and line breaks, with the lengths
+//  around the 16 and 32 byte blocks, and some random ones in between
+static vector<string> whitespaceInputs() {
+	const char alphabet[] = { ' ', ' ', ' ', '\t', '\r', '\n', 'a', 'b' };
+	mt19937 rng(4321);
+	vector<size_t> lengths = { 0, 1, 2 };
+	vector<string> inputs;
+
+	for (const size_t block : { 16, 32, 48, 64, 96 }) {
+		lengths.push_back(block - 1);
+		lengths.push_back(block);
+		lengths.push_back(block + 1);
+	}
+
+	for (size_t n = 0; n < 200; ++n) lengths.push_back(uniform_int_distribution<size_t>(0, 300)(rng));
+
+	for (const size_t length : lengths) {
+		for (size_t n = 0; n < 8; ++n) {
+			string input(length, ' ');
+			for (char &c : input) c = alphabet[rng() % sizeof (alphabet)];
+			inputs.push_back(move(input));
+		}
+
+		inputs.push_back(string(length, ' '));
+		inputs.push_back(string(length, 'a'));
+	}
+
+	return inputs;
+}
+
+// Runs the kernel on every input at the scalar level first, and then
+//  requires the same result from every SIMD level
+template<typename T>
+static void compareSIMDLevels(const vector<string> &inputs, const function<T(const string &)> &kernel) {
+	const SIMDLevel original = getSIMDLevel();
+	vector<T> expected;
+
+	setSIMDLevel(SIMDNone);
+	for (const string &input : inputs) expected.push_back(kernel(input));
+	setSIMDLevel(original);
+
+	forEachSIMDLevel([&]() {
+		for (size_t i = 0; i < inputs.size(); ++i) {
+			INFO("input " << i << ", length " << inputs[i].size());
+			REQUIRE(kernel(inputs[i]) == expected[i]);
+		}
+	});
+}
+
+// ================================
+// Whitespace kernels
+// ================================
+
+TEST_CASE("Whitespace kernels agree at every SIMD level") {
+	const vector<string> inputs = whitespaceInputs();
+
+	// The scalar level itself is checked against a few known answers
+	const SIMDLevel original = setSIMDLevel(SIMDNone);
+	REQUIRE(findLineBreak("abc\r\n", 5) == 3);
+	REQUIRE(findWhitespaceFold("a b  c", 6) == 3);
+	REQUIRE(trimTrailingWhitespace("ab \t ", 5) == 2);
+	setSIMDLevel(original);
+
+	compareSIMDLevels<size_t>(inputs, [](const string &input) {
+		return findLineBreak(input.c_str(), input.size());
+	});
+
+	compareSIMDLevels<size_t>(inputs, [](const string &input) {
+		return findWhitespaceFold(input.c_str(), input.size());
+	});
+
+	compareSIMDLevels<size_t>(inputs, [](const string &input) {
+		return trimTrailingWhitespace(input.c_str(), input.size());
+	});
+
+	for (const bool tabs : { false, true }) {
+		INFO("tabs " << tabs);
+		compareSIMDLevels<string>(inputs, [tabs](const string &input) {
+			string out(input.size(), '\0');
+			out.resize(collapseWhitespace(input.c_str(), input.size(), &out[0], tabs));
+			return out;
+		});
+	}
+}
+
+// ================================
+// Body canonicalization
+// ================================
+
+// Collects the output of the streaming canonicalizer
+class DKIMTestCanonicalizer : public DKIMBodyCanonicalizer {
+public:
+	using DKIMBodyCanonicalizer::DKIMBodyCanonicalizer;
+	string m_Result;
+protected:
+	void write(const char *data, const size_t len) {
+		this->m_Result.append(data, len);
+	}
+};
+
+// An empty body is an empty string with relaxed canonicalization ( RFC 6376
+//  errata 1384 ), and a single CRLF with simple canonicalization
+
+TEST_CASE("Body canonicalization of empty bodies") {
+	forEachSIMDLevel([]() {
+		for (const string body : { "", "\r\n", "\r\n\r\n", " \t \r\n", "\r\n \r\n\t\r\n" }) {
+			INFO("body '" << body << "'");
+			REQUIRE(relaxedBody(body) == "");
+		}
+
+		REQUIRE(simpleBody("") == "\r\n");
+		REQUIRE(simpleBody("\r\n\r\n") == "\r\n");
+	});
+}
+
+TEST_CASE("Body canonicalization of the RFC 6376 example") {
+	forEachSIMDLevel([]() {
+		REQUIRE(relaxedBody(" C \r\nD \t E\r\n\r\n\r\n") == " C\r\nD E\r\n");
+		REQUIRE(simpleBody(" C \r\nD \t E\r\n\r\n\r\n") == " C \r\nD \t E\r\n");
+		REQUIRE(relaxedBody("a  b \t") == "a b\r\n");
+	});
+}
+
+// The streaming canonicalizer must give the same result at every level, no
+//  matter where the pieces split the whitespace runs and line breaks
+
+TEST_CASE("Body canonicalization agrees at every SIMD level and piece size") {
+	const vector<string> inputs = whitespaceInputs();
+
+	for (const bool relaxed : { false, true }) {
+		INFO("relaxed " << relaxed);
+		compareSIMDLevels<string>(inputs, [relaxed](const string &input) {
+			return relaxed ? relaxedBody(input) : simpleBody(input);
+		});
+
+		forEachSIMDLevel([&]() {
+			for (size_t i = 0; i < inputs.size(); i += 17) {
+				const string &input = inputs[i];
+				const string expected = relaxed ? relaxedBody(input) : simpleBody(input);
+
+				for (const size_t piece : { 1, 2, 3, 15, 16, 17, 33 }) {
+					DKIMTestCanonicalizer canonicalizer(relaxed);
+					for (size_t off = 0; off < input.size(); off += piece)
+						canonicalizer.update(input.c_str() + off, min(piece, input.size() - off));
+					canonicalizer.finish();
+
+					INFO("input " << i << ", piece size " << piece);
+					REQUIRE(canonicalizer.m_Result == expected);
+					REQUIRE(canonicalizer.getLength() == expected.size());
+				}
+			}
+		});
+	}
+}